@@ -395,6 +395,10 @@ NGS_EXTERNC int ngsMapSetSize(char mapId, int width, int height, char YAxisInver
 NGS_EXTERNC int ngsMapDraw(char mapId, enum ngsDrawState state,
                            ngsProgressFunc callback, void *callbackData);
 NGS_EXTERNC int ngsMapInvalidate(char mapId, ngsExtent bounds);
+NGS_EXTERNC unsigned char *ngsMapRenderTile(char mapId, int x, int y, int z,
+                                            int tileSize, int *size);
+NGS_EXTERNC unsigned char *ngsMapRenderExtent(char mapId, ngsExtent extent,
+                                              int width, int height, int *size);
 NGS_EXTERNC int ngsMapSetBackgroundColor(char mapId, const ngsRGBA color);
 NGS_EXTERNC ngsRGBA ngsMapGetBackgroundColor(char mapId);
 NGS_EXTERNC int ngsMapSetCenter(char mapId, double x, double y);
@@ -407,6 +411,7 @@ NGS_EXTERNC int ngsMapSetScale(char mapId, double scale);
 NGS_EXTERNC double ngsMapGetScale(char mapId);
 
 NGS_EXTERNC int ngsMapSetOptions(char mapId, char **options);
+NGS_EXTERNC char **ngsMapGetOptions(char mapId);
 NGS_EXTERNC int ngsMapSetExtentLimits(char mapId, double minX, double minY, double maxX, double maxY);
 NGS_EXTERNC ngsExtent ngsMapGetExtent(char mapId, int epsg);
 NGS_EXTERNC int ngsMapSetExtent(char mapId, ngsExtent extent);
@@ -183,6 +183,7 @@ const char *ngsGetVersionString(const char *request)
  * - LOCALE ["en_US.UTF-8", "de_DE", "ja_JP", ...] - Locale for error messages, etc.
  * - NUM_THREADS - Number threads in various functions (a positive number or "ALL_CPUS")
  * - GL_MULTISAMPLE - Enable sampling if applicable
+ * - HEADLESS ["ON", "OFF"] - Render maps on CPU without GL context
  * - SSL_CERT_FILE - Path to ssl cert file (*.pem)
  * - PROJ_DATA - Path to libproj data directory (may be skipped on Linux)
  * - HOME - Root directory for library
@@ -215,6 +216,11 @@ int ngsInit(char **options)
     if(multisample) {
         CPLSetConfigOption("GL_MULTISAMPLE", multisample);
     }
+    const char *headless = CSLFetchNameValue(options, "HEADLESS");
+    if(headless) {
+        CPLSetConfigOption("NGS_HEADLESS", headless);
+        CPLDebug("ngstore", "NGS_HEADLESS set to %s", headless);
+    }
 
     const char *cainfo = CSLFetchNameValue(options, "SSL_CERT_FILE");
     if(cainfo) {
@@ -1466,7 +1472,18 @@ const char *ngsCatalogPathFromSystem(const char *path)
  * @param dstObjectContainer Destination catalog container
  * @param options Copy options. This is a list of key=value items.
  * The common value is MOVE=ON indicating to move object. The other values depends on
- * destination container.
+ * destination container. For rasters copied to folder:
+ * - COG - If ON, write tiled compressed cloud optimized GeoTIFF with internal
+ *   overviews. Overviews are built in parallel by blocks
+ * - COMPRESS - COG compression. Default is DEFLATE
+ * - BLOCKSIZE - COG block size. Default is 512
+ * - RESAMPLING - COG overviews resampling, AVERAGE or NEAREST. Default is
+ *   AVERAGE
+ * - NUM_THREADS - COG overviews and compression threads count. Default is
+ *   CPU count
+ * For tables and feature classes copied to datasets:
+ * - TRANSACTION_SIZE - Rows count inserted in one transaction. Default is
+ *   100000
  * @param callback Progress function (template is ngsProgressFunc) executed
  * periodically to report progress and cancel. If returns 1 the execution will
  * continue, 0 - cancelled. May be null.
@@ -2016,6 +2033,16 @@ ngsGeometryType ngsFeatureClassGeometryType(CatalogObjectH object)
  * @brief ngsFeatureClassCreateOverviews Creates Gl optimized vector tiles
  * @param object Catalog object handle. Must be feature class or simple datasource.
  * @param options The options key-value array specific to operation.
+ * - FORCE - ON/OFF. Recreate overviews if they already exist
+ * - ZOOM_LEVELS - comma separated values of zoom levels
+ * - MEMORY_LIMIT - memory limit in megabytes for tiles kept before saving to
+ *   the overviews table. Default 256
+ * - HILBERT_ORDER - ON/OFF. Tile features in Hilbert curve order of their
+ *   envelope centers. Reduces tiles split between saves. Default OFF
+ * - NUM_THREADS - number of tiling threads. Default is library threads count
+ * - TILE_CODEC - RAW/DELTA/DEFLATE. Tile storage encoding. DELTA stores
+ *   quantized coordinates and ids as delta varints, DEFLATE also compresses
+ *   them. Default RAW
  * @param callback Progress function (template is ngsProgressFunc) executed
  * periodically to report progress and cancel. If returns 1 the execution will
  * continue, 0 - cancelled. May be null.
@@ -2037,7 +2064,13 @@ int ngsFeatureClassCreateOverviews(CatalogObjectH object, char **options,
                 COD_SUCCESS : COD_CREATE_FAILED;
 }
 
-
+/**
+ * @brief ngsFeatureClassBatchMode Starts or stops batch edit mode of the
+ * dataset. Overview tiles changed by edits in batch mode are saved when the
+ * batch mode stops.
+ * @param object Dataset or feature class handle
+ * @param enable 1 to start batch mode, 0 to stop
+ */
 void ngsFeatureClassBatchMode(CatalogObjectH object, char enable)
 {
     Object *catalogObject = static_cast<Object*>(object);
@@ -2691,6 +2724,14 @@ char ngsFeatureAttachmentUpdate(FeatureH feature, POINTER_SIZE aid,
  * - MAXX - maximum X coordinate of bounding box
  * - MAXY - maximum Y coordinate of bounding box
  * - ZOOM_LEVELS - comma separated values of zoom levels
+ * - MAX_CONNECTIONS - number of simultaneous requests. Each connection is kept
+ *   alive between tiles. Default 5, maximum 32
+ * - MAX_REQUESTS_PER_SECOND - limit of requests per second to one host.
+ *   Default 0 - no limit
+ * - Other options are passed to GDAL HTTP requests, e.g. TIMEOUT, HTTP_VERSION
+ * Failed tile is retried after other tiles and doesn't stop the download. If
+ * some tiles failed or download was cancelled, the next call with the same
+ * area and zoom levels continues from the not downloaded tiles.
  * @param callback Progress function (template is ngsProgressFunc) executed
  * periodically to report progress and cancel. If returns 1 the execution will
  * continue, 0 - cancelled. May be null.
@@ -2887,6 +2928,59 @@ int ngsMapInvalidate(char mapId, ngsExtent bounds)
     return COD_SUCCESS;
 }
 
+/**
+ * @brief ngsMapRenderTile Renders XYZ tile of headless map (library
+ * initialized with HEADLESS option) to PNG image.
+ * @param mapId Map identifier received from create or open map functions
+ * @param x Tile column
+ * @param y Tile row. The 0 row is at the top.
+ * @param z Tile zoom level
+ * @param tileSize Tile size in pixels
+ * @param size Output PNG buffer size
+ * @return PNG buffer or null on error. Must be freed with ngsFree.
+ */
+unsigned char *ngsMapRenderTile(char mapId, int x, int y, int z, int tileSize,
+                                int *size)
+{
+    MapStore * const mapStore = MapStore::instance();
+    if(nullptr == mapStore) {
+        outMessage(COD_DRAW_FAILED, _("MapStore is not initialized"));
+        return nullptr;
+    }
+    if(nullptr == size || z < 0 || z > 30 || tileSize <= 0) {
+        outMessage(COD_INVALID, _("Invalid tile parameters"));
+        return nullptr;
+    }
+    return mapStore->renderMapTile(mapId, x, y, static_cast<unsigned char>(z),
+                                   tileSize, *size);
+}
+
+/**
+ * @brief ngsMapRenderExtent Renders extent of headless map (library
+ * initialized with HEADLESS option) to PNG image.
+ * @param mapId Map identifier received from create or open map functions
+ * @param extent Extent in map coordinates
+ * @param width Image width in pixels
+ * @param height Image height in pixels
+ * @param size Output PNG buffer size
+ * @return PNG buffer or null on error. Must be freed with ngsFree.
+ */
+unsigned char *ngsMapRenderExtent(char mapId, ngsExtent extent, int width,
+                                  int height, int *size)
+{
+    MapStore * const mapStore = MapStore::instance();
+    if(nullptr == mapStore) {
+        outMessage(COD_DRAW_FAILED, _("MapStore is not initialized"));
+        return nullptr;
+    }
+    if(nullptr == size) {
+        outMessage(COD_INVALID, _("Invalid size pointer"));
+        return nullptr;
+    }
+    Envelope env(extent.minX, extent.minY, extent.maxX, extent.maxY);
+    return mapStore->renderMapExtent(mapId, env, width, height, *size);
+}
+
 /**
  * @brief ngsGetMapBackgroundColor Map background color
  * @param mapId Map identifier received from create or open map functions
@@ -3143,6 +3237,22 @@ int ngsMapLayerDelete(char mapId, LayerH layer)
  *   ZOOM_INCREMENT - Add integer value to zoom level correspondent to scale. May be negative
  *   VIEWPORT_REDUCE_FACTOR - Reduce view size on provided value. Make sense to
  *     reduce number of tiles in map extent. The tiles will be more pixelate
+ *   TILE_CACHE_SIZE - Memory budget in bytes for layer tiles data which left
+ *     the view (decoded vector tiles and vertex arrays). Default is 32 Mb, 0
+ *     disables cache
+ *   TILE_CACHE_RESET_STATISTICS - If ON, reset tile cache and raster tile
+ *     cache hits and misses counters
+ *   RASTER_CACHE_SIZE - Memory budget in bytes for decoded raster tiles. The
+ *     tiles are shared by all raster layers of the map. Default is 64 Mb, 0
+ *     disables memory cache
+ *   RASTER_CACHE_DISK - If ON, decoded raster tiles are also stored deflate
+ *     compressed in raster_tiles folder of common/cache_path setting. Default
+ *     is OFF. Tiles of TMS connections expire after the connection
+ *     cache_expires period
+ *   RASTER_CACHE_DISK_SIZE - Disk budget in bytes for raster tiles. Least
+ *     recently used tiles are deleted above it. Default is 256 Mb
+ *   TILE_PREFETCH - If ON, fill tile cache for neighbour tiles around the
+ *     view and for the next zoom level with low priority. Default is OFF
  * @return ngsCode value - COD_SUCCESS if everything is OK
  */
 int ngsMapSetOptions(char mapId, char **options)
@@ -3155,6 +3265,32 @@ int ngsMapSetOptions(char mapId, char **options)
     return mapStore->setOptions(mapId, mapOptions) ? COD_SUCCESS : COD_SET_FAILED;
 }
 
+/**
+ * @brief ngsMapGetOptions Get map options and statistics
+ * @param mapId Map identifier
+ * @return Key=value list (may be empty). Besides the options set by
+ * ngsMapSetOptions the list contains TILE_CACHE_USED - bytes used by tile
+ * cache, TILE_CACHE_HITS and TILE_CACHE_MISSES - tile cache counters and the
+ * same RASTER_CACHE_USED, RASTER_CACHE_HITS and RASTER_CACHE_MISSES for raster
+ * tile cache, RASTER_CACHE_DISK_USED - bytes used by raster tiles on disk,
+ * FRAME_TIME - milliseconds from the last pan or zoom to the first complete
+ * frame (negative if not measured yet). User must free returned value via
+ * ngsDestroyList.
+ */
+char **ngsMapGetOptions(char mapId)
+{
+    MapStore * const mapStore = MapStore::instance();
+    if(nullptr == mapStore) {
+        errorMessage(_("MapStore is not initialized"));
+        return nullptr;
+    }
+    Options options = mapStore->getOptions(mapId);
+    if(options.empty()) {
+        return nullptr;
+    }
+    return options.asCPLStringList().StealList();
+}
+
 /**
  * @brief ngsMapSetExtentLimits Set limits to prevent pan out of them.
  * @param mapId Map identifier
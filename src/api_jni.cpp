@@ -1733,6 +1733,48 @@ NGS_JNI_FUNC(jboolean, mapSetOptions)(JNIEnv *env, jobject thisObj, jint mapId,
     return ret == COD_SUCCESS ? NGS_JNI_TRUE : NGS_JNI_FALSE;
 }
 
+NGS_JNI_FUNC(jobjectArray, mapGetOptions)(JNIEnv *env, jobject thisObj, jint mapId)
+{
+    ngsUnused(thisObj);
+    char **outOptions = ngsMapGetOptions(static_cast<char>(mapId));
+    jobjectArray ret = fromOptions(env, outOptions);
+    ngsListFree(outOptions);
+    return ret;
+}
+
+static jbyteArray fromPng(JNIEnv *env, unsigned char *png, int size)
+{
+    if(nullptr == png) {
+        return nullptr;
+    }
+    jbyteArray barray = env->NewByteArray(size);
+    env->SetByteArrayRegion(barray, 0, size, reinterpret_cast<const jbyte *>(png));
+    ngsFree(png);
+    return barray;
+}
+
+NGS_JNI_FUNC(jbyteArray, mapRenderTile)(JNIEnv *env, jobject thisObj, jint mapId,
+                                        jint x, jint y, jint z, jint tileSize)
+{
+    ngsUnused(thisObj);
+    int size = 0;
+    unsigned char *png = ngsMapRenderTile(static_cast<char>(mapId), x, y, z,
+                                          tileSize, &size);
+    return fromPng(env, png, size);
+}
+
+NGS_JNI_FUNC(jbyteArray, mapRenderExtent)(JNIEnv *env, jobject thisObj, jint mapId,
+                                          jdouble minX, jdouble minY, jdouble maxX,
+                                          jdouble maxY, jint width, jint height)
+{
+    ngsUnused(thisObj);
+    ngsExtent extent = {minX, minY, maxX, maxY};
+    int size = 0;
+    unsigned char *png = ngsMapRenderExtent(static_cast<char>(mapId), extent,
+                                            width, height, &size);
+    return fromPng(env, png, size);
+}
+
 NGS_JNI_FUNC(jboolean, mapSetExtentLimits)(JNIEnv *env, jobject thisObj, jint mapId,
                                            jdouble minX, jdouble minY, jdouble maxX, jdouble maxY)
 {
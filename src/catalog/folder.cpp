@@ -519,6 +519,9 @@ int Folder::pasteRaster(ObjectPtr child, bool move, const std::string &newPath,
 
     enum ngsCatalogObjectType dstType = static_cast<enum ngsCatalogObjectType>(
                 options.asInt("TYPE", 0));
+    if(options.asBool("COG", false)) { // Cloud optimized GeoTIFF is rewritten
+        dstType = CAT_RASTER_TIFF;
+    }
     if(dstType == CAT_UNKNOWN) {
         if(Filter::isFileBased(child->type())) {
             if(move) {
@@ -48,6 +48,10 @@ constexpr std::array<char, 23> forbiddenChars = {{':', '@', '#', '%', '^', '&',
     '*','!', '$', '(', ')', '+', '-', '?', '=', '/', '\\', '"', '\'', '[', ']',
     ',', ' '}};
 
+// Connections of finished threads stay in the pool until it is cleared, so
+// the pool size is limited.
+constexpr size_t MAX_READ_CONNECTIONS = 32;
+
 constexpr std::array<const char*, 124> forbiddenSQLFieldNames {{ "ABORT", "ACTION",
     "ADD", "AFTER", "ALL", "ALTER", "ANALYZE", "AND", "AS", "ASC", "ATTACH",
     "AUTOINCREMENT", "BEFORE", "BEGIN", "BETWEEN", "BY", "CASCADE", "CASE",
@@ -380,8 +384,80 @@ void Dataset::lockExecuteSql(bool lock)
     }
 }
 
+/**
+ * @brief Dataset::readLayer Returns layer of the read-only connection bound
+ * to the current thread. Reading through it does not need the execute SQL
+ * lock, so several threads may read the dataset simultaneously.
+ * @param name Layer name.
+ * @param connection Holds the connection while the layer is in use.
+ * @return Layer or nullptr if concurrent read is not available. In this case
+ * the main connection must be used under the execute SQL lock.
+ */
+OGRLayer *Dataset::readLayer(const std::string &name,
+                             GDALDatasetPtr &connection)
+{
+    // Changes are not committed during batch operation and the journal is off.
+    if(!isOpened() || isBatchOperation() || !isConcurrentReadSupported()) {
+        return nullptr;
+    }
+
+    connection = readConnection(false);
+    if(!connection) {
+        return nullptr;
+    }
+
+    OGRLayer *layer = connection->GetLayerByName(name.c_str());
+    if(nullptr == layer) {
+        // The table may be created after the connection was opened.
+        connection = readConnection(true);
+        if(!connection) {
+            return nullptr;
+        }
+        layer = connection->GetLayerByName(name.c_str());
+    }
+    return layer;
+}
+
+void Dataset::clearReadConnections()
+{
+    MutexHolder holder(m_readConnectionsMutex);
+    m_readConnections.clear();
+}
+
+bool Dataset::isConcurrentReadSupported() const
+{
+    // Readers of rollback journal database get SQLITE_BUSY while writer holds
+    // the lock. Only stores switched to WAL mode support concurrent reads.
+    return false;
+}
+
+GDALDatasetPtr Dataset::readConnection(bool reopen)
+{
+    GIntBig threadId = CPLGetPID();
+    MutexHolder holder(m_readConnectionsMutex);
+    auto it = m_readConnections.find(threadId);
+    if(it != m_readConnections.end()) {
+        if(!reopen) {
+            return it->second;
+        }
+        m_readConnections.erase(it);
+    }
+    else if(m_readConnections.size() >= MAX_READ_CONNECTIONS) {
+        return GDALDatasetPtr();
+    }
+
+    GDALDatasetPtr connection = static_cast<GDALDataset*>(
+                GDALOpenEx(m_path.c_str(), GDAL_OF_VECTOR|GDAL_OF_READONLY,
+                           nullptr, nullptr, nullptr));
+    if(connection) {
+        m_readConnections[threadId] = connection;
+    }
+    return connection;
+}
+
 bool Dataset::destroyTable(Table *table)
 {
+    clearReadConnections();
     if(destroyTable(m_DS, table->m_layer)) {
         deleteProperties(table->name());
         destroyAttachmentsTable(table->name()); // Attachments table maybe not exists
@@ -724,6 +800,7 @@ ObjectPtr Dataset::getChild(const std::string &name) const
 
 void Dataset::close()
 {
+    clearReadConnections();
     clear();
     DatasetBase::close();
     m_addsDS = nullptr;
@@ -829,7 +906,8 @@ int Dataset::paste(ObjectPtr child, bool move, const Options &options,
 
         // Create fields map. We expected equal count of fields
         FieldMapPtr fieldMap(srcTable->fields(), dstTable->fields());
-        int result = dstTable->copyRows(srcTable, fieldMap, progressMulti);
+        int result = dstTable->copyRows(srcTable, fieldMap, progressMulti,
+                                        options);
         if(result != COD_SUCCESS) {
             delete dstTable;
             return result;
@@ -21,6 +21,7 @@
 #ifndef NGSDATASET_H
 #define NGSDATASET_H
 
+#include <map>
 #include <memory>
 
 #include "api_priv.h"
@@ -145,6 +146,8 @@ public:
     virtual void stopBatchOperation() {}
     virtual bool isBatchOperation() const { return false; }
     virtual void lockExecuteSql(bool lock);
+    OGRLayer *readLayer(const std::string &name, GDALDatasetPtr &connection);
+    void clearReadConnections();
 
     // Object interface
 public:
@@ -222,11 +225,16 @@ protected:
     virtual OGRLayer *getEditHistoryTable(const std::string &name);
     virtual void clearEditHistoryTable(const std::string &name);
     virtual std::string historyTableName(const std::string &name) const;
+    /// Read connections
+    virtual bool isConcurrentReadSupported() const;
+    GDALDatasetPtr readConnection(bool reopen);
 
 protected:
     GDALDatasetPtr m_addsDS;
     OGRLayer *m_metadata;
     Mutex m_executeSQLMutex;
+    std::map<GIntBig, GDALDatasetPtr> m_readConnections;
+    Mutex m_readConnectionsMutex;
 };
 
 /**
@@ -436,6 +436,30 @@ OGRLayer *DataStore::createEditHistoryTable(const std::string &name)
     return ngw::createEditHistoryTable(m_addsDS, logLayerName);
 }
 
+void DataStore::startBatchOperation()
+{
+    // Journal mode can not be changed while other connections are opened.
+    if(m_disableJournalCounter == 0) {
+        clearReadConnections();
+    }
+    enableJournal(false);
+}
+
+void DataStore::stopBatchOperation()
+{
+    // Save overview tiles changed during the batch operation.
+    if(m_disableJournalCounter == 1) {
+        for(const ObjectPtr &child : m_children) {
+            FeatureClassOverview *featureClass =
+                    ngsDynamicCast(FeatureClassOverview, child);
+            if(nullptr != featureClass) {
+                featureClass->flushDirtyTiles();
+            }
+        }
+    }
+    enableJournal(true);
+}
+
 bool DataStore::isBatchOperation() const
 {
     return m_disableJournalCounter > 0;
@@ -804,6 +828,7 @@ bool DataStore::destroyOverviewsTable(const std::string &name)
     OGRLayer *layer = m_addsDS->GetLayerByName(overviewsTableName(name).c_str());
     if(!layer)
         return false;
+    clearReadConnections();
     return destroyTable(m_DS, layer);
 }
 
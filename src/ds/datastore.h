@@ -54,8 +54,8 @@ public:
 public:
     virtual bool open(unsigned int openFlags = DatasetBase::defaultOpenFlags,
                       const Options &options = Options()) override;
-    virtual void startBatchOperation() override { enableJournal(false); }
-    virtual void stopBatchOperation() override { enableJournal(true); }
+    virtual void startBatchOperation() override;
+    virtual void stopBatchOperation() override;
     virtual bool isBatchOperation() const override;
 
     virtual FeatureClass *createFeatureClass(const std::string &name,
@@ -116,6 +116,7 @@ protected:
     virtual bool createOverviewsTableIndex(const std::string &name);
     virtual bool dropOverviewsTableIndex(const std::string &name);
     virtual std::string overviewsTableName(const std::string &name) const;
+    virtual bool isConcurrentReadSupported() const override { return true; }
 
 protected:
     void enableJournal(bool enable);
@@ -20,11 +20,15 @@
  ****************************************************************************/
 #include "featureclass.h"
 
+#include <algorithm>
+#include <deque>
+
 #include "api_priv.h"
 #include "coordinatetransformation.h"
 #include "dataset.h"
 #include "ngstore/catalog/filter.h"
 #include "util/error.h"
+#include "util/threadpool.h"
 
 // For gettext translation
 #define POINT_STR _("Point")
@@ -36,6 +40,197 @@
 
 namespace ngs {
 
+constexpr size_t COPY_CHUNK_SIZE = 1024;
+constexpr size_t COPY_CHUNKS_PER_THREAD = 2;
+constexpr GIntBig COPY_TRANSACTION_SIZE = 100000;
+
+//------------------------------------------------------------------------------
+// CopyFeaturesContext
+//------------------------------------------------------------------------------
+
+/**
+ * @brief The CopyFeaturesContext class Shared state of copy features workers.
+ * Coordinate transformations are not thread safe, so each worker takes own one
+ * from the list.
+ */
+class CopyFeaturesContext
+{
+public:
+    CopyFeaturesContext(const FeatureClass *dstFClass,
+                        const FieldMapPtr fieldMap,
+                        OGRwkbGeometryType filterGeomType,
+                        const Options &options) :
+        m_dstFClass(dstFClass),
+        m_fieldMap(fieldMap),
+        m_filterGeomType(filterGeomType),
+        m_dstGeomType(dstFClass->geometryType()),
+        m_skipEmpty(options.asBool("SKIP_EMPTY_GEOMETRY", false)),
+        m_skipInvalid(options.asBool("SKIP_INVALID_GEOMETRY", false)),
+        m_toMulti(options.asBool("FORCE_GEOMETRY_TO_MULTI", false)),
+        m_ogrStyleToField(options.asBool("OGR_STYLE_STRING_TO_FIELD", false)),
+        m_ogrStyleFieldToStyle(options.asBool("OGR_STYLE_FIELD_TO_STRING", false))
+    {
+    }
+
+    void addTransformation(SpatialReferencePtr srcSRS, SpatialReferencePtr dstSRS) {
+        m_transformations.emplace_back(
+                    new CoordinateTransformation(srcSRS, dstSRS));
+        m_freeTransformations.push_back(m_transformations.back().get());
+    }
+
+    CoordinateTransformation *takeTransformation() {
+        MutexHolder holder(m_mutex);
+        CoordinateTransformation *CT = m_freeTransformations.back();
+        m_freeTransformations.pop_back();
+        return CT;
+    }
+
+    void returnTransformation(CoordinateTransformation *CT) {
+        MutexHolder holder(m_mutex);
+        m_freeTransformations.push_back(CT);
+    }
+
+public:
+    const FeatureClass *m_dstFClass;
+    FieldMapPtr m_fieldMap;
+    OGRwkbGeometryType m_filterGeomType, m_dstGeomType;
+    bool m_skipEmpty, m_skipInvalid, m_toMulti;
+    bool m_ogrStyleToField, m_ogrStyleFieldToStyle;
+    Mutex m_mutex;
+    Condition m_condition;
+
+private:
+    std::vector<std::unique_ptr<CoordinateTransformation>> m_transformations;
+    std::vector<CoordinateTransformation*> m_freeTransformations;
+};
+
+//------------------------------------------------------------------------------
+// CopyFeaturesData
+//------------------------------------------------------------------------------
+
+/**
+ * @brief The CopyFeaturesData class Chunk of source features and prepared
+ * destination features. Empty destination feature means the source feature was
+ * skipped.
+ */
+class CopyFeaturesData : public ThreadData
+{
+public:
+    explicit CopyFeaturesData(CopyFeaturesContext *context) :
+        ThreadData(false),
+        m_context(context),
+        m_done(false)
+    {
+        m_srcFeatures.reserve(COPY_CHUNK_SIZE);
+    }
+
+    virtual void onComplete(bool result) override {
+        ngsUnused(result);
+        MutexHolder holder(m_context->m_mutex);
+        m_done = true;
+        m_context->m_condition.broadcast();
+    }
+
+    void waitComplete() {
+        MutexHolder holder(m_context->m_mutex);
+        while(!m_done) {
+            m_context->m_condition.wait(m_context->m_mutex);
+        }
+    }
+
+public:
+    typedef struct _copyResult {
+        FeaturePtr feature;
+        bool setFieldsFailed;
+        std::string error;
+    } CopyResult;
+
+    CopyFeaturesContext *m_context;
+    std::vector<FeaturePtr> m_srcFeatures;
+    std::vector<CopyResult> m_results;
+    bool m_done;
+};
+
+static FeaturePtr copyFeature(const FeaturePtr &feature,
+                              CopyFeaturesContext *context,
+                              CoordinateTransformation *CT,
+                              CopyFeaturesData::CopyResult &result)
+{
+    OGRGeometry *geom = feature->GetGeometryRef();
+    OGRGeometry *newGeom = nullptr;
+    if(nullptr == geom) {
+        if(context->m_skipEmpty) {
+            return FeaturePtr();
+        }
+    }
+    else {
+        if(context->m_skipEmpty && geom->IsEmpty()) {
+            return FeaturePtr();
+        }
+        if(context->m_skipInvalid && !geom->IsValid()) {
+            return FeaturePtr();
+        }
+
+        OGRwkbGeometryType geomType = geom->getGeometryType();
+        OGRwkbGeometryType multiGeomType = geomType;
+        if(OGR_GT_Flatten(geomType) < wkbPolygon && context->m_toMulti) {
+            multiGeomType = static_cast<OGRwkbGeometryType>(geomType + 3);
+        }
+        if(context->m_filterGeomType != wkbUnknown &&
+                context->m_filterGeomType != multiGeomType) {
+            return FeaturePtr();
+        }
+
+        newGeom = geom->clone();
+        if (context->m_dstGeomType != geomType) {
+            newGeom = OGRGeometryFactory::forceTo(newGeom,
+                                                  context->m_dstGeomType);
+        }
+
+        CT->transform(newGeom);
+    }
+
+    FeaturePtr dstFeature = context->m_dstFClass->createFeature();
+    if(!dstFeature) {
+        delete newGeom;
+        return FeaturePtr();
+    }
+    if(nullptr != newGeom) {
+        dstFeature->SetGeometryDirectly(newGeom);
+    }
+    if(dstFeature->SetFieldsFrom(feature, context->m_fieldMap.get()) !=
+            OGRERR_NONE) {
+        result.setFieldsFailed = true;
+        result.error = CPLGetLastErrorMsg();
+    }
+
+    if(context->m_ogrStyleToField) {
+        dstFeature->SetField(OGR_STYLE_FIELD, feature->GetStyleString());
+    }
+    if(context->m_ogrStyleFieldToStyle) {
+        dstFeature->SetStyleString(feature->GetFieldAsString(OGR_STYLE_FIELD));
+    }
+    return dstFeature;
+}
+
+static bool copyFeaturesJobThreadFunc(ThreadData *threadData)
+{
+    CopyFeaturesData *data = static_cast<CopyFeaturesData*>(threadData);
+    CopyFeaturesContext *context = data->m_context;
+    CoordinateTransformation *CT = context->takeTransformation();
+
+    data->m_results.resize(data->m_srcFeatures.size());
+    for(size_t i = 0; i < data->m_srcFeatures.size(); ++i) {
+        CopyFeaturesData::CopyResult &result = data->m_results[i];
+        result.setFieldsFailed = false;
+        result.feature = copyFeature(data->m_srcFeatures[i], context, CT,
+                                     result);
+    }
+
+    context->returnTransformation(CT);
+    return true;
+}
+
 //------------------------------------------------------------------------------
 // FeatureClass
 //------------------------------------------------------------------------------
@@ -92,90 +287,132 @@ int FeatureClass::copyFeatures(const FeatureClassPtr srcFClass,
                        _("Start copy features from '%s' to '%s'"),
                        srcFClass->name().c_str(), name().c_str());
 
-    bool skipEmpty = options.asBool("SKIP_EMPTY_GEOMETRY", false);
-    bool skipInvalid = options.asBool("SKIP_INVALID_GEOMETRY", false);
-    bool toMulti = options.asBool("FORCE_GEOMETRY_TO_MULTI", false);
+    Dataset *dataset = dynamic_cast<Dataset*>(m_parent);
+    DatasetBatchOperationHolder holder(dataset);
 
-    DatasetBatchOperationHolder holder(dynamic_cast<Dataset*>(m_parent));
+    // Features are read and inserted in this thread as source and destination
+    // may share one GDAL dataset. Geometries transform and fields map in the
+    // thread pool by chunks. Chunks are inserted in the read order.
+    unsigned char threadCount = static_cast<unsigned char>(
+                std::max(1, std::min(options.asInt("NUM_THREADS",
+                                                   getNumberThreads()), 255)));
 
+    CopyFeaturesContext context(this, fieldMap, filterGeomType, options);
     SpatialReferencePtr srcSRS = srcFClass->spatialReference();
     SpatialReferencePtr dstSRS = spatialReference();
-    CoordinateTransformation CT(srcSRS, dstSRS);
-    GIntBig featureCount = srcFClass->featureCount();
-    OGRwkbGeometryType dstGeomType = geometryType();
-    double counter = 0;
-    srcFClass->reset();
-    FeaturePtr feature;
-    bool ogrStyleToField = options.asBool("OGR_STYLE_STRING_TO_FIELD", false);
-    bool ogrStyleFieldToStyle = options.asBool("OGR_STYLE_FIELD_TO_STRING", false);
-    while((feature = srcFClass->nextFeature())) {
-        double complete = counter / featureCount;
-        if(!progress.onProgress(COD_IN_PROCESS, complete,
-                                _("Copy in process ..."))) {
-            return COD_CANCELED;
-        }
+    for(unsigned char i = 0; i < threadCount; ++i) {
+        context.addTransformation(srcSRS, dstSRS);
+    }
 
-        OGRGeometry *geom = feature->GetGeometryRef();
-        OGRGeometry *newGeom = nullptr;
-        if(nullptr == geom) {
-            if(skipEmpty) {
-                continue;
+    std::deque<std::unique_ptr<CopyFeaturesData>> chunks;
+    ThreadPool threadPool;
+    threadPool.init(threadCount, copyFeaturesJobThreadFunc, 0);
+    CancelToken cancelToken;
+    size_t maxChunks = threadCount * COPY_CHUNKS_PER_THREAD;
+
+    double total = static_cast<double>(srcFClass->featureCount());
+    if(total <= 0.0) {
+        total = 1.0;
+    }
+    GIntBig processed = 0;
+    GIntBig counter = 0;
+    GIntBig transactionCounter = 0;
+    bool transaction = false;
+    bool readComplete = false;
+    int result = COD_SUCCESS;
+    srcFClass->reset();
+    while(true) {
+        // Keep the pool busy while the oldest chunk is inserting.
+        while(!readComplete && chunks.size() < maxChunks) {
+            std::unique_ptr<CopyFeaturesData> chunk(
+                        new CopyFeaturesData(&context));
+            FeaturePtr feature;
+            while(chunk->m_srcFeatures.size() < COPY_CHUNK_SIZE &&
+                  (feature = srcFClass->nextFeature())) {
+                chunk->m_srcFeatures.emplace_back(feature);
             }
-        }
-        else {
-            if(skipEmpty && geom->IsEmpty()) {
-                continue;
+            if(chunk->m_srcFeatures.size() < COPY_CHUNK_SIZE) {
+                readComplete = true;
             }
-            if(skipInvalid && !geom->IsValid()) {
-                continue;
+            if(chunk->m_srcFeatures.empty()) {
+                break;
             }
+            chunk->setCancelToken(cancelToken);
+            threadPool.addThreadData(chunk.get());
+            chunks.emplace_back(std::move(chunk));
+        }
 
-            OGRwkbGeometryType geomType = geom->getGeometryType();
-            OGRwkbGeometryType multiGeomType = geomType;
-            if(OGR_GT_Flatten(geomType) < wkbPolygon && toMulti) {
-                multiGeomType = static_cast<OGRwkbGeometryType>(geomType + 3);
-            }
-            if(filterGeomType != wkbUnknown && filterGeomType != multiGeomType) {
+        if(chunks.empty()) {
+            break;
+        }
+
+        std::unique_ptr<CopyFeaturesData> chunk = std::move(chunks.front());
+        chunks.pop_front();
+        chunk->waitComplete();
+
+        if(!transaction && nullptr != dataset) {
+            transaction = dataset->startTransaction();
+        }
+
+        for(size_t i = 0; i < chunk->m_srcFeatures.size(); ++i) {
+            const FeaturePtr &feature = chunk->m_srcFeatures[i];
+            const CopyFeaturesData::CopyResult &copyResult = chunk->m_results[i];
+            if(!copyResult.feature) {
                 continue;
             }
 
-            newGeom = geom->clone();
-            if (dstGeomType != geomType) {
-                newGeom = OGRGeometryFactory::forceTo(newGeom, dstGeomType);
+            double complete = (processed + i) / total;
+            if(copyResult.setFieldsFailed) {
+                if(!progress.onProgress(COD_WARNING, complete,
+                                   _("Set feature fields failed. Source feature FID:" CPL_FRMT_GIB ". Error: %s"),
+                                   feature->GetFID(), copyResult.error.c_str())) {
+                    result = COD_CANCELED;
+                    break;
+                }
             }
 
-            CT.transform(newGeom);
-        }
-
-        FeaturePtr dstFeature = createFeature();
-        if(nullptr != newGeom) {
-            dstFeature->SetGeometryDirectly(newGeom);
-        }
-        if(dstFeature->SetFieldsFrom(feature, fieldMap.get()) != OGRERR_NONE) {
-            if(!progress.onProgress(COD_WARNING, complete,
-                               _("Set feature fields failed. Source feature FID:" CPL_FRMT_GIB ". Error: %s"),
-                               feature->GetFID (), CPLGetLastErrorMsg())) {
-                return COD_CANCELED;
+            if(!insertFeature(copyResult.feature, false)) {
+                if(!progress.onProgress(COD_WARNING, complete,
+                                   _("Create feature failed. Source feature FID:" CPL_FRMT_GIB),
+                                   feature->GetFID())) {
+                    result = COD_CANCELED;
+                    break;
+                }
             }
+            onRowCopied(feature, copyResult.feature, options);
+            counter++;
+            transactionCounter++;
         }
 
-        if(ogrStyleToField) {
-            dstFeature->SetField(OGR_STYLE_FIELD, feature->GetStyleString());
+        if(transaction && transactionCounter >= COPY_TRANSACTION_SIZE) {
+            dataset->commitTransaction();
+            transaction = false;
+            transactionCounter = 0;
         }
-        if(ogrStyleFieldToStyle) {
-            dstFeature->SetStyleString(feature->GetFieldAsString(OGR_STYLE_FIELD));
+
+        if(result == COD_CANCELED) {
+            break;
         }
 
-        if(!insertFeature(dstFeature, false)) {
-            if(!progress.onProgress(COD_WARNING, complete,
-                               _("Create feature failed. Source feature FID:" CPL_FRMT_GIB),
-                               feature->GetFID ())) {
-                return COD_CANCELED;
-            }
+        processed += static_cast<GIntBig>(chunk->m_srcFeatures.size());
+        if(!progress.onProgress(COD_IN_PROCESS, processed / total,
+                                _("Copy in process ..."))) {
+            result = COD_CANCELED;
+            break;
         }
-        onRowCopied(feature, dstFeature, options);
-        counter++;
     }
+
+    if(transaction) {
+        dataset->commitTransaction();
+    }
+
+    if(result == COD_CANCELED) {
+        cancelToken.cancel();
+        threadPool.clearThreadData();
+        threadPool.waitComplete(Progress());
+        return result;
+    }
+
     progress.onProgress(COD_FINISHED, 1.0, _("Done. Copied %d features"),
                         static_cast<int>(counter));
 
@@ -221,6 +458,61 @@ void FeatureClass::setSpatialFilter(double minX, double minY,
     }
 }
 
+/**
+ * @brief FeatureClass::featureIds Returns ids of features which envelopes
+ * intersect the extent. The envelope index is built on first call and updated
+ * on feature edits.
+ * @param extent Extent to search.
+ * @return Sorted feature ids.
+ */
+std::vector<GIntBig> FeatureClass::featureIds(const Envelope &extent) const
+{
+    m_envelopeIndexMutex.acquire();
+    bool built = m_envelopeIndex.isBuilt();
+    m_envelopeIndexMutex.release();
+
+    if(!built) {
+        // Lock in the same order as edits do.
+        DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
+        MutexHolder indexHolder(m_envelopeIndexMutex);
+        if(!m_envelopeIndex.isBuilt()) {
+            buildEnvelopeIndex();
+        }
+    }
+
+    MutexHolder holder(m_envelopeIndexMutex);
+    std::vector<GIntBig> out = m_envelopeIndex.search(extent);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+void FeatureClass::buildEnvelopeIndex() const
+{
+    std::vector<EnvelopeIndex::Item> items;
+    if(nullptr != m_layer) {
+        MutexHolder holder(m_featureMutex);
+        emptyFields(true);
+        reset();
+        FeaturePtr feature;
+        while((feature = nextFeature())) {
+            OGRGeometry *geom = feature->GetGeometryRef();
+            if(nullptr == geom) {
+                continue;
+            }
+            OGREnvelope env;
+            geom->getEnvelope(&env);
+            Envelope extent = env;
+            extent.fix();
+            items.push_back({feature->GetFID(), extent});
+        }
+        emptyFields(false);
+        reset();
+    }
+    CPLDebug("ngstore", "Envelope index of %s built for " CPL_FRMT_GUIB " features",
+             m_name.c_str(), static_cast<GUIntBig>(items.size()));
+    m_envelopeIndex.build(std::move(items));
+}
+
 Envelope FeatureClass::extent() const
 {
     return m_extent;
@@ -337,11 +629,16 @@ std::vector<OGRwkbGeometryType> FeatureClass::geometryTypes() const
 
 void FeatureClass::emptyFields(bool enable) const
 {
-    if(nullptr == m_layer) {
+    emptyFields(m_layer, enable);
+}
+
+void FeatureClass::emptyFields(OGRLayer *layer, bool enable) const
+{
+    if(nullptr == layer) {
         return;
     }
     if(!enable) {
-        m_layer->SetIgnoredFields(nullptr);
+        layer->SetIgnoredFields(nullptr);
         return;
     }
 
@@ -349,7 +646,7 @@ void FeatureClass::emptyFields(bool enable) const
     for(const std::string &fieldName : m_ignoreFields) {
         ignoreFields = CSLAddString(ignoreFields, fieldName.c_str());
     }
-    m_layer->SetIgnoredFields(const_cast<const char**>(ignoreFields));
+    layer->SetIgnoredFields(const_cast<const char**>(ignoreFields));
     CSLDestroy(ignoreFields);
     return;
 }
@@ -395,6 +692,31 @@ void FeatureClass::onFeatureInserted(FeaturePtr feature)
     Envelope extentBase = env;
     extentBase.fix();
     m_extent.merge(extentBase);
+
+    MutexHolder holder(m_envelopeIndexMutex);
+    m_envelopeIndex.insert(feature->GetFID(), extentBase);
+}
+
+void FeatureClass::onFeaturesInserted(const FeatureBatch &batch,
+                                      const std::vector<GIntBig> &fids,
+                                      const std::vector<OGREnvelope> &envelopes)
+{
+    Table::onFeaturesInserted(batch, fids, envelopes);
+    if(envelopes.empty()) {
+        return;
+    }
+
+    // Update envelope and index once for the whole batch
+    MutexHolder holder(m_envelopeIndexMutex);
+    for(size_t i = 0; i < fids.size(); ++i) {
+        if(fids[i] == NOT_FOUND || !envelopes[i].IsInit()) {
+            continue;
+        }
+        Envelope extentBase = envelopes[i];
+        extentBase.fix();
+        m_extent.merge(extentBase);
+        m_envelopeIndex.insert(fids[i], extentBase);
+    }
 }
 
 void FeatureClass::onFeatureUpdated(FeaturePtr oldFeature, FeaturePtr newFeature)
@@ -417,15 +739,39 @@ void FeatureClass::onFeatureUpdated(FeaturePtr oldFeature, FeaturePtr newFeature
         extentBase = env;
     }
 
+    Envelope newExtent;
     if(nullptr != newGeom) {
         OGREnvelope env;
         newGeom->getEnvelope(&env);
+        newExtent = env;
+        newExtent.fix();
         extentBase.merge(env);
     }
 
     extentBase.fix();
     m_extent.merge(extentBase);
 
+    MutexHolder holder(m_envelopeIndexMutex);
+    m_envelopeIndex.remove(oldFeature->GetFID());
+    if(nullptr != newGeom) {
+        m_envelopeIndex.insert(newFeature->GetFID(), newExtent);
+    }
+}
+
+void FeatureClass::onFeatureDeleted(FeaturePtr delFeature)
+{
+    Table::onFeatureDeleted(delFeature);
+    MutexHolder holder(m_envelopeIndexMutex);
+    m_envelopeIndex.remove(delFeature->GetFID());
+}
+
+void FeatureClass::onFeaturesDeleted()
+{
+    Table::onFeaturesDeleted();
+    MutexHolder holder(m_envelopeIndexMutex);
+    if(m_envelopeIndex.isBuilt()) {
+        m_envelopeIndex.build(std::vector<EnvelopeIndex::Item>());
+    }
 }
 
 } // namespace ngs
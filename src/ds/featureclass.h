@@ -62,6 +62,7 @@ public:
             std::vector<std::string>());
     void setSpatialFilter(const GeometryPtr &geom = GeometryPtr());
     void setSpatialFilter(double minX, double minY, double maxX, double maxY);
+    std::vector<GIntBig> featureIds(const Envelope &extent) const;
 
     virtual Envelope extent() const;
     virtual int copyFeatures(const FeatureClassPtr srcFClass,
@@ -78,17 +79,26 @@ public:
     // Table interface
 protected:
     virtual void onFeatureInserted(FeaturePtr feature) override;
+    virtual void onFeaturesInserted(const FeatureBatch &batch,
+                                    const std::vector<GIntBig> &fids,
+                                    const std::vector<OGREnvelope> &envelopes) override;
     virtual void onFeatureUpdated(FeaturePtr oldFeature,
                                   FeaturePtr newFeature) override;
+    virtual void onFeatureDeleted(FeaturePtr delFeature) override;
+    virtual void onFeaturesDeleted() override;
 
 protected:
     void emptyFields(bool enable = true) const;
+    void emptyFields(OGRLayer *layer, bool enable) const;
+    void buildEnvelopeIndex() const;
     void init();
 
 protected:
     std::vector<std::string> m_ignoreFields;
     mutable Envelope m_extent;
     bool m_fastSpatialFilter;
+    mutable EnvelopeIndex m_envelopeIndex;
+    mutable Mutex m_envelopeIndexMutex;
 };
 
 } // namespace ngs
@@ -22,6 +22,9 @@
 #include "datastore.h"
 #include "featureclassovr.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include "map/maptransform.h"
 #include "util/error.h"
 
@@ -30,6 +33,51 @@ namespace ngs {
 constexpr const char *ZOOM_LEVELS_OPTION = "ZOOM_LEVELS";
 constexpr unsigned short TILE_SIZE = 256; //240; //512;// 160; // Only use for overviews now in pixelSize
 constexpr double WORLD_WIDTH = DEFAULT_BOUNDS_X2.width();
+constexpr const char *MEMORY_LIMIT_OPTION = "MEMORY_LIMIT";
+constexpr const char *HILBERT_ORDER_OPTION = "HILBERT_ORDER";
+constexpr long DEFAULT_MEMORY_LIMIT = 256; // In megabytes
+constexpr GIntBig FEATURES_CHUNK_SIZE = 10000;
+constexpr unsigned char HILBERT_ORDER = 16;
+constexpr unsigned char TILES_SHARDS_PER_THREAD = 8;
+constexpr const char *TILE_CODEC_OPTION = "TILE_CODEC";
+constexpr const char *TILE_CODEC_KEY = "tile_codec";
+// Quantization step is pixel size divided by this value.
+constexpr double TILE_QUANTIZE_FACTOR = 8.0;
+constexpr size_t DIRTY_TILES_MEMORY_LIMIT = 64 * 1024 * 1024;
+
+static TileCodec tileCodecFromString(const std::string &value)
+{
+    if(EQUAL(value.c_str(), "DELTA")) {
+        return TileCodec::DELTA;
+    }
+    if(EQUAL(value.c_str(), "DEFLATE")) {
+        return TileCodec::DEFLATE;
+    }
+    return TileCodec::RAW;
+}
+
+static const char *tileCodecToString(TileCodec codec)
+{
+    switch(codec) {
+    case TileCodec::DELTA:
+        return "DELTA";
+    case TileCodec::DEFLATE:
+        return "DEFLATE";
+    default:
+        return "RAW";
+    }
+}
+
+static VectorTile tileFromFeature(const FeaturePtr &feature)
+{
+    VectorTile vtile;
+    int size = 0;
+    GByte *data = feature->GetFieldAsBinary(feature->GetFieldIndex(OVR_TILE_KEY),
+                                            &size);
+    Buffer buff(data, size, false);
+    vtile.load(buff);
+    return vtile;
+}
 
 //------------------------------------------------------------------------------
 // TilingData
@@ -55,10 +103,15 @@ FeatureClassOverview::FeatureClassOverview(OGRLayer *layer,
                                            const std::string &name) :
     FeatureClass(layer, parent, type, name),
     m_ovrTable(nullptr),
-    m_creatingOvr(false)
+    m_creatingOvr(false),
+    m_tileCodec(TileCodec::RAW),
+    m_savedTilesCount(0),
+    m_dirtyTilesSize(0)
 {
     if(nullptr != m_layer) {
         fillZoomLevels();
+        m_tileCodec = tileCodecFromString(
+                    property(TILE_CODEC_KEY, "RAW", NG_ADDITIONS_KEY));
     }
 
     hasTilesTable();
@@ -132,12 +185,26 @@ FeaturePtr FeatureClassOverview::getTileFeature(const Tile &tile)
         return FeaturePtr();
     }
 
-    DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
+    std::string filter = CPLSPrintf("%s = %d AND %s = %d AND %s = %d",
+                                    OVR_X_KEY, tile.x,
+                                    OVR_Y_KEY, tile.y,
+                                    OVR_ZOOM_KEY, tile.z);
+
+    // Read with the connection of this thread if possible to not wait others.
+    Dataset *dataset = dynamic_cast<Dataset*>(m_parent);
+    GDALDatasetPtr connection;
+    OGRLayer *layer = nullptr == dataset ? nullptr :
+            dataset->readLayer(m_ovrTable->GetName(), connection);
+    if(nullptr != layer) {
+        layer->SetAttributeFilter(filter.c_str());
+        FeaturePtr out(layer->GetNextFeature());
+        layer->SetAttributeFilter(nullptr);
+        return out;
+    }
 
-    m_ovrTable->SetAttributeFilter(CPLSPrintf("%s = %d AND %s = %d AND %s = %d",
-                                              OVR_X_KEY, tile.x,
-                                              OVR_Y_KEY, tile.y,
-                                              OVR_ZOOM_KEY, tile.z));
+    DatasetExecuteSQLLockHolder holder(dataset);
+
+    m_ovrTable->SetAttributeFilter(filter.c_str());
     FeaturePtr out(m_ovrTable->GetNextFeature());
     m_ovrTable->SetAttributeFilter(nullptr);
 
@@ -146,6 +213,16 @@ FeaturePtr FeatureClassOverview::getTileFeature(const Tile &tile)
 
 VectorTile FeatureClassOverview::getTileInternal(const Tile &tile)
 {
+    // Changed tiles not saved yet during batch operation.
+    m_dirtyTilesMutex.acquire();
+    auto it = m_dirtyTiles.find(dirtyTileKey(tile));
+    if(it != m_dirtyTiles.end() && it->second.modified) {
+        VectorTile vtile = it->second.tile;
+        m_dirtyTilesMutex.release();
+        return vtile;
+    }
+    m_dirtyTilesMutex.release();
+
     VectorTile vtile;
     FeaturePtr ovrTile = getTileFeature(tile);
     if(ovrTile) {
@@ -153,29 +230,17 @@ VectorTile FeatureClassOverview::getTileInternal(const Tile &tile)
         GByte *data = ovrTile->GetFieldAsBinary(ovrTile->GetFieldIndex(OVR_TILE_KEY),
                                                 &size);
         Buffer buff(data, size, false);
-        vtile.load(buff);
+        // Tile items are views into the blob, the feature keeps it alive.
+        vtile.load(buff, ovrTile);
     }
     return vtile;
 }
 
-bool FeatureClassOverview::setTileFeature(FeaturePtr tile)
-{
-    if(!hasTilesTable()) {
-        return false;
-    }
-
-    DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
-    return m_ovrTable->SetFeature(tile) == OGRERR_NONE;
-}
-
-bool FeatureClassOverview::createTileFeature(FeaturePtr tile)
+BufferPtr FeatureClassOverview::saveTile(const VectorTile &vtile,
+                                         unsigned char zoom) const
 {
-    if(!hasTilesTable()) {
-        return false;
-    }
-
-    DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
-    return m_ovrTable->CreateFeature(tile) == OGRERR_NONE;
+    return vtile.save(m_tileCodec,
+                      pixelSize(zoom, true) / TILE_QUANTIZE_FACTOR);
 }
 
 bool FeatureClassOverview::tilingDataJobThreadFunc(ThreadData *threadData)
@@ -222,6 +287,7 @@ bool FeatureClassOverview::createOverviews(const Progress &progress, const Optio
 {
     CPLDebug("ngstore", "start create overviews");
     m_genTiles.clear();
+    clearDirtyTiles();
     bool force = options.asBool("FORCE", false);
     if(!force && hasOverviews()) {
         return true;
@@ -257,80 +323,324 @@ bool FeatureClassOverview::createOverviews(const Progress &progress, const Optio
 
     setProperty("zoom_levels", zoomLevelListStr, NG_ADDITIONS_KEY);
 
+    m_tileCodec = tileCodecFromString(options.asString(TILE_CODEC_OPTION,
+                                                       "RAW"));
+    setProperty(TILE_CODEC_KEY, tileCodecToString(m_tileCodec),
+                NG_ADDITIONS_KEY);
+
     // Tile and simplify geometry
     progress.onProgress(COD_IN_PROCESS, 0.0,
                         _("Start tiling and simplifying geometry"));
 
+    size_t memoryLimit = static_cast<size_t>(
+                options.asLong(MEMORY_LIMIT_OPTION, DEFAULT_MEMORY_LIMIT)) *
+            1024 * 1024;
+    bool hilbertOrder = options.asBool(HILBERT_ORDER_OPTION, false);
+    std::vector<GIntBig> fids;
+    if(hilbertOrder) {
+        fids = hilbertOrderedFeatures();
+    }
+
     // Multithreaded thread pool
     CPLDebug("ngstore", "fill pool create overviews");
+    unsigned char threadCount = static_cast<unsigned char>(
+                std::max(1, std::min(options.asInt("NUM_THREADS",
+                                                   getNumberThreads()), 255)));
+    initTilesShards(threadCount);
     ThreadPool threadPool;
-    threadPool.init(getNumberThreads(), tilingDataJobThreadFunc);
+    threadPool.init(threadCount, tilingDataJobThreadFunc);
+
+    // Tiles are flushed to the overviews table while tiling, so the table is
+    // not ready for queries until the end.
+    m_creatingOvr = true;
     emptyFields(true);
     reset();
 
-    FeaturePtr feature;
-    while((feature = nextFeature())) {
-        threadPool.addThreadData(new TilingData(this, feature, true));
+    double total = hilbertOrder ? static_cast<double>(fids.size()) :
+                                  static_cast<double>(featureCount());
+    if(total <= 0.0) {
+        total = 1.0;
     }
+    GIntBig processed = 0;
+    size_t fidIndex = 0;
+    unsigned int flushCount = 0;
+    m_savedTilesCount = 0;
+    bool result = true;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    while(true) {
+        // Feed the pool by chunks to not hold all features in memory.
+        GIntBig chunkSize = 0;
+        FeaturePtr feature;
+        while(chunkSize < FEATURES_CHUNK_SIZE) {
+            if(hilbertOrder) {
+                if(fidIndex >= fids.size()) {
+                    break;
+                }
+                feature = getFeature(fids[fidIndex++]);
+                if(!feature) {
+                    continue;
+                }
+            }
+            else {
+                feature = nextFeature();
+                if(!feature) {
+                    break;
+                }
+            }
+            threadPool.addThreadData(new TilingData(this, feature, true));
+            chunkSize++;
+        }
 
-    Progress newProgress(progress);
-    newProgress.setTotalSteps(2);
-    newProgress.setStep(0);
-    threadPool.waitComplete(newProgress);
-    threadPool.clearThreadData();
-
-    emptyFields(false);
-    reset();
+        if(chunkSize == 0) {
+            break;
+        }
 
-    // Save tiles
-    m_creatingOvr = true;
-    parentDS->lockExecuteSql(true);
-    parentDS->startBatchOperation();
+        threadPool.waitComplete(Progress());
+        processed += chunkSize;
 
-    CPLDebug("ngstore", "finish create overviews");
-    double counter = 0.0;
-    newProgress.setStep(1);
-    for(auto item : m_genTiles) {
-        if(!item.second.isValid() || item.second.empty()) {
-            continue;
+        size_t memoryUsed = tilesShardsSize();
+        if(memoryUsed > memoryLimit) {
+            CPLDebug("ngstore", "Flush overview tiles. Memory used: " CPL_FRMT_GUIB,
+                     static_cast<GUIntBig>(memoryUsed));
+            flushOverviewTiles(parentDS);
+            flushCount++;
         }
-        BufferPtr data = item.second.save();
-
-        FeaturePtr newFeature = OGRFeature::CreateFeature(
-                    m_ovrTable->GetLayerDefn() );
 
-        newFeature->SetField(OVR_ZOOM_KEY, item.first.z);
-        newFeature->SetField(OVR_X_KEY, item.first.x);
-        newFeature->SetField(OVR_Y_KEY, item.first.y);
-        newFeature->SetField(newFeature->GetFieldIndex(OVR_TILE_KEY), data->size(),
-                          data->data());
+        double seconds = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - startTime).count();
+        if(seconds <= 0.0) {
+            seconds = 1.0;
+        }
+        // Tiles flushed several times are counted once per flush
+        size_t generatedTiles = m_savedTilesCount + tilesShardsCount();
+        if(!progress.onProgress(COD_IN_PROCESS, processed / total * 0.9,
+                                _("Tiling ... %.0f features/s, %.0f tiles/s"),
+                                processed / seconds,
+                                generatedTiles / seconds)) {
+            threadPool.clearThreadData();
+            result = false;
+            break;
+        }
+    }
 
-//        CPLDebug("ngstore", "Tile size to store %d", data->size());
+    emptyFields(false);
+    reset();
 
-        if(m_ovrTable->CreateFeature(newFeature) != OGRERR_NONE) {
-            outMessage(COD_INSERT_FAILED, _("Failed to create feature"));
+    // Tiles already flushed are incomplete, so drop them. Otherwise the next
+    // call without FORCE would take them as built overviews.
+    if(!result) {
+        m_genTiles.clear();
+        {
+            DatasetExecuteSQLLockHolder holder(parentDS);
+            parentDS->destroyOverviewsTable(name());
+            m_ovrTable = nullptr;
         }
-
-        newProgress.onProgress(COD_IN_PROCESS, counter/m_genTiles.size(),
-                               _("Save tiles ..."));
-        counter++;
+        m_zoomLevels.clear();
+        setProperty("zoom_levels", "", NG_ADDITIONS_KEY);
+        m_creatingOvr = false;
+        progress.onProgress(COD_CANCELED, 0.0, _("Create overviews canceled"));
+        return errorMessage(_("Create overviews canceled"));
     }
 
-    parentDS->stopBatchOperation();
+    // Save tiles left in memory
+    flushOverviewTiles(parentDS);
+    flushCount++;
     m_genTiles.clear();
 
     // Create index
     parentDS->createOverviewsTableIndex(name());
-    parentDS->lockExecuteSql(false);
+
+    // Tiles flushed several times may be split between table rows.
+    if(flushCount > 1) {
+        progress.onProgress(COD_IN_PROCESS, 0.95, _("Merge tiles ..."));
+        mergeSplitTiles(parentDS);
+    }
     m_creatingOvr = false;
 
+    double seconds = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - startTime).count();
     progress.onProgress(COD_FINISHED, 1.0,
-                        _("Finish tiling and simplifying geometry"));
+                        _("Finish tiling and simplifying geometry. "
+                          CPL_FRMT_GIB " features, " CPL_FRMT_GUIB " tiles in %.1f s"),
+                        processed, static_cast<GUIntBig>(m_savedTilesCount),
+                        seconds);
 
     CPLDebug("ngstore", "finish create overviews");
     return true;
 }
 
+void FeatureClassOverview::flushOverviewTiles(DataStore *parentDS)
+{
+    DatasetExecuteSQLLockHolder holder(parentDS);
+    DatasetBatchOperationHolder batchHolder(parentDS);
+    parentDS->m_addsDS->StartTransaction();
+    for(auto &shard : m_genTiles) {
+        MutexHolder shardHolder(shard->mutex);
+        for(auto &item : shard->tiles) {
+            if(!item.second.isValid() || item.second.empty()) {
+                continue;
+            }
+            BufferPtr data = saveTile(item.second, item.first.z);
+
+            FeaturePtr newFeature = OGRFeature::CreateFeature(
+                        m_ovrTable->GetLayerDefn() );
+
+            newFeature->SetField(OVR_ZOOM_KEY, item.first.z);
+            newFeature->SetField(OVR_X_KEY, item.first.x);
+            newFeature->SetField(OVR_Y_KEY, item.first.y);
+            newFeature->SetField(newFeature->GetFieldIndex(OVR_TILE_KEY),
+                                 data->size(), data->data());
+
+            if(m_ovrTable->CreateFeature(newFeature) != OGRERR_NONE) {
+                outMessage(COD_INSERT_FAILED, _("Failed to create feature"));
+            }
+            m_savedTilesCount++;
+        }
+        shard->tiles.clear();
+        shard->size = 0;
+    }
+    parentDS->m_addsDS->CommitTransaction();
+}
+
+void FeatureClassOverview::initTilesShards(unsigned char threadCount)
+{
+    m_genTiles.clear();
+    size_t count = static_cast<size_t>(threadCount) * TILES_SHARDS_PER_THREAD;
+    for(size_t i = 0; i < count; ++i) {
+        m_genTiles.emplace_back(TilesShardUPtr(new TilesShard));
+    }
+}
+
+size_t FeatureClassOverview::tilesShardsSize() const
+{
+    size_t size = 0;
+    for(const auto &shard : m_genTiles) {
+        MutexHolder holder(shard->mutex);
+        size += shard->size;
+    }
+    return size;
+}
+
+size_t FeatureClassOverview::tilesShardsCount() const
+{
+    size_t count = 0;
+    for(const auto &shard : m_genTiles) {
+        MutexHolder holder(shard->mutex);
+        count += shard->tiles.size();
+    }
+    return count;
+}
+
+void FeatureClassOverview::mergeSplitTiles(DataStore *parentDS)
+{
+    std::string tableName = m_ovrTable->GetName();
+    std::vector<Tile> tiles;
+
+    DatasetExecuteSQLLockHolder holder(parentDS);
+    OGRLayer *splitTiles = parentDS->m_addsDS->ExecuteSQL(
+                CPLSPrintf("SELECT %s, %s, %s FROM %s GROUP BY %s, %s, %s HAVING COUNT(*) > 1",
+                           OVR_X_KEY, OVR_Y_KEY, OVR_ZOOM_KEY, tableName.c_str(),
+                           OVR_X_KEY, OVR_Y_KEY, OVR_ZOOM_KEY), nullptr, nullptr);
+    if(nullptr == splitTiles) {
+        return;
+    }
+
+    FeaturePtr feature;
+    while((feature = splitTiles->GetNextFeature())) {
+        Tile tile;
+        tile.x = feature->GetFieldAsInteger(0);
+        tile.y = feature->GetFieldAsInteger(1);
+        tile.z = static_cast<unsigned char>(feature->GetFieldAsInteger(2));
+        tile.crossExtent = 0;
+        tiles.push_back(tile);
+    }
+    parentDS->m_addsDS->ReleaseResultSet(splitTiles);
+
+    CPLDebug("ngstore", "Merge " CPL_FRMT_GUIB " split tiles",
+             static_cast<GUIntBig>(tiles.size()));
+
+    DatasetBatchOperationHolder batchHolder(parentDS);
+    parentDS->m_addsDS->StartTransaction();
+    for(const Tile &tile : tiles) {
+        m_ovrTable->SetAttributeFilter(CPLSPrintf("%s = %d AND %s = %d AND %s = %d",
+                                                  OVR_X_KEY, tile.x,
+                                                  OVR_Y_KEY, tile.y,
+                                                  OVR_ZOOM_KEY, tile.z));
+        VectorTile vtile;
+        FeaturePtr tileFeature;
+        std::vector<GIntBig> splitFids;
+        while((feature = m_ovrTable->GetNextFeature())) {
+            VectorTile part = tileFromFeature(feature);
+            vtile.add(part.items(), true);
+            if(tileFeature) {
+                splitFids.push_back(feature->GetFID());
+            }
+            else {
+                tileFeature = feature;
+            }
+        }
+        m_ovrTable->SetAttributeFilter(nullptr);
+
+        if(!tileFeature) {
+            continue;
+        }
+
+        BufferPtr data = saveTile(vtile, tile.z);
+        tileFeature->SetField(tileFeature->GetFieldIndex(OVR_TILE_KEY),
+                              data->size(), data->data());
+        m_ovrTable->SetFeature(tileFeature);
+        for(GIntBig fid : splitFids) {
+            if(m_ovrTable->DeleteFeature(fid) == OGRERR_NONE) {
+                m_savedTilesCount--;
+            }
+        }
+    }
+    parentDS->m_addsDS->CommitTransaction();
+}
+
+std::vector<GIntBig> FeatureClassOverview::hilbertOrderedFeatures() const
+{
+    std::vector<GIntBig> out;
+    Envelope ext = extent();
+    if(!ext.isInit()) {
+        return out;
+    }
+
+    double maxCell = (1 << HILBERT_ORDER) - 1;
+    double scaleX = ext.width() > 0.0 ? maxCell / ext.width() : 0.0;
+    double scaleY = ext.height() > 0.0 ? maxCell / ext.height() : 0.0;
+
+    std::vector<std::pair<GUIntBig, GIntBig>> order;
+    emptyFields(true);
+    reset();
+    FeaturePtr feature;
+    while((feature = nextFeature())) {
+        OGRGeometry *geom = feature->GetGeometryRef();
+        if(nullptr == geom) {
+            continue;
+        }
+        OGREnvelope env;
+        geom->getEnvelope(&env);
+        double x = ((env.MinX + env.MaxX) * 0.5 - ext.minX()) * scaleX;
+        double y = ((env.MinY + env.MaxY) * 0.5 - ext.minY()) * scaleY;
+        x = std::min(std::max(x, 0.0), maxCell);
+        y = std::min(std::max(y, 0.0), maxCell);
+        order.emplace_back(hilbertIndex(static_cast<GUInt32>(x),
+                                        static_cast<GUInt32>(y),
+                                        HILBERT_ORDER),
+                           feature->GetFID());
+    }
+    emptyFields(false);
+    reset();
+
+    std::sort(order.begin(), order.end());
+    out.reserve(order.size());
+    for(const auto &item : order) {
+        out.push_back(item.second);
+    }
+    return out;
+}
+
 VectorTile FeatureClassOverview::getTile(const Tile &tile, const Envelope &tileExtent)
 {
     VectorTile vtile;
@@ -376,39 +686,52 @@ VectorTile FeatureClassOverview::getTile(const Tile &tile, const Envelope &tileE
 
     double step = pixelSize(tile.z, precisePixelSize);
 
-    std::vector<FeaturePtr> features;
-    OGREnvelope extEnv;
+    // Without fast spatial filter the driver reads all features, so take ids
+    // from the envelope index and fetch features by id.
+    std::vector<GIntBig> fids;
     if(!m_fastSpatialFilter) {
-        extEnv = tileExtent.toOgrEnvelope();
+        fids = featureIds(tileExtent);
+        if(fids.empty()) {
+            return vtile;
+        }
     }
 
-    // Lock threads here
-    dataset->lockExecuteSql(true);
-    m_featureMutex.acquire(10.5);
-    emptyFields(true);
-    GeometryPtr extGeom = tileExtent.toGeometry(spatialReference());
-    setSpatialFilter(extGeom);
-    //reset();
+    std::vector<FeaturePtr> features;
+    // Read with the connection of this thread if possible, otherwise lock
+    // threads here.
+    GDALDatasetPtr connection;
+    OGRLayer *layer = dataset->readLayer(m_layer->GetName(), connection);
+    bool locked = nullptr == layer;
+    if(locked) {
+        dataset->lockExecuteSql(true);
+        m_featureMutex.acquire(10.5);
+        layer = m_layer;
+    }
+    emptyFields(layer, true);
     FeaturePtr feature;
-    while((feature = nextFeature())) {
-        if(m_fastSpatialFilter) {
+    if(m_fastSpatialFilter) {
+        GeometryPtr extGeom = tileExtent.toGeometry(spatialReference());
+        layer->SetSpatialFilter(extGeom.get());
+        layer->ResetReading();
+        while((feature = FeaturePtr(layer->GetNextFeature(), this))) {
             features.push_back(feature);
         }
-        else {
-            OGRGeometry* geom = feature->GetGeometryRef();
-            if(geom) {
-                OGREnvelope env;
-                geom->getEnvelope(&env);
-                if(env.IsInit() && env.Intersects(extEnv)) {
-                    features.push_back(feature);
-                }
+        layer->SetSpatialFilter(nullptr);
+    }
+    else {
+        features.reserve(fids.size());
+        for(GIntBig fid : fids) {
+            feature = FeaturePtr(layer->GetFeature(fid), this);
+            if(feature) {
+                features.push_back(feature);
             }
         }
     }
-    emptyFields(false);
-    setSpatialFilter();
-    dataset->lockExecuteSql(false);
-    m_featureMutex.release();
+    emptyFields(layer, false);
+    if(locked) {
+        dataset->lockExecuteSql(false);
+        m_featureMutex.release();
+    }
 
     while(!features.empty()) {
         feature = features.back();
@@ -519,11 +842,19 @@ Envelope FeatureClassOverview::extraExtentForZoom(unsigned char zoom, const Enve
     return extent;
 }
 
+bool FeatureClassOverview::isOverviewsUpdatable()
+{
+    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
+    if(nullptr == dataset || m_creatingOvr || m_zoomLevels.empty()) {
+        return false;
+    }
+    return hasTilesTable();
+}
+
 void FeatureClassOverview::onFeatureInserted(FeaturePtr feature)
 {
     FeatureClass::onFeatureInserted(feature);
-    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
-    if(nullptr == dataset || dataset->isBatchOperation()) {
+    if(!isOverviewsUpdatable()) {
         return;
     }
 
@@ -531,11 +862,53 @@ void FeatureClassOverview::onFeatureInserted(FeaturePtr feature)
     if(nullptr == geom) {
         return;
     }
+
+    // Same lock order as flushDirtyTiles.
+    DatasetExecuteSQLLockHolder sqlHolder(dynamic_cast<Dataset*>(m_parent));
+    MutexHolder holder(m_dirtyTilesMutex);
+    addDirtyGeometry(feature->GetFID(), geom);
+    saveDirtyTiles();
+}
+
+void FeatureClassOverview::onFeaturesInserted(const FeatureBatch &batch,
+                                              const std::vector<GIntBig> &fids,
+                                              const std::vector<OGREnvelope> &envelopes)
+{
+    FeatureClass::onFeaturesInserted(batch, fids, envelopes);
+    if(!batch.hasGeometry() || !isOverviewsUpdatable()) {
+        return;
+    }
+
+    // Same lock order as flushDirtyTiles.
+    DatasetExecuteSQLLockHolder sqlHolder(dynamic_cast<Dataset*>(m_parent));
+    MutexHolder holder(m_dirtyTilesMutex);
+    for(size_t i = 0; i < fids.size(); ++i) {
+        const std::string &wkb = batch.geometries()[i];
+        if(fids[i] == NOT_FOUND || wkb.empty()) {
+            continue;
+        }
+        OGRGeometry *geom = nullptr;
+        if(OGRGeometryFactory::createFromWkb(wkb.data(), nullptr, &geom,
+                static_cast<int>(wkb.size())) != OGRERR_NONE) {
+            continue;
+        }
+        addDirtyGeometry(fids[i], geom);
+        OGRGeometryFactory::destroyGeometry(geom);
+    }
+    saveDirtyTiles();
+}
+
+/**
+ * @brief FeatureClassOverview::addDirtyGeometry Adds inserted geometry to
+ * dirty tiles of all zoom levels. Dataset SQL lock and dirty tiles mutex must
+ * be held.
+ */
+void FeatureClassOverview::addDirtyGeometry(GIntBig fid, OGRGeometry *geom)
+{
     bool precisePixelSize = !(OGR_GT_Flatten(geom->getGeometryType()) == wkbPoint ||
                               OGR_GT_Flatten(geom->getGeometryType()) == wkbMultiPoint);
 
     GEOSGeometryPtr geosGeom(new GEOSGeometryWrap(geom));
-    GIntBig fid = feature->GetFID();
 
     OGREnvelope env;
     geom->getEnvelope(&env);
@@ -548,50 +921,23 @@ void FeatureClassOverview::onFeatureInserted(FeaturePtr feature)
         Envelope extent = extraExtentForZoom(zoomLevel, extentBase);
         std::vector<TileItem> items =
                 MapTransform::getTilesForExtent(extent, zoomLevel, false, true);
+        loadDirtyTiles(items);
 
         double step = FeatureClassOverview::pixelSize(zoomLevel, precisePixelSize);
         geosGeom->simplify(step);
 
         for(auto tileItem : items) {
-
             Envelope ext = tileItem.env;
             ext.resize(TILE_RESIZE);
 
             auto vItem = tileGeometry(fid, geosGeom, ext);
-
-            FeaturePtr tile = getTileFeature(tileItem.tile);
-            VectorTile  vtile;
-            bool create = true;
-            if(tile) {
-                int size = 0;
-                GByte *data = tile->GetFieldAsBinary(
-                            tile->GetFieldIndex(OVR_TILE_KEY), &size);
-                Buffer buff(data, size, false);
-                vtile.load(buff);
-                create = false;
+            if(vItem.empty()) {
+                continue;
             }
-            else {
-                tile = OGRFeature::CreateFeature(m_ovrTable->GetLayerDefn());
-
-                tile->SetField(OVR_ZOOM_KEY, tileItem.tile.z);
-                tile->SetField(OVR_X_KEY, tileItem.tile.x);
-                tile->SetField(OVR_Y_KEY, tileItem.tile.y);
-            }
-            vtile.add(vItem, true);
 
-            // Add tile back
-            if(vtile.isValid()) {
-                BufferPtr data = vtile.save();
-                tile->SetField(tile->GetFieldIndex(OVR_TILE_KEY), data->size(),
-                               data->data());
-
-                if(create) {
-                    createTileFeature(tile);
-                }
-                else {
-                    setTileFeature(tile);
-                }
-            }
+            DirtyTile &dirty = m_dirtyTiles[dirtyTileKey(tileItem.tile)];
+            dirty.tile.add(vItem, true);
+            setTileModified(dirty);
         }
     }
 }
@@ -600,8 +946,7 @@ void FeatureClassOverview::onFeatureUpdated(FeaturePtr oldFeature,
                                             FeaturePtr newFeature)
 {
     FeatureClass::onFeatureUpdated(oldFeature, newFeature);
-    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
-    if(nullptr == dataset || dataset->isBatchOperation()) {
+    if(!isOverviewsUpdatable()) {
         return;
     }
 
@@ -630,6 +975,9 @@ void FeatureClassOverview::onFeatureUpdated(FeaturePtr oldFeature,
     GEOSGeometryPtr geosGeom(new GEOSGeometryWrap(newGeom));
     GIntBig fid = newFeature->GetFID();
 
+    // Same lock order as flushDirtyTiles.
+    DatasetExecuteSQLLockHolder sqlHolder(dynamic_cast<Dataset*>(m_parent));
+    MutexHolder holder(m_dirtyTilesMutex);
     auto zoomLevelsList = zoomLevels();
     for(auto it = zoomLevelsList.rbegin(); it != zoomLevelsList.rend(); ++it) {
         unsigned char zoomLevel = *it;
@@ -637,110 +985,235 @@ void FeatureClassOverview::onFeatureUpdated(FeaturePtr oldFeature,
 
         std::vector<TileItem> items =
                 MapTransform::getTilesForExtent(extent, zoomLevel, false, true);
+        loadDirtyTiles(items);
 
         double step = FeatureClassOverview::pixelSize(zoomLevel, precisePixelSize);
         geosGeom->simplify(step);
 
         for(auto tileItem : items) {
-            FeaturePtr tile = getTileFeature(tileItem.tile);
-            VectorTile  vtile;
-            bool create = true;
-            if(tile) {
-                int size = 0;
-                GByte *data = tile->GetFieldAsBinary(
-                            tile->GetFieldIndex(OVR_TILE_KEY), &size);
-                Buffer buff(data, size, false);
-                vtile.load(buff);
-                create = false;
-            }
-            else {
-                tile = OGRFeature::CreateFeature(m_ovrTable->GetLayerDefn());
-
-                tile->SetField(OVR_ZOOM_KEY, tileItem.tile.z);
-                tile->SetField(OVR_X_KEY, tileItem.tile.x);
-                tile->SetField(OVR_Y_KEY, tileItem.tile.y);
-            }
-
-            vtile.remove(oldFeature->GetFID());
+            DirtyTile &dirty = m_dirtyTiles[dirtyTileKey(tileItem.tile)];
+            dirty.tile.remove(oldFeature->GetFID());
 
             Envelope env = tileItem.env;
             env.resize(TILE_RESIZE);
             auto vItem = tileGeometry(fid, geosGeom, env);
-            vtile.add(vItem, true);
-
-            // Add tile back
-            if(vtile.isValid()) {
-                BufferPtr data = vtile.save();
-                tile->SetField(tile->GetFieldIndex(OVR_TILE_KEY), data->size(),
-                                                     data->data());
-
-                if(create) {
-                    createTileFeature(tile);
-                }
-                else {
-                    setTileFeature(tile);
-                }
-            }
+            dirty.tile.add(vItem, true);
+            setTileModified(dirty);
         }
     }
+
+    saveDirtyTiles();
 }
 
 void FeatureClassOverview::onFeatureDeleted(FeaturePtr delFeature)
 {
     FeatureClass::onFeatureDeleted(delFeature);
-    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
-    if(nullptr == dataset || dataset->isBatchOperation()) {
+    if(!isOverviewsUpdatable()) {
         return;
     }
 
-    OGREnvelope env;OGRGeometry *geom = delFeature->GetGeometryRef();
+    OGRGeometry *geom = delFeature->GetGeometryRef();
+    if(nullptr == geom) {
+        return;
+    }
+    OGREnvelope env;
     geom->getEnvelope(&env);
 
+    DatasetExecuteSQLLockHolder sqlHolder(dynamic_cast<Dataset*>(m_parent));
+    MutexHolder holder(m_dirtyTilesMutex);
     for(auto zoomLevel : zoomLevels()) {
         Envelope extent = extraExtentForZoom(zoomLevel, env);
         std::vector<TileItem> items =
                 MapTransform::getTilesForExtent(extent, zoomLevel, false, true);
-        for(auto tileItem : items) {
-            FeaturePtr tile = getTileFeature(tileItem.tile);
-
-            VectorTile  vtile;
-            if(tile) {
-                int size = 0;
-                GByte *data = tile->GetFieldAsBinary(
-                            tile->GetFieldIndex(OVR_TILE_KEY), &size);
-                Buffer buff(data, size, false);
-                if(vtile.load(buff)) {
-                    vtile.remove(delFeature->GetFID());
-                }
-            }
+        loadDirtyTiles(items);
 
-            // Add tile back
-            if(vtile.isValid()) {
-                BufferPtr data = vtile.save();
-                tile->SetField(tile->GetFieldIndex(OVR_TILE_KEY), data->size(),
-                               data->data());
-
-                setTileFeature(tile);
-            }
-            else if(tile) {
-                ngsUnused(m_ovrTable->DeleteFeature(tile->GetFID()));
-            }
+        for(auto tileItem : items) {
+            DirtyTile &dirty = m_dirtyTiles[dirtyTileKey(tileItem.tile)];
+            dirty.tile.remove(delFeature->GetFID());
+            setTileModified(dirty);
         }
     }
+
+    saveDirtyTiles();
 }
 
 void FeatureClassOverview::onFeaturesDeleted()
 {
+    FeatureClass::onFeaturesDeleted();
+    clearDirtyTiles();
     DataStore *dataset = dynamic_cast<DataStore*>(m_parent);
     if(nullptr != dataset) {
         dataset->clearOverviewsTable(name());
     }
 }
 
+Tile FeatureClassOverview::dirtyTileKey(const Tile &tile)
+{
+    // Overviews table has no cross extent column.
+    Tile key = tile;
+    key.crossExtent = 0;
+    return key;
+}
+
+void FeatureClassOverview::loadDirtyTiles(const std::vector<TileItem> &items)
+{
+    if(items.empty()) {
+        return;
+    }
+
+    // Read all not cached tiles of the extent by one query.
+    std::set<Tile> newTiles;
+    int minX = std::numeric_limits<int>::max();
+    int minY = std::numeric_limits<int>::max();
+    int maxX = std::numeric_limits<int>::min();
+    int maxY = std::numeric_limits<int>::min();
+    unsigned char zoom = items.front().tile.z;
+    for(const TileItem &item : items) {
+        Tile key = dirtyTileKey(item.tile);
+        if(m_dirtyTiles.find(key) != m_dirtyTiles.end()) {
+            continue;
+        }
+        m_dirtyTiles[key] = DirtyTile();
+        newTiles.insert(key);
+        minX = std::min(minX, key.x);
+        maxX = std::max(maxX, key.x);
+        minY = std::min(minY, key.y);
+        maxY = std::max(maxY, key.y);
+    }
+
+    if(newTiles.empty()) {
+        return;
+    }
+
+    DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
+    m_ovrTable->SetAttributeFilter(
+                CPLSPrintf("%s = %d AND %s >= %d AND %s <= %d AND %s >= %d AND %s <= %d",
+                           OVR_ZOOM_KEY, zoom, OVR_X_KEY, minX, OVR_X_KEY, maxX,
+                           OVR_Y_KEY, minY, OVR_Y_KEY, maxY));
+    m_ovrTable->ResetReading();
+    FeaturePtr feature;
+    while((feature = m_ovrTable->GetNextFeature())) {
+        Tile key;
+        key.x = feature->GetFieldAsInteger(OVR_X_KEY);
+        key.y = feature->GetFieldAsInteger(OVR_Y_KEY);
+        key.z = zoom;
+        key.crossExtent = 0;
+        if(newTiles.find(key) == newTiles.end()) {
+            continue;
+        }
+        DirtyTile &dirty = m_dirtyTiles[key];
+        if(dirty.fid != OGRNullFID) {
+            continue;
+        }
+        dirty.tile = tileFromFeature(feature);
+        dirty.fid = feature->GetFID();
+        dirty.size = dirty.tile.memorySize();
+        m_dirtyTilesSize += dirty.size;
+    }
+    m_ovrTable->SetAttributeFilter(nullptr);
+}
+
+void FeatureClassOverview::setTileModified(DirtyTile &dirty)
+{
+    dirty.modified = true;
+    size_t size = dirty.tile.memorySize();
+    m_dirtyTilesSize = m_dirtyTilesSize - dirty.size + size;
+    dirty.size = size;
+}
+
+void FeatureClassOverview::saveDirtyTiles()
+{
+    // Batch operation keeps changed tiles until the end or memory limit.
+    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
+    if(nullptr != dataset && dataset->isBatchOperation() &&
+            m_dirtyTilesSize < DIRTY_TILES_MEMORY_LIMIT) {
+        return;
+    }
+    flushDirtyTiles();
+}
+
+void FeatureClassOverview::flushDirtyTiles()
+{
+    DataStore *parentDS = dynamic_cast<DataStore*>(m_parent);
+    DatasetExecuteSQLLockHolder holder(parentDS);
+    MutexHolder dirtyHolder(m_dirtyTilesMutex);
+    if(m_dirtyTiles.empty()) {
+        return;
+    }
+
+    if(nullptr == parentDS || !hasTilesTable()) {
+        clearDirtyTiles();
+        return;
+    }
+
+    CPLDebug("ngstore", "Save " CPL_FRMT_GUIB " changed overview tiles",
+             static_cast<GUIntBig>(m_dirtyTiles.size()));
+
+    parentDS->m_addsDS->StartTransaction();
+    for(auto &item : m_dirtyTiles) {
+        const Tile &tile = item.first;
+        DirtyTile &dirty = item.second;
+        if(!dirty.modified) {
+            continue;
+        }
+
+        if(dirty.tile.empty()) {
+            if(dirty.fid != OGRNullFID) {
+                ngsUnused(m_ovrTable->DeleteFeature(dirty.fid));
+            }
+            continue;
+        }
+
+        BufferPtr data = saveTile(dirty.tile, tile.z);
+        FeaturePtr feature = OGRFeature::CreateFeature(m_ovrTable->GetLayerDefn());
+        feature->SetField(OVR_ZOOM_KEY, tile.z);
+        feature->SetField(OVR_X_KEY, tile.x);
+        feature->SetField(OVR_Y_KEY, tile.y);
+        feature->SetField(feature->GetFieldIndex(OVR_TILE_KEY), data->size(),
+                          data->data());
+        OGRErr result;
+        if(dirty.fid != OGRNullFID) {
+            feature->SetFID(dirty.fid);
+            result = m_ovrTable->SetFeature(feature);
+        }
+        else {
+            result = m_ovrTable->CreateFeature(feature);
+        }
+        if(result != OGRERR_NONE) {
+            outMessage(COD_UPDATE_FAILED, _("Failed to save overview tile"));
+        }
+    }
+    parentDS->m_addsDS->CommitTransaction();
+
+    clearDirtyTiles();
+}
+
+void FeatureClassOverview::clearDirtyTiles()
+{
+    MutexHolder holder(m_dirtyTilesMutex);
+    m_dirtyTiles.clear();
+    m_dirtyTilesSize = 0;
+}
+
 void FeatureClassOverview::addOverviewItem(const Tile &tile, const VectorTileItemArray &items)
 {
-    MutexHolder holder(m_genTileMutex, 150.0);
-    m_genTiles[tile].add(items, true);
+    if(items.empty() || m_genTiles.empty()) {
+        return;
+    }
+
+    size_t size = 0;
+    for(const auto &item : items) {
+        size += item.memorySize();
+    }
+
+    // Spread tiles between shards to not lock all workers on one mutex.
+    size_t hash = static_cast<size_t>(tile.x) * 73856093 ^
+            static_cast<size_t>(tile.y) * 19349663 ^
+            static_cast<size_t>(tile.z) * 83492791;
+    TilesShard *shard = m_genTiles[hash % m_genTiles.size()].get();
+    MutexHolder holder(shard->mutex, 150.0);
+    shard->tiles[tile].add(items, true);
+    shard->size += size;
 }
 
 } // namespace ngs
@@ -27,6 +27,8 @@ namespace ngs {
 
 constexpr double TILE_RESIZE = 1.1;
 
+class DataStore;
+
 /**
  * @brief The FeatureClassOverview class
  */
@@ -47,6 +49,7 @@ public:
     VectorTile getTile(const Tile &tile, const Envelope &tileExtent = Envelope());
     std::set<unsigned char> zoomLevels() const { return m_zoomLevels; }
     void addOverviewItem(const Tile &tile, const VectorTileItemArray &items);
+    void flushDirtyTiles();
 
     // static
     static double pixelSize(int zoom, bool precize = false);
@@ -59,6 +62,9 @@ public:
     // Table interface
 protected:
     virtual void onFeatureInserted(FeaturePtr feature) override;
+    virtual void onFeaturesInserted(const FeatureBatch &batch,
+                                    const std::vector<GIntBig> &fids,
+                                    const std::vector<OGREnvelope> &envelopes) override;
     virtual void onFeatureUpdated(FeaturePtr oldFeature, FeaturePtr newFeature) override;
     virtual void onFeatureDeleted(FeaturePtr delFeature) override;
     virtual void onFeaturesDeleted() override;
@@ -80,23 +86,65 @@ protected:
                           */
 
     bool hasTilesTable();
+    void initTilesShards(unsigned char threadCount);
+    size_t tilesShardsSize() const;
+    size_t tilesShardsCount() const;
+    void flushOverviewTiles(DataStore *parentDS);
+    void mergeSplitTiles(DataStore *parentDS);
+    std::vector<GIntBig> hilbertOrderedFeatures() const;
     FeaturePtr getTileFeature(const Tile &tile);
     VectorTile getTileInternal(const Tile &tile);
-    bool setTileFeature(FeaturePtr tile);
-    bool createTileFeature(FeaturePtr tile);
+    BufferPtr saveTile(const VectorTile &vtile, unsigned char zoom) const;
+
+    bool isOverviewsUpdatable();
+    void loadDirtyTiles(const std::vector<TileItem> &items);
+    void addDirtyGeometry(GIntBig fid, OGRGeometry *geom);
+    void saveDirtyTiles();
+    void clearDirtyTiles();
 
     // static
 protected:
     static bool tilingDataJobThreadFunc(ThreadData *threadData);
+    static Tile dirtyTileKey(const Tile &tile);
 
 protected:
     OGRLayer *m_ovrTable;
     std::set<unsigned char> m_zoomLevels;
-    Mutex m_genTileMutex;
     bool m_creatingOvr;
+    TileCodec m_tileCodec;
 
 private:
-    std::map<Tile, VectorTile> m_genTiles;
+    /**
+     * @brief The TilesShard struct Part of generated tiles with own lock
+     */
+    typedef struct _tilesShard {
+        _tilesShard() : size(0) {}
+        Mutex mutex;
+        std::map<Tile, VectorTile> tiles;
+        size_t size;
+    } TilesShard;
+    using TilesShardUPtr = std::unique_ptr<TilesShard>;
+
+    std::vector<TilesShardUPtr> m_genTiles;
+    size_t m_savedTilesCount;
+
+    /**
+     * @brief The DirtyTile struct Overview tile changed by feature edits and
+     * not saved yet
+     */
+    typedef struct _dirtyTile {
+        _dirtyTile() : fid(OGRNullFID), size(0), modified(false) {}
+        VectorTile tile;
+        GIntBig fid; // Overviews table row or OGRNullFID for a new tile
+        size_t size;
+        bool modified;
+    } DirtyTile;
+
+    void setTileModified(DirtyTile &dirty);
+
+    std::map<Tile, DirtyTile> m_dirtyTiles;
+    size_t m_dirtyTilesSize;
+    Mutex m_dirtyTilesMutex;
 };
 
 using FeatureClassOverviewPtr = std::shared_ptr<FeatureClassOverview>;
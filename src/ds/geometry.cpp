@@ -20,10 +20,17 @@
  ****************************************************************************/
 #include "geometry.h"
 
+#include "cpl_conv.h"
 #include "earcut.hpp"
 #include "geos_c.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+
 #include "api_priv.h"
+#include "util/error.h"
 
 namespace ngs {
 
@@ -35,6 +42,202 @@ constexpr const char *MAP_MAX_X_KEY = "max_x";
 constexpr const char *MAP_MAX_Y_KEY = "max_y";
 
 constexpr unsigned short MAX_EDGE_INDEX = 65534;
+// Tile blob header: magic ("NGVT" in little endian) and format version.
+constexpr GUInt32 TILE_FORMAT_MAGIC = 0x5456474E;
+constexpr GByte TILE_FORMAT_VERSION = 2;
+constexpr GByte TILE_FORMAT_ENCODED_VERSION = 3;
+// Tile arrays start at aligned offsets to be used in place from the blob.
+constexpr size_t TILE_ARRAY_ALIGNMENT = 8;
+// Limit of decompressed tile size to not trust corrupted data.
+constexpr GUInt32 MAX_TILE_SIZE = 256 * 1024 * 1024;
+// Approximate size of std::set<GIntBig> node (value + tree pointers + color).
+constexpr size_t SET_NODE_SIZE = sizeof(GIntBig) + 4 * sizeof(void*);
+// Approximate size of hash index node (key, value, next pointer, bucket).
+constexpr size_t INDEX_NODE_SIZE = 2 * sizeof(size_t) + 2 * sizeof(void*);
+
+// Envelope R-tree node capacity and changes count to pack the tree again.
+constexpr size_t RTREE_NODE_ITEMS = 16;
+constexpr unsigned char RTREE_HILBERT_ORDER = 16;
+constexpr size_t RTREE_MIN_REBUILD_CHANGES = 1024;
+
+static GUIntBig mixHash(GUIntBig hash, GUIntBig value)
+{
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    hash ^= value;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 29);
+}
+
+static size_t alignedPosition(size_t position)
+{
+    return (position + TILE_ARRAY_ALIGNMENT - 1) / TILE_ARRAY_ALIGNMENT *
+            TILE_ARRAY_ALIGNMENT;
+}
+
+template<typename T>
+static void putArray(Buffer *buffer, const ArrayView<T> &array)
+{
+    static const GByte padding[TILE_ARRAY_ALIGNMENT] = {};
+    buffer->put(static_cast<GUInt32>(array.size()));
+    buffer->put(padding,
+                alignedPosition(buffer->position()) - buffer->position());
+    buffer->put(array.data(), array.size() * sizeof(T));
+}
+
+template<typename T>
+static bool getArrayView(Buffer &buffer, const GByte *&data, GUInt32 &size)
+{
+    if(buffer.available() < sizeof(GUInt32)) {
+        return false;
+    }
+    size = buffer.getULong();
+    buffer.seek(alignedPosition(buffer.position()));
+    // Check size before use to not trust corrupted data.
+    if(static_cast<size_t>(size) * sizeof(T) > buffer.available()) {
+        return false;
+    }
+    data = buffer.view(static_cast<size_t>(size) * sizeof(T));
+    return size == 0 || data != nullptr;
+}
+
+template<typename T>
+static void copyArray(const GByte *data, GUInt32 size, std::vector<T> &array)
+{
+    array.resize(size);
+    if(size > 0) {
+        std::memcpy(array.data(), data, array.size() * sizeof(T));
+    }
+}
+
+template<typename T>
+static T viewValue(const GByte *data, size_t index)
+{
+    // Blob data may be unaligned.
+    T value;
+    std::memcpy(&value, data + index * sizeof(T), sizeof(T));
+    return value;
+}
+
+static void putVarint(std::vector<GByte> &out, GUIntBig value)
+{
+    while(value >= 0x80) {
+        out.push_back(static_cast<GByte>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<GByte>(value));
+}
+
+static bool getVarint(const GByte *&data, const GByte *end, GUIntBig &value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(data >= end) {
+            return false;
+        }
+        GByte byte = *data++;
+        value |= static_cast<GUIntBig>(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Count of elements, each at least one byte long.
+static bool getCount(const GByte *&data, const GByte *end, GUIntBig &count)
+{
+    return getVarint(data, end, count) &&
+            count <= static_cast<GUIntBig>(end - data);
+}
+
+static GUIntBig zigzag(GIntBig value)
+{
+    return (static_cast<GUIntBig>(value) << 1) ^
+            static_cast<GUIntBig>(value >> 63);
+}
+
+static GIntBig unzigzag(GUIntBig value)
+{
+    return static_cast<GIntBig>(value >> 1) ^ -static_cast<GIntBig>(value & 1);
+}
+
+static void putEncodedPoints(std::vector<GByte> &out,
+                             const ArrayView<SimplePoint> &points,
+                             double originX, double originY, double precision)
+{
+    putVarint(out, points.size());
+    GIntBig prevX = 0, prevY = 0;
+    for(const SimplePoint &pt : points) {
+        GIntBig x = std::llround((pt.x - originX) / precision);
+        GIntBig y = std::llround((pt.y - originY) / precision);
+        putVarint(out, zigzag(x - prevX));
+        putVarint(out, zigzag(y - prevY));
+        prevX = x;
+        prevY = y;
+    }
+}
+
+static bool getEncodedPoints(const GByte *&data, const GByte *end,
+                             std::vector<SimplePoint> &points,
+                             double originX, double originY, double precision)
+{
+    GUIntBig count;
+    if(!getCount(data, end, count)) {
+        return false;
+    }
+    points.resize(static_cast<size_t>(count));
+    GIntBig x = 0, y = 0;
+    for(SimplePoint &pt : points) {
+        GUIntBig dx, dy;
+        if(!getVarint(data, end, dx) || !getVarint(data, end, dy)) {
+            return false;
+        }
+        x += unzigzag(dx);
+        y += unzigzag(dy);
+        pt.x = static_cast<float>(originX + x * precision);
+        pt.y = static_cast<float>(originY + y * precision);
+    }
+    return true;
+}
+
+static void putEncodedIndices(std::vector<GByte> &out,
+                              const ArrayView<unsigned short> &indices)
+{
+    putVarint(out, indices.size());
+    for(unsigned short index : indices) {
+        putVarint(out, index);
+    }
+}
+
+static bool getEncodedIndices(const GByte *&data, const GByte *end,
+                              std::vector<unsigned short> &indices)
+{
+    GUIntBig count;
+    if(!getCount(data, end, count)) {
+        return false;
+    }
+    indices.resize(static_cast<size_t>(count));
+    for(unsigned short &index : indices) {
+        GUIntBig value;
+        if(!getVarint(data, end, value) || value > std::numeric_limits<unsigned short>::max()) {
+            return false;
+        }
+        index = static_cast<unsigned short>(value);
+    }
+    return true;
+}
+
+static GUInt32 floatBits(float value)
+{
+    // Positive and negative zero are equal points.
+    if(value == 0.0f) {
+        return 0;
+    }
+    GUInt32 out;
+    memcpy(&out, &value, sizeof(out));
+    return out;
+}
 
 //------------------------------------------------------------------------------
 // GeometryPtr
@@ -66,6 +269,7 @@ ngs::GeometryPtr::operator OGRGeometry *() const
 //------------------------------------------------------------------------------
 
 VectorTileItem::VectorTileItem() :
+     m_hash(0),
      m_valid(false),
      m_2d(true)
 {
@@ -73,6 +277,13 @@ VectorTileItem::VectorTileItem() :
 
 void VectorTileItem::removeId(GIntBig id)
 {
+    if(m_storage) {
+        if(!std::binary_search(m_idsView.begin(), m_idsView.end(), id)) {
+            return;
+        }
+        copyViews();
+    }
+
     auto it = m_ids.find(id);
     if(it != m_ids.end()) {
         m_ids.erase(it);
@@ -84,6 +295,7 @@ void VectorTileItem::removeId(GIntBig id)
 
 void VectorTileItem::addBorderIndex(unsigned short ring, unsigned short index)
 {
+    detach();
     if(m_borderIndices.size() <= ring) {
        for(unsigned short i = static_cast<unsigned short>(m_borderIndices.size());
            i < ring + 1; ++i) {
@@ -93,57 +305,169 @@ void VectorTileItem::addBorderIndex(unsigned short ring, unsigned short index)
     m_borderIndices[ring].push_back(index);
 }
 
-void VectorTileItem::save(Buffer *buffer)
+size_t VectorTileItem::borderCount() const
 {
-    buffer->put(static_cast<GByte>(m_2d));
+    if(m_storage) {
+        return m_ringOffsetsView.empty() ? 0 : m_ringOffsetsView.size() - 1;
+    }
+    return m_borderIndices.size();
+}
 
-    // vector<SimplePoint> m_points
-    buffer->put(static_cast<GUInt32>(m_points.size()));
-    for(auto point : m_points) {
-        if(m_2d) {
-            buffer->put(point.x);
-            buffer->put(point.y);
-        }
-        else {
-            // TODO: Add point with z support
-        }
+ArrayView<unsigned short> VectorTileItem::borderIndices(size_t ring) const
+{
+    if(m_storage) {
+        GUInt32 begin = m_ringOffsetsView[ring];
+        return ArrayView<unsigned short>(m_borderView.data() + begin,
+                                         m_ringOffsetsView[ring + 1] - begin);
     }
+    return ArrayView<unsigned short>(m_borderIndices[ring]);
+}
 
-    // vector<unsigned short> m_indices
-    buffer->put(static_cast<GUInt32>(m_indices.size()));
-    for(auto index : m_indices) {
-        buffer->put(index);
+std::vector<GIntBig> VectorTileItem::sortedIds() const
+{
+    if(m_storage) {
+        return std::vector<GIntBig>(m_idsView.begin(), m_idsView.end());
     }
+    return std::vector<GIntBig>(m_ids.begin(), m_ids.end());
+}
 
-    //vector<vector<unsigned short>> m_borderIndices
-    buffer->put(static_cast<GUInt32>(m_borderIndices.size()));
-    for(auto borderIndexArray : m_borderIndices) {
-        buffer->put(static_cast<GUInt32>(borderIndexArray.size()));
-        for(auto borderIndex : borderIndexArray) {
-            buffer->put(borderIndex);
-        }
+void VectorTileItem::copyViews()
+{
+    m_points.assign(m_pointsView.begin(), m_pointsView.end());
+    m_indices.assign(m_indicesView.begin(), m_indicesView.end());
+    m_borderIndices.clear();
+    for(size_t ring = 0; ring < borderCount(); ++ring) {
+        ArrayView<unsigned short> ringIndices = borderIndices(ring);
+        m_borderIndices.emplace_back(ringIndices.begin(), ringIndices.end());
+    }
+    m_centroids.assign(m_centroidsView.begin(), m_centroidsView.end());
+    m_ids.clear();
+    for(GIntBig id : m_idsView) {
+        m_ids.insert(m_ids.end(), id);
     }
 
-    // vector<SimplePoint> m_centroids
-    buffer->put(static_cast<GUInt32>(m_centroids.size()));
-    for(auto centroid : m_centroids) {
-        if(m_2d) {
-            buffer->put(centroid.x);
-            buffer->put(centroid.y);
+    m_pointsView = ArrayView<SimplePoint>();
+    m_indicesView = ArrayView<unsigned short>();
+    m_ringOffsetsView = ArrayView<GUInt32>();
+    m_borderView = ArrayView<unsigned short>();
+    m_centroidsView = ArrayView<SimplePoint>();
+    m_idsView = ArrayView<GIntBig>();
+    m_storage.reset();
+}
+
+void VectorTileItem::save(Buffer *buffer) const
+{
+    buffer->put(static_cast<GByte>(m_2d));
+    // TODO: Add point with z support
+
+    putArray(buffer, points());
+    putArray(buffer, indices());
+
+    // Border rings as one indices array and ring start offsets in it with the
+    // end offset. Empty rings are skipped.
+    std::vector<GUInt32> ringOffsets;
+    std::vector<unsigned short> border;
+    for(size_t ring = 0; ring < borderCount(); ++ring) {
+        ArrayView<unsigned short> ringIndices = borderIndices(ring);
+        if(ringIndices.empty()) {
+            continue;
         }
-        else {
-            // TODO: Add point with z support
+        ringOffsets.push_back(static_cast<GUInt32>(border.size()));
+        border.insert(border.end(), ringIndices.begin(), ringIndices.end());
+    }
+    if(!ringOffsets.empty()) {
+        ringOffsets.push_back(static_cast<GUInt32>(border.size()));
+    }
+    putArray(buffer, ArrayView<GUInt32>(ringOffsets));
+    putArray(buffer, ArrayView<unsigned short>(border));
+
+    putArray(buffer, centroids());
+
+    // Ids are sorted
+    putArray(buffer, ArrayView<GIntBig>(sortedIds()));
+}
+
+bool VectorTileItem::load(Buffer &buffer, GByte version,
+                          const std::shared_ptr<const void> &storage)
+{
+    if(version < TILE_FORMAT_VERSION) {
+        return loadVersion1(buffer);
+    }
+
+    m_2d = buffer.getByte() != 0;
+    // TODO: Add point with z support
+
+    const GByte *points = nullptr, *indices = nullptr, *ringOffsets = nullptr,
+            *border = nullptr, *centroids = nullptr, *ids = nullptr;
+    GUInt32 pointCount = 0, indexCount = 0, ringOffsetCount = 0,
+            borderCount = 0, centroidCount = 0, idCount = 0;
+    if(!getArrayView<SimplePoint>(buffer, points, pointCount) ||
+            !getArrayView<unsigned short>(buffer, indices, indexCount) ||
+            !getArrayView<GUInt32>(buffer, ringOffsets, ringOffsetCount) ||
+            !getArrayView<unsigned short>(buffer, border, borderCount) ||
+            !getArrayView<SimplePoint>(buffer, centroids, centroidCount) ||
+            !getArrayView<GIntBig>(buffer, ids, idCount)) {
+        return false;
+    }
+
+    // Ring offsets start from 0, grow and end with border indices count.
+    if(ringOffsetCount == 1) {
+        return false;
+    }
+    GUInt32 prevOffset = 0;
+    for(GUInt32 i = 0; i < ringOffsetCount; ++i) {
+        GUInt32 offset = viewValue<GUInt32>(ringOffsets, i);
+        if(offset < prevOffset || (i == 0 && offset != 0)) {
+            return false;
         }
+        prevOffset = offset;
+    }
+    if(prevOffset != borderCount) {
+        return false;
     }
 
-    // set<GIntBig> m_ids
-    buffer->put(static_cast<GUInt32>(m_ids.size()));
-    for(auto id : m_ids) {
-        buffer->put(id);
+    if(storage) {
+        // Arrays are used in place, storage keeps blob data alive.
+        m_storage = storage;
+        m_pointsView = ArrayView<SimplePoint>(
+                    reinterpret_cast<const SimplePoint*>(points), pointCount);
+        m_indicesView = ArrayView<unsigned short>(
+                    reinterpret_cast<const unsigned short*>(indices), indexCount);
+        m_ringOffsetsView = ArrayView<GUInt32>(
+                    reinterpret_cast<const GUInt32*>(ringOffsets),
+                    ringOffsetCount);
+        m_borderView = ArrayView<unsigned short>(
+                    reinterpret_cast<const unsigned short*>(border), borderCount);
+        m_centroidsView = ArrayView<SimplePoint>(
+                    reinterpret_cast<const SimplePoint*>(centroids),
+                    centroidCount);
+        m_idsView = ArrayView<GIntBig>(reinterpret_cast<const GIntBig*>(ids),
+                                       idCount);
+        m_valid = true;
+        return true;
     }
+
+    copyArray(points, pointCount, m_points);
+    copyArray(indices, indexCount, m_indices);
+    m_borderIndices.reserve(ringOffsetCount);
+    for(GUInt32 i = 1; i < ringOffsetCount; ++i) {
+        GUInt32 begin = viewValue<GUInt32>(ringOffsets, i - 1);
+        GUInt32 end = viewValue<GUInt32>(ringOffsets, i);
+        std::vector<unsigned short> array;
+        copyArray(border + begin * sizeof(unsigned short), end - begin, array);
+        m_borderIndices.push_back(std::move(array));
+    }
+    copyArray(centroids, centroidCount, m_centroids);
+    // Ids are sorted, so each insert at end is amortized constant.
+    for(GUInt32 i = 0; i < idCount; ++i) {
+        m_ids.insert(m_ids.end(), viewValue<GIntBig>(ids, i));
+    }
+
+    m_valid = true;
+    return true;
 }
 
-bool VectorTileItem::load(Buffer &buffer)
+bool VectorTileItem::loadVersion1(Buffer &buffer)
 {
     m_2d = buffer.getByte();
     // vector<SimplePoint> m_points
@@ -203,16 +527,98 @@ bool VectorTileItem::load(Buffer &buffer)
     return true;
 }
 
+void VectorTileItem::saveEncoded(std::vector<GByte> &out, double originX,
+                                 double originY, double precision) const
+{
+    out.push_back(static_cast<GByte>(m_2d));
+    // TODO: Add point with z support
+
+    putEncodedPoints(out, points(), originX, originY, precision);
+    putEncodedIndices(out, indices());
+
+    putVarint(out, borderCount());
+    for(size_t ring = 0; ring < borderCount(); ++ring) {
+        putEncodedIndices(out, borderIndices(ring));
+    }
+
+    putEncodedPoints(out, centroids(), originX, originY, precision);
+
+    // Ids are sorted, so deltas are small positive numbers.
+    std::vector<GIntBig> ids = sortedIds();
+    putVarint(out, ids.size());
+    GIntBig prevId = 0;
+    for(GIntBig id : ids) {
+        putVarint(out, zigzag(id - prevId));
+        prevId = id;
+    }
+}
+
+bool VectorTileItem::loadEncoded(const GByte *&data, const GByte *end,
+                                 double originX, double originY,
+                                 double precision)
+{
+    if(data >= end) {
+        return false;
+    }
+    m_2d = *data++ != 0;
+
+    if(!getEncodedPoints(data, end, m_points, originX, originY, precision) ||
+            !getEncodedIndices(data, end, m_indices)) {
+        return false;
+    }
+
+    GUIntBig count;
+    if(!getCount(data, end, count)) {
+        return false;
+    }
+    m_borderIndices.reserve(static_cast<size_t>(count));
+    for(GUIntBig i = 0; i < count; ++i) {
+        std::vector<unsigned short> array;
+        if(!getEncodedIndices(data, end, array)) {
+            return false;
+        }
+        if(!array.empty()) {
+            m_borderIndices.push_back(std::move(array));
+        }
+    }
+
+    if(!getEncodedPoints(data, end, m_centroids, originX, originY,
+                         precision)) {
+        return false;
+    }
+
+    if(!getCount(data, end, count)) {
+        return false;
+    }
+    GIntBig id = 0;
+    for(GUIntBig i = 0; i < count; ++i) {
+        GUIntBig delta;
+        if(!getVarint(data, end, delta)) {
+            return false;
+        }
+        id += unzigzag(delta);
+        m_ids.insert(m_ids.end(), id);
+    }
+
+    m_valid = true;
+    return true;
+}
+
 bool VectorTileItem::isClosed() const
 {
-    return isEqual(m_points.front().x, m_points.back().x) &&
-            isEqual(m_points.front().y, m_points.back().y);
+    ArrayView<SimplePoint> pts = points();
+    return isEqual(pts.front().x, pts.back().x) &&
+            isEqual(pts.front().y, pts.back().y);
 }
 
 void VectorTileItem::loadIds(const VectorTileItem &item)
 {
-    for(GIntBig id : item.m_ids) {
-        m_ids.insert(id);
+    detach();
+    if(item.m_storage) {
+        m_ids.insert(item.m_idsView.begin(), item.m_idsView.end());
+    }
+    else {
+        m_ids.insert(item.m_ids.begin(), item.m_ids.end());
     }
 }
 
@@ -221,6 +627,18 @@ bool VectorTileItem::isIdsPresent(const std::set<GIntBig> &other, bool full) con
     if(other.empty()) {
         return false;
     }
+    if(m_storage) {
+        if(full) {
+            return std::includes(other.begin(), other.end(),
+                                 m_idsView.begin(), m_idsView.end());
+        }
+        for(auto id : other) {
+            if(std::binary_search(m_idsView.begin(), m_idsView.end(), id)) {
+                return true;
+            }
+        }
+        return false;
+    }
     if(full) {
         return  std::includes(other.begin(), other.end(),
                              m_ids.begin(), m_ids.end());
@@ -242,12 +660,57 @@ std::set<GIntBig> VectorTileItem::idsIntesect(const std::set<GIntBig> &other) co
     std::set<GIntBig> common_data;
     if(other.empty())
         return common_data;
+    if(m_storage) {
+        std::set_intersection(other.begin(), other.end(),
+                              m_idsView.begin(), m_idsView.end(),
+                              std::inserter(common_data, common_data.begin()));
+        return common_data;
+    }
     std::set_intersection(other.begin(), other.end(),
                           m_ids.begin(), m_ids.end(),
                           std::inserter(common_data, common_data.begin()));
     return common_data;
 }
 
+size_t VectorTileItem::hash() const
+{
+    if(m_hash == 0) {
+        ArrayView<SimplePoint> pts = points();
+        GUIntBig hash = pts.size();
+        for(const SimplePoint &pt : pts) {
+            hash = mixHash(hash,
+                           static_cast<GUIntBig>(floatBits(pt.x)) << 32 |
+                           floatBits(pt.y));
+        }
+        m_hash = static_cast<size_t>(hash) | 1; // Never 0
+    }
+    return m_hash;
+}
+
+size_t VectorTileItem::memorySize() const
+{
+    size_t size = sizeof(VectorTileItem);
+    if(m_storage) {
+        // Item part of the shared blob.
+        size += m_pointsView.size() * sizeof(SimplePoint);
+        size += m_indicesView.size() * sizeof(unsigned short);
+        size += m_ringOffsetsView.size() * sizeof(GUInt32);
+        size += m_borderView.size() * sizeof(unsigned short);
+        size += m_centroidsView.size() * sizeof(SimplePoint);
+        size += m_idsView.size() * sizeof(GIntBig);
+        return size;
+    }
+    size += m_points.capacity() * sizeof(SimplePoint);
+    size += m_indices.capacity() * sizeof(unsigned short);
+    for(const auto &borderIndexArray : m_borderIndices) {
+        size += sizeof(std::vector<unsigned short>) +
+                borderIndexArray.capacity() * sizeof(unsigned short);
+    }
+    size += m_centroids.capacity() * sizeof(SimplePoint);
+    size += m_ids.size() * SET_NODE_SIZE;
+    return size;
+}
+
 
 //------------------------------------------------------------------------------
 // VectorTile
@@ -259,15 +722,25 @@ void VectorTile::add(const VectorTileItem &item, bool checkDuplicates)
         return;
     }
     if(checkDuplicates) {
-        auto it = std::find(m_items.begin(), m_items.end(), item);
-        if(it == m_items.end()) {
-            m_items.push_back(item);
-        }
-        else {
-            (*it).loadIds(item);
+        if(!m_indexed) {
+            buildIndex();
+        }
+        size_t hash = item.hash();
+        auto range = m_index.equal_range(hash);
+        for(auto it = range.first; it != range.second; ++it) {
+            VectorTileItem &tileItem = m_items[it->second];
+            if(tileItem == item) {
+                tileItem.loadIds(item);
+                return;
+            }
         }
+        m_index.emplace(hash, m_items.size());
+        m_items.push_back(item);
     }
     else {
+        if(m_indexed) {
+            m_index.emplace(item.hash(), m_items.size());
+        }
         m_items.push_back(item);
     }
 
@@ -285,6 +758,10 @@ void VectorTile::add(const VectorTileItemArray &items, bool checkDuplicates)
 
 void VectorTile::remove(GIntBig id)
 {
+    // Item positions are changed, so rebuild index on next add.
+    m_index.clear();
+    m_indexed = false;
+
     auto it = m_items.begin();
     while(it != m_items.end()) {
         (*it).removeId(id);
@@ -297,32 +774,196 @@ void VectorTile::remove(GIntBig id)
     }
 }
 
-BufferPtr VectorTile::save()
+BufferPtr VectorTile::save(TileCodec codec, double precision) const
 {
+    if(codec != TileCodec::RAW && precision > 0.0) {
+        return saveEncoded(codec, precision);
+    }
+
     BufferPtr buff(new Buffer);
+    buff->put(TILE_FORMAT_MAGIC);
+    buff->put(TILE_FORMAT_VERSION);
     buff->put(static_cast<GUInt32>(m_items.size()));
-    for(auto item : m_items) {
+    for(const auto &item : m_items) {
         item.save(buff.get());
     }
     return buff;
 }
 
-bool VectorTile::load(Buffer &buffer)
+BufferPtr VectorTile::saveEncoded(TileCodec codec, double precision) const
+{
+    // Tile local origin keeps quantized coordinates small.
+    double originX = std::numeric_limits<double>::max();
+    double originY = std::numeric_limits<double>::max();
+    for(const auto &item : m_items) {
+        for(const SimplePoint &pt : item.points()) {
+            originX = std::min(originX, static_cast<double>(pt.x));
+            originY = std::min(originY, static_cast<double>(pt.y));
+        }
+        for(const SimplePoint &pt : item.centroids()) {
+            originX = std::min(originX, static_cast<double>(pt.x));
+            originY = std::min(originY, static_cast<double>(pt.y));
+        }
+    }
+    if(originX == std::numeric_limits<double>::max()) {
+        originX = originY = 0.0;
+    }
+
+    std::vector<GByte> payload;
+    payload.resize(3 * sizeof(double));
+    std::memcpy(payload.data(), &originX, sizeof(double));
+    std::memcpy(payload.data() + sizeof(double), &originY, sizeof(double));
+    std::memcpy(payload.data() + 2 * sizeof(double), &precision,
+                sizeof(double));
+    putVarint(payload, m_items.size());
+    for(const auto &item : m_items) {
+        item.saveEncoded(payload, originX, originY, precision);
+    }
+
+    void *compressed = nullptr;
+    size_t compressedSize = 0;
+    if(codec == TileCodec::DEFLATE) {
+        compressed = CPLZLibDeflate(payload.data(), payload.size(), -1,
+                                    nullptr, 0, &compressedSize);
+        if(nullptr == compressed) {
+            codec = TileCodec::DELTA;
+        }
+    }
+
+    BufferPtr buff(new Buffer);
+    buff->put(TILE_FORMAT_MAGIC);
+    buff->put(TILE_FORMAT_ENCODED_VERSION);
+    buff->put(static_cast<GByte>(codec));
+    if(nullptr != compressed) {
+        buff->put(static_cast<GUInt32>(payload.size()));
+        buff->put(compressed, compressedSize);
+        CPLFree(compressed);
+    }
+    else {
+        buff->put(payload.data(), payload.size());
+    }
+    return buff;
+}
+
+/**
+ * @brief VectorTile::load Loads tile from the buffer.
+ * @param buffer Tile blob.
+ * @param storage Owner of the buffer data. If set, items of the current RAW
+ * format keep views into the buffer data instead of copies and keep storage
+ * alive.
+ * @return True on success.
+ */
+bool VectorTile::load(Buffer &buffer,
+                      const std::shared_ptr<const void> &storage)
 {
+    // First version has no header and starts from items count.
+    GByte version = 1;
     GUInt32 size = buffer.getULong();
+    if(size == TILE_FORMAT_MAGIC) {
+        version = buffer.getByte();
+        if(version == TILE_FORMAT_ENCODED_VERSION) {
+            return loadEncoded(buffer);
+        }
+        if(version > TILE_FORMAT_VERSION) {
+            return errorMessage(_("Unsupported tile format version %d"),
+                                version);
+        }
+        size = buffer.getULong();
+    }
+
+    // Arrays are aligned from the blob start, so data can be used in place
+    // only if the blob itself is aligned.
+    std::shared_ptr<const void> itemStorage;
+    if(reinterpret_cast<std::uintptr_t>(buffer.data()) %
+            TILE_ARRAY_ALIGNMENT == 0) {
+        itemStorage = storage;
+    }
+
+    m_items.reserve(m_items.size() + size);
     for(GUInt32 i = 0; i < size; ++i) {
         VectorTileItem item;
-        item.load(buffer);
-        m_items.push_back(item);
+        if(!item.load(buffer, version, itemStorage)) {
+            return errorMessage(_("Tile data is corrupted"));
+        }
+        if(m_indexed) {
+            m_index.emplace(item.hash(), m_items.size());
+        }
+        m_items.push_back(std::move(item));
     }
     m_valid = true;
     return true;
 }
 
+bool VectorTile::loadEncoded(Buffer &buffer)
+{
+    TileCodec codec = static_cast<TileCodec>(buffer.getByte());
+    const GByte *data = buffer.data() + buffer.position();
+    const GByte *end = buffer.data() + buffer.size();
+
+    std::vector<GByte> inflated;
+    if(codec == TileCodec::DEFLATE) {
+        GUInt32 size = buffer.getULong();
+        if(size > MAX_TILE_SIZE) {
+            return errorMessage(_("Tile data is corrupted"));
+        }
+        data = buffer.data() + buffer.position();
+        inflated.resize(size);
+        size_t outSize = 0;
+        if(nullptr == CPLZLibInflate(data, static_cast<size_t>(end - data),
+                                     inflated.data(), inflated.size(),
+                                     &outSize)) {
+            return errorMessage(_("Tile data is corrupted"));
+        }
+        data = inflated.data();
+        end = data + outSize;
+    }
+    else if(codec != TileCodec::DELTA) {
+        return errorMessage(_("Unsupported tile codec %d"),
+                            static_cast<int>(codec));
+    }
+
+    if(end - data < static_cast<std::ptrdiff_t>(3 * sizeof(double))) {
+        return errorMessage(_("Tile data is corrupted"));
+    }
+    double originX, originY, precision;
+    std::memcpy(&originX, data, sizeof(double));
+    std::memcpy(&originY, data + sizeof(double), sizeof(double));
+    std::memcpy(&precision, data + 2 * sizeof(double), sizeof(double));
+    data += 3 * sizeof(double);
+
+    GUIntBig size;
+    if(!getCount(data, end, size)) {
+        return errorMessage(_("Tile data is corrupted"));
+    }
+    m_items.reserve(m_items.size() + static_cast<size_t>(size));
+    for(GUIntBig i = 0; i < size; ++i) {
+        VectorTileItem item;
+        if(!item.loadEncoded(data, end, originX, originY, precision)) {
+            return errorMessage(_("Tile data is corrupted"));
+        }
+        if(m_indexed) {
+            m_index.emplace(item.hash(), m_items.size());
+        }
+        m_items.push_back(std::move(item));
+    }
+    m_valid = true;
+    return true;
+}
+
+void VectorTile::buildIndex()
+{
+    m_index.clear();
+    m_index.reserve(m_items.size());
+    for(size_t i = 0; i < m_items.size(); ++i) {
+        m_index.emplace(m_items[i].hash(), i);
+    }
+    m_indexed = true;
+}
+
 bool VectorTile::empty() const
 {
     if(!m_items.empty()) {
-        for(auto item : m_items) {
+        for(const auto &item : m_items) {
             if(item.pointCount() > 0) {
                 return false;
             }
@@ -331,6 +972,15 @@ bool VectorTile::empty() const
     return true;
 }
 
+size_t VectorTile::memorySize() const
+{
+    size_t size = sizeof(VectorTile) + m_index.size() * INDEX_NODE_SIZE;
+    for(const auto &item : m_items) {
+        size += item.memorySize();
+    }
+    return size;
+}
+
 //------------------------------------------------------------------------------
 // Envelope
 //------------------------------------------------------------------------------
@@ -588,6 +1238,182 @@ void Envelope::fix()
     }
 }
 
+GUIntBig hilbertIndex(GUInt32 x, GUInt32 y, unsigned char order)
+{
+    const GUInt32 n = 1U << order;
+    GUIntBig d = 0;
+    for(GUInt32 s = n / 2; s > 0; s /= 2) {
+        GUInt32 rx = (x & s) > 0 ? 1 : 0;
+        GUInt32 ry = (y & s) > 0 ? 1 : 0;
+        d += static_cast<GUIntBig>(s) * s * ((3 * rx) ^ ry);
+        // Rotate quadrant
+        if(ry == 0) {
+            if(rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+//------------------------------------------------------------------------------
+// EnvelopeIndex
+//------------------------------------------------------------------------------
+
+EnvelopeIndex::EnvelopeIndex() :
+    m_built(false)
+{
+}
+
+void EnvelopeIndex::build(std::vector<Item> &&items)
+{
+    clear();
+    m_built = true;
+    if(items.empty()) {
+        return;
+    }
+
+    Envelope ext;
+    for(const Item &item : items) {
+        ext.merge(item.env);
+    }
+
+    double maxCell = (1 << RTREE_HILBERT_ORDER) - 1;
+    double scaleX = ext.width() > 0.0 ? maxCell / ext.width() : 0.0;
+    double scaleY = ext.height() > 0.0 ? maxCell / ext.height() : 0.0;
+    std::vector<std::pair<GUIntBig, size_t>> order;
+    order.reserve(items.size());
+    for(size_t i = 0; i < items.size(); ++i) {
+        const Envelope &env = items[i].env;
+        double x = ((env.minX() + env.maxX()) * 0.5 - ext.minX()) * scaleX;
+        double y = ((env.minY() + env.maxY()) * 0.5 - ext.minY()) * scaleY;
+        x = std::min(std::max(x, 0.0), maxCell);
+        y = std::min(std::max(y, 0.0), maxCell);
+        order.emplace_back(hilbertIndex(static_cast<GUInt32>(x),
+                                        static_cast<GUInt32>(y),
+                                        RTREE_HILBERT_ORDER), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    // Leaves plus upper levels nodes.
+    size_t total = items.size() + items.size() / (RTREE_NODE_ITEMS - 1) + 1;
+    m_boxes.reserve(total);
+    m_indices.reserve(total);
+    for(const auto &item : order) {
+        m_boxes.push_back(items[item.second].env);
+        m_indices.push_back(items[item.second].id);
+    }
+    m_levelEnds.push_back(m_boxes.size());
+
+    size_t levelBegin = 0;
+    while(m_levelEnds.back() - levelBegin > 1) {
+        size_t levelEnd = m_levelEnds.back();
+        for(size_t i = levelBegin; i < levelEnd; i += RTREE_NODE_ITEMS) {
+            size_t end = std::min(i + RTREE_NODE_ITEMS, levelEnd);
+            Envelope box = m_boxes[i];
+            for(size_t j = i + 1; j < end; ++j) {
+                box.merge(m_boxes[j]);
+            }
+            m_boxes.push_back(box);
+            m_indices.push_back(static_cast<GIntBig>(i));
+        }
+        levelBegin = levelEnd;
+        m_levelEnds.push_back(m_boxes.size());
+    }
+}
+
+void EnvelopeIndex::insert(GIntBig id, const Envelope &env)
+{
+    if(!m_built) {
+        return;
+    }
+    m_inserted.push_back({id, env});
+    rebuild();
+}
+
+void EnvelopeIndex::remove(GIntBig id)
+{
+    if(!m_built) {
+        return;
+    }
+    auto it = std::find_if(m_inserted.begin(), m_inserted.end(),
+                           [id](const Item &item) { return item.id == id; });
+    if(it != m_inserted.end()) {
+        m_inserted.erase(it);
+    }
+    m_removed.insert(id);
+    rebuild();
+}
+
+void EnvelopeIndex::clear()
+{
+    m_boxes.clear();
+    m_indices.clear();
+    m_levelEnds.clear();
+    m_inserted.clear();
+    m_removed.clear();
+    m_built = false;
+}
+
+std::vector<GIntBig> EnvelopeIndex::search(const Envelope &env) const
+{
+    std::vector<GIntBig> out;
+    if(!m_boxes.empty()) {
+        // Pairs of the first node position and the level.
+        std::vector<std::pair<size_t, size_t>> stack;
+        stack.emplace_back(m_boxes.size() - 1, m_levelEnds.size() - 1);
+        while(!stack.empty()) {
+            size_t begin = stack.back().first;
+            size_t level = stack.back().second;
+            stack.pop_back();
+
+            size_t end = std::min(begin + RTREE_NODE_ITEMS, m_levelEnds[level]);
+            for(size_t i = begin; i < end; ++i) {
+                if(!env.intersects(m_boxes[i])) {
+                    continue;
+                }
+                if(level == 0) {
+                    if(m_removed.find(m_indices[i]) == m_removed.end()) {
+                        out.push_back(m_indices[i]);
+                    }
+                }
+                else {
+                    stack.emplace_back(static_cast<size_t>(m_indices[i]),
+                                       level - 1);
+                }
+            }
+        }
+    }
+
+    for(const Item &item : m_inserted) {
+        if(env.intersects(item.env)) {
+            out.push_back(item.id);
+        }
+    }
+    return out;
+}
+
+void EnvelopeIndex::rebuild()
+{
+    size_t count = m_levelEnds.empty() ? 0 : m_levelEnds.front();
+    size_t changes = m_inserted.size() + m_removed.size();
+    if(changes < std::max(RTREE_MIN_REBUILD_CHANGES, count / 8)) {
+        return;
+    }
+
+    std::vector<Item> items;
+    items.reserve(count + m_inserted.size());
+    for(size_t i = 0; i < count; ++i) {
+        if(m_removed.find(m_indices[i]) == m_removed.end()) {
+            items.push_back({m_indices[i], m_boxes[i]});
+        }
+    }
+    items.insert(items.end(), m_inserted.begin(), m_inserted.end());
+    build(std::move(items));
+}
+
 Normal ngsGetNormals(const SimplePoint &beg, const SimplePoint &end)
 {
     float deltaX = static_cast<float>(end.x - beg.x);
@@ -608,6 +1434,21 @@ Normal ngsGetNormals(const SimplePoint &beg, const SimplePoint &end)
     return {normX, normY};
 }
 
+//------------------------------------------------------------------------------
+// GEOSContextHandlePtr
+//------------------------------------------------------------------------------
+
+std::shared_ptr<GEOSContextHandle_HS> GEOSContextHandlePtr::threadContext()
+{
+    // GEOS context must not be used by several threads at once, but one
+    // context per thread is enough. Wrappers keep a reference, so the context
+    // is freed after the thread ends and the last geometry is destroyed.
+    static thread_local std::shared_ptr<GEOSContextHandle_HS> context(
+                OGRGeometry::createGEOSContext(),
+                OGRGeometry::freeGEOSContext);
+    return context;
+}
+
 //------------------------------------------------------------------------------
 // GEOSGeometryWrap
 //------------------------------------------------------------------------------
@@ -650,6 +1491,90 @@ static OGRRawPoint generalize(double x, double y, double step)
     return out;
 }
 
+/**
+ * @brief The GridCell struct Cell of generalization grid
+ */
+typedef struct _gridCell {
+    GIntBig x, y;
+    bool operator==(const struct _gridCell &other) const {
+        return x == other.x && y == other.y;
+    }
+} GridCell;
+
+struct GridCellHash {
+    size_t operator()(const GridCell &cell) const {
+        return static_cast<size_t>(mixHash(static_cast<GUIntBig>(cell.x),
+                                           static_cast<GUIntBig>(cell.y)));
+    }
+};
+
+// Plain loop over contiguous array to be vectorized by compiler.
+static void snapToGrid(const double *values, size_t count, double step,
+                       GIntBig *cells)
+{
+    for(size_t i = 0; i < count; ++i) {
+        cells[i] = static_cast<GIntBig>(values[i] / step);
+    }
+}
+
+static bool coordSeqToBuffer(GEOSContextHandle_t handle,
+                             const GEOSCoordSequence *cs, unsigned int count,
+                             std::vector<double> &xy)
+{
+    xy.resize(static_cast<size_t>(count) * 2);
+    if(0 == count) {
+        return true;
+    }
+#if GEOS_VERSION_MAJOR > 3 || (GEOS_VERSION_MAJOR == 3 && GEOS_VERSION_MINOR >= 10)
+    return GEOSCoordSeq_copyToBuffer_r(handle, cs, xy.data(), 0, 0) != 0;
+#else
+    for(unsigned int i = 0; i < count; ++i) {
+        if(GEOSCoordSeq_getX_r(handle, cs, i, &xy[2 * i]) == 0 ||
+                GEOSCoordSeq_getY_r(handle, cs, i, &xy[2 * i + 1]) == 0) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+static GEOSCoordSequence *coordSeqFromBuffer(GEOSContextHandle_t handle,
+                                             const std::vector<double> &xy)
+{
+    unsigned int count = static_cast<unsigned int>(xy.size() / 2);
+#if GEOS_VERSION_MAJOR > 3 || (GEOS_VERSION_MAJOR == 3 && GEOS_VERSION_MINOR >= 10)
+    return GEOSCoordSeq_copyFromBuffer_r(handle, xy.data(), count, 0, 0);
+#else
+    GEOSCoordSequence *cs = GEOSCoordSeq_create_r(handle, count, 2);
+    if(nullptr == cs) {
+        return nullptr;
+    }
+    for(unsigned int i = 0; i < count; ++i) {
+        GEOSCoordSeq_setX_r(handle, cs, i, xy[2 * i]);
+        GEOSCoordSeq_setY_r(handle, cs, i, xy[2 * i + 1]);
+    }
+    return cs;
+#endif
+}
+
+// Points of multipoint to one x/y array. Empty points are skipped.
+static void multiPointToBuffer(GEOSContextHandle_t handle, const GEOSGeom_t *geom,
+                               int count, std::vector<double> &xy)
+{
+    xy.clear();
+    xy.reserve(static_cast<size_t>(count) * 2);
+    for(int i = 0; i < count; ++i) {
+        const GEOSGeom_t *g = GEOSGetGeometryN_r(handle, geom, i);
+        double x(0.0), y(0.0);
+        if(GEOSGeomGetX_r(handle, g, &x) == 0 ||
+                GEOSGeomGetY_r(handle, g, &y) == 0) {
+            continue;
+        }
+        xy.push_back(x);
+        xy.push_back(y);
+    }
+}
+
 GEOSGeom GEOSGeometryWrap::generalizePoint(const GEOSGeom_t *geom, double step)
 {
     double x, y;
@@ -675,30 +1600,25 @@ GEOSGeom GEOSGeometryWrap::generalizeMultiPoint(const GEOSGeom_t *geom,
         CPLError(CE_Failure, CPLE_ObjectNull, "Geometry has no parts");
         return nullptr;
     }
-    std::vector<GEOSGeom> parts;
-    OGRRawPoint prevGpoint(BIG_VALUE, BIG_VALUE);
-    double x, y;
-
-    for(int i = 0; i < count; ++i) {
-        const GEOSGeom_t *g = GEOSGetGeometryN_r(m_geosHandle.get(), geom, i);
-        const GEOSCoordSequence* cs = GEOSGeom_getCoordSeq_r(m_geosHandle.get(),
-                                                             g);
+    std::vector<double> xy;
+    multiPointToBuffer(m_geosHandle.get(), geom, count, xy);
+    std::vector<GIntBig> cells(xy.size());
+    snapToGrid(xy.data(), xy.size(), step, cells.data());
 
-        GEOSCoordSeq_getX_r(m_geosHandle.get(), cs, 0, &x);
-        GEOSCoordSeq_getY_r(m_geosHandle.get(), cs, 0, &y);
-        OGRRawPoint gpoint = generalize(x, y, step);
-
-        if(isEqual(prevGpoint.x, gpoint.x) && isEqual(prevGpoint.y, gpoint.y)) {
+    // Points snapped to the same cell as previous one are skipped.
+    std::vector<GEOSGeom> parts;
+    size_t pointCount = xy.size() / 2;
+    parts.reserve(pointCount);
+    for(size_t i = 0; i < pointCount; ++i) {
+        if(i > 0 && cells[2 * i] == cells[2 * i - 2] &&
+                cells[2 * i + 1] == cells[2 * i - 1]) {
             continue;
         }
 
-        GEOSCoordSequence *ncs = GEOSCoordSeq_clone_r(m_geosHandle.get(), cs);
-
-        GEOSCoordSeq_setX_r(m_geosHandle.get(), ncs, 0, gpoint.x);
-        GEOSCoordSeq_setY_r(m_geosHandle.get(), ncs, 0, gpoint.y);
-
+        GEOSCoordSequence *ncs = GEOSCoordSeq_create_r(m_geosHandle.get(), 1, 2);
+        GEOSCoordSeq_setX_r(m_geosHandle.get(), ncs, 0, cells[2 * i] * step);
+        GEOSCoordSeq_setY_r(m_geosHandle.get(), ncs, 0, cells[2 * i + 1] * step);
         parts.push_back(GEOSGeom_createPoint_r(m_geosHandle.get(), ncs));
-        prevGpoint = gpoint;
     }
 
     if(parts.empty()) {
@@ -718,55 +1638,56 @@ GEOSGeom GEOSGeometryWrap::generalizeLine(const GEOSGeom_t *geom, double step,
     unsigned int count = 0;
     GEOSCoordSeq_getSize_r(m_geosHandle.get(), cs, &count);
 
-    OGRRawPoint prevGpoint(BIG_VALUE, BIG_VALUE);
-    double x, y;
-    std::vector<OGRRawPoint> parts;
-    struct OGRRawPointIs {
-        OGRRawPointIs( OGRRawPoint s ) : toFind(s) { }
-        bool operator() (const OGRRawPoint &n) {
-            return isEqual(n.x, toFind.x) && isEqual(n.y, toFind.y);
-        }
-        OGRRawPoint toFind;
-    };
-
-    for(unsigned int i = 0; i < count; ++i) {
-        GEOSCoordSeq_getX_r(m_geosHandle.get(), cs, i, &x);
-        GEOSCoordSeq_getY_r(m_geosHandle.get(), cs, i, &y);
-        OGRRawPoint gpoint = generalize(x, y, step);
+    std::vector<double> xy;
+    if(!coordSeqToBuffer(m_geosHandle.get(), cs, count, xy)) {
+        return nullptr;
+    }
+    std::vector<GIntBig> cells(xy.size());
+    snapToGrid(xy.data(), xy.size(), step, cells.data());
 
-        if(isRing && std::find_if(parts.begin(), parts.end(),
-                                  OGRRawPointIs(gpoint)) != parts.end()) {
+    // Generalized points are written back to the same array.
+    std::unordered_set<GridCell, GridCellHash> ringCells;
+    if(isRing) {
+        ringCells.reserve(count);
+    }
+    size_t outCount = 0;
+    for(size_t i = 0; i < count; ++i) {
+        GridCell cell = {cells[2 * i], cells[2 * i + 1]};
+        if(outCount > 0 && cell == GridCell{cells[2 * (outCount - 1)],
+                                            cells[2 * (outCount - 1) + 1]}) {
             continue;
         }
-
-        if(isEqual(prevGpoint.x, gpoint.x) && isEqual(prevGpoint.y, gpoint.y)) {
+        if(isRing && !ringCells.insert(cell).second) {
             continue;
         }
-
-        parts.push_back(gpoint);
-        prevGpoint = gpoint;
+        cells[2 * outCount] = cell.x;
+        cells[2 * outCount + 1] = cell.y;
+        outCount++;
     }
 
-    if(parts.size() < 2) {
+    if(outCount < 2) {
         return nullptr;
     }
 
+    cells.resize(2 * outCount);
     if(isRing) {
-        if(parts.size() < 3) {
+        if(outCount < 3) {
             return nullptr;
         }
-        parts.push_back(parts.front());
+        GIntBig firstX = cells[0];
+        GIntBig firstY = cells[1];
+        cells.push_back(firstX);
+        cells.push_back(firstY);
     }
 
-    GEOSCoordSeq ncs = GEOSCoordSeq_create_r(m_geosHandle.get(),
-                                             static_cast<unsigned int>(parts.size()),
-                                             2);
-    unsigned int counter = 0;
-    CPLDebug("ngstore", "parts - %ld", parts.size());
-    for(const OGRRawPoint &pt : parts) {
-        GEOSCoordSeq_setX_r(m_geosHandle.get(), ncs, counter, pt.x);
-        GEOSCoordSeq_setY_r(m_geosHandle.get(), ncs, counter, pt.y);
-        counter++;
+    xy.resize(cells.size());
+    for(size_t i = 0; i < xy.size(); ++i) {
+        xy[i] = cells[i] * step;
+    }
+
+    GEOSCoordSeq ncs = coordSeqFromBuffer(m_geosHandle.get(), xy);
+    if(nullptr == ncs) {
+        return nullptr;
     }
 
     if(isRing) {
@@ -814,21 +1735,22 @@ GEOSGeom GEOSGeometryWrap::generalizePolygon(const GEOSGeom_t *geom, double step
 
     const GEOSCoordSequence* cs = GEOSGeom_getCoordSeq_r(m_geosHandle.get(),
                                                          exteriorRing);
-    if(nullptr == cs) {
+    unsigned int count = 0;
+    std::vector<double> xy;
+    if(nullptr == cs ||
+            GEOSCoordSeq_getSize_r(m_geosHandle.get(), cs, &count) == 0 ||
+            count < 3 ||
+            !coordSeqToBuffer(m_geosHandle.get(), cs, count, xy)) {
         GEOSGeom_destroy_r(m_geosHandle.get(), env);
         return nullptr;
     }
 
-    double x(0.0), y(0.0);
-    GEOSCoordSeq_getX_r(m_geosHandle.get(), cs, 0, &x);
-    GEOSCoordSeq_getY_r(m_geosHandle.get(), cs, 0, &y);
+    // Envelope ring corners 0 and 2 are opposite.
     Envelope extent;
-    extent.setMinX(x);
-    extent.setMinY(y);
-    GEOSCoordSeq_getX_r(m_geosHandle.get(), cs, 2, &x);
-    GEOSCoordSeq_getY_r(m_geosHandle.get(), cs, 2, &y);
-    extent.setMaxX(x);
-    extent.setMaxY(y);
+    extent.setMinX(xy[0]);
+    extent.setMinY(xy[1]);
+    extent.setMaxX(xy[4]);
+    extent.setMaxY(xy[5]);
     extent.fix();
     if(extent.width() < step || extent.height() < step) {
         CPLDebug("ngstore", "Too small generalize polygon for step %f", step);
@@ -975,12 +1897,10 @@ void GEOSGeometryWrap::fillMultiPointTile(GIntBig fid, const GEOSGeom_t *geom,
     VectorTileItem vitem;
     vitem.addId(fid);
 
-    for(int i = 0; i < count; ++i) {
-        const GEOSGeom_t *g = GEOSGetGeometryN_r(m_geosHandle.get(), geom, i);
-        double x(0.0), y(0.0);
-        GEOSGeomGetX_r(m_geosHandle.get(), g, &x);
-        GEOSGeomGetY_r(m_geosHandle.get(), g, &y);
-        SimplePoint pt = { static_cast<float>(x), static_cast<float>(y) };
+    std::vector<double> xy;
+    multiPointToBuffer(m_geosHandle.get(), geom, count, xy);
+    for(size_t i = 0; i < xy.size(); i += 2) {
+        SimplePoint pt = { static_cast<float>(xy[i]), static_cast<float>(xy[i + 1]) };
         vitem.addPoint(pt);
     }
 
@@ -1001,11 +1921,13 @@ void GEOSGeometryWrap::fillLineTile(GIntBig fid, const GEOSGeom_t *geom,
     unsigned int count = 0;
     GEOSCoordSeq_getSize_r(m_geosHandle.get(), cs, &count);
 
-    double x(0.0), y(0.0);
+    std::vector<double> xy;
+    if(!coordSeqToBuffer(m_geosHandle.get(), cs, count, xy)) {
+        return;
+    }
     for(unsigned int i = 0; i < count; ++i) {
-        GEOSCoordSeq_getX_r(m_geosHandle.get(), cs, i, &x);
-        GEOSCoordSeq_getY_r(m_geosHandle.get(), cs, i, &y);
-        SimplePoint pt = { static_cast<float>(x), static_cast<float>(y) };
+        SimplePoint pt = { static_cast<float>(xy[2 * i]),
+                           static_cast<float>(xy[2 * i + 1]) };
         vitem.addPoint(pt);
     }
 
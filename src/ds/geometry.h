@@ -27,9 +27,12 @@
 #include "ogr_geometry.h"
 
 // std
+#include <algorithm>
 #include <array>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "api_priv.h"
 #include "ngstore/util/constants.h"
@@ -114,6 +117,52 @@ constexpr Envelope DEFAULT_BOUNDS_Y2X4 = Envelope(DEFAULT_BOUNDS.minX() * 4,
 
 //    OGRGeometry* simplifyGeometry(const OGRGeometry* geometry, double distance);
 
+/**
+ * @brief hilbertIndex Returns cell distance along the Hilbert curve.
+ * @param x Cell column from 0 to 2^order - 1.
+ * @param y Cell row from 0 to 2^order - 1.
+ * @param order Curve order.
+ * @return Distance along the curve.
+ */
+GUIntBig hilbertIndex(GUInt32 x, GUInt32 y, unsigned char order);
+
+/**
+ * @brief The EnvelopeIndex class Packed Hilbert R-tree of feature envelopes.
+ * Envelopes are sorted along the Hilbert curve by center and packed to nodes
+ * bottom up. Envelopes inserted after build are searched linearly and removed
+ * ones are skipped, the tree is packed again when there are many such changes.
+ */
+class EnvelopeIndex
+{
+public:
+    typedef struct _item {
+        GIntBig id;
+        Envelope env;
+    } Item;
+
+public:
+    EnvelopeIndex();
+    void build(std::vector<Item> &&items);
+    void insert(GIntBig id, const Envelope &env);
+    void remove(GIntBig id);
+    void clear();
+    bool isBuilt() const { return m_built; }
+    std::vector<GIntBig> search(const Envelope &env) const;
+
+protected:
+    void rebuild();
+
+protected:
+    // Nodes of all levels, leaves first. For leaves index is item id, for
+    // other nodes it is position of the first child.
+    std::vector<Envelope> m_boxes;
+    std::vector<GIntBig> m_indices;
+    std::vector<size_t> m_levelEnds;
+    std::vector<Item> m_inserted;
+    std::unordered_set<GIntBig> m_removed;
+    bool m_built;
+};
+
 typedef struct _normal {
     float x, y;
     bool operator==(const _normal &other) const { return isEqual(x, other.x) &&
@@ -151,44 +200,129 @@ double ngsDistance(const OGRRawPoint &pt1, const OGRRawPoint &pt2);
 bool ngsIsNear(const OGRRawPoint &pt1, const OGRRawPoint &pt2, double tolerance);
 OGRRawPoint ngsGetMiddlePoint(const OGRRawPoint &pt1, const OGRRawPoint &pt2);
 
+/**
+ * @brief The VectorTile blob encoding
+ */
+enum class TileCodec : GByte {
+    RAW = 0,    // Contiguous arrays of floats, indices and ids
+    DELTA = 1,  // Quantized coordinates and ids as delta + zigzag varints
+    DEFLATE = 2 // DELTA compressed with deflate
+};
+
+/**
+ * @brief The ArrayView class Read only view of contiguous array. The array
+ * data must outlive the view.
+ */
+template<typename T>
+class ArrayView
+{
+public:
+    ArrayView() : m_data(nullptr), m_size(0) {}
+    ArrayView(const T *data, size_t size) : m_data(data), m_size(size) {}
+    ArrayView(const std::vector<T> &array) :
+        m_data(array.data()), m_size(array.size()) {}
+    const T *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const T &operator[](size_t index) const { return m_data[index]; }
+    const T &front() const { return m_data[0]; }
+    const T &back() const { return m_data[m_size - 1]; }
+    const T *begin() const { return m_data; }
+    const T *end() const { return m_data + m_size; }
+    bool operator==(const ArrayView &other) const {
+        return m_size == other.m_size && std::equal(begin(), end(),
+                                                    other.begin());
+    }
+    bool operator!=(const ArrayView &other) const { return !(*this == other); }
+
+private:
+    const T *m_data;
+    size_t m_size;
+};
+
+/**
+ * @brief The VectorTileItem class Tile geometry with feature ids. Item loaded
+ * from the tile blob keeps views into the blob and copies them to own arrays
+ * only on change.
+ */
 class VectorTileItem
 {
     friend class VectorTile;
 public:
     VectorTileItem();
-    void addId(GIntBig id) { m_ids.insert(id); }
+    void addId(GIntBig id) { detach(); m_ids.insert(id); }
     void removeId(GIntBig id);
-    void addPoint(const SimplePoint &pt) { m_points.push_back(pt); }
-    void addIndex(unsigned short index) { m_indices.push_back(index); }
+    void addPoint(const SimplePoint &pt) {
+        detach();
+        m_points.push_back(pt);
+        m_hash = 0;
+    }
+    void addIndex(unsigned short index) { detach(); m_indices.push_back(index); }
     void addBorderIndex(unsigned short ring, unsigned short index);
-    void addCentroid(const SimplePoint &pt) { m_centroids.push_back(pt); }
+    void addCentroid(const SimplePoint &pt) {
+        detach();
+        m_centroids.push_back(pt);
+    }
 
-    size_t pointCount() const { return m_points.size(); }
-    const SimplePoint &point(size_t index) const { return m_points[index]; }
+    size_t pointCount() const { return points().size(); }
+    const SimplePoint &point(size_t index) const { return points()[index]; }
     bool isClosed() const;
-    const std::vector<SimplePoint> &points() const { return m_points; }
-    const std::vector<unsigned short> &indices() const { return m_indices; }
-    const std::vector<std::vector<unsigned short>> &borderIndices() const {
-        return m_borderIndices;
+    ArrayView<SimplePoint> points() const {
+        return m_storage ? m_pointsView : ArrayView<SimplePoint>(m_points);
+    }
+    ArrayView<unsigned short> indices() const {
+        return m_storage ? m_indicesView :
+                           ArrayView<unsigned short>(m_indices);
+    }
+    size_t borderCount() const;
+    ArrayView<unsigned short> borderIndices(size_t ring) const;
+    ArrayView<SimplePoint> centroids() const {
+        return m_storage ? m_centroidsView : ArrayView<SimplePoint>(m_centroids);
     }
     bool isValid() const { return m_valid; }
     void setValid(bool valid) { m_valid = valid; }
+    bool isView() const { return m_storage != nullptr; }
     bool operator==(const VectorTileItem &other) const {
-        return m_points == other.m_points;
+        return points() == other.points();
     }
+    size_t hash() const;
     bool isIdsPresent(const std::set<GIntBig> &other, bool full = true) const;
     std::set<GIntBig> idsIntesect(const std::set<GIntBig> &other) const;
+    size_t memorySize() const;
 
 protected:
     void loadIds(const VectorTileItem &item);
-    void save(Buffer *buffer);
-    bool load(Buffer &buffer);
+    void save(Buffer *buffer) const;
+    bool load(Buffer &buffer, GByte version,
+              const std::shared_ptr<const void> &storage);
+    bool loadView(Buffer &buffer, const std::shared_ptr<const void> &storage);
+    bool loadVersion1(Buffer &buffer);
+    void saveEncoded(std::vector<GByte> &out, double originX, double originY,
+                     double precision) const;
+    bool loadEncoded(const GByte *&data, const GByte *end, double originX,
+                     double originY, double precision);
+    void detach() {
+        if(m_storage) {
+            copyViews();
+        }
+    }
+    void copyViews();
+    std::vector<GIntBig> sortedIds() const;
 private:
     std::vector<SimplePoint> m_points;
     std::vector<unsigned short> m_indices;
     std::vector<std::vector<unsigned short>> m_borderIndices; // NOTE: first array is exterior ring indices
     std::vector<SimplePoint> m_centroids;
     std::set<GIntBig> m_ids;
+    // Blob data owner and views into it, used instead of arrays above if set.
+    std::shared_ptr<const void> m_storage;
+    ArrayView<SimplePoint> m_pointsView;
+    ArrayView<unsigned short> m_indicesView;
+    ArrayView<GUInt32> m_ringOffsetsView; // Ring starts in m_borderView + end
+    ArrayView<unsigned short> m_borderView;
+    ArrayView<SimplePoint> m_centroidsView;
+    ArrayView<GIntBig> m_idsView; // Sorted
+    mutable size_t m_hash; // Points hash, 0 if not computed yet
     bool m_valid;
     bool m_2d;
 };
@@ -198,25 +332,40 @@ using VectorTileItemArray = std::vector<VectorTileItem>;
 class VectorTile
 {
 public:
-    VectorTile() : m_valid(false) {}
+    VectorTile() : m_valid(false), m_indexed(false) {}
     void add(const VectorTileItem &item, bool checkDuplicates = false);
     void add(const VectorTileItemArray &items, bool checkDuplicates = false);
     void remove(GIntBig id);
-    BufferPtr save();
-    bool load(Buffer &buffer);
-    VectorTileItemArray items() const { return m_items; }
+    BufferPtr save(TileCodec codec = TileCodec::RAW,
+                   double precision = 0.0) const;
+    bool load(Buffer &buffer,
+              const std::shared_ptr<const void> &storage = nullptr);
+    const VectorTileItemArray &items() const { return m_items; }
     bool empty() const;
     bool isValid() const { return m_valid; }
+    size_t memorySize() const;
+private:
+    void buildIndex();
+    BufferPtr saveEncoded(TileCodec codec, double precision) const;
+    bool loadEncoded(Buffer &buffer);
 private:
     VectorTileItemArray m_items;
+    std::unordered_multimap<size_t, size_t> m_index; // Points hash -> item index
     bool m_valid;
+    bool m_indexed;
 };
 
+/**
+ * @brief The GEOSContextHandlePtr class GEOS context of the current thread.
+ * All handles created on one thread share one context.
+ */
 class GEOSContextHandlePtr : public std::shared_ptr<struct GEOSContextHandle_HS>
 {
 public:
-    GEOSContextHandlePtr() : shared_ptr(OGRGeometry::createGEOSContext(),
-                                        OGRGeometry::freeGEOSContext) {}
+    GEOSContextHandlePtr() : shared_ptr(threadContext()) {}
+
+private:
+    static std::shared_ptr<struct GEOSContextHandle_HS> threadContext();
 };
 
 class GEOSGeometryWrap;
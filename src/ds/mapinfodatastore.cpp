@@ -32,9 +32,12 @@
 #include "util.h"
 #include "util/error.h"
 #include "util/notify.h"
+#include "util/threadpool.h"
 #include "util/url.h"
 
+#include <algorithm>
 #include <ctime>
+#include <deque>
 
 
 namespace ngs {
@@ -44,10 +47,105 @@ constexpr const char *STORE_EXT = "ngmi"; // NextGIS MapInfo Store
 constexpr const char *STORE_META_DB = "sys.db";
 constexpr const char *HASH_SUFFIX = "hash";
 constexpr const char *HASH_FIELD = "hash";
+constexpr const char *HASH_TYPE_KEY = "HASH_TYPE";
+constexpr const char *HASH_TYPE_MD5 = "MD5";
+constexpr const char *HASH_TYPE_FAST = "FAST";
+constexpr size_t HASH_CHUNK_SIZE = 1024;
+constexpr size_t HASH_CHUNKS_PER_THREAD = 2;
+constexpr GIntBig HASH_TRANSACTION_SIZE = 100000;
+constexpr unsigned char HASH_TRIES = 3;
 constexpr const char *STATE_CLOSE = "close";
 constexpr const char *STATE_RO = "read-only";
 constexpr const char *STATE_RW = "read-write";
 
+typedef struct _hashItem {
+    GIntBig fid;
+    GIntBig rowId;
+    GIntBig rid;
+    std::string hash;
+    bool present;
+
+    bool operator<(const struct _hashItem &other) const {
+        return fid < other.fid;
+    }
+} HashItem;
+
+//------------------------------------------------------------------------------
+// HashFeaturesContext
+//------------------------------------------------------------------------------
+
+/**
+ * @brief The HashFeaturesContext class Shared state of hash features workers.
+ */
+class HashFeaturesContext
+{
+public:
+    explicit HashFeaturesContext(enum FeaturePtr::HashType type) :
+        m_type(type)
+    {
+    }
+
+public:
+    enum FeaturePtr::HashType m_type;
+    Mutex m_mutex;
+    Condition m_condition;
+};
+
+//------------------------------------------------------------------------------
+// HashFeaturesData
+//------------------------------------------------------------------------------
+
+/**
+ * @brief The HashFeaturesData class Chunk of features and their hashes.
+ */
+class HashFeaturesData : public ThreadData
+{
+public:
+    explicit HashFeaturesData(HashFeaturesContext *context) :
+        ThreadData(false),
+        m_context(context),
+        m_done(false),
+        m_failed(false)
+    {
+        m_features.reserve(HASH_CHUNK_SIZE);
+    }
+
+    virtual void onComplete(bool result) override {
+        MutexHolder holder(m_context->m_mutex);
+        m_failed = !result;
+        m_done = true;
+        m_context->m_condition.broadcast();
+    }
+
+    void waitComplete() {
+        MutexHolder holder(m_context->m_mutex);
+        while(!m_done) {
+            m_context->m_condition.wait(m_context->m_mutex);
+        }
+    }
+
+public:
+    HashFeaturesContext *m_context;
+    std::vector<FeaturePtr> m_features;
+    std::vector<std::string> m_hashes;
+    bool m_done;
+    bool m_failed; // Some hashes are empty after all tries
+};
+
+static bool hashFeaturesJobThreadFunc(ThreadData *threadData)
+{
+    HashFeaturesData *data = static_cast<HashFeaturesData*>(threadData);
+    data->m_hashes.resize(data->m_features.size());
+    bool result = true;
+    for(size_t i = 0; i < data->m_features.size(); ++i) {
+        data->m_hashes[i] = data->m_features[i].hash(data->m_context->m_type);
+        if(data->m_hashes[i].empty()) {
+            result = false;
+        }
+    }
+    return result;
+}
+
 // -----------------------------------------------------------------------------
 static const std::vector<std::string> tabExts = {"dat", "map", "id", "ind",
                                                  "cpg", "qix", "osf"};
@@ -418,14 +516,19 @@ bool MapInfoStoreFeatureClass::checkSetProperty(const std::string &key,
     return FeatureClass::checkSetProperty(key, value, domain);
 }
 
+bool MapInfoStoreFeatureClass::isRowCopiedHandled(const Options &options) const
+{
+    auto sync = options.asString(ngw::SYNC_ATT_KEY, ngw::SYNC_DISABLE);
+    auto maxSize = options.asLong(ngw::ATTACHMENTS_DOWNLOAD_MAX_SIZE, 0);
+    return maxSize != 0 || !(compare(sync, ngw::SYNC_DISABLE) ||
+                             compare(sync, ngw::SYNC_UPLOAD));
+}
+
 void MapInfoStoreFeatureClass::onRowCopied(FeaturePtr srcFeature,
                                            FeaturePtr dstFature,
                                            const Options &options)
 {
-    auto sync = options.asString(ngw::SYNC_ATT_KEY, ngw::SYNC_DISABLE);
-    auto maxSize = options.asLong(ngw::ATTACHMENTS_DOWNLOAD_MAX_SIZE, 0);
-    if(maxSize == 0 && (compare(sync, ngw::SYNC_DISABLE) ||
-                        compare(sync, ngw::SYNC_UPLOAD))) {
+    if(!isRowCopiedHandled(options)) {
         return;
     }
 
@@ -450,38 +553,68 @@ void MapInfoStoreFeatureClass::onRowCopied(FeaturePtr srcFeature,
 bool MapInfoStoreFeatureClass::insertFeature(const FeaturePtr &feature,
                                              bool logEdits)
 {
-    auto parentDS = dynamic_cast<MapInfoDataStore*>(m_parent);
-    if(nullptr != parentDS) {
-        resetError();
-        auto hashTable = parentDS->getHashTable(storeName());
-        if(hashTable) {
-            auto hashFeature = OGRFeature::CreateFeature(hashTable->GetLayerDefn());
-            hashFeature->SetField(FEATURE_ID_FIELD, feature->GetFID());
-            hashFeature->SetField(
-                HASH_FIELD, feature.dump(FeaturePtr::DumpOutputType::HASH_STYLE).c_str());
+    if(!FeatureClass::insertFeature(feature, logEdits)) {
+        return false;
+    }
+
+    auto hashTable = getHashTable();
+    if(nullptr == hashTable) {
+        return true;
+    }
+    return insertHash(hashTable, feature->GetFID(), hashType());
+}
+
+/**
+ * @brief MapInfoStoreFeatureClass::insertFeatures Inserts batch of rows and
+ * adds inserted rows hashes to the hash table.
+ */
+bool MapInfoStoreFeatureClass::insertFeatures(const FeatureBatch &batch,
+                                              std::vector<GIntBig> &fids,
+                                              GIntBig transactionSize,
+                                              bool logEdits,
+                                              std::vector<FeaturePtr> *features,
+                                              GIntBig *transactionCounter)
+{
+    bool result = FeatureClass::insertFeatures(batch, fids, transactionSize,
+                                               logEdits, features,
+                                               transactionCounter);
+    auto hashTable = getHashTable();
+    if(nullptr == hashTable) {
+        return result;
+    }
+
+    auto type = hashType();
+    bool transaction = hashTable->StartTransaction() == OGRERR_NONE;
+    for(GIntBig fid : fids) {
+        if(fid != NOT_FOUND && !insertHash(hashTable, fid, type)) {
+            result = false;
         }
     }
-    return FeatureClass::insertFeature(feature, logEdits);
+    if(transaction) {
+        hashTable->CommitTransaction();
+    }
+    return result;
 }
 
 bool MapInfoStoreFeatureClass::updateFeature(const FeaturePtr &feature,
                                              bool logEdits)
 {
-    auto parentDS = dynamic_cast<MapInfoDataStore*>(m_parent);
-    if(nullptr != parentDS) {
-        resetError();
-        auto hashTable = parentDS->getHashTable(storeName());
-        auto hashFeature = getFeatureByLocalIdInt(hashTable, feature->GetFID());
-        if(hashFeature) {
-            hashFeature->SetField(
-                HASH_FIELD, feature.dump(FeaturePtr::DumpOutputType::HASH_STYLE).c_str());
-            if(hashTable->SetFeature(hashFeature) != OGRERR_NONE) {
-                return errorMessage("Update feature failed. Error: %s",
-                                    CPLGetLastErrorMsg());
-            }
-        }
+    if(!FeatureClass::updateFeature(feature, logEdits)) {
+        return false;
     }
-    return FeatureClass::updateFeature(feature, logEdits);
+
+    auto hashTable = getHashTable();
+    auto hashFeature = getFeatureByLocalIdInt(hashTable, feature->GetFID());
+    FeaturePtr storedFeature = getFeature(feature->GetFID());
+    if(!hashFeature || !storedFeature) {
+        return true;
+    }
+    hashFeature->SetField(HASH_FIELD, storedFeature.hash(hashType()).c_str());
+    if(hashTable->SetFeature(hashFeature) != OGRERR_NONE) {
+        return errorMessage("Update feature failed. Error: %s",
+                            CPLGetLastErrorMsg());
+    }
+    return true;
 }
 
 bool MapInfoStoreFeatureClass::deleteFeature(GIntBig id, bool logEdits)
@@ -559,14 +692,14 @@ bool MapInfoStoreFeatureClass::onRowsCopied(const TablePtr srcTable,
             }
         }
 
-        return fillHash(progress, options);
+        return fillHash(progress, options) == COD_SUCCESS;
     }
     auto logEdit = options.asBool(LOG_EDIT_HISTORY_KEY, false);
     if(logEdit) {
         if(!setProperty(LOG_EDIT_HISTORY_KEY, "ON", NG_ADDITIONS_KEY)) {
             return false;
         }
-        return fillHash(progress, options);
+        return fillHash(progress, options) == COD_SUCCESS;
     }
     return FeatureClass::onRowsCopied(srcTable, progress, options);
 }
@@ -637,10 +770,21 @@ void MapInfoStoreFeatureClass::close()
     m_layer = nullptr;
 }
 
+/**
+ * @brief MapInfoStoreFeatureClass::fillHash Fills hash table for all features.
+ * Features are read in this thread, hashed by chunks in the thread pool and
+ * written to hash table in the read order inside transactions. Hash includes
+ * geometry and all fields as in insertFeature, updateFeature and
+ * updateHashAndEditLog.
+ * @param progress Progress and cancel.
+ * @param options Key - value list. The available values are:
+ * - HASH_TYPE - FAST (default) or MD5 for compatibility with old stores.
+ * - NUM_THREADS - Number of hash threads.
+ * @return COD_SUCCESS or error code.
+ */
 int MapInfoStoreFeatureClass::fillHash(const Progress &progress,
                                         const Options &options)
 {
-    ngsUnused(options);
     auto parentDS = dynamic_cast<MapInfoDataStore*>(m_parent);
     if(nullptr == parentDS) {
         progress.onProgress(COD_CREATE_FAILED, 0.0,
@@ -655,36 +799,167 @@ int MapInfoStoreFeatureClass::fillHash(const Progress &progress,
     else {
         parentDS->clearHashTable(storeName());
     }
+    if(nullptr == hashTable) {
+        return COD_CREATE_FAILED;
+    }
+
+    std::string hashTypeStr = options.asString(HASH_TYPE_KEY, HASH_TYPE_FAST);
+    auto type = compare(hashTypeStr, HASH_TYPE_MD5) ?
+                FeaturePtr::HashType::MD5 : FeaturePtr::HashType::FAST;
+    if(!setProperty(HASH_TYPE_KEY, type == FeaturePtr::HashType::MD5 ?
+                    HASH_TYPE_MD5 : HASH_TYPE_FAST, NG_ADDITIONS_KEY)) {
+        return COD_CREATE_FAILED;
+    }
+
+    unsigned char threadCount = static_cast<unsigned char>(
+                std::max(1, std::min(options.asInt("NUM_THREADS",
+                                                   getNumberThreads()), 255)));
+
+    HashFeaturesContext context(type);
+    std::deque<std::unique_ptr<HashFeaturesData>> chunks;
+    ThreadPool threadPool;
+    threadPool.init(threadCount, hashFeaturesJobThreadFunc, HASH_TRIES);
+    CancelToken cancelToken;
+    size_t maxChunks = threadCount * HASH_CHUNKS_PER_THREAD;
 
     // Hash features.
 
-    emptyFields(true);
     reset();
     progress.onProgress(COD_IN_PROCESS, 0.0, _("Start hashing features"));
-    double counter(0.0);
-    auto featureCountVal = featureCount();
-    FeaturePtr feature;
-    while((feature = nextFeature())) {
-        double complete = counter / featureCountVal;
-        if(!progress.onProgress(COD_IN_PROCESS, complete,
-                                _("Hash in process ..."))) {
-            return  COD_CANCELED;
+    double total = static_cast<double>(featureCount());
+    if(total <= 0.0) {
+        total = 1.0;
+    }
+    GIntBig processed = 0;
+    GIntBig transactionCounter = 0;
+    bool transaction = false;
+    bool readComplete = false;
+    int result = COD_SUCCESS;
+    while(true) {
+        // Keep the pool busy while the oldest chunk is writing.
+        while(!readComplete && chunks.size() < maxChunks) {
+            std::unique_ptr<HashFeaturesData> chunk(
+                        new HashFeaturesData(&context));
+            FeaturePtr feature;
+            while(chunk->m_features.size() < HASH_CHUNK_SIZE &&
+                  (feature = nextFeature())) {
+                chunk->m_features.emplace_back(feature);
+            }
+            if(chunk->m_features.size() < HASH_CHUNK_SIZE) {
+                readComplete = true;
+            }
+            if(chunk->m_features.empty()) {
+                break;
+            }
+            chunk->setCancelToken(cancelToken);
+            threadPool.addThreadData(chunk.get());
+            chunks.emplace_back(std::move(chunk));
+        }
+
+        if(chunks.empty()) {
+            break;
+        }
+
+        std::unique_ptr<HashFeaturesData> chunk = std::move(chunks.front());
+        chunks.pop_front();
+        chunk->waitComplete();
+        if(chunk->m_failed) {
+            result = COD_INSERT_FAILED;
+            break;
+        }
+
+        if(!transaction) {
+            transaction = hashTable->StartTransaction() == OGRERR_NONE;
         }
-        auto hash = feature.dump(FeaturePtr::DumpOutputType::HASH_STYLE);
-        FeaturePtr newFeature = OGRFeature::CreateFeature(
-                    hashTable->GetLayerDefn() );
-        newFeature->SetField(FEATURE_ID_FIELD, feature->GetFID());
-        newFeature->SetField(HASH_FIELD, hash.c_str());
-        if(hashTable->CreateFeature(newFeature) != OGRERR_NONE) {
-            outMessage(COD_INSERT_FAILED, _("Failed to create feature"));
+
+        for(size_t i = 0; i < chunk->m_features.size(); ++i) {
+            FeaturePtr newFeature = OGRFeature::CreateFeature(
+                        hashTable->GetLayerDefn() );
+            newFeature->SetField(FEATURE_ID_FIELD,
+                                 chunk->m_features[i]->GetFID());
+            newFeature->SetField(HASH_FIELD, chunk->m_hashes[i].c_str());
+            if(hashTable->CreateFeature(newFeature) != OGRERR_NONE) {
+                outMessage(COD_INSERT_FAILED, _("Failed to create feature"));
+            }
+        }
+        transactionCounter += static_cast<GIntBig>(chunk->m_features.size());
+        processed += static_cast<GIntBig>(chunk->m_features.size());
+
+        if(transaction && transactionCounter >= HASH_TRANSACTION_SIZE) {
+            hashTable->CommitTransaction();
+            transaction = false;
+            transactionCounter = 0;
+        }
+
+        if(!progress.onProgress(COD_IN_PROCESS, processed / total,
+                                _("Hash in process ..."))) {
+            result = COD_CANCELED;
+            break;
         }
     }
 
-    progress.onProgress(COD_FINISHED, 1.0, _("Hashing features finished"));
+    if(transaction) {
+        hashTable->CommitTransaction();
+    }
 
-    emptyFields(false);
     reset();
 
+    if(result != COD_SUCCESS) {
+        cancelToken.cancel();
+        threadPool.clearThreadData();
+        threadPool.waitComplete(Progress());
+    }
+
+    if(result == COD_CANCELED) {
+        return result;
+    }
+
+    if(result == COD_INSERT_FAILED) {
+        // Features without hash would be reported as changed on sync.
+        parentDS->clearHashTable(storeName());
+        progress.onProgress(COD_INSERT_FAILED, 0.0,
+                            _("Failed to hash features"));
+        return outMessage(COD_INSERT_FAILED, _("Failed to hash features"));
+    }
+
+    progress.onProgress(COD_FINISHED, 1.0, _("Hashing features finished"));
+
+    return COD_SUCCESS;
+}
+
+OGRLayer *MapInfoStoreFeatureClass::getHashTable() const
+{
+    auto parentDS = dynamic_cast<MapInfoDataStore*>(m_parent);
+    if(nullptr == parentDS) {
+        return nullptr;
+    }
+    return parentDS->getHashTable(storeName());
+}
+
+/**
+ * @brief MapInfoStoreFeatureClass::insertHash Adds feature hash to the hash
+ * table. The hash is computed from the feature read back from TAB file as
+ * fillHash and updateHashAndEditLog do, so coordinates rounded by the driver
+ * are not reported as changes.
+ * @param hashTable Hash table.
+ * @param fid Feature identifier.
+ * @param type Hash type.
+ * @return true on success.
+ */
+bool MapInfoStoreFeatureClass::insertHash(OGRLayer *hashTable, GIntBig fid,
+                                          enum FeaturePtr::HashType type)
+{
+    FeaturePtr feature = getFeature(fid);
+    if(!feature) {
+        return errorMessage(_("Feature " CPL_FRMT_GIB " not found"), fid);
+    }
+    FeaturePtr hashFeature = OGRFeature::CreateFeature(hashTable->GetLayerDefn());
+    hashFeature->SetField(FEATURE_ID_FIELD, feature->GetFID());
+    hashFeature->SetField(HASH_FIELD, feature.hash(type).c_str());
+    if(hashTable->CreateFeature(hashFeature) != OGRERR_NONE) {
+        return errorMessage(_("Failed to create feature hash. Error: %s"),
+                            CPLGetLastErrorMsg());
+    }
     return true;
 }
 
@@ -702,68 +977,99 @@ bool MapInfoStoreFeatureClass::updateHashAndEditLog()
 
     resetError();
 
+    // Load hash table sorted by feature id. One pass instead of query per row.
+    std::vector<HashItem> hashItems;
+    hashItems.reserve(static_cast<size_t>(
+                          std::max(GIntBig(0), hashTable->GetFeatureCount())));
     FeaturePtr feature;
     hashTable->ResetReading();
-    std::vector<GIntBig> deleteIDs;
-    std::vector<GIntBig> presentIDs;
     while((feature = hashTable->GetNextFeature())) {
-        // Check update or delete
-        auto fid = feature->GetFieldAsInteger64(FEATURE_ID_FIELD);
-        auto rid = feature->GetFieldAsInteger64(ngw::REMOTE_ID_KEY);
-        auto tabFeature = getFeature(fid);
+        HashItem item;
+        item.fid = feature->GetFieldAsInteger64(FEATURE_ID_FIELD);
+        item.rowId = feature->GetFID();
+        item.rid = feature->GetFieldAsInteger64(ngw::REMOTE_ID_KEY);
+        item.hash = feature->GetFieldAsString(HASH_FIELD);
+        item.present = false;
+        hashItems.emplace_back(item);
+    }
+    if(!std::is_sorted(hashItems.begin(), hashItems.end())) {
+        std::sort(hashItems.begin(), hashItems.end());
+    }
+
+    // Merge features with hash items. TAB features are read in FID order, so
+    // search continues from the last matched item.
+    auto type = hashType();
+    auto cursor = hashItems.begin();
+    GIntBig prevFid = -1;
+    reset();
+    while((feature = nextFeature())) {
+        GIntBig fid = feature->GetFID();
+        HashItem key;
+        key.fid = fid;
+        auto it = std::lower_bound(fid > prevFid ? cursor : hashItems.begin(),
+                                   hashItems.end(), key);
+        prevFid = fid;
+        if(it == hashItems.end() || it->fid != fid) {
+            // New feature added
+            FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
+                                                  CC_CREATE_FEATURE);
+            opFeature->SetField(FEATURE_ID_FIELD, fid);
+            logEditOperation(opFeature);
+            cursor = it;
+            continue;
+        }
+
+        cursor = it + 1;
+        it->present = true;
         // Check update
-        if(tabFeature) {
-            auto storedHash = feature->GetFieldAsString(HASH_FIELD);
-            auto currentHash = tabFeature.dump(FeaturePtr::DumpOutputType::HASH_STYLE);
-            if(!compare(storedHash, currentHash)) {
-                FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
+        auto currentHash = feature.hash(type);
+        if(!compare(it->hash, currentHash)) {
+            FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
                                                   CC_CHANGE_FEATURE);
-                opFeature->SetField(FEATURE_ID_FIELD, fid);
-                opFeature->SetField(ngw::REMOTE_ID_KEY, rid);
-
-                logEditOperation(opFeature);
+            opFeature->SetField(FEATURE_ID_FIELD, fid);
+            opFeature->SetField(ngw::REMOTE_ID_KEY, it->rid);
+            logEditOperation(opFeature);
 
-                // Update hash
-                feature->SetField(HASH_FIELD, currentHash.c_str());
-                if (hashTable->SetFeature(feature) != OGRERR_NONE) {
+            // Update hash
+            FeaturePtr hashFeature = hashTable->GetFeature(it->rowId);
+            if(hashFeature) {
+                hashFeature->SetField(HASH_FIELD, currentHash.c_str());
+                if(hashTable->SetFeature(hashFeature) != OGRERR_NONE) {
                     warningMessage(_("Failed to save new hash for feature " CPL_FRMT_GIB),
-                                   tabFeature->GetFID());
+                                   fid);
                 }
             }
-            presentIDs.push_back(fid);
-        }
-        else { // Feature deleted
-            deleteIDs.push_back(feature->GetFID());
-            FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
-                                                  CC_DELETE_FEATURE);
-            opFeature->SetField(FEATURE_ID_FIELD, fid);
-            opFeature->SetField(ngw::REMOTE_ID_KEY, rid);
-            logEditOperation(opFeature);
         }
     }
+    reset();
 
-    for(auto deleteID : deleteIDs) {
-        if(hashTable->DeleteFeature(deleteID) != OGRERR_NONE) {
-            warningMessage("Failed delete hash table item " CPL_FRMT_GIB, deleteID);
+    // Features deleted
+    for(const auto &item : hashItems) {
+        if(item.present) {
+            continue;
         }
-    }
-
-    // Check add
-    reset();
-    while((feature = nextFeature())) {
-        if(std::find(presentIDs.begin(), presentIDs.end(), feature->GetFID()) ==
-                presentIDs.end() ) {
-            // New feature added
-            FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
-                                                  CC_CREATE_FEATURE);
-            opFeature->SetField(FEATURE_ID_FIELD, feature->GetFID());
-            logEditOperation(opFeature);
+        FeaturePtr opFeature = logEditFeature(FeaturePtr(), FeaturePtr(),
+                                              CC_DELETE_FEATURE);
+        opFeature->SetField(FEATURE_ID_FIELD, item.fid);
+        opFeature->SetField(ngw::REMOTE_ID_KEY, item.rid);
+        logEditOperation(opFeature);
+
+        if(hashTable->DeleteFeature(item.rowId) != OGRERR_NONE) {
+            warningMessage("Failed delete hash table item " CPL_FRMT_GIB, item.rowId);
         }
     }
 
     return true;
 }
 
+enum FeaturePtr::HashType MapInfoStoreFeatureClass::hashType() const
+{
+    // Hash tables created before fast hash have no type property
+    auto type = property(HASH_TYPE_KEY, HASH_TYPE_MD5, NG_ADDITIONS_KEY);
+    return compare(type, HASH_TYPE_FAST) ? FeaturePtr::HashType::FAST :
+                                           FeaturePtr::HashType::MD5;
+}
+
 //------------------------------------------------------------------------------
 // MapInfoDataStore
 //------------------------------------------------------------------------------
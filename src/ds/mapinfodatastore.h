@@ -158,6 +158,12 @@ public:
     virtual bool updateFeature(const FeaturePtr &feature, bool logEdits) override;
     virtual bool deleteFeature(GIntBig id, bool logEdits) override;
     virtual bool deleteFeatures(bool logEdits) override;
+    virtual bool insertFeatures(const FeatureBatch &batch,
+                                std::vector<GIntBig> &fids,
+                                GIntBig transactionSize = 100000,
+                                bool logEdits = true,
+                                std::vector<FeaturePtr> *features = nullptr,
+                                GIntBig *transactionCounter = nullptr) override;
     virtual std::vector<ngsEditOperation> editOperations() override;
     // Table interface
 protected:
@@ -168,6 +174,7 @@ protected:
 
     // Table interface
  public:
+    virtual bool isRowCopiedHandled(const Options &options) const override;
     virtual void onRowCopied(FeaturePtr srcFeature, FeaturePtr dstFature,
                              const Options &options = Options()) override;
     virtual bool onRowsCopied(const TablePtr srcTable, const Progress &progress,
@@ -182,6 +189,10 @@ public:
 protected:
     int fillHash(const Progress &progress, const Options &options);
     bool updateHashAndEditLog();
+    enum FeaturePtr::HashType hashType() const;
+    OGRLayer *getHashTable() const;
+    bool insertHash(OGRLayer *hashTable, GIntBig fid,
+                    enum FeaturePtr::HashType type);
 
 private:
    GDALDatasetPtr m_TABDS;
@@ -20,6 +20,11 @@
  ****************************************************************************/
 #include "raster.h"
 
+// stl
+#include <algorithm>
+#include <atomic>
+#include <set>
+
 // gdal
 #include "cpl_http.h"
 
@@ -27,43 +32,332 @@
 #include "catalog/folder.h"
 #include "map/maptransform.h"
 #include "ngstore/catalog/filter.h"
+#include "util/download.h"
 #include "util/error.h"
 #include "util/notify.h"
 #include "util/settings.h"
 #include "util/stringutil.h"
+#include "util/url.h"
 
 namespace ngs {
 
 //------------------------------------------------------------------------------
-// DownloadData
+// AreaDownloadContext
 //------------------------------------------------------------------------------
-constexpr unsigned short DOWNLOAD_THREAD_COUNT = 5;
-
-class DownloadData : public ThreadData {
+constexpr unsigned char DOWNLOAD_THREAD_COUNT = 5;
+constexpr int DOWNLOAD_MAX_THREAD_COUNT = 32;
+constexpr unsigned char DOWNLOAD_TRIES = 3;
+constexpr double DOWNLOAD_RETRY_DELAY = 0.5; // Seconds, doubled on each try
+constexpr size_t DOWNLOAD_BATCH_SIZE = 4096;
+constexpr int DOWNLOAD_STATE_FLUSH_COUNT = 64;
+constexpr const char *DOWNLOAD_STATE_EXT = "state";
+
+/**
+ * @brief The AreaDownloadContext class Shared state of the area download.
+ * Finished tiles are appended to the state file in the cache directory, so
+ * the interrupted download continues from the same place.
+ */
+class AreaDownloadContext {
 public:
-    DownloadData(const std::string &basePath, const std::string &url, int expires,
-                 const Tile &tile, const Options &options, bool own);
-    virtual ~DownloadData() override;
-    Tile m_tile;
-    std::string m_basePath, m_url;
+    AreaDownloadContext(const std::string &basePath, const std::string &url,
+                        int expires, const Options &options,
+                        double requestsPerSecond);
+    ~AreaDownloadContext();
+    bool openState(const std::string &statePath);
+    void closeState(bool remove);
+    bool isFinished(const Tile &tile) const;
+    void setFinished(const Tile &tile);
+    std::string tileUrl(const Tile &tile) const;
+    bool makeDir(const std::string &path);
+
+    std::string m_basePath;
     int m_expires;
     Options m_options;
+    http::HostRateLimiter m_rateLimiter;
+    http::PersistentSessions m_sessions;
+    std::atomic<size_t> m_downloaded, m_cached, m_missing, m_failed;
+    std::atomic_int m_lastErrorCode;
+
+private:
+    std::string m_url;
+    std::string m_statePath;
+    std::set<Tile> m_finishedTiles; // Loaded from state, read only later
+    VSILFILE *m_stateFile;
+    int m_unflushedCount;
+    Mutex m_stateMutex, m_dirMutex;
 };
 
-DownloadData::DownloadData(const std::string &basePath, const std::string &url,
-                           int expires, const Tile &tile, const Options &options,
-                           bool own) :
-    ThreadData(own),
-    m_tile(tile),
+AreaDownloadContext::AreaDownloadContext(const std::string &basePath,
+                                         const std::string &url, int expires,
+                                         const Options &options,
+                                         double requestsPerSecond) :
     m_basePath(basePath),
-    m_url(url),
     m_expires(expires),
-    m_options(options)
+    m_options(options),
+    m_rateLimiter(requestsPerSecond),
+    m_sessions(CPLSPrintf("ngs_area_%p", static_cast<void*>(this))),
+    m_downloaded(0),
+    m_cached(0),
+    m_missing(0),
+    m_failed(0),
+    m_lastErrorCode(0),
+    m_url(url),
+    m_stateFile(nullptr),
+    m_unflushedCount(0)
+{
+    // Connection url is escaped for GDAL WMS XML
+    m_url = CPLString(m_url).replaceAll("&amp;", "&");
+}
+
+AreaDownloadContext::~AreaDownloadContext()
+{
+    closeState(false);
+}
+
+bool AreaDownloadContext::openState(const std::string &statePath)
+{
+    m_statePath = statePath;
+    m_finishedTiles.clear();
+    if(Folder::isExists(statePath)) {
+        // Tiles of stale state may be already expired in cache
+        if(m_expires > 0 &&
+                time(nullptr) - File::modificationDate(statePath) > m_expires) {
+            File::deleteFile(statePath);
+        }
+        else {
+            VSILFILE *file = VSIFOpenL(statePath.c_str(), "r");
+            if(file != nullptr) {
+                const char *line;
+                while((line = CPLReadLineL(file)) != nullptr) {
+                    int x, y, z;
+                    if(sscanf(line, "%d %d %d", &z, &x, &y) == 3) {
+                        Tile tile = { x, y, static_cast<unsigned char>(z), 0 };
+                        m_finishedTiles.insert(tile);
+                    }
+                }
+                VSIFCloseL(file);
+            }
+        }
+    }
+
+    m_stateFile = VSIFOpenL(statePath.c_str(), "a");
+    if(nullptr == m_stateFile) {
+        return errorMessage(_("Failed to open download state file %s"),
+                            statePath.c_str());
+    }
+    return true;
+}
+
+void AreaDownloadContext::closeState(bool remove)
+{
+    MutexHolder holder(m_stateMutex);
+    if(m_stateFile != nullptr) {
+        VSIFCloseL(m_stateFile);
+        m_stateFile = nullptr;
+    }
+    if(remove && !m_statePath.empty()) {
+        File::deleteFile(m_statePath);
+    }
+}
+
+bool AreaDownloadContext::isFinished(const Tile &tile) const
+{
+    Tile key = { tile.x, tile.y, tile.z, 0 };
+    return m_finishedTiles.find(key) != m_finishedTiles.end();
+}
+
+void AreaDownloadContext::setFinished(const Tile &tile)
+{
+    MutexHolder holder(m_stateMutex);
+    if(nullptr == m_stateFile) {
+        return;
+    }
+    const char *line = CPLSPrintf("%d %d %d\n", tile.z, tile.x, tile.y);
+    VSIFWriteL(line, strlen(line), 1, m_stateFile);
+    // The lost lines only cause download of the tiles once more
+    if(++m_unflushedCount >= DOWNLOAD_STATE_FLUSH_COUNT) {
+        VSIFFlushL(m_stateFile);
+        m_unflushedCount = 0;
+    }
+}
+
+std::string AreaDownloadContext::tileUrl(const Tile &tile) const
+{
+    CPLString url(m_url);
+    url = url.replaceAll("${x}", std::to_string(tile.x));
+    url = url.replaceAll("${y}", std::to_string(tile.y));
+    url = url.replaceAll("${z}", std::to_string(tile.z));
+    return url;
+}
+
+bool AreaDownloadContext::makeDir(const std::string &path)
+{
+    if(Folder::isExists(path)) {
+        return true;
+    }
+    MutexHolder holder(m_dirMutex);
+    return Folder::mkDir(path, true);
+}
+
+//------------------------------------------------------------------------------
+// DownloadData
+//------------------------------------------------------------------------------
+
+class DownloadData : public ThreadData {
+public:
+    DownloadData(AreaDownloadContext *context, const Tile &tile, bool own) :
+        ThreadData(own), m_context(context), m_tile(tile), m_code(0) {}
+    virtual void onComplete(bool result) override;
+    AreaDownloadContext *m_context;
+    Tile m_tile;
+    int m_code; // Last response code
+};
+
+void DownloadData::onComplete(bool result)
+{
+    if(result) {
+        m_context->setFinished(m_tile);
+    }
+    else {
+        m_context->m_failed++;
+        m_context->m_lastErrorCode = m_code;
+    }
+}
+
+/**
+ * @brief The AreaProgress class Maps progress of the tiles batch to the
+ * progress of the whole area and remembers cancel. Thread pool waiting drops
+ * queued jobs on cancel and returns as usual, so callers check isCanceled().
+ */
+class AreaProgress : public Progress
 {
+public:
+    AreaProgress(const Progress &progress, size_t total) : Progress(progress),
+        m_total(total), m_done(0), m_batch(0), m_canceled(false) {}
+    void setBatch(size_t done, size_t batch) { m_done = done; m_batch = batch; }
+    bool isCanceled() const { return m_canceled; }
+    virtual bool onProgress(enum ngsCode status, double complete,
+                            const char *format, ...) const override;
+
+private:
+    size_t m_total, m_done, m_batch;
+    mutable bool m_canceled;
+};
+
+bool AreaProgress::onProgress(enum ngsCode status, double complete,
+                              const char *format, ...) const
+{
+    double areaComplete = m_total > 0 ?
+                (m_done + complete * m_batch) / m_total : 1.0;
+    va_list args;
+    va_start(args, format);
+    CPLString message;
+    message.vPrintf(format, args);
+    va_end(args);
+    if(!Progress::onProgress(status, areaComplete, "%s", message.c_str())) {
+        m_canceled = true;
+    }
+    return !m_canceled;
 }
 
-DownloadData::~DownloadData()
+//------------------------------------------------------------------------------
+// OverviewContext
+//------------------------------------------------------------------------------
+constexpr int COG_BLOCK_SIZE = 512;
+constexpr const char *COG_DEFAULT_COMPRESS = "DEFLATE";
+
+/**
+ * @brief The OverviewContext class Shared state of one overview level build.
+ * Source pixels are read from own read only handles in parallel, the writes to
+ * the output dataset are serialized.
+ */
+class OverviewContext {
+public:
+    OverviewContext(const std::string &path, GDALDataset *dstDS, int level,
+                    bool average) :
+        m_path(path), m_dstDS(dstDS), m_level(level), m_average(average) {}
+    GDALDatasetPtr takeReadHandle();
+    void returnReadHandle(const GDALDatasetPtr &handle);
+
+    std::string m_path;
+    GDALDataset *m_dstDS;
+    int m_level; // Overview to fill. Source is previous overview or raster
+    bool m_average;
+    Mutex m_writeMutex;
+
+private:
+    std::vector<GDALDatasetPtr> m_readHandles;
+    Mutex m_readHandlesMutex;
+};
+
+GDALDatasetPtr OverviewContext::takeReadHandle()
 {
+    {
+        MutexHolder holder(m_readHandlesMutex);
+        if(!m_readHandles.empty()) {
+            GDALDatasetPtr handle = m_readHandles.back();
+            m_readHandles.pop_back();
+            return handle;
+        }
+    }
+
+    return static_cast<GDALDataset*>(
+                GDALOpenEx(m_path.c_str(), GDAL_OF_RASTER|GDAL_OF_READONLY|
+                           GDAL_OF_VERBOSE_ERROR, nullptr, nullptr, nullptr));
+}
+
+void OverviewContext::returnReadHandle(const GDALDatasetPtr &handle)
+{
+    MutexHolder holder(m_readHandlesMutex);
+    m_readHandles.push_back(handle);
+}
+
+//------------------------------------------------------------------------------
+// OverviewData
+//------------------------------------------------------------------------------
+
+class OverviewData : public ThreadData {
+public:
+    OverviewData(OverviewContext *context, int x, int y, int width, int height,
+                 bool own) :
+        ThreadData(own), m_context(context), m_x(x), m_y(y), m_width(width),
+        m_height(height) {}
+    OverviewContext *m_context;
+    int m_x, m_y, m_width, m_height; // Block in overview pixels
+};
+
+/**
+ * @brief downsample Reduces source pixels twice by each side.
+ */
+static void downsample(const std::vector<double> &src, int srcWidth,
+                       int srcHeight, std::vector<double> &dst, int width,
+                       int height, bool average, bool hasNoData, double noData)
+{
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            double &out = dst[static_cast<size_t>(y * width + x)];
+            int srcX = x * 2;
+            int srcY = y * 2;
+            if(!average) {
+                out = src[static_cast<size_t>(srcY * srcWidth + srcX)];
+                continue;
+            }
+
+            double sum = 0.0;
+            int count = 0;
+            for(int j = srcY; j < srcY + 2 && j < srcHeight; ++j) {
+                for(int i = srcX; i < srcX + 2 && i < srcWidth; ++i) {
+                    double value = src[static_cast<size_t>(j * srcWidth + i)];
+                    if(hasNoData && isEqual(value, noData)) {
+                        continue;
+                    }
+                    sum += value;
+                    count++;
+                }
+            }
+            out = count > 0 ? sum / count : (hasNoData ? noData : 0.0);
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -78,7 +372,10 @@ Raster::Raster(std::vector<std::string> siblingFiles,
     DatasetBase(),
     SpatialDataset(),
     m_openFlags(GDAL_OF_SHARED|GDAL_OF_READONLY|GDAL_OF_VERBOSE_ERROR),
-    m_siblingFiles(siblingFiles)
+    m_siblingFiles(siblingFiles),
+    m_readHandleCount(0),
+    m_readHandleGeneration(0),
+    m_readHandlesDirty(true)
 {
 }
 
@@ -135,6 +432,7 @@ bool Raster::open(unsigned int openFlags, const Options &options)
 
         bool result = DatasetBase::open(connStr, openFlags, options);
         if(result) {
+            m_openPath = connStr;
             // Set NG_ADDITIONS metadata
             m_DS->SetMetadataItem("TMS_URL", url.c_str(), "");
             m_DS->SetMetadataItem("TMS_CACHE_EXPIRES", CPLSPrintf("%d", cacheExpires), "");
@@ -219,6 +517,7 @@ bool Raster::open(unsigned int openFlags, const Options &options)
     }
     else {
         if(DatasetBase::open(m_path, openFlags, options)) {
+            m_openPath = m_path;
             std::string spatRefStr = m_DS->GetProjectionRef();
             m_spatialReference.setFromUserInput(spatRefStr);
             setExtent();
@@ -257,13 +556,40 @@ bool Raster::pixelData(void *data, int xOff, int yOff, int xSize, int ySize,
         return false;
     }
 
-    MutexHolder holder(m_dataLock, 0.05);
+    int ioBandCount = skipLastBand ? bandCount - 1 : bandCount;
+    GDALDatasetPtr handle;
+    int generation = 0;
+    if(read) {
+        handle = takeReadHandle(generation);
+    }
 
-    CPLErr result = m_DS->RasterIO(read ? GF_Read : GF_Write, xOff, yOff,
-                                   xSize, ySize, data, bufXSize, bufYSize,
-                                   dataType, skipLastBand ? bandCount - 1 :
-                                                            bandCount, bandList,
-                                   pixelSpace, lineSpace, bandSpace);
+    CPLErr result;
+    if(handle) {
+        result = handle->RasterIO(GF_Read, xOff, yOff, xSize, ySize, data,
+                                  bufXSize, bufYSize, dataType, ioBandCount,
+                                  bandList, pixelSpace, lineSpace, bandSpace);
+        returnReadHandle(handle, generation);
+    }
+    else {
+        {
+            MutexHolder holder(m_dataLock);
+            // Closed while waiting for the lock
+            if(nullptr == m_DS) {
+                return false;
+            }
+            result = m_DS->RasterIO(read ? GF_Read : GF_Write, xOff, yOff,
+                                    xSize, ySize, data, bufXSize, bufYSize,
+                                    dataType, ioBandCount, bandList,
+                                    pixelSpace, lineSpace, bandSpace);
+        }
+        if(!read) {
+            // Read handles have own block caches, so they are reopened after
+            // written blocks are flushed. Set without m_dataLock held, as
+            // takeReadHandle locks in the opposite order.
+            MutexHolder holder(m_readHandlesLock);
+            m_readHandlesDirty = true;
+        }
+    }
 
     if(result != CE_None) {
         return errorMessage(CPLGetLastErrorMsg());
@@ -272,6 +598,89 @@ bool Raster::pixelData(void *data, int xOff, int yOff, int xSize, int ySize,
     return true;
 }
 
+/**
+ * @brief Raster::takeReadHandle Takes free read only dataset handle or opens
+ * new one. Handles count is limited by raster/max_handles setting. Pending
+ * writes of the main dataset are flushed first.
+ * @param generation Pool generation to pass to returnReadHandle.
+ * @return Handle or empty pointer if limit reached or raster is closed.
+ */
+GDALDatasetPtr Raster::takeReadHandle(int &generation)
+{
+    {
+        MutexHolder holder(m_readHandlesLock);
+        if(m_openPath.empty()) {
+            return GDALDatasetPtr();
+        }
+        if(m_readHandlesDirty) {
+            resetReadHandles();
+            MutexHolder dataHolder(m_dataLock);
+            m_DS->FlushCache();
+            m_readHandlesDirty = false;
+        }
+        generation = m_readHandleGeneration;
+        if(!m_readHandles.empty()) {
+            GDALDatasetPtr handle = m_readHandles.back();
+            m_readHandles.pop_back();
+            return handle;
+        }
+
+        int maxHandles = Settings::instance().getInteger("raster/max_handles",
+                                                         getNumberThreads());
+        if(m_readHandleCount >= maxHandles) {
+            return GDALDatasetPtr();
+        }
+        m_readHandleCount++;
+    }
+
+    // Not shared handle, so GDAL returns new dataset object
+    unsigned int openFlags = (m_openFlags & ~(GDAL_OF_SHARED|GDAL_OF_UPDATE)) |
+            GDAL_OF_READONLY;
+    auto openOptions = m_openOptions.asCPLStringList();
+    GDALDatasetPtr handle = static_cast<GDALDataset*>(
+                GDALOpenEx(m_openPath.c_str(), openFlags, nullptr, openOptions,
+                           nullptr));
+    if(!handle) {
+        MutexHolder holder(m_readHandlesLock);
+        if(generation == m_readHandleGeneration) {
+            m_readHandleCount--;
+        }
+    }
+    return handle;
+}
+
+void Raster::returnReadHandle(const GDALDatasetPtr &handle, int generation)
+{
+    MutexHolder holder(m_readHandlesLock);
+    // Handle of the previous generation may see stale data, close it
+    if(generation == m_readHandleGeneration) {
+        m_readHandles.push_back(handle);
+    }
+}
+
+/**
+ * @brief Raster::resetReadHandles Closes free read handles. Busy handles are
+ * closed on return. Call with m_readHandlesLock held.
+ */
+void Raster::resetReadHandles()
+{
+    m_readHandles.clear();
+    m_readHandleCount = 0;
+    m_readHandleGeneration++;
+}
+
+void Raster::close()
+{
+    {
+        MutexHolder holder(m_readHandlesLock);
+        resetReadHandles();
+        m_readHandlesDirty = true;
+        m_openPath.clear();
+    }
+    MutexHolder holder(m_dataLock);
+    DatasetBase::close();
+}
+
 bool Raster::destroy()
 {
     if(Filter::isFileBased(m_type)) {
@@ -517,8 +926,6 @@ int Raster::getBestOverview(int &xOff, int &yOff, int &xSize, int &ySize,
                                          xSize, ySize, bufXSize, bufYSize, nullptr);
 }
 
-static CPLLock *hLock = nullptr;
-
 bool Raster::cacheAreaJobThreadFunc(ThreadData* threadData)
 {
     auto data = dynamic_cast<DownloadData*>(threadData);
@@ -526,44 +933,62 @@ bool Raster::cacheAreaJobThreadFunc(ThreadData* threadData)
         return true;
     }
 
-    CPLString url(data->m_url);
-    url = url.replaceAll("${x}", std::to_string(data->m_tile.x));
-    url = url.replaceAll("${y}", std::to_string(data->m_tile.y));
-    url = url.replaceAll("${z}", std::to_string(data->m_tile.z));
+    // Don't repeat requests which never succeed, like 401 or 403
+    if(data->tries() > 0 && !http::isRetryable(data->m_code)) {
+        return false;
+    }
 
+    AreaDownloadContext *context = data->m_context;
+    std::string url = context->tileUrl(data->m_tile);
     std::string fileName = md5(url);
     std::string dirPath = CPLSPrintf("%c/%c", fileName[0], fileName[1]);
-    std::string path = File::formFileName(data->m_basePath, dirPath, "");
-
-    if(!Folder::isExists(path)) {
-        CPLLockHolderD(&hLock, LOCK_RECURSIVE_MUTEX)
-
-        if(!Folder::mkDir(path, true)) {
-            return false;
-        }
+    std::string path = File::formFileName(context->m_basePath, dirPath, "");
+    if(!context->makeDir(path)) {
+        return false;
     }
 
     path = File::formFileName(path, fileName, "");
-    File::modificationDate(path);
-    if(time(nullptr) - File::modificationDate(path) < data->m_expires) {
+    if(time(nullptr) - File::modificationDate(path) < context->m_expires) {
+        context->m_cached++;
         return true;
     }
 
-    // Download tile and save it to cache
-    auto requestOptions = data->m_options.asCPLStringList();
-    CPLHTTPResult *result = CPLHTTPFetch(url, requestOptions);
-    if(result->nStatus != 0 || result->pszErrBuf != nullptr) {
-        outMessage(COD_REQUEST_FAILED, result->pszErrBuf);
-        CPLHTTPDestroyResult(result);
+    context->m_rateLimiter.wait(url);
+
+    // Each worker thread keeps own connection to the server alive
+    CPLStringList requestOptions = context->m_options.asCPLStringList();
+    requestOptions = http::addAuthHeaders(url, requestOptions);
+    requestOptions.SetNameValue("PERSISTENT",
+                                context->m_sessions.current().c_str());
+
+    // Failed tiles are reported once for the whole area
+    CPLPushErrorHandler(CPLQuietErrorHandler);
+    http::HTTPResultPtr result = CPLHTTPFetch(url.c_str(), requestOptions);
+    CPLPopErrorHandler();
+
+    data->m_code = http::responseCode(result);
+    if(data->m_code == 404 || (data->m_code == 200 && result->nDataLen == 0)) {
+        // No tile on server, the same as GDAL WMS ZeroBlockHttpCodes
+        context->m_missing++;
+        return true;
+    }
+    if(data->m_code != 200) {
+        // Pool requeues the tile, the worker downloads others meanwhile
+        data->setRetryDelay(DOWNLOAD_RETRY_DELAY * (1 << data->tries()));
         return false;
     }
 
-    bool out = File::writeFile(path, result->pabyData,
-                               static_cast<size_t>(result->nDataLen));
-
-    CPLHTTPDestroyResult(result);
+    // Write to temporary file, so the broken download never get to cache
+    std::string tmpPath = path + ".tmp";
+    if(!File::writeFile(tmpPath, result->pabyData,
+                        static_cast<size_t>(result->nDataLen)) ||
+            VSIRename(tmpPath.c_str(), path.c_str()) != 0) {
+        File::deleteFile(tmpPath);
+        return false;
+    }
 
-    return out;
+    context->m_downloaded++;
+    return true;
 }
 
 bool Raster::cacheArea(const Options &options, const Progress &progress)
@@ -601,15 +1026,25 @@ bool Raster::cacheArea(const Options &options, const Progress &progress)
         return false;
     }
 
+    int threadCount = options.asInt("MAX_CONNECTIONS", DOWNLOAD_THREAD_COUNT);
+    threadCount = std::max(1, std::min(threadCount, DOWNLOAD_MAX_THREAD_COUNT));
+    double requestsPerSecond = options.asDouble("MAX_REQUESTS_PER_SECOND", 0.0);
+
     Options loadOptions(options);
     loadOptions.remove("MINX");
     loadOptions.remove("MINY");
     loadOptions.remove("MAXX");
     loadOptions.remove("MAXY");
     loadOptions.remove("ZOOM_LEVELS");
+    loadOptions.remove("MAX_CONNECTIONS");
+    loadOptions.remove("MAX_REQUESTS_PER_SECOND");
 
     // Get cache path
     std::string basePath = fromCString(m_DS->GetMetadataItem("CACHE_PATH"));
+    if(basePath.empty()) {
+        outMessage(COD_UNSUPPORTED, _("Raster cache path is not set"));
+        return false;
+    }
     std::string url = fromCString(m_DS->GetMetadataItem("TMS_URL"));
     const char *strExpires = m_DS->GetMetadataItem("TMS_CACHE_EXPIRES");
     int expires = std::stoi(strExpires == nullptr ? "0" : strExpires);
@@ -619,44 +1054,321 @@ bool Raster::cacheArea(const Options &options, const Progress &progress)
         reverseY = true;
     }
 
+    // State of the same area download is continued
+    AreaDownloadContext context(basePath, url, expires, loadOptions,
+                                requestsPerSecond);
+    std::string areaKey = url + CPLSPrintf("|%f,%f,%f,%f|", minX, minY, maxX,
+                                           maxY);
+    for(auto zoomLevel : zoomLevels) {
+        areaKey += std::to_string(zoomLevel) + ",";
+    }
+    std::string statePath = File::formFileName(basePath, "area_" + md5(areaKey),
+                                               DOWNLOAD_STATE_EXT);
+    if(!context.makeDir(basePath) || !context.openState(statePath)) {
+        return false;
+    }
+
     // Get tiles list
     progress.onProgress(COD_IN_PROCESS, 0.0, _("Start download area..."));
 
-    // Multithreaded thread pool
-    CPLDebug("ngstore", "cache area");
-
-    ThreadPool threadPool;
-    threadPool.init(DOWNLOAD_THREAD_COUNT, cacheAreaJobThreadFunc, 3, true);
-
+    std::vector<Tile> tiles;
     for(auto zoomLevel : zoomLevels) {
         std::vector<TileItem> items =
                 MapTransform::getTilesForExtent(extent, zoomLevel, reverseY,
                                                 true);
-
-        for(auto item : items) {
-            threadPool.addThreadData(new DownloadData(basePath, url, expires,
-                                                      item.tile, loadOptions,
-                                                      true));
+        for(const TileItem &item : items) {
+            Tile tile = item.tile;
+            tile.crossExtent = 0;
+            if(!context.isFinished(tile)) {
+                tiles.push_back(tile);
+            }
         }
     }
+    std::sort(tiles.begin(), tiles.end());
+    tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
 
-    threadPool.waitComplete(progress);
+    CPLDebug("ngstore", "cache area: %d tiles, %d connections",
+             static_cast<int>(tiles.size()), threadCount);
+
+    // Failed tile is retried after other tiles and doesn't stop the area
+    ThreadPool threadPool;
+    threadPool.init(static_cast<unsigned char>(threadCount),
+                    cacheAreaJobThreadFunc, DOWNLOAD_TRIES, false);
+
+    // Add tiles by batches to keep queue small for large areas
+    AreaProgress areaProgress(progress, tiles.size());
+    for(size_t start = 0; start < tiles.size() && !areaProgress.isCanceled();
+        start += DOWNLOAD_BATCH_SIZE) {
+        size_t end = std::min(start + DOWNLOAD_BATCH_SIZE, tiles.size());
+        areaProgress.setBatch(start, end - start);
+        for(size_t i = start; i < end; ++i) {
+            threadPool.addThreadData(new DownloadData(&context, tiles[i], true));
+        }
+        threadPool.waitComplete(areaProgress);
+    }
     threadPool.clearThreadData();
 
-    if(threadPool.isFailed()) {
+    CPLDebug("ngstore", "cache area: downloaded %d, cached %d, missing %d, "
+             "failed %d", static_cast<int>(context.m_downloaded),
+             static_cast<int>(context.m_cached),
+             static_cast<int>(context.m_missing),
+             static_cast<int>(context.m_failed));
+
+    if(areaProgress.isCanceled()) {
+        context.closeState(false);
+        progress.onProgress(COD_CANCELED, 1.0, _("Download area canceled"));
+        return false;
+    }
+
+    if(context.m_failed > 0) {
+        context.closeState(false);
+        outMessage(COD_GET_FAILED,
+                   _("Failed to download %d of %d tiles, last HTTP code %d. "
+                     "Repeat to download the rest tiles."),
+                   static_cast<int>(context.m_failed),
+                   static_cast<int>(tiles.size()),
+                   static_cast<int>(context.m_lastErrorCode));
         progress.onProgress(COD_GET_FAILED, 1.0, _("Download area failed"));
         return false;
     }
+
+    context.closeState(true);
     progress.onProgress(COD_FINISHED, 1.0, _("Finish download area"));
 
     CPLDebug("ngstore", "finish cache area");
     return true;
 }
 
+bool Raster::buildOverviewJobThreadFunc(ThreadData *threadData)
+{
+    auto data = dynamic_cast<OverviewData*>(threadData);
+    if(nullptr == data) {
+        return true;
+    }
+
+    OverviewContext *context = data->m_context;
+    GDALDatasetPtr handle = context->takeReadHandle();
+    if(!handle) {
+        return false;
+    }
+
+    std::vector<double> src, dst;
+    bool result = true;
+    for(int band = 1; band <= handle->GetRasterCount(); ++band) {
+        GDALRasterBand *srcBand = handle->GetRasterBand(band);
+        if(context->m_level > 0) {
+            srcBand = srcBand->GetOverview(context->m_level - 1);
+        }
+        if(nullptr == srcBand) {
+            result = false;
+            break;
+        }
+
+        int srcX = data->m_x * 2;
+        int srcY = data->m_y * 2;
+        int srcWidth = std::min(data->m_width * 2, srcBand->GetXSize() - srcX);
+        int srcHeight = std::min(data->m_height * 2, srcBand->GetYSize() - srcY);
+        if(srcWidth <= 0 || srcHeight <= 0) {
+            continue;
+        }
+        src.resize(static_cast<size_t>(srcWidth * srcHeight));
+        dst.resize(static_cast<size_t>(data->m_width * data->m_height));
+
+        if(srcBand->RasterIO(GF_Read, srcX, srcY, srcWidth, srcHeight,
+                             src.data(), srcWidth, srcHeight, GDT_Float64, 0, 0,
+                             nullptr) != CE_None) {
+            result = errorMessage(CPLGetLastErrorMsg());
+            break;
+        }
+
+        int hasNoData = FALSE;
+        double noData = srcBand->GetNoDataValue(&hasNoData);
+        downsample(src, srcWidth, srcHeight, dst, data->m_width,
+                   data->m_height, context->m_average, hasNoData == TRUE,
+                   noData);
+
+        MutexHolder holder(context->m_writeMutex);
+        GDALRasterBand *dstBand = context->m_dstDS->GetRasterBand(band)->
+                GetOverview(context->m_level);
+        if(nullptr == dstBand ||
+                dstBand->RasterIO(GF_Write, data->m_x, data->m_y,
+                                  data->m_width, data->m_height, dst.data(),
+                                  data->m_width, data->m_height, GDT_Float64,
+                                  0, 0, nullptr) != CE_None) {
+            result = errorMessage(CPLGetLastErrorMsg());
+            break;
+        }
+    }
+
+    context->returnReadHandle(handle);
+    return result;
+}
+
+/**
+ * @brief Raster::buildOverviews Creates internal overviews of GeoTIFF dataset
+ * down to one block size. Each level is filled from previous one by blocks in
+ * parallel.
+ * @param ds Dataset opened for update.
+ * @param path Dataset path to open additional read only handles.
+ * @param blockSize Dataset block size.
+ * @param numThreads Threads count.
+ * @param average Average or nearest resampling.
+ * @param progress Progress with one step per level starting from current step.
+ * @return True on success.
+ */
+bool Raster::buildOverviews(GDALDataset *ds, const std::string &path,
+                            int blockSize, int numThreads, bool average,
+                            Progress &progress)
+{
+    std::vector<int> factors = overviewFactors(ds->GetRasterXSize(),
+                                               ds->GetRasterYSize(), blockSize);
+    if(factors.empty()) {
+        return true;
+    }
+
+    // Create empty overviews and fill them here
+    if(ds->BuildOverviews("NONE", static_cast<int>(factors.size()),
+                          factors.data(), 0, nullptr, nullptr,
+                          nullptr) != CE_None) {
+        return errorMessage(CPLGetLastErrorMsg());
+    }
+    ds->FlushCache();
+
+    unsigned char step = progress.step();
+    for(size_t level = 0; level < factors.size(); ++level) {
+        progress.setStep(static_cast<unsigned char>(step + level));
+        if(!progress.onProgress(COD_IN_PROCESS, 0.0,
+                                _("Build overview %d of %d"),
+                                static_cast<int>(level + 1),
+                                static_cast<int>(factors.size()))) {
+            return false;
+        }
+
+        GDALRasterBand *band = ds->GetRasterBand(1)->GetOverview(
+                    static_cast<int>(level));
+        if(nullptr == band) {
+            return errorMessage(_("Overview %d is not created"),
+                                static_cast<int>(level + 1));
+        }
+
+        OverviewContext context(path, ds, static_cast<int>(level), average);
+        ThreadPool threadPool;
+        threadPool.init(static_cast<unsigned char>(numThreads),
+                        buildOverviewJobThreadFunc, 1, true);
+        for(int y = 0; y < band->GetYSize(); y += blockSize) {
+            for(int x = 0; x < band->GetXSize(); x += blockSize) {
+                threadPool.addThreadData(new OverviewData(&context, x, y,
+                    std::min(blockSize, band->GetXSize() - x),
+                    std::min(blockSize, band->GetYSize() - y), true));
+            }
+        }
+        // The level is the only batch
+        AreaProgress levelProgress(progress, 1);
+        levelProgress.setBatch(0, 1);
+        threadPool.waitComplete(levelProgress);
+        threadPool.clearThreadData();
+
+        if(threadPool.isFailed()) {
+            return false;
+        }
+
+        // Skipped blocks leave the level incomplete, so stop before next one
+        if(levelProgress.isCanceled()) {
+            progress.onProgress(COD_CANCELED, 1.0,
+                                _("Build overviews canceled"));
+            return false;
+        }
+
+        // Next level handles must see written pixels
+        ds->FlushCache();
+    }
+    progress.setStep(static_cast<unsigned char>(step + factors.size() - 1));
+    return true;
+}
+
+std::vector<int> Raster::overviewFactors(int width, int height, int blockSize)
+{
+    std::vector<int> factors;
+    int factor = 2;
+    while((std::max(width, height) + factor / 2 - 1) / (factor / 2) > blockSize) {
+        factors.push_back(factor);
+        factor *= 2;
+    }
+    return factors;
+}
+
+bool Raster::createCloudOptimizedCopy(const std::string &outPath,
+                                      const Options &options,
+                                      const Progress &progress)
+{
+    GDALDriver *driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if(nullptr == driver) {
+        return errorMessage(_("GeoTIFF driver is not available"));
+    }
+
+    int blockSize = options.asInt("BLOCKSIZE", COG_BLOCK_SIZE);
+    int numThreads = std::max(1, std::min(options.asInt("NUM_THREADS",
+                                                        getNumberThreads()),
+                                          255));
+    bool average = !compare(options.asString("RESAMPLING", "AVERAGE"),
+                            "NEAREST");
+
+    Options tiffOptions;
+    tiffOptions.add("TILED", "YES");
+    tiffOptions.add("BLOCKXSIZE", static_cast<long>(blockSize));
+    tiffOptions.add("BLOCKYSIZE", static_cast<long>(blockSize));
+    tiffOptions.add("COMPRESS", options.asString("COMPRESS",
+                                                 COG_DEFAULT_COMPRESS));
+    tiffOptions.add("NUM_THREADS", static_cast<long>(numThreads));
+    tiffOptions.add("BIGTIFF", "IF_SAFER");
+
+    // Steps are copy to tiled GeoTIFF, overview levels and copy to COG layout
+    size_t levels = overviewFactors(width(), height(), blockSize).size();
+    Progress multiProgress(progress);
+    multiProgress.setTotalSteps(static_cast<unsigned char>(levels + 2));
+    multiProgress.setStep(0);
+
+    std::string tmpPath = outPath + ".tmp.tif";
+    GDALDatasetPtr tmpDS = driver->CreateCopy(tmpPath.c_str(), m_DS, FALSE,
+                                              tiffOptions.asCPLStringList(),
+                                              ngsGDALProgress, &multiProgress);
+    if(!tmpDS) {
+        return false;
+    }
+
+    multiProgress.setStep(1);
+    bool result = buildOverviews(tmpDS, tmpPath, blockSize, numThreads,
+                                 average, multiProgress);
+    if(result) {
+        // Overviews after the full resolution image and block offsets first,
+        // so low zoom reads only a few blocks.
+        multiProgress.setStep(static_cast<unsigned char>(levels + 1));
+        tiffOptions.add("COPY_SRC_OVERVIEWS", "YES");
+        GDALDataset *outDS = driver->CreateCopy(outPath.c_str(), tmpDS, FALSE,
+                                                tiffOptions.asCPLStringList(),
+                                                ngsGDALProgress,
+                                                &multiProgress);
+        result = outDS != nullptr;
+        GDALClose(outDS);
+    }
+
+    tmpDS = nullptr;
+    driver->Delete(tmpPath.c_str());
+    return result;
+}
+
 bool Raster::createCopy(const std::string &outPath,
                         const Options &options, const Progress &progress)
 {
     resetError();
+    if(options.asBool("COG", false)) {
+        std::string newPath(outPath);
+        if(!endsWith(newPath, Filter::extension(CAT_RASTER_TIFF))) {
+            newPath += Filter::extension(CAT_RASTER_TIFF);
+        }
+        return createCloudOptimizedCopy(newPath, options, progress);
+    }
+
     enum ngsCatalogObjectType dstType = static_cast<enum ngsCatalogObjectType>(
                 options.asInt("TYPE", 0));
     std::string newPath(outPath);
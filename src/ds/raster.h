@@ -102,13 +102,26 @@ public:
     virtual bool open(unsigned int openFlags = DatasetBase::defaultOpenFlags,
                       const Options &options = Options()) override;
     virtual std::string options(ngsOptionType optionType) const override;
+    virtual void close() override;
 
 protected:
     void setExtent();
+    GDALDatasetPtr takeReadHandle(int &generation);
+    void returnReadHandle(const GDALDatasetPtr &handle, int generation);
+    void resetReadHandles();
+    bool createCloudOptimizedCopy(const std::string &outPath,
+                                  const Options &options,
+                                  const Progress &progress);
 
     // static
 protected:
     static bool cacheAreaJobThreadFunc(ThreadData *threadData);
+    static bool buildOverviewJobThreadFunc(ThreadData *threadData);
+    static bool buildOverviews(GDALDataset *ds, const std::string &path,
+                               int blockSize, int numThreads, bool average,
+                               Progress &progress);
+    static std::vector<int> overviewFactors(int width, int height,
+                                            int blockSize);
 
 protected:
     Envelope m_extent, m_pixelExtent;
@@ -118,6 +131,14 @@ protected:
 private:
     std::vector<std::string> m_siblingFiles;
     Mutex m_dataLock;
+    // Additional read only handles for parallel reading. The m_DS handle is
+    // used for writes and when all handles are busy. Handles taken before
+    // reset are closed on return.
+    std::string m_openPath;
+    std::vector<GDALDatasetPtr> m_readHandles;
+    int m_readHandleCount, m_readHandleGeneration;
+    bool m_readHandlesDirty;
+    Mutex m_readHandlesLock;
 };
 
 using RasterPtr = std::shared_ptr<Raster>;
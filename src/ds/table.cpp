@@ -31,6 +31,8 @@
 namespace ngs {
 
 constexpr const char *FEATURE_SEPARATOR = "#";
+constexpr size_t COPY_BATCH_SIZE = 4096;
+constexpr GIntBig COPY_TRANSACTION_SIZE = 100000;
 
 
 //------------------------------------------------------------------------------
@@ -79,6 +81,125 @@ void FieldMapPtr::matchFields(const std::vector<Field> &src,
     }
 }
 
+//------------------------------------------------------------------------------
+// FeatureBatch
+//------------------------------------------------------------------------------
+
+FeatureBatch::FeatureBatch(OGRFeatureDefn *definition) :
+    m_hasGeometry(definition->GetGeomFieldCount() > 0),
+    m_size(0)
+{
+    m_columns.resize(static_cast<size_t>(definition->GetFieldCount()));
+    for(int i = 0; i < definition->GetFieldCount(); ++i) {
+        m_columns[static_cast<size_t>(i)].type =
+                definition->GetFieldDefn(i)->GetType();
+    }
+}
+
+void FeatureBatch::reserve(size_t size)
+{
+    for(Column &column : m_columns) {
+        column.states.reserve(size);
+        switch(column.type) {
+        case OFTInteger:
+        case OFTInteger64:
+            column.integers.reserve(size);
+            break;
+        case OFTReal:
+            column.reals.reserve(size);
+            break;
+        default:
+            column.strings.reserve(size);
+            break;
+        }
+    }
+    if(m_hasGeometry) {
+        m_geometries.reserve(size);
+    }
+}
+
+void FeatureBatch::clear()
+{
+    for(Column &column : m_columns) {
+        column.states.clear();
+        column.integers.clear();
+        column.reals.clear();
+        column.strings.clear();
+    }
+    m_geometries.clear();
+    m_size = 0;
+}
+
+void FeatureBatch::addFeature(const FeaturePtr &feature, const int *fieldMap)
+{
+    // All columns get a value, unset by default
+    for(Column &column : m_columns) {
+        column.states.push_back(State::UNSET);
+        switch(column.type) {
+        case OFTInteger:
+        case OFTInteger64:
+            column.integers.push_back(0);
+            break;
+        case OFTReal:
+            column.reals.push_back(0.0);
+            break;
+        default:
+            column.strings.emplace_back();
+            break;
+        }
+    }
+
+    int columnCount = static_cast<int>(m_columns.size());
+    for(int i = 0; i < feature->GetFieldCount(); ++i) {
+        int dstIndex = nullptr == fieldMap ? i : fieldMap[i];
+        if(dstIndex < 0 || dstIndex >= columnCount) {
+            continue;
+        }
+        Column &column = m_columns[static_cast<size_t>(dstIndex)];
+        if(!feature->IsFieldSet(i)) {
+            continue;
+        }
+        if(feature->IsFieldNull(i)) {
+            column.states.back() = State::NUL;
+            continue;
+        }
+
+        column.states.back() = State::SET;
+        switch(column.type) {
+        case OFTInteger:
+        case OFTInteger64:
+            column.integers.back() = feature->GetFieldAsInteger64(i);
+            break;
+        case OFTReal:
+            column.reals.back() = feature->GetFieldAsDouble(i);
+            break;
+        case OFTBinary:
+        {
+            int size = 0;
+            GByte *data = feature->GetFieldAsBinary(i, &size);
+            column.strings.back().assign(reinterpret_cast<const char*>(data),
+                                         static_cast<size_t>(size));
+        }
+            break;
+        default:
+            column.strings.back() = feature->GetFieldAsString(i);
+            break;
+        }
+    }
+
+    if(m_hasGeometry) {
+        m_geometries.emplace_back();
+        OGRGeometry *geom = feature->GetGeometryRef();
+        if(nullptr != geom) {
+            std::string &wkb = m_geometries.back();
+            wkb.resize(static_cast<size_t>(geom->WkbSize()));
+            geom->exportToWkb(wkbNDR, reinterpret_cast<unsigned char*>(&wkb[0]),
+                              wkbVariantIso);
+        }
+    }
+    m_size++;
+}
+
 //------------------------------------------------------------------------------
 // FeaturePtr
 //------------------------------------------------------------------------------
@@ -165,6 +286,79 @@ std::string FeaturePtr::dump(FeaturePtr::DumpOutputType type) const
     }
 }
 
+/**
+ * @brief FeaturePtr::hash Feature hash with the same content as HASH_STYLE dump.
+ * The FAST hash is computed over WKB geometry and binary field values without
+ * formatting them to strings.
+ * @param type Hash function type.
+ * @return Hash hex string.
+ */
+std::string FeaturePtr::hash(enum HashType type) const
+{
+    if(type == HashType::MD5) {
+        return dump(DumpOutputType::HASH_STYLE);
+    }
+
+    std::string out;
+    OGRFeature *feature = get();
+    if(nullptr != feature) {
+        OGRGeometry *geom = feature->GetGeometryRef();
+        if(nullptr != geom) {
+            out.resize(static_cast<size_t>(geom->WkbSize()));
+            geom->exportToWkb(wkbNDR, reinterpret_cast<unsigned char*>(&out[0]),
+                              wkbVariantIso);
+        }
+
+        int styleFieldId = feature->GetFieldIndex("ogr_style");
+        for(int i = 0; i < feature->GetFieldCount(); ++i) {
+            if(i == styleFieldId) {
+                continue;
+            }
+            if(!feature->IsFieldSetAndNotNull(i)) {
+                out += '\0';
+                continue;
+            }
+
+            out += '\1';
+            const OGRField *field = feature->GetRawFieldRef(i);
+            switch(feature->GetFieldDefnRef(i)->GetType()) {
+            case OFTInteger:
+                out.append(reinterpret_cast<const char*>(&field->Integer),
+                           sizeof(field->Integer));
+                break;
+            case OFTInteger64:
+                out.append(reinterpret_cast<const char*>(&field->Integer64),
+                           sizeof(field->Integer64));
+                break;
+            case OFTReal:
+                out.append(reinterpret_cast<const char*>(&field->Real),
+                           sizeof(field->Real));
+                break;
+            case OFTString:
+                out.append(field->String);
+                out += '\0';
+                break;
+            case OFTBinary:
+                out.append(reinterpret_cast<const char*>(&field->Binary.nCount),
+                           sizeof(field->Binary.nCount));
+                out.append(reinterpret_cast<const char*>(field->Binary.paData),
+                           static_cast<size_t>(field->Binary.nCount));
+                break;
+            default:
+                out.append(feature->GetFieldAsString(i));
+                out += '\0';
+                break;
+            }
+        }
+
+        const char *style = feature->GetStyleString();
+        if(style) {
+            out.append(style);
+        }
+    }
+    return fastHash(out);
+}
+
 GIntBig FeaturePtr::addAttachment(const std::string &fileName,
                                   const std::string &description,
                                   const std::string &filePath,
@@ -319,6 +513,168 @@ bool Table::insertFeature(const FeaturePtr &feature, bool logEdits)
     return errorMessage(_("Failed to insert feature. %s"), CPLGetLastErrorMsg());
 }
 
+/**
+ * @brief Table::insertFeatures Inserts batch of rows. Rows are inserted with
+ * one reused feature inside explicit transactions. Per row notifications and
+ * hooks are replaced with one table change notification and one
+ * onFeaturesInserted hook.
+ * @param batch Rows to insert.
+ * @param fids Output inserted rows identifiers. Failed rows get NOT_FOUND.
+ * @param transactionSize Rows count to commit. If dataset does not support
+ * transactions rows are inserted without them.
+ * @param logEdits Log edit operations if edit history is enabled.
+ * @param features Optional output inserted features. Failed rows get empty
+ * feature.
+ * @param transactionCounter Optional rows count in the open transaction. If
+ * set, the last transaction is kept open to continue it in the next call, and
+ * it must be finished with commitTransaction.
+ * @return true if all rows inserted.
+ */
+bool Table::insertFeatures(const FeatureBatch &batch, std::vector<GIntBig> &fids,
+                           GIntBig transactionSize, bool logEdits,
+                           std::vector<FeaturePtr> *features,
+                           GIntBig *transactionCounter)
+{
+    if(nullptr == m_layer) {
+        return false;
+    }
+
+    resetError();
+    fids.clear();
+    if(batch.empty()) {
+        return true;
+    }
+    fids.reserve(batch.size());
+    if(nullptr != features) {
+        features->clear();
+        features->reserve(batch.size());
+    }
+
+    Dataset * const dataset = dynamic_cast<Dataset*>(m_parent);
+    bool logEditOperations = logEdits && saveEditHistory();
+
+    // Lock all Dataset SQL queries here
+    DatasetExecuteSQLLockHolder holder(dataset);
+    FeaturePtr feature = createFeature();
+    const auto &columns = batch.columns();
+    GIntBig counter = nullptr == transactionCounter ? 0 : *transactionCounter;
+    bool transaction = counter > 0;
+    std::vector<OGREnvelope> envelopes;
+    if(batch.hasGeometry()) {
+        envelopes.resize(batch.size());
+    }
+    bool result = true;
+    for(size_t row = 0; row < batch.size(); ++row) {
+        if(!transaction) {
+            transaction = m_layer->StartTransaction() == OGRERR_NONE;
+        }
+        // Failed rows are counted too, so counter is set while transaction is open
+        if(transaction) {
+            counter++;
+        }
+
+        feature->SetFID(OGRNullFID);
+        for(size_t i = 0; i < columns.size(); ++i) {
+            const FeatureBatch::Column &column = columns[i];
+            int index = static_cast<int>(i);
+            switch(column.states[row]) {
+            case FeatureBatch::State::UNSET:
+                feature->UnsetField(index);
+                continue;
+            case FeatureBatch::State::NUL:
+                feature->SetFieldNull(index);
+                continue;
+            case FeatureBatch::State::SET:
+                break;
+            }
+
+            switch(column.type) {
+            case OFTInteger:
+            case OFTInteger64:
+                feature->SetField(index, column.integers[row]);
+                break;
+            case OFTReal:
+                feature->SetField(index, column.reals[row]);
+                break;
+            case OFTBinary:
+                feature->SetField(index,
+                                  static_cast<int>(column.strings[row].size()),
+                                  column.strings[row].data());
+                break;
+            default:
+                feature->SetField(index, column.strings[row].c_str());
+                break;
+            }
+        }
+
+        if(batch.hasGeometry()) {
+            const std::string &wkb = batch.geometries()[row];
+            OGRGeometry *geom = nullptr;
+            if(!wkb.empty()) {
+                OGRGeometryFactory::createFromWkb(wkb.data(), nullptr, &geom,
+                                                  static_cast<int>(wkb.size()));
+            }
+            if(nullptr != geom && !geom->IsEmpty()) {
+                geom->getEnvelope(&envelopes[row]);
+            }
+            feature->SetGeometryDirectly(geom);
+        }
+
+        if(m_layer->CreateFeature(feature) != OGRERR_NONE) {
+            errorMessage(_("Failed to insert feature. %s"), CPLGetLastErrorMsg());
+            fids.push_back(NOT_FOUND);
+            if(nullptr != features) {
+                features->emplace_back();
+            }
+            result = false;
+        }
+        else {
+            fids.push_back(feature->GetFID());
+            if(nullptr != features) {
+                features->emplace_back(feature->Clone(), this);
+            }
+            if(logEditOperations) {
+                FeaturePtr opFeature = logEditFeature(feature, FeaturePtr(),
+                                                      CC_CREATE_FEATURE);
+                logEditOperation(opFeature);
+            }
+        }
+
+        if(transaction && counter >= transactionSize) {
+            m_layer->CommitTransaction();
+            transaction = false;
+            counter = 0;
+        }
+    }
+
+    if(nullptr != transactionCounter) {
+        *transactionCounter = counter;
+    }
+    else if(transaction) {
+        m_layer->CommitTransaction();
+    }
+
+    if(dataset && !dataset->isBatchOperation()) {
+        Notify::instance().onNotify(fullName(), ngsChangeCode::CC_CHANGE_OBJECT);
+    }
+    onFeaturesInserted(batch, fids, envelopes);
+    return result;
+}
+
+/**
+ * @brief Table::commitTransaction Commits transaction kept open by
+ * insertFeatures.
+ * @param transactionCounter Rows count in the open transaction. Set to 0.
+ */
+void Table::commitTransaction(GIntBig &transactionCounter)
+{
+    if(nullptr != m_layer && transactionCounter > 0) {
+        DatasetExecuteSQLLockHolder holder(dynamic_cast<Dataset*>(m_parent));
+        m_layer->CommitTransaction();
+    }
+    transactionCounter = 0;
+}
+
 bool Table::updateFeature(const FeaturePtr &feature, bool logEdits)
 {
     if(nullptr == m_layer) {
@@ -451,30 +807,65 @@ int Table::copyRows(const TablePtr srcTable, const FieldMapPtr fieldMap,
     // Lock any SQL query in dataset
     DatasetBatchOperationHolder holder(dynamic_cast<Dataset*>(m_parent));
 
-    GIntBig featureCount = srcTable->featureCount();
+    GIntBig transactionSize = options.asLong("TRANSACTION_SIZE",
+                                             COPY_TRANSACTION_SIZE);
+    double total = static_cast<double>(srcTable->featureCount());
+    if(total <= 0.0) {
+        total = 1.0;
+    }
     double counter = 0;
+    FeatureBatch batch(definition());
+    batch.reserve(COPY_BATCH_SIZE);
+    std::vector<FeaturePtr> srcFeatures;
+    srcFeatures.reserve(COPY_BATCH_SIZE);
+    std::vector<GIntBig> fids;
+    // Inserted rows are cloned only if onRowCopied needs them
+    bool rowCopiedHandled = isRowCopiedHandled(options);
+    std::vector<FeaturePtr> dstFeatures;
+    // Transaction is kept open between batches up to transaction size
+    GIntBig transactionCounter = 0;
+    bool readComplete = false;
     srcTable->reset();
-    FeaturePtr feature;
-    while((feature = srcTable->nextFeature())) {
-        double complete = counter / featureCount;
-        if(!progress.onProgress(COD_IN_PROCESS, complete,
-                                _("Copy in process ..."))) {
-            return  COD_CANCELED;
+    while(!readComplete) {
+        FeaturePtr feature;
+        while(srcFeatures.size() < COPY_BATCH_SIZE &&
+              (feature = srcTable->nextFeature())) {
+            batch.addFeature(feature, fieldMap.get());
+            srcFeatures.emplace_back(feature);
+        }
+        readComplete = srcFeatures.size() < COPY_BATCH_SIZE;
+        if(srcFeatures.empty()) {
+            break;
         }
 
-        FeaturePtr dstFeature = createFeature();
-        dstFeature->SetFieldsFrom(feature, fieldMap.get());
-
-        if(!insertFeature(dstFeature, false)) {
-            if(!progress.onProgress(COD_WARNING, complete,
-                               _("Create feature failed. Source feature FID:" CPL_FRMT_GIB),
-                               feature->GetFID ())) {
-               return  COD_CANCELED;
+        insertFeatures(batch, fids, transactionSize, false,
+                       rowCopiedHandled ? &dstFeatures : nullptr,
+                       &transactionCounter);
+        for(size_t i = 0; i < srcFeatures.size(); ++i) {
+            if(fids[i] == NOT_FOUND) {
+                if(!progress.onProgress(COD_WARNING, (counter + i) / total,
+                                   _("Create feature failed. Source feature FID:" CPL_FRMT_GIB),
+                                   srcFeatures[i]->GetFID())) {
+                   commitTransaction(transactionCounter);
+                   return  COD_CANCELED;
+                }
+                continue;
+            }
+            if(rowCopiedHandled) {
+                onRowCopied(srcFeatures[i], dstFeatures[i], options);
             }
         }
-        onRowCopied(feature, dstFeature, options);
-        counter++;
+
+        counter += srcFeatures.size();
+        batch.clear();
+        srcFeatures.clear();
+        if(!progress.onProgress(COD_IN_PROCESS, counter / total,
+                                _("Copy in process ..."))) {
+            commitTransaction(transactionCounter);
+            return  COD_CANCELED;
+        }
     }
+    commitTransaction(transactionCounter);
 
     progress.onProgress(COD_FINISHED, 1.0, _("Done. Copied %d rows"),
                        int(counter));
@@ -869,6 +1260,15 @@ void Table::onFeatureInserted(FeaturePtr feature)
     feature.setTable(this);
 }
 
+void Table::onFeaturesInserted(const FeatureBatch &batch,
+                               const std::vector<GIntBig> &fids,
+                               const std::vector<OGREnvelope> &envelopes)
+{
+    ngsUnused(batch);
+    ngsUnused(fids);
+    ngsUnused(envelopes);
+}
+
 void Table::onFeatureUpdated(FeaturePtr oldFeature, FeaturePtr newFeature)
 {
     ngsUnused(oldFeature);
@@ -885,6 +1285,17 @@ void Table::onFeaturesDeleted()
 
 }
 
+/**
+ * @brief Table::isRowCopiedHandled Returns true if onRowCopied does anything
+ * with these copy options. Otherwise copyRows does not clone inserted rows and
+ * skips the hook.
+ */
+bool Table::isRowCopiedHandled(const Options &options) const
+{
+    ngsUnused(options);
+    return false;
+}
+
 void Table::onRowCopied(FeaturePtr srcFeature, FeaturePtr dstFature,
                         const Options &options)
 {
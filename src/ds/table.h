@@ -72,6 +72,11 @@ public:
         SIMPLE
     };
 
+    enum class HashType {
+        MD5,    /**< md5 of HASH_STYLE dump. Compatible with old hashes */
+        FAST    /**< 128-bit non-cryptographic hash of binary data */
+    };
+
     /**
      * Attachment info struct
      */
@@ -89,6 +94,7 @@ public:
     FeaturePtr &operator=(OGRFeature *feature);
     operator OGRFeature*() const;
     std::string dump(enum DumpOutputType type = DumpOutputType::HASH) const;
+    std::string hash(enum HashType type = HashType::FAST) const;
     GIntBig addAttachment(const std::string &fileName,
                           const std::string &description,
                           const std::string &filePath,
@@ -112,6 +118,59 @@ protected:
 
 using TablePtr = std::shared_ptr<Table>;
 
+/**
+ * @brief The FeatureBatch class Columnar batch of rows for Table::insertFeatures.
+ * There is one column per destination table field. Integer, real and binary
+ * values are stored as is. Other field types are stored as strings. Geometry
+ * is stored as ISO WKB and is kept only if the table has a geometry field.
+ */
+class FeatureBatch
+{
+public:
+    enum class State : char {
+        SET,
+        UNSET,
+        NUL
+    };
+
+    typedef struct _column {
+        OGRFieldType type;
+        std::vector<State> states;
+        std::vector<GIntBig> integers;
+        std::vector<double> reals;
+        std::vector<std::string> strings;
+    } Column;
+
+public:
+    explicit FeatureBatch(OGRFeatureDefn *definition);
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    void reserve(size_t size);
+    void clear();
+    /**
+     * @brief addFeature Appends feature values to columns.
+     * @param feature Source feature.
+     * @param fieldMap Destination field index for each source field or -1 to
+     * skip the field. If null, fields are copied by index.
+     */
+    void addFeature(const FeaturePtr &feature, const int *fieldMap = nullptr);
+    const std::vector<Column> &columns() const { return m_columns; }
+    std::vector<Column> &columns() { return m_columns; }
+    const std::vector<std::string> &geometries() const { return m_geometries; }
+    std::vector<std::string> &geometries() { return m_geometries; }
+    bool hasGeometry() const { return m_hasGeometry; }
+    /**
+     * @brief setSize Sets rows count after columns filled directly.
+     */
+    void setSize(size_t size) { m_size = size; }
+
+protected:
+    std::vector<Column> m_columns;
+    std::vector<std::string> m_geometries;
+    bool m_hasGeometry;
+    size_t m_size;
+};
+
 /**
  * Table class
  */
@@ -132,6 +191,13 @@ public:
     virtual bool updateFeature(const FeaturePtr &feature, bool logEdits = true);
     virtual bool deleteFeature(GIntBig id, bool logEdits = true);
     virtual bool deleteFeatures(bool logEdits = true);
+    virtual bool insertFeatures(const FeatureBatch &batch,
+                                std::vector<GIntBig> &fids,
+                                GIntBig transactionSize = 100000,
+                                bool logEdits = true,
+                                std::vector<FeaturePtr> *features = nullptr,
+                                GIntBig *transactionCounter = nullptr);
+    void commitTransaction(GIntBig &transactionCounter);
     GIntBig featureCount(bool force = false) const;
     void reset() const;
     void setAttributeFilter(const std::string &filter = "");
@@ -201,9 +267,13 @@ protected:
     virtual std::string storeName() const;
     // Events
     virtual void onFeatureInserted(FeaturePtr feature);
+    virtual void onFeaturesInserted(const FeatureBatch &batch,
+                                    const std::vector<GIntBig> &fids,
+                                    const std::vector<OGREnvelope> &envelopes);
     virtual void onFeatureUpdated(FeaturePtr oldFeature, FeaturePtr newFeature);
     virtual void onFeatureDeleted(FeaturePtr delFeature);
     virtual void onFeaturesDeleted();
+    virtual bool isRowCopiedHandled(const Options &options) const;
     virtual void onRowCopied(FeaturePtr srcFeature, FeaturePtr dstFature,
                              const Options &options = Options());
     virtual bool onRowsCopied(const TablePtr srcTable, const Progress &progress,
@@ -0,0 +1,363 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "canvas.h"
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// gdal
+#include "gdal_priv.h"
+
+#include "util/error.h"
+
+namespace ngs {
+
+constexpr int MIN_CIRCLE_SEGMENTS = 8;
+constexpr int MAX_CIRCLE_SEGMENTS = 64;
+constexpr double MITER_LIMIT = 0.25; // Cosine of half angle, as 4 line widths
+constexpr double MIN_HALF_WIDTH = 0.5;
+
+static double edgeX(const CanvasPoint &pt1, const CanvasPoint &pt2, double y)
+{
+    return pt1.x + (y - pt1.y) * (pt2.x - pt1.x) / (pt2.y - pt1.y);
+}
+
+static CanvasPoint unitNormal(const CanvasPoint &pt1, const CanvasPoint &pt2)
+{
+    double dx = pt2.x - pt1.x;
+    double dy = pt2.y - pt1.y;
+    double length = std::sqrt(dx * dx + dy * dy);
+    if(length == 0.0) {
+        return {0.0, 0.0};
+    }
+    return {-dy / length, dx / length};
+}
+
+Canvas::Canvas(int width, int height) :
+    m_width(width),
+    m_height(height),
+    m_data(static_cast<size_t>(width * height * 4), 0)
+{
+    resetClip();
+}
+
+void Canvas::clear(const ngsRGBA &color)
+{
+    GByte *pixel = m_data.data();
+    GByte *end = pixel + m_data.size();
+    while(pixel < end) {
+        pixel[0] = color.R;
+        pixel[1] = color.G;
+        pixel[2] = color.B;
+        pixel[3] = color.A;
+        pixel += 4;
+    }
+}
+
+void Canvas::setClip(int minX, int minY, int maxX, int maxY)
+{
+    m_clipMinX = std::max(minX, 0);
+    m_clipMinY = std::max(minY, 0);
+    m_clipMaxX = std::min(maxX, m_width);
+    m_clipMaxY = std::min(maxY, m_height);
+}
+
+void Canvas::resetClip()
+{
+    m_clipMinX = 0;
+    m_clipMinY = 0;
+    m_clipMaxX = m_width;
+    m_clipMaxY = m_height;
+}
+
+void Canvas::fillSpan(int y, int minX, int maxX, const ngsRGBA &color)
+{
+    minX = std::max(minX, m_clipMinX);
+    maxX = std::min(maxX, m_clipMaxX);
+    if(minX >= maxX || color.A == 0) {
+        return;
+    }
+
+    GByte *pixel = &m_data[static_cast<size_t>((y * m_width + minX) * 4)];
+    int count = maxX - minX;
+    if(color.A == 255) {
+        for(int i = 0; i < count; ++i, pixel += 4) {
+            pixel[0] = color.R;
+            pixel[1] = color.G;
+            pixel[2] = color.B;
+            pixel[3] = 255;
+        }
+        return;
+    }
+
+    // Source over for not premultiplied colors
+    const int alpha = color.A;
+    const int invAlpha = 255 - alpha;
+    for(int i = 0; i < count; ++i, pixel += 4) {
+        int dstAlpha = pixel[3] * invAlpha / 255;
+        int outAlpha = alpha + dstAlpha;
+        pixel[0] = static_cast<GByte>((color.R * alpha + pixel[0] * dstAlpha) / outAlpha);
+        pixel[1] = static_cast<GByte>((color.G * alpha + pixel[1] * dstAlpha) / outAlpha);
+        pixel[2] = static_cast<GByte>((color.B * alpha + pixel[2] * dstAlpha) / outAlpha);
+        pixel[3] = static_cast<GByte>(outAlpha);
+    }
+}
+
+void Canvas::fillTriangle(const CanvasPoint &pt1, const CanvasPoint &pt2,
+                          const CanvasPoint &pt3, const ngsRGBA &color)
+{
+    // Sort by y
+    const CanvasPoint *top = &pt1;
+    const CanvasPoint *middle = &pt2;
+    const CanvasPoint *bottom = &pt3;
+    if(middle->y < top->y) {
+        std::swap(top, middle);
+    }
+    if(bottom->y < middle->y) {
+        std::swap(middle, bottom);
+    }
+    if(middle->y < top->y) {
+        std::swap(top, middle);
+    }
+
+    // Rows which pixel centers are inside [top, bottom)
+    int beginY = std::max(static_cast<int>(std::ceil(top->y - 0.5)),
+                          m_clipMinY);
+    int endY = std::min(static_cast<int>(std::ceil(bottom->y - 0.5)),
+                        m_clipMaxY);
+    for(int y = beginY; y < endY; ++y) {
+        double centerY = y + 0.5;
+        double x1 = edgeX(*top, *bottom, centerY);
+        double x2 = centerY < middle->y ? edgeX(*top, *middle, centerY) :
+                                          edgeX(*middle, *bottom, centerY);
+        if(x1 > x2) {
+            std::swap(x1, x2);
+        }
+        fillSpan(y, static_cast<int>(std::ceil(x1 - 0.5)),
+                 static_cast<int>(std::ceil(x2 - 0.5)), color);
+    }
+}
+
+void Canvas::fillConvex(const std::vector<CanvasPoint> &points,
+                        const ngsRGBA &color)
+{
+    for(size_t i = 2; i < points.size(); ++i) {
+        fillTriangle(points[0], points[i - 1], points[i], color);
+    }
+}
+
+void Canvas::fillCircle(const CanvasPoint &center, double radius,
+                        const ngsRGBA &color)
+{
+    int segments = std::min(std::max(static_cast<int>(radius * 2.0),
+                                     MIN_CIRCLE_SEGMENTS), MAX_CIRCLE_SEGMENTS);
+    std::vector<CanvasPoint> points;
+    points.reserve(static_cast<size_t>(segments));
+    double step = M_PI * 2.0 / segments;
+    for(int i = 0; i < segments; ++i) {
+        points.push_back({center.x + radius * std::cos(step * i),
+                          center.y + radius * std::sin(step * i)});
+    }
+    fillConvex(points, color);
+}
+
+void Canvas::fillSegment(const CanvasPoint &pt1, const CanvasPoint &pt2,
+                         double halfWidth, double beginExtend, double endExtend,
+                         const ngsRGBA &color)
+{
+    CanvasPoint normal = unitNormal(pt1, pt2);
+    // Direction is normal rotated back by 90 degrees
+    CanvasPoint dir = {normal.y, -normal.x};
+    CanvasPoint begin = {pt1.x - dir.x * beginExtend, pt1.y - dir.y * beginExtend};
+    CanvasPoint end = {pt2.x + dir.x * endExtend, pt2.y + dir.y * endExtend};
+    double nx = normal.x * halfWidth;
+    double ny = normal.y * halfWidth;
+    fillConvex({{begin.x + nx, begin.y + ny}, {end.x + nx, end.y + ny},
+                {end.x - nx, end.y - ny}, {begin.x - nx, begin.y - ny}}, color);
+}
+
+void Canvas::fillJoin(const CanvasPoint &pt, const CanvasPoint &prevNormal,
+                      const CanvasPoint &normal, double halfWidth,
+                      enum CpuJoinType join, const ngsRGBA &color)
+{
+    if(join == CpuJoinType::Round) {
+        fillCircle(pt, halfWidth, color);
+        return;
+    }
+
+    // Fill only outer side of the turn, inner side is covered by segments
+    double turn = prevNormal.x * normal.y - prevNormal.y * normal.x;
+    if(turn == 0.0) {
+        return;
+    }
+    double side = turn < 0.0 ? halfWidth : -halfWidth;
+    CanvasPoint pt1 = {pt.x + prevNormal.x * side, pt.y + prevNormal.y * side};
+    CanvasPoint pt2 = {pt.x + normal.x * side, pt.y + normal.y * side};
+
+    if(join == CpuJoinType::Miter) {
+        double mx = prevNormal.x + normal.x;
+        double my = prevNormal.y + normal.y;
+        double length = std::sqrt(mx * mx + my * my);
+        if(length > 0.0) {
+            mx /= length;
+            my /= length;
+            double cosHalf = mx * prevNormal.x + my * prevNormal.y;
+            if(cosHalf > MITER_LIMIT) {
+                double miter = side / cosHalf;
+                fillConvex({pt, pt1, {pt.x + mx * miter, pt.y + my * miter},
+                            pt2}, color);
+                return;
+            }
+        }
+    }
+    fillTriangle(pt, pt1, pt2, color);
+}
+
+void Canvas::drawLine(const std::vector<CanvasPoint> &points, double width,
+                      enum CpuCapType cap, enum CpuJoinType join, bool closed,
+                      const ngsRGBA &color)
+{
+    if(points.size() < 2) {
+        return;
+    }
+
+    double halfWidth = std::max(width * 0.5, MIN_HALF_WIDTH);
+    double capExtend = cap == CpuCapType::Square ? halfWidth : 0.0;
+    size_t last = points.size() - 1;
+    CanvasPoint prevNormal = {0.0, 0.0};
+    CanvasPoint firstNormal = {0.0, 0.0};
+    bool hasPrev = false;
+    for(size_t i = 0; i < last; ++i) {
+        const CanvasPoint &pt1 = points[i];
+        const CanvasPoint &pt2 = points[i + 1];
+        CanvasPoint normal = unitNormal(pt1, pt2);
+        if(normal.x == 0.0 && normal.y == 0.0) {
+            continue; // Skip zero length segment
+        }
+
+        if(hasPrev) {
+            fillJoin(pt1, prevNormal, normal, halfWidth, join, color);
+        }
+        else {
+            firstNormal = normal;
+        }
+
+        fillSegment(pt1, pt2, halfWidth,
+                    !closed && i == 0 ? capExtend : 0.0,
+                    !closed && i + 1 == last ? capExtend : 0.0, color);
+        prevNormal = normal;
+        hasPrev = true;
+    }
+
+    if(!hasPrev) {
+        return;
+    }
+
+    if(closed) {
+        fillJoin(points[last], prevNormal, firstNormal, halfWidth, join, color);
+    }
+    else if(cap == CpuCapType::Round) {
+        fillCircle(points[0], halfWidth, color);
+        fillCircle(points[last], halfWidth, color);
+    }
+}
+
+void Canvas::drawImage(const GByte *data, int x, int y, int width, int height)
+{
+    int beginX = std::max(x, m_clipMinX);
+    int endX = std::min(x + width, m_clipMaxX);
+    int beginY = std::max(y, m_clipMinY);
+    int endY = std::min(y + height, m_clipMaxY);
+    for(int row = beginY; row < endY; ++row) {
+        const GByte *src = data + ((row - y) * width + (beginX - x)) * 4;
+        for(int column = beginX; column < endX; ++column, src += 4) {
+            ngsRGBA color = {src[0], src[1], src[2], src[3]};
+            fillSpan(row, column, column + 1, color);
+        }
+    }
+}
+
+void Canvas::copy(const Canvas &other, int x, int y)
+{
+    int beginX = std::max(x, 0);
+    int endX = std::min(x + other.m_width, m_width);
+    if(beginX >= endX) {
+        return;
+    }
+    size_t rowSize = static_cast<size_t>((endX - beginX) * 4);
+    int beginY = std::max(y, 0);
+    int endY = std::min(y + other.m_height, m_height);
+    for(int row = beginY; row < endY; ++row) {
+        std::memcpy(&m_data[static_cast<size_t>((row * m_width + beginX) * 4)],
+                    &other.m_data[static_cast<size_t>(
+                        ((row - y) * other.m_width + beginX - x) * 4)],
+                    rowSize);
+    }
+}
+
+GByte *Canvas::toPng(int &size) const
+{
+    size = 0;
+    GDALDriver *memDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+    GDALDriver *pngDriver = GetGDALDriverManager()->GetDriverByName("PNG");
+    if(nullptr == memDriver || nullptr == pngDriver) {
+        errorMessage(_("PNG driver is not available"));
+        return nullptr;
+    }
+
+    GDALDataset *memDS = memDriver->Create("", m_width, m_height, 4, GDT_Byte,
+                                           nullptr);
+    if(nullptr == memDS) {
+        errorMessage(CPLGetLastErrorMsg());
+        return nullptr;
+    }
+
+    int bands[4] = {1, 2, 3, 4};
+    if(memDS->RasterIO(GF_Write, 0, 0, m_width, m_height,
+                       const_cast<GByte*>(m_data.data()), m_width, m_height,
+                       GDT_Byte, 4, bands, 4, m_width * 4, 1) != CE_None) {
+        errorMessage(CPLGetLastErrorMsg());
+        GDALClose(memDS);
+        return nullptr;
+    }
+
+    CPLString path = CPLSPrintf("/vsimem/canvas_%p.png",
+                                static_cast<const void*>(this));
+    GDALDataset *pngDS = pngDriver->CreateCopy(path, memDS, FALSE, nullptr,
+                                               nullptr, nullptr);
+    GDALClose(memDS);
+    if(nullptr == pngDS) {
+        errorMessage(CPLGetLastErrorMsg());
+        VSIUnlink(path);
+        return nullptr;
+    }
+    GDALClose(pngDS);
+
+    vsi_l_offset length = 0;
+    GByte *out = VSIGetMemFileBuffer(path, &length, TRUE);
+    VSIUnlink(path);
+    size = static_cast<int>(length);
+    return out;
+}
+
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSCPUCANVAS_H
+#define NGSCPUCANVAS_H
+
+// stl
+#include <vector>
+
+// gdal
+#include "cpl_port.h"
+
+#include "style.h"
+
+namespace ngs {
+
+/**
+ * @brief Point in canvas pixels. Origin is top left corner.
+ */
+typedef struct _canvasPoint {
+    double x, y;
+} CanvasPoint;
+
+/**
+ * @brief The Canvas class RGBA image with scanline rasterizer. Pixel is
+ * covered if its center is inside the shape, so triangles with common edge
+ * never draw the same pixel twice. Colors are blended with source over
+ * operator. No antialiasing as in GL view without multisampling.
+ */
+class Canvas
+{
+public:
+    explicit Canvas(int width = 0, int height = 0);
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    GByte *data() { return m_data.data(); }
+    const GByte *data() const { return m_data.data(); }
+    void clear(const ngsRGBA &color);
+    void setClip(int minX, int minY, int maxX, int maxY);
+    void resetClip();
+
+    void fillTriangle(const CanvasPoint &pt1, const CanvasPoint &pt2,
+                      const CanvasPoint &pt3, const ngsRGBA &color);
+    void fillConvex(const std::vector<CanvasPoint> &points,
+                    const ngsRGBA &color);
+    void fillCircle(const CanvasPoint &center, double radius,
+                    const ngsRGBA &color);
+    void drawLine(const std::vector<CanvasPoint> &points, double width,
+                  enum CpuCapType cap, enum CpuJoinType join, bool closed,
+                  const ngsRGBA &color);
+    void drawImage(const GByte *data, int x, int y, int width, int height);
+    void copy(const Canvas &other, int x, int y);
+
+    /**
+     * @brief toPng Encodes canvas to PNG.
+     * @param size Output buffer size.
+     * @return Buffer allocated with CPLMalloc or nullptr. Caller must free it.
+     */
+    GByte *toPng(int &size) const;
+
+protected:
+    void fillSpan(int y, int minX, int maxX, const ngsRGBA &color);
+    void fillSegment(const CanvasPoint &pt1, const CanvasPoint &pt2,
+                     double halfWidth, double beginExtend, double endExtend,
+                     const ngsRGBA &color);
+    void fillJoin(const CanvasPoint &pt, const CanvasPoint &prevNormal,
+                  const CanvasPoint &normal, double halfWidth,
+                  enum CpuJoinType join, const ngsRGBA &color);
+
+private:
+    int m_width, m_height;
+    std::vector<GByte> m_data;
+    int m_clipMinX, m_clipMinY, m_clipMaxX, m_clipMaxY;
+};
+
+}
+
+#endif // NGSCPUCANVAS_H
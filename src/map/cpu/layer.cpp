@@ -0,0 +1,572 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "layer.h"
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cpl_conv.h"
+
+#include "view.h"
+#include "ds/featureclassovr.h"
+#include "map/maptransform.h"
+#include "util/stringutil.h"
+
+namespace ngs {
+
+constexpr double LOCK_TIME = 5.0;
+constexpr double normal45 = 0.70710678;
+constexpr double sin60 = 0.86602540;
+constexpr double STAR_BASE = 0.35;
+constexpr int WARP_GRID_STEP = 16; // Pixels
+constexpr double WARP_MAX_ERROR = 0.125; // Pixels, as gdalwarp default
+constexpr double WARP_WINDOW_MARGIN = 2.0; // Cubic kernel radius
+
+static std::string defaultStyleName(const FeatureClassOverviewPtr &featureClass)
+{
+    switch(OGR_GT_Flatten(featureClass->geometryType())) {
+    case wkbPoint:
+    case wkbMultiPoint:
+        return "primitivePoint";
+    case wkbLineString:
+    case wkbMultiLineString:
+        return "simpleLine";
+    case wkbPolygon:
+    case wkbMultiPolygon:
+        return "simpleFillBordered";
+    default:
+        return "";
+    }
+}
+
+static int toPixel(double value)
+{
+    return static_cast<int>(std::floor(value + 0.5));
+}
+
+//------------------------------------------------------------------------------
+// CpuRenderLayer
+//------------------------------------------------------------------------------
+
+CpuRenderLayer::CpuRenderLayer()
+{
+}
+
+bool CpuRenderLayer::setStyleName(const std::string &name)
+{
+    MutexHolder holder(m_styleMutex, LOCK_TIME);
+    return m_style.setName(name);
+}
+
+bool CpuRenderLayer::setStyle(const CPLJSONObject &style)
+{
+    MutexHolder holder(m_styleMutex, LOCK_TIME);
+    if(m_style.name().empty()) {
+        return false;
+    }
+    return m_style.load(style);
+}
+
+CPLJSONObject CpuRenderLayer::style() const
+{
+    MutexHolder holder(m_styleMutex, LOCK_TIME);
+    if(m_style.name().empty()) {
+        return CPLJSONObject();
+    }
+    return m_style.save();
+}
+
+std::string CpuRenderLayer::styleName() const
+{
+    MutexHolder holder(m_styleMutex, LOCK_TIME);
+    return m_style.name();
+}
+
+CpuStyle CpuRenderLayer::renderStyle() const
+{
+    MutexHolder holder(m_styleMutex, LOCK_TIME);
+    return m_style;
+}
+
+void CpuRenderLayer::finishRender()
+{
+}
+
+//------------------------------------------------------------------------------
+// CpuFeatureLayer
+//------------------------------------------------------------------------------
+
+CpuFeatureLayer::CpuFeatureLayer(Map *map, const std::string &name) :
+    FeatureLayer(map, name),
+    CpuRenderLayer()
+{
+}
+
+bool CpuFeatureLayer::render(Canvas &canvas, const Envelope &extent,
+                             unsigned char zoom)
+{
+    if(!(m_visible && zoom > m_minZoom && zoom < m_maxZoom) || !m_featureClass) {
+        return true;
+    }
+
+    CpuStyle style = renderStyle();
+    if(style.name().empty()) {
+        return true;
+    }
+
+    CpuStyle selectionStyle = style;
+    CpuView *mapView = dynamic_cast<CpuView*>(m_map);
+    if(nullptr != mapView && hasSelectedIds()) {
+        selectionStyle = mapView->selectionRenderStyle(style.type());
+    }
+
+    double pixelSize = extent.width() / canvas.width();
+    auto tiles = MapTransform::getTilesForExtent(extent, zoom, false, false);
+    for(const TileItem &tileItem : tiles) {
+        std::shared_future<VectorTile> vtile = tile(tileItem);
+
+        // Features in tile buffer are drawn by neighbour tiles
+        canvas.setClip(toPixel((tileItem.env.minX() - extent.minX()) / pixelSize),
+                       toPixel((extent.maxY() - tileItem.env.maxY()) / pixelSize),
+                       toPixel((tileItem.env.maxX() - extent.minX()) / pixelSize),
+                       toPixel((extent.maxY() - tileItem.env.minY()) / pixelSize));
+        renderTile(canvas, vtile.get(), extent, style, selectionStyle);
+    }
+    canvas.resetClip();
+    return true;
+}
+
+void CpuFeatureLayer::finishRender()
+{
+    MutexHolder holder(m_renderTilesMutex, LOCK_TIME);
+    m_renderTiles.clear();
+}
+
+std::shared_future<VectorTile> CpuFeatureLayer::tile(const TileItem &tileItem)
+{
+    std::promise<VectorTile> promise;
+    std::shared_future<VectorTile> future;
+    {
+        MutexHolder holder(m_renderTilesMutex, LOCK_TIME);
+        auto it = m_renderTiles.find(tileItem.tile);
+        if(it != m_renderTiles.end()) {
+            return it->second;
+        }
+        future = promise.get_future().share();
+        m_renderTiles[tileItem.tile] = future;
+    }
+
+    // Read without lock, other blocks may read other tiles meanwhile
+    Envelope tileExtent = tileItem.env;
+    tileExtent.resize(TILE_RESIZE);
+    promise.set_value(m_featureClass->getTile(tileItem.tile, tileExtent));
+    return future;
+}
+
+void CpuFeatureLayer::renderTile(Canvas &canvas, const VectorTile &tile,
+                                 const Envelope &extent, const CpuStyle &style,
+                                 const CpuStyle &selectionStyle) const
+{
+    double pixelSize = extent.width() / canvas.width();
+    auto toCanvas = [&extent, pixelSize](const SimplePoint &pt) -> CanvasPoint {
+        return {(pt.x - extent.minX()) / pixelSize,
+                (extent.maxY() - pt.y) / pixelSize};
+    };
+
+    std::vector<CanvasPoint> points;
+    for(const VectorTileItem &tileItem : tile.items()) {
+        if(tileItem.pointCount() == 0) {
+            continue;
+        }
+        if(!m_hideFIDs.empty() && tileItem.isIdsPresent(m_hideFIDs)) {
+            continue;
+        }
+        const CpuStyle &itemStyle = !m_selectedFIDs.empty() &&
+                tileItem.isIdsPresent(m_selectedFIDs, false) ? selectionStyle :
+                                                               style;
+        switch(itemStyle.type()) {
+        case ST_POINT:
+            for(const SimplePoint &pt : tileItem.points()) {
+                renderPoint(canvas, toCanvas(pt), itemStyle);
+            }
+            break;
+        case ST_LINE:
+            points.clear();
+            for(const SimplePoint &pt : tileItem.points()) {
+                points.push_back(toCanvas(pt));
+            }
+            canvas.drawLine(points, itemStyle.width() * 2.0,
+                            itemStyle.capType(), itemStyle.joinType(),
+                            tileItem.isClosed(), itemStyle.color());
+            break;
+        case ST_FILL:
+        {
+            const auto &tilePoints = tileItem.points();
+            points.clear();
+            for(const SimplePoint &pt : tilePoints) {
+                points.push_back(toCanvas(pt));
+            }
+            const auto &indices = tileItem.indices();
+            for(size_t i = 2; i < indices.size(); i += 3) {
+                canvas.fillTriangle(points[indices[i - 2]],
+                                    points[indices[i - 1]],
+                                    points[indices[i]], itemStyle.color());
+            }
+
+            if(itemStyle.hasBorder()) {
+                std::vector<CanvasPoint> ring;
+                for(size_t i = 0; i < tileItem.borderCount(); ++i) {
+                    ring.clear();
+                    for(auto index : tileItem.borderIndices(i)) {
+                        ring.push_back(points[index]);
+                    }
+                    canvas.drawLine(ring, itemStyle.width() * 2.0,
+                                    itemStyle.capType(), itemStyle.joinType(),
+                                    true, itemStyle.borderColor());
+                }
+            }
+        }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void CpuFeatureLayer::renderPoint(Canvas &canvas, const CanvasPoint &point,
+                                  const CpuStyle &style) const
+{
+    double size = static_cast<double>(style.size());
+    // Shape vertices as in GL primitive point style. Map Y axis is up.
+    auto vertex = [&point, size](double x, double y) -> CanvasPoint {
+        return {point.x + x * size, point.y - y * size};
+    };
+
+    switch(style.pointType()) {
+    case CpuPointType::Square:
+        canvas.fillConvex({vertex(-normal45, normal45), vertex(normal45, normal45),
+                           vertex(normal45, -normal45), vertex(-normal45, -normal45)},
+                          style.color());
+        break;
+    case CpuPointType::Rectangle:
+        canvas.fillConvex({vertex(-sin60, 0.5), vertex(sin60, 0.5),
+                           vertex(sin60, -0.5), vertex(-sin60, -0.5)},
+                          style.color());
+        break;
+    case CpuPointType::Triangle:
+        canvas.fillTriangle(vertex(0.0, 1.0), vertex(sin60, -0.5),
+                            vertex(-sin60, -0.5), style.color());
+        break;
+    case CpuPointType::Diamond:
+        canvas.fillConvex({vertex(0.0, 1.0), vertex(normal45, 0.0),
+                           vertex(0.0, -1.0), vertex(-normal45, 0.0)},
+                          style.color());
+        break;
+    case CpuPointType::Star:
+    {
+        int ends = std::max(1, static_cast<int>(style.starEndsCount()));
+        double step = M_PI * 2.0 / ends;
+        for(int i = 0; i < ends; ++i) {
+            double angle = M_PI_2 + step * i;
+            double x = STAR_BASE * std::cos(angle + M_PI_2);
+            double y = STAR_BASE * std::sin(angle + M_PI_2);
+            canvas.fillTriangle(vertex(std::cos(angle), std::sin(angle)),
+                                vertex(x, y), vertex(-x, -y), style.color());
+        }
+    }
+        break;
+    default: // Circle. Markers icons are not supported yet.
+        canvas.fillCircle(point, size, style.color());
+        break;
+    }
+}
+
+bool CpuFeatureLayer::load(const CPLJSONObject &store,
+                           ObjectContainer *objectContainer)
+{
+    if(!FeatureLayer::load(store, objectContainer)) {
+        return false;
+    }
+
+    std::string styleName = store.GetString("style_name", "");
+    if(styleName.empty()) {
+        if(m_featureClass) {
+            return setStyleName(defaultStyleName(m_featureClass));
+        }
+        return true;
+    }
+    if(!setStyleName(styleName)) {
+        return false;
+    }
+    return setStyle(store.GetObj("style"));
+}
+
+CPLJSONObject CpuFeatureLayer::save(const ObjectContainer *objectContainer) const
+{
+    CPLJSONObject out = FeatureLayer::save(objectContainer);
+    std::string name = styleName();
+    if(!name.empty()) {
+        out.Add("style_name", name);
+        out.Add("style", style());
+    }
+    return out;
+}
+
+void CpuFeatureLayer::setFeatureClass(const FeatureClassOverviewPtr &featureClass)
+{
+    FeatureLayer::setFeatureClass(featureClass);
+    std::string name = defaultStyleName(featureClass);
+    if(!name.empty()) {
+        setStyleName(name);
+    }
+}
+
+//------------------------------------------------------------------------------
+// CpuRasterLayer
+//------------------------------------------------------------------------------
+
+CpuRasterLayer::CpuRasterLayer(Map *map, const std::string &name) :
+    RasterLayer(map, name),
+    CpuRenderLayer(),
+    m_red(1),
+    m_green(2),
+    m_blue(3),
+    m_alpha(0),
+    m_transparency(0),
+    m_warp(false),
+    m_resampling(RasterResampling::Nearest)
+{
+}
+
+bool CpuRasterLayer::render(Canvas &canvas, const Envelope &extent,
+                            unsigned char zoom)
+{
+    if(!(m_visible && zoom > m_minZoom && zoom < m_maxZoom) || !m_raster) {
+        return true;
+    }
+
+    if(m_warp) {
+        return renderWarped(canvas, extent);
+    }
+
+    Envelope outExt = m_raster->extent();
+    if(!outExt.intersects(extent)) {
+        return true;
+    }
+    outExt.intersect(extent);
+
+    double pixelSize = extent.width() / canvas.width();
+    int x = toPixel((outExt.minX() - extent.minX()) / pixelSize);
+    int y = toPixel((extent.maxY() - outExt.maxY()) / pixelSize);
+    int width = toPixel((outExt.maxX() - extent.minX()) / pixelSize) - x;
+    int height = toPixel((extent.maxY() - outExt.minY()) / pixelSize) - y;
+    if(width <= 0 || height <= 0) {
+        return true;
+    }
+
+    // Rasters without georeference are in pixel coordinates with Y axis up
+    double geoTransform[6] = { 0.0, 1.0, 0.0,
+                               static_cast<double>(m_raster->height()),
+                               0.0, -1.0 };
+    m_raster->geoTransform(geoTransform);
+    double invGeoTransform[6] = { 0.0 };
+    if(!GDALInvGeoTransform(geoTransform, invGeoTransform)) {
+        return true;
+    }
+
+    double minX, minY, maxX, maxY;
+    GDALApplyGeoTransform(invGeoTransform, outExt.minX(), outExt.maxY(),
+                          &minX, &minY);
+    GDALApplyGeoTransform(invGeoTransform, outExt.maxX(), outExt.minY(),
+                          &maxX, &maxY);
+    Envelope pixelExt(minX, minY, maxX, maxY);
+    pixelExt.fix();
+
+    int xOff = std::max(0, static_cast<int>(std::floor(pixelExt.minX())));
+    int yOff = std::max(0, static_cast<int>(std::floor(pixelExt.minY())));
+    int xSize = std::min(m_raster->width(),
+                         static_cast<int>(std::ceil(pixelExt.maxX()))) - xOff;
+    int ySize = std::min(m_raster->height(),
+                         static_cast<int>(std::ceil(pixelExt.maxY()))) - yOff;
+    if(xSize <= 0 || ySize <= 0) {
+        return true;
+    }
+
+    std::vector<GByte> pixels(static_cast<size_t>(width * height * 4));
+    if(!readPixels(pixels.data(), xOff, yOff, xSize, ySize, width, height)) {
+        return false;
+    }
+
+    canvas.drawImage(pixels.data(), x, y, width, height);
+    return true;
+}
+
+bool CpuRasterLayer::renderWarped(Canvas &canvas, const Envelope &extent)
+{
+    double geoTransform[6] = { 0.0 };
+    m_raster->geoTransform(geoTransform);
+    WarpGrid grid;
+    if(!grid.create(m_srcWKT, geoTransform, m_dstWKT, extent, canvas.width(),
+                    canvas.height(), WARP_GRID_STEP, WARP_MAX_ERROR)) {
+        // Canvas is out of source spatial reference area of use
+        return true;
+    }
+
+    // Get source window with kernel margin
+    double scaleX, scaleY;
+    Envelope window = grid.sourceExtent(scaleX, scaleY);
+    if(!window.isInit()) {
+        return true;
+    }
+    int minX = static_cast<int>(std::max(
+                std::floor(window.minX() - WARP_WINDOW_MARGIN), 0.0));
+    int minY = static_cast<int>(std::max(
+                std::floor(window.minY() - WARP_WINDOW_MARGIN), 0.0));
+    int maxX = static_cast<int>(std::min(
+                std::ceil(window.maxX() + WARP_WINDOW_MARGIN),
+                static_cast<double>(m_raster->width())));
+    int maxY = static_cast<int>(std::min(
+                std::ceil(window.maxY() + WARP_WINDOW_MARGIN),
+                static_cast<double>(m_raster->height())));
+    if(maxX <= minX || maxY <= minY) {
+        return true;
+    }
+
+    // Read source pixels at about the canvas resolution, GDAL uses overviews
+    int width = maxX - minX;
+    int height = maxY - minY;
+    int bufWidth = scaleX > 1.0 ?
+                static_cast<int>(std::ceil(width / scaleX)) : width;
+    int bufHeight = scaleY > 1.0 ?
+                static_cast<int>(std::ceil(height / scaleY)) : height;
+    std::vector<GByte> srcData(static_cast<size_t>(bufWidth * bufHeight * 4));
+    if(!readPixels(srcData.data(), minX, minY, width, height, bufWidth,
+                   bufHeight)) {
+        return false;
+    }
+
+    // Pixels out of raster stay transparent
+    std::vector<GByte> pixels(
+                static_cast<size_t>(canvas.width() * canvas.height() * 4), 0);
+    warpImage(grid, srcData.data(), Envelope(minX, minY, maxX, maxY),
+              bufWidth, bufHeight, m_raster->width(), m_raster->height(),
+              m_resampling, pixels.data());
+    canvas.drawImage(pixels.data(), 0, 0, canvas.width(), canvas.height());
+    return true;
+}
+
+bool CpuRasterLayer::readPixels(GByte *pixels, int xOff, int yOff, int xSize,
+                                int ySize, int width, int height)
+{
+    int bands[4] = { m_red, m_green, m_blue, m_alpha };
+    if(m_alpha == 0) {
+        std::memset(pixels, 255 - m_transparency,
+                    static_cast<size_t>(width * height * 4));
+        return m_raster->pixelData(pixels, xOff, yOff, xSize, ySize, width,
+                                   height, GDT_Byte, 4, bands, true, true);
+    }
+    return m_raster->pixelData(pixels, xOff, yOff, xSize, ySize, width, height,
+                               GDT_Byte, 4, bands);
+}
+
+void CpuRasterLayer::updateWarp()
+{
+    m_warp = false;
+    if(!m_raster || nullptr == m_map) {
+        return;
+    }
+
+    SpatialReferencePtr srcSRS = m_raster->spatialReference();
+    SpatialReferencePtr dstSRS = SpatialReferencePtr::importFromEPSG(m_map->epsg());
+    double geoTransform[6] = { 0.0 };
+    if(!srcSRS || !dstSRS || !m_raster->geoTransform(geoTransform)) {
+        return;
+    }
+    const char *options[] = { "IGNORE_DATA_AXIS_TO_SRS_AXIS_MAPPING=YES",
+                              nullptr };
+    if(srcSRS->IsSame(dstSRS, options)) {
+        return;
+    }
+
+    char *wkt = nullptr;
+    srcSRS->exportToWkt(&wkt);
+    m_srcWKT = fromCString(wkt);
+    CPLFree(wkt);
+    wkt = nullptr;
+    dstSRS->exportToWkt(&wkt);
+    m_dstWKT = fromCString(wkt);
+    CPLFree(wkt);
+
+    m_warp = true;
+}
+
+bool CpuRasterLayer::setStyleName(const std::string &name)
+{
+    return compare(name, "simpleImage");
+}
+
+bool CpuRasterLayer::load(const CPLJSONObject &store,
+                          ObjectContainer *objectContainer)
+{
+    if(!RasterLayer::load(store, objectContainer)) {
+        return false;
+    }
+    CPLJSONObject raster = store.GetObj("raster");
+    if(raster.IsValid()) {
+        m_red = static_cast<unsigned char>(raster.GetInteger("red", m_red));
+        m_green = static_cast<unsigned char>(raster.GetInteger("green", m_green));
+        m_blue = static_cast<unsigned char>(raster.GetInteger("blue", m_blue));
+        m_alpha = static_cast<unsigned char>(raster.GetInteger("alpha", m_alpha));
+        m_transparency = static_cast<unsigned char>(raster.GetInteger("transparency",
+                                                                      m_transparency));
+        m_resampling = resamplingFromString(raster.GetString("resampling",
+                                            resamplingToString(m_resampling)));
+    }
+    updateWarp();
+    return true;
+}
+
+CPLJSONObject CpuRasterLayer::save(const ObjectContainer *objectContainer) const
+{
+    CPLJSONObject out = RasterLayer::save(objectContainer);
+    CPLJSONObject raster;
+    raster.Add("red", m_red);
+    raster.Add("green", m_green);
+    raster.Add("blue", m_blue);
+    raster.Add("alpha", m_alpha);
+    raster.Add("transparency", m_transparency);
+    raster.Add("resampling", resamplingToString(m_resampling));
+    out.Add("raster", raster);
+    return out;
+}
+
+void CpuRasterLayer::setRaster(const RasterPtr &raster)
+{
+    RasterLayer::setRaster(raster);
+    if(raster->bandCount() == 4) {
+        m_alpha = 4;
+    }
+    updateWarp();
+}
+
+} // namespace ngs
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSCPULAYER_H
+#define NGSCPULAYER_H
+
+// stl
+#include <future>
+#include <map>
+
+#include "canvas.h"
+#include "style.h"
+#include "map/layer.h"
+#include "map/warp.h"
+#include "util/mutex.h"
+
+namespace ngs {
+
+/**
+ * @brief The CpuRenderLayer class Base class for layers rendered on CPU.
+ * Render is executed from several threads for different canvases at once.
+ */
+class CpuRenderLayer : public IRenderLayer
+{
+public:
+    CpuRenderLayer();
+    virtual ~CpuRenderLayer() = default;
+    /**
+     * @brief render Draws layer data to canvas.
+     * @param canvas Canvas to draw. Canvas covers all extent.
+     * @param extent Canvas extent in map coordinates.
+     * @param zoom Zoom level to get data.
+     * @return false if data not ready and render should be repeated.
+     */
+    virtual bool render(Canvas &canvas, const Envelope &extent,
+                        unsigned char zoom) = 0;
+    /**
+     * @brief finishRender Frees data shared by blocks of one render. Executed
+     * after all blocks are rendered.
+     */
+    virtual void finishRender();
+
+    // IRenderLayer interface
+public:
+    virtual bool setStyleName(const std::string &name) override;
+    virtual bool setStyle(const CPLJSONObject &style) override;
+    virtual CPLJSONObject style() const override;
+    virtual std::string styleName() const override;
+
+protected:
+    CpuStyle renderStyle() const;
+
+protected:
+    CpuStyle m_style;
+    mutable Mutex m_styleMutex;
+};
+
+/**
+ * @brief The CpuFeatureLayer class Draws vector tiles of feature class
+ */
+class CpuFeatureLayer : public FeatureLayer, public CpuRenderLayer
+{
+public:
+    explicit CpuFeatureLayer(Map *map, const std::string &name = DEFAULT_LAYER_NAME);
+
+    // CpuRenderLayer interface
+public:
+    virtual bool render(Canvas &canvas, const Envelope &extent,
+                        unsigned char zoom) override;
+    virtual void finishRender() override;
+
+    // Layer interface
+public:
+    virtual bool load(const CPLJSONObject &store,
+                      ObjectContainer *objectContainer) override;
+    virtual CPLJSONObject save(const ObjectContainer *objectContainer) const override;
+
+    // FeatureLayer interface
+public:
+    virtual void setFeatureClass(const FeatureClassOverviewPtr &featureClass) override;
+
+protected:
+    std::shared_future<VectorTile> tile(const TileItem &tileItem);
+    void renderTile(Canvas &canvas, const VectorTile &tile,
+                    const Envelope &extent, const CpuStyle &style,
+                    const CpuStyle &selectionStyle) const;
+    void renderPoint(Canvas &canvas, const CanvasPoint &point,
+                     const CpuStyle &style) const;
+
+private:
+    // Tiles of current render. Neighbour blocks share tiles, so each tile is
+    // read once and other blocks wait for it.
+    std::map<Tile, std::shared_future<VectorTile>> m_renderTiles;
+    Mutex m_renderTilesMutex;
+};
+
+/**
+ * @brief The CpuRasterLayer class Draws raster pixels resampled by GDAL
+ */
+class CpuRasterLayer : public RasterLayer, public CpuRenderLayer
+{
+public:
+    explicit CpuRasterLayer(Map *map, const std::string &name = DEFAULT_LAYER_NAME);
+
+    // CpuRenderLayer interface
+public:
+    virtual bool render(Canvas &canvas, const Envelope &extent,
+                        unsigned char zoom) override;
+
+    // IRenderLayer interface
+public:
+    virtual bool setStyleName(const std::string &name) override;
+    virtual std::string styleName() const override { return "simpleImage"; }
+
+    // Layer interface
+public:
+    virtual bool load(const CPLJSONObject &store,
+                      ObjectContainer *objectContainer) override;
+    virtual CPLJSONObject save(const ObjectContainer *objectContainer) const override;
+
+    // RasterLayer interface
+public:
+    virtual void setRaster(const RasterPtr &raster) override;
+
+protected:
+    void updateWarp();
+    bool renderWarped(Canvas &canvas, const Envelope &extent);
+    bool readPixels(GByte *pixels, int xOff, int yOff, int xSize, int ySize,
+                    int width, int height);
+
+private:
+    unsigned char m_red, m_green, m_blue, m_alpha, m_transparency;
+    // Reprojection of raster which spatial reference differs from map one
+    bool m_warp;
+    enum RasterResampling m_resampling;
+    std::string m_srcWKT, m_dstWKT;
+};
+
+} // namespace ngs
+
+#endif // NGSCPULAYER_H
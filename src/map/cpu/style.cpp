@@ -0,0 +1,190 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "style.h"
+
+#include "util/error.h"
+#include "util/stringutil.h"
+
+namespace ngs {
+
+constexpr ngsRGBA defaultColor = { 0, 255, 0, 255 };
+constexpr ngsRGBA defaultBorderColor = { 128, 128, 128, 255 };
+
+CpuStyle::CpuStyle() :
+    m_type(ST_POINT),
+    m_color(defaultColor),
+    m_borderColor(defaultBorderColor),
+    m_border(false),
+    m_size(6.0f),
+    m_rotation(0.0f),
+    m_width(1.0f),
+    m_pointType(CpuPointType::Circle),
+    m_capType(CpuCapType::Butt),
+    m_joinType(CpuJoinType::Beveled),
+    m_segmentCount(10),
+    m_starEndsCount(5),
+    m_iconIndex(0),
+    m_iconWidth(16),
+    m_iconHeight(16)
+{
+}
+
+bool CpuStyle::setName(const std::string &name)
+{
+    if(!isSupported(name)) {
+        return errorMessage(_("Style %s is not supported"), name.c_str());
+    }
+
+    m_name = name;
+    m_border = false;
+    if(compare(name, "simplePoint")) {
+        m_type = ST_POINT;
+        m_pointType = CpuPointType::Square;
+    }
+    else if(compare(name, "primitivePoint")) {
+        m_type = ST_POINT;
+        m_pointType = CpuPointType::Circle;
+        m_segmentCount = 10;
+    }
+    else if(compare(name, "marker")) {
+        m_type = ST_POINT;
+        m_pointType = CpuPointType::Marker;
+    }
+    else if(compare(name, "simpleLine")) {
+        m_type = ST_LINE;
+        m_segmentCount = 6;
+    }
+    else if(compare(name, "simpleFill")) {
+        m_type = ST_FILL;
+    }
+    else if(compare(name, "simpleFillBordered")) {
+        m_type = ST_FILL;
+        m_border = true;
+        m_segmentCount = 6;
+    }
+    return true;
+}
+
+bool CpuStyle::load(const CPLJSONObject &store)
+{
+    if(m_border) {
+        if(!loadLine(store.GetObj("line"))) {
+            return false;
+        }
+        m_borderColor = m_color;
+        m_color = ngsHEX2RGBA(store.GetObj("fill").GetString("color",
+                                                 ngsRGBA2HEX(defaultColor)));
+        return true;
+    }
+
+    if(m_type == ST_LINE) {
+        return loadLine(store);
+    }
+
+    m_color = ngsHEX2RGBA(store.GetString("color", ngsRGBA2HEX(defaultColor)));
+    if(m_type == ST_POINT) {
+        m_size = static_cast<float>(store.GetDouble("size", 6.0));
+        m_rotation = static_cast<float>(store.GetDouble("rotate", 0.0));
+        if(compare(m_name, "primitivePoint")) {
+            m_pointType = static_cast<enum CpuPointType>(
+                        store.GetInteger("type", 3));
+            m_segmentCount = static_cast<unsigned char>(
+                        store.GetInteger("segments", m_segmentCount));
+            m_starEndsCount = static_cast<unsigned char>(
+                        store.GetInteger("starEnds", m_starEndsCount));
+        }
+        else if(compare(m_name, "marker")) {
+            m_iconIndex = store.GetInteger("icon_index", 0);
+            m_iconWidth = store.GetInteger("icon_width", 16);
+            m_iconHeight = store.GetInteger("icon_height", 16);
+            m_iconSetName = store.GetString("iconset_name", "");
+        }
+    }
+    return true;
+}
+
+CPLJSONObject CpuStyle::save() const
+{
+    if(m_border) {
+        CPLJSONObject out;
+        out.Add("line", saveLine(m_borderColor));
+        CPLJSONObject fill;
+        fill.Add("color", ngsRGBA2HEX(m_color));
+        out.Add("fill", fill);
+        return out;
+    }
+
+    if(m_type == ST_LINE) {
+        return saveLine(m_color);
+    }
+
+    CPLJSONObject out;
+    out.Add("color", ngsRGBA2HEX(m_color));
+    if(m_type == ST_POINT) {
+        out.Add("size", static_cast<double>(m_size));
+        out.Add("type", static_cast<int>(m_pointType));
+        out.Add("rotate", static_cast<double>(m_rotation));
+        if(compare(m_name, "primitivePoint")) {
+            out.Add("segments", m_segmentCount);
+            out.Add("starEnds", m_starEndsCount);
+        }
+        else if(compare(m_name, "marker")) {
+            out.Add("icon_index", m_iconIndex);
+            out.Add("icon_width", m_iconWidth);
+            out.Add("icon_height", m_iconHeight);
+            out.Add("iconset_name", m_iconSetName);
+        }
+    }
+    return out;
+}
+
+bool CpuStyle::loadLine(const CPLJSONObject &store)
+{
+    m_color = ngsHEX2RGBA(store.GetString("color", ngsRGBA2HEX(defaultColor)));
+    m_width = static_cast<float>(store.GetDouble("line_width", 3.0));
+    m_capType = static_cast<enum CpuCapType>(
+                store.GetInteger("cap", static_cast<int>(m_capType)));
+    m_joinType = static_cast<enum CpuJoinType>(
+                store.GetInteger("join", static_cast<int>(m_joinType)));
+    m_segmentCount = static_cast<unsigned char>(
+                store.GetInteger("segments", m_segmentCount));
+    return true;
+}
+
+CPLJSONObject CpuStyle::saveLine(const ngsRGBA &color) const
+{
+    CPLJSONObject out;
+    out.Add("color", ngsRGBA2HEX(color));
+    out.Add("line_width", static_cast<double>(m_width));
+    out.Add("cap", static_cast<int>(m_capType));
+    out.Add("join", static_cast<int>(m_joinType));
+    out.Add("segments", m_segmentCount);
+    return out;
+}
+
+bool CpuStyle::isSupported(const std::string &name)
+{
+    return compare(name, "simplePoint") || compare(name, "primitivePoint") ||
+            compare(name, "marker") || compare(name, "simpleLine") ||
+            compare(name, "simpleFill") || compare(name, "simpleFillBordered");
+}
+
+}
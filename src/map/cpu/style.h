@@ -0,0 +1,108 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSCPUSTYLE_H
+#define NGSCPUSTYLE_H
+
+// gdal
+#include "cpl_json.h"
+
+#include "api_priv.h"
+
+namespace ngs {
+
+// NOTE: Values are stored in map files and must be the same as in GL styles.
+enum class CpuPointType {
+    Unknown = 0,
+    Square,
+    Rectangle,
+    Circle,
+    Triangle,
+    Diamond,
+    Star,
+    Marker
+};
+
+enum class CpuCapType {
+    Butt = 0,
+    Round,
+    Square
+};
+
+enum class CpuJoinType {
+    Miter = 0,
+    Round,
+    Beveled
+};
+
+/**
+ * @brief The CpuStyle class Vector style for CPU rendering. Reads and writes
+ * the same JSON as GL styles, so map files can be rendered by both views.
+ * Supported names are simplePoint, primitivePoint, marker, simpleLine,
+ * simpleFill and simpleFillBordered. Markers are drawn as circles.
+ */
+class CpuStyle
+{
+public:
+    CpuStyle();
+    bool setName(const std::string &name);
+    const std::string &name() const { return m_name; }
+    enum ngsStyleType type() const { return m_type; }
+    bool load(const CPLJSONObject &store);
+    CPLJSONObject save() const;
+
+    ngsRGBA color() const { return m_color; }
+    ngsRGBA borderColor() const { return m_borderColor; }
+    bool hasBorder() const { return m_border; }
+    float size() const { return m_size; }
+    float rotation() const { return m_rotation; }
+    float width() const { return m_width; }
+    enum CpuPointType pointType() const { return m_pointType; }
+    enum CpuCapType capType() const { return m_capType; }
+    enum CpuJoinType joinType() const { return m_joinType; }
+    unsigned char segmentCount() const { return m_segmentCount; }
+    unsigned char starEndsCount() const { return m_starEndsCount; }
+
+    // static
+public:
+    static bool isSupported(const std::string &name);
+
+protected:
+    bool loadLine(const CPLJSONObject &store);
+    CPLJSONObject saveLine(const ngsRGBA &color) const;
+
+protected:
+    std::string m_name;
+    enum ngsStyleType m_type;
+    ngsRGBA m_color, m_borderColor;
+    bool m_border;
+    float m_size, m_rotation, m_width;
+    enum CpuPointType m_pointType;
+    enum CpuCapType m_capType;
+    enum CpuJoinType m_joinType;
+    unsigned char m_segmentCount, m_starEndsCount;
+    // Marker properties are kept to save style back unchanged
+    int m_iconIndex, m_iconWidth, m_iconHeight;
+    std::string m_iconSetName;
+};
+
+}
+
+#endif // NGSCPUSTYLE_H
@@ -0,0 +1,321 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "view.h"
+
+// stl
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "layer.h"
+#include "util/error.h"
+
+namespace ngs {
+
+constexpr unsigned char MAX_TRIES = 2;
+constexpr const char* SELECTION_KEY = "selection";
+constexpr int RENDER_BLOCK_SIZE = 256;
+
+//------------------------------------------------------------------------------
+// RenderBlockData
+//------------------------------------------------------------------------------
+
+class RenderBlockData : public ThreadData {
+public:
+    RenderBlockData(const std::vector<LayerPtr> &layers, const Envelope &extent,
+                    unsigned char zoom, const ngsRGBA &color, Canvas *canvas,
+                    int x, int y, int width, int height,
+                    std::atomic_bool *failed, std::atomic_int *rendered,
+                    bool own) :
+        ThreadData(own), m_layers(layers), m_extent(extent), m_zoom(zoom),
+        m_color(color), m_canvas(canvas), m_x(x), m_y(y), m_width(width),
+        m_height(height), m_failed(failed), m_rendered(rendered) {
+    }
+    virtual void onComplete(bool result) override {
+        if(result) {
+            (*m_rendered)++;
+        }
+        else {
+            *m_failed = true;
+        }
+    }
+    std::vector<LayerPtr> m_layers;
+    Envelope m_extent;
+    unsigned char m_zoom;
+    ngsRGBA m_color;
+    Canvas *m_canvas;
+    int m_x, m_y, m_width, m_height;
+    std::atomic_bool *m_failed;
+    std::atomic_int *m_rendered;
+};
+
+//------------------------------------------------------------------------------
+// CpuView
+//------------------------------------------------------------------------------
+
+CpuView::CpuView() : MapView()
+{
+    initView();
+}
+
+CpuView::CpuView(const std::string &name, const std::string &description,
+                 unsigned short epsg, const Envelope &bounds) :
+    MapView(name, description, epsg, bounds)
+{
+    initView();
+}
+
+void CpuView::initView()
+{
+    m_selectionStyles[ST_POINT].setName("primitivePoint");
+    m_selectionStyles[ST_LINE].setName("simpleLine");
+    m_selectionStyles[ST_FILL].setName("simpleFillBordered");
+    createOverlays();
+    m_threadPool.init(getNumberThreads(), renderBlockJobThreadFunc, MAX_TRIES);
+}
+
+CpuStyle CpuView::selectionRenderStyle(enum ngsStyleType styleType) const
+{
+    auto it = m_selectionStyles.find(styleType);
+    if(it == m_selectionStyles.end()) {
+        return CpuStyle();
+    }
+    return it->second;
+}
+
+unsigned char CpuView::zoomForExtent(const Envelope &extent, int width)
+{
+    // 156543.04 is m/pixel on 0 zoom as in MapTransform::getZoom
+    double metersPerPixel = extent.width() / width;
+    double retVal = std::log2(156543.04 / metersPerPixel);
+    return retVal < 0.0 ? 0 : static_cast<unsigned char>(retVal + 0.5);
+}
+
+bool CpuView::renderBlockJobThreadFunc(ThreadData *threadData)
+{
+    RenderBlockData *blockData = dynamic_cast<RenderBlockData*>(threadData);
+    if(nullptr == blockData) {
+        return true;
+    }
+
+    Canvas block(blockData->m_width, blockData->m_height);
+    block.clear(blockData->m_color);
+    for(auto layerIt = blockData->m_layers.rbegin();
+        layerIt != blockData->m_layers.rend(); ++layerIt) {
+        CpuRenderLayer *renderLayer = ngsDynamicCast(CpuRenderLayer, (*layerIt));
+        if(nullptr != renderLayer &&
+                !renderLayer->render(block, blockData->m_extent,
+                                     blockData->m_zoom)) {
+            return false;
+        }
+    }
+
+    // Blocks do not overlap, so copy is safe without lock
+    blockData->m_canvas->copy(block, blockData->m_x, blockData->m_y);
+    return true;
+}
+
+bool CpuView::renderExtent(const Envelope &extent, int width, int height,
+                           Canvas &canvas, const Progress &progress)
+{
+    if(width <= 0 || height <= 0 || !extent.isInit()) {
+        return errorMessage(_("Invalid render size or extent"));
+    }
+
+    MutexHolder holder(m_renderMutex);
+    canvas = Canvas(width, height);
+
+    unsigned char zoom = zoomForExtent(extent, width);
+    double pixelWidth = extent.width() / width;
+    double pixelHeight = extent.height() / height;
+    std::atomic_bool failed(false);
+    std::atomic_int rendered(0);
+    int blockCount = 0;
+    for(int y = 0; y < height; y += RENDER_BLOCK_SIZE) {
+        int blockHeight = std::min(RENDER_BLOCK_SIZE, height - y);
+        for(int x = 0; x < width; x += RENDER_BLOCK_SIZE) {
+            int blockWidth = std::min(RENDER_BLOCK_SIZE, width - x);
+            Envelope blockExtent(extent.minX() + x * pixelWidth,
+                                 extent.maxY() - (y + blockHeight) * pixelHeight,
+                                 extent.minX() + (x + blockWidth) * pixelWidth,
+                                 extent.maxY() - y * pixelHeight);
+            m_threadPool.addThreadData(
+                        new RenderBlockData(m_layers, blockExtent, zoom,
+                                            m_bkColor, &canvas, x, y,
+                                            blockWidth, blockHeight,
+                                            &failed, &rendered, true));
+            blockCount++;
+        }
+    }
+    m_threadPool.waitComplete(progress);
+
+    // Blocks data kept by layers is valid only for this render
+    for(const LayerPtr &layer : m_layers) {
+        CpuRenderLayer *renderLayer = ngsDynamicCast(CpuRenderLayer, layer);
+        if(nullptr != renderLayer) {
+            renderLayer->finishRender();
+        }
+    }
+
+    if(failed) {
+        return errorMessage(_("Failed to render map"));
+    }
+    // Cancel drops queued blocks without complete notification
+    if(rendered < blockCount) {
+        progress.onProgress(COD_CANCELED, 1.0, _("Render canceled"));
+        return errorMessage(_("Render canceled"));
+    }
+    progress.onProgress(COD_FINISHED, 1.0, _("Finished"));
+    return true;
+}
+
+bool CpuView::renderTile(int x, int y, unsigned char z, int tileSize,
+                         Canvas &canvas, const Progress &progress)
+{
+    int tilesInDim = 1 << z;
+    if(x < 0 || y < 0 || x >= tilesInDim || y >= tilesInDim) {
+        return errorMessage(_("Tile %d/%d/%d is out of bounds"), z, x, y);
+    }
+
+    double tileWidth = DEFAULT_BOUNDS.width() / tilesInDim;
+    double tileHeight = DEFAULT_BOUNDS.height() / tilesInDim;
+    Envelope extent(DEFAULT_BOUNDS.minX() + x * tileWidth,
+                    DEFAULT_BOUNDS.maxY() - (y + 1) * tileHeight,
+                    DEFAULT_BOUNDS.minX() + (x + 1) * tileWidth,
+                    DEFAULT_BOUNDS.maxY() - y * tileHeight);
+    return renderExtent(extent, tileSize, tileSize, canvas, progress);
+}
+
+LayerPtr CpuView::createLayer(const std::string &name, Layer::Type type)
+{
+    switch (type) {
+    case Layer::Type::Vector:
+        return LayerPtr(new CpuFeatureLayer(this, name));
+    case Layer::Type::Raster:
+        return LayerPtr(new CpuRasterLayer(this, name));
+    default:
+        return MapView::createLayer(name, type);
+    }
+}
+
+bool CpuView::draw(ngsDrawState state, const Progress &progress)
+{
+    ngsUnused(state);
+    if(m_layers.empty()) {
+        m_canvas = Canvas(m_displayWidht, m_displayHeight);
+        clearBackground();
+        progress.onProgress(COD_FINISHED, 1.0, _("No layers. Nothing to render."));
+        return true;
+    }
+
+    return renderExtent(getExtent(), m_displayWidht, m_displayHeight, m_canvas,
+                        progress);
+}
+
+void CpuView::invalidate(const Envelope &bounds)
+{
+    // Nothing cached. Every draw renders all layers.
+    ngsUnused(bounds);
+}
+
+bool CpuView::setSelectionStyleName(enum ngsStyleType styleType,
+                                    const std::string &name)
+{
+    CpuStyle style;
+    if(!style.setName(name)) {
+        return false;
+    }
+    if(style.type() != styleType) {
+        return errorMessage(_("Style %s has different type"), name.c_str());
+    }
+    m_selectionStyles[styleType] = style;
+    return true;
+}
+
+bool CpuView::setSelectionStyle(enum ngsStyleType styleType,
+                                const CPLJSONObject &style)
+{
+    return m_selectionStyles[styleType].load(style);
+}
+
+std::string CpuView::selectionStyleName(enum ngsStyleType styleType) const
+{
+    return selectionRenderStyle(styleType).name();
+}
+
+CPLJSONObject CpuView::selectionStyle(enum ngsStyleType styleType) const
+{
+    return selectionRenderStyle(styleType).save();
+}
+
+bool CpuView::openInternal(const CPLJSONObject &root, MapFile * const mapFile)
+{
+    if(!MapView::openInternal(root, mapFile)) {
+        return false;
+    }
+
+    CPLJSONObject selection = root.GetObj(SELECTION_KEY);
+    CpuStyle style;
+    if(style.setName(selection.GetString("point_style_name", "primitivePoint"))) {
+        style.load(selection.GetObj("point_style"));
+        m_selectionStyles[ST_POINT] = style;
+    }
+
+    if(style.setName(selection.GetString("line_style_name", "simpleLine"))) {
+        style.load(selection.GetObj("line_style"));
+        m_selectionStyles[ST_LINE] = style;
+    }
+
+    if(style.setName(selection.GetString("fill_style_name", "simpleFillBordered"))) {
+        style.load(selection.GetObj("fill_style"));
+        m_selectionStyles[ST_FILL] = style;
+    }
+
+    return true;
+}
+
+bool CpuView::saveInternal(CPLJSONObject &root, MapFile * const mapFile)
+{
+    if(!MapView::saveInternal(root, mapFile))
+        return false;
+
+    CPLJSONObject selection;
+    selection.Add("point_style_name", m_selectionStyles[ST_POINT].name());
+    selection.Add("point_style", m_selectionStyles[ST_POINT].save());
+    selection.Add("line_style_name", m_selectionStyles[ST_LINE].name());
+    selection.Add("line_style", m_selectionStyles[ST_LINE].save());
+    selection.Add("fill_style_name", m_selectionStyles[ST_FILL].name());
+    selection.Add("fill_style", m_selectionStyles[ST_FILL].save());
+    root.Add(SELECTION_KEY, selection);
+    return true;
+}
+
+void CpuView::clearBackground()
+{
+    m_canvas.clear(m_bkColor);
+}
+
+void CpuView::createOverlays()
+{
+    // Overlays are interactive and not drawn in headless mode
+}
+
+}  // namespace ngs
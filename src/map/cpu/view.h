@@ -0,0 +1,104 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSCPUVIEW_H
+#define NGSCPUVIEW_H
+
+// stl
+#include <map>
+
+#include "canvas.h"
+#include "style.h"
+#include "map/mapview.h"
+#include "util/threadpool.h"
+
+namespace ngs {
+
+/**
+ * @brief The CpuView class Map view rendered without GL context. Map is drawn
+ * by blocks in thread pool to RGBA canvas which can be encoded to PNG.
+ */
+class CpuView : public MapView
+{
+public:
+    CpuView();
+    CpuView(const std::string &name, const std::string &description,
+            unsigned short epsg, const Envelope &bounds);
+    virtual ~CpuView() override = default;
+    CpuStyle selectionRenderStyle(enum ngsStyleType styleType) const;
+    const Canvas &canvas() const { return m_canvas; }
+    /**
+     * @brief renderExtent Renders all map layers to canvas.
+     * @param extent Extent in map coordinates.
+     * @param width Canvas width in pixels.
+     * @param height Canvas height in pixels.
+     * @param canvas Output canvas. It will be resized to width and height.
+     * @param progress Progress and cancel.
+     * @return true on success.
+     */
+    bool renderExtent(const Envelope &extent, int width, int height,
+                      Canvas &canvas, const Progress &progress = Progress());
+    /**
+     * @brief renderTile Renders XYZ tile. Tile y axis is from top to bottom.
+     */
+    bool renderTile(int x, int y, unsigned char z, int tileSize,
+                    Canvas &canvas, const Progress &progress = Progress());
+
+    // Map interface
+protected:
+    virtual LayerPtr createLayer(const std::string &name = DEFAULT_LAYER_NAME,
+                                 Layer::Type type = Layer::Type::Invalid) override;
+    virtual bool openInternal(const CPLJSONObject &root, MapFile * const mapFile) override;
+    virtual bool saveInternal(CPLJSONObject &root, MapFile * const mapFile) override;
+
+    // MapView interface
+public:
+    virtual bool draw(ngsDrawState state, const Progress &progress) override;
+    virtual void invalidate(const Envelope &bounds) override;
+    virtual bool setSelectionStyleName(enum ngsStyleType styleType,
+                                       const std::string &name) override;
+    virtual bool setSelectionStyle(enum ngsStyleType styleType,
+                                   const CPLJSONObject &style) override;
+    virtual std::string selectionStyleName(enum ngsStyleType styleType) const override;
+    virtual CPLJSONObject selectionStyle(enum ngsStyleType styleType) const override;
+
+    // MapView interface
+protected:
+    virtual void clearBackground() override;
+    virtual void createOverlays() override;
+
+protected:
+    void initView();
+
+    // static
+protected:
+    static bool renderBlockJobThreadFunc(ThreadData *threadData);
+    static unsigned char zoomForExtent(const Envelope &extent, int width);
+
+private:
+    std::map<enum ngsStyleType, CpuStyle> m_selectionStyles;
+    Canvas m_canvas;
+    Mutex m_renderMutex;
+    ThreadPool m_threadPool;
+};
+
+}  // namespace ngs
+
+#endif  // NGSCPUVIEW_H
@@ -20,25 +20,39 @@
  ****************************************************************************/
 #include "buffer.h"
 
+#include <algorithm>
+
 #include "cpl_conv.h"
 
 namespace ngs {
 
 constexpr GLuint GL_BUFFER_IVALID = 0;
 constexpr unsigned short MAX_INDEX_BUFFER_SIZE = 65535;
-constexpr unsigned char VERTEX_SIZE = 3;
-// 5 = 3 for vertex + 2 for normal
-constexpr unsigned char VERTEX_WITH_NORMAL_SIZE = 5;
 //GL_UNSIGNED_BYTE, with a maximum value of 255.
 //GL_UNSIGNED_SHORT, with a maximum value of 65,535
 constexpr unsigned short MAX_VERTEX_BUFFER_SIZE = 65535;
+// With GL_UNSIGNED_INT indices one buffer holds whole tile. The limit only
+// keeps single Gl buffer at reasonable size (64 Mb of floats).
+constexpr size_t MAX_UINT_VERTEX_BUFFER_SIZE = 16 * 1024 * 1024;
+constexpr size_t MAX_UINT_INDEX_BUFFER_SIZE = 16 * 1024 * 1024;
 
 GlBuffer::GlBuffer(BufferType type) : GlObject(),
     m_bufferIds{{GL_BUFFER_IVALID,GL_BUFFER_IVALID}},
-    m_type(type)
+    m_type(type),
+    m_maxIndex(0),
+    m_indexType(GL_UNSIGNED_SHORT)
+{
+}
+
+GlBuffer::GlBuffer(BufferType type, size_t vertices, size_t indices) :
+    GlObject(),
+    m_bufferIds{{GL_BUFFER_IVALID,GL_BUFFER_IVALID}},
+    m_type(type),
+    m_maxIndex(0),
+    m_indexType(GL_UNSIGNED_SHORT)
 {
-    m_vertices.reserve(MAX_VERTEX_BUFFER_SIZE);
-    m_indices.reserve(MAX_INDEX_BUFFER_SIZE);
+    m_vertices.reserve(std::min(vertices, maxVertices()));
+    m_indices.reserve(std::min(indices, maxIndices()));
 }
 
 GlBuffer::~GlBuffer()
@@ -50,12 +64,12 @@ bool GlBuffer::canStoreVertices(size_t amount, bool withNormals) const
 {
     if(m_type == BF_TEX) {
         return (m_vertices.size() + amount * (
-                    withNormals ? 7 : 5)) <  MAX_VERTEX_BUFFER_SIZE;
+                    withNormals ? 7 : 5)) < maxVertices();
     }
     else {
         return (m_vertices.size() + amount * (
                     withNormals ? VERTEX_WITH_NORMAL_SIZE : VERTEX_SIZE)) <
-                MAX_VERTEX_BUFFER_SIZE;
+                maxVertices();
     }
 }
 
@@ -63,9 +77,25 @@ void GlBuffer::destroy()
 {
     if (m_bound) {
         ngsCheckGLError(glDeleteBuffers(GL_BUFFERS_COUNT, m_bufferIds.data()));
+        m_bufferIds.fill(GL_BUFFER_IVALID);
+        m_bound = false;
     }
 }
 
+size_t GlBuffer::memorySize() const
+{
+    return sizeof(GlBuffer) + m_vertices.capacity() * sizeof(GLfloat) +
+            m_indices.capacity() * sizeof(GLuint);
+}
+
+void GlBuffer::shrink()
+{
+    // Buffers reserve the maximum size on creation, release unused tail to
+    // keep filled and cached tiles small.
+    m_vertices.shrink_to_fit();
+    m_indices.shrink_to_fit();
+}
+
 GLuint GlBuffer::id(bool vertices) const
 {
     if(vertices)
@@ -76,12 +106,14 @@ GLuint GlBuffer::id(bool vertices) const
 
 size_t GlBuffer::maxIndices()
 {
-    return MAX_INDEX_BUFFER_SIZE;
+    return isUintIndexSupported() ? MAX_UINT_INDEX_BUFFER_SIZE :
+                                    MAX_INDEX_BUFFER_SIZE;
 }
 
 size_t GlBuffer::maxVertices()
 {
-    return MAX_VERTEX_BUFFER_SIZE;
+    return isUintIndexSupported() ? MAX_UINT_VERTEX_BUFFER_SIZE :
+                                    MAX_VERTEX_BUFFER_SIZE;
 }
 
 void GlBuffer::bind()
@@ -97,12 +129,39 @@ void GlBuffer::bind()
             GL_STATIC_DRAW));
 
     ngsCheckGLError(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id(false)));
-    size = static_cast<GLsizeiptr>(sizeof(GLushort) * m_indices.size());
-    ngsCheckGLError(glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, m_indices.data(),
-            GL_STATIC_DRAW));
+    std::vector<GLushort> shortIndices;
+    if(packIndices(shortIndices) == GL_UNSIGNED_INT) {
+        size = static_cast<GLsizeiptr>(sizeof(GLuint) * m_indices.size());
+        ngsCheckGLError(glBufferData(GL_ELEMENT_ARRAY_BUFFER, size,
+                                     m_indices.data(), GL_STATIC_DRAW));
+    }
+    else {
+        size = static_cast<GLsizeiptr>(sizeof(GLushort) * shortIndices.size());
+        ngsCheckGLError(glBufferData(GL_ELEMENT_ARRAY_BUFFER, size,
+                                     shortIndices.data(), GL_STATIC_DRAW));
+    }
     m_bound = true;
 }
 
+/**
+ * @brief GlBuffer::packIndices Chooses index type for Gl buffer. Small
+ * buffers use half of Gl memory for indices.
+ * @param shortIndices Indices converted to GLushort if all of them fit
+ * @return GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, same as indexType()
+ */
+GLenum GlBuffer::packIndices(std::vector<GLushort> &shortIndices)
+{
+    if(m_maxIndex > MAX_INDEX_BUFFER_SIZE) {
+        m_indexType = GL_UNSIGNED_INT;
+        shortIndices.clear();
+    }
+    else {
+        m_indexType = GL_UNSIGNED_SHORT;
+        shortIndices.assign(m_indices.begin(), m_indices.end());
+    }
+    return m_indexType;
+}
+
 void GlBuffer::rebind() const
 {
     ngsCheckGLError(glBindBuffer(GL_ARRAY_BUFFER, id(true)));
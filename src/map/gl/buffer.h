@@ -29,6 +29,9 @@
 namespace ngs {
 
 constexpr GLsizei GL_BUFFERS_COUNT = 2;
+constexpr unsigned char VERTEX_SIZE = 3;
+// 5 = 3 for vertex + 2 for normal
+constexpr unsigned char VERTEX_WITH_NORMAL_SIZE = 5;
 
 class GlBuffer : public GlObject
 {
@@ -41,6 +44,13 @@ public:
     };
 public:
     explicit GlBuffer(enum BufferType type = BF_TEX);
+    /**
+     * @brief GlBuffer Creates buffer with reserved arrays
+     * @param type Buffer type
+     * @param vertices Expected vertex array size in floats
+     * @param indices Expected index count
+     */
+    explicit GlBuffer(enum BufferType type, size_t vertices, size_t indices);
     virtual ~GlBuffer() override;
 
     bool canStoreVertices(size_t amount, bool withNormals = false) const;
@@ -51,11 +61,23 @@ public:
     size_t vertexSize() const {
         return m_vertices.size();
     }
+    size_t memorySize() const;
+    void shrink();
 
     void addVertex(float value) { m_vertices.push_back(value); }
-    void addIndex(unsigned short value) { m_indices.push_back(value); }
+    void addIndex(GLuint value) {
+        m_indices.push_back(value);
+        if(m_maxIndex < value) {
+            m_maxIndex = value;
+        }
+    }
 
     enum BufferType type() const { return m_type; }
+    /**
+     * @brief indexType Index type for glDrawElements. Valid after bind.
+     */
+    GLenum indexType() const { return m_indexType; }
+    GLenum packIndices(std::vector<GLushort> &shortIndices);
     static size_t maxIndices();
     static size_t maxVertices();
 
@@ -68,9 +90,11 @@ public:
 
 private:
     std::vector<GLfloat> m_vertices;
-    std::vector<GLushort> m_indices;
+    std::vector<GLuint> m_indices;
     std::array<GLuint, GL_BUFFERS_COUNT> m_bufferIds;
     enum BufferType m_type;
+    GLuint m_maxIndex;
+    GLenum m_indexType;
 };
 
 using GlBufferPtr = std::shared_ptr<GlBuffer>;
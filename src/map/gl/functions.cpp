@@ -20,6 +20,10 @@
  ****************************************************************************/
 #include "functions.h"
 
+#include <atomic>
+#include <cctype>
+#include <cstring>
+
 #include "cpl_string.h"
 
 #include "util/error.h"
@@ -51,6 +55,40 @@
 
 namespace ngs {
 
+constexpr const char *GLES_VERSION_PREFIX = "OpenGL ES";
+
+// Fill threads read it to choose buffer size, Gl thread sets it.
+static std::atomic_bool uintIndexChecked(false);
+static std::atomic_bool uintIndexSupported(false);
+
+// Desktop OpenGL and OpenGL ES 3.0 draw GL_UNSIGNED_INT elements in core,
+// OpenGL ES 2.0 needs extension. The API is taken from the current context as
+// the same headers are used for both.
+static bool checkUintIndexSupport()
+{
+    const char *version = reinterpret_cast<const char*>(
+                glGetString(GL_VERSION));
+    if(nullptr == version) {
+        return false;
+    }
+    if(!STARTS_WITH(version, GLES_VERSION_PREFIX)) {
+        return true;
+    }
+
+    const char *number = version + strlen(GLES_VERSION_PREFIX);
+    while(*number != '\0' && !isdigit(static_cast<unsigned char>(*number))) {
+        number++;
+    }
+    if(atoi(number) >= 3) {
+        return true;
+    }
+
+    const char *extensions = reinterpret_cast<const char*>(
+                glGetString(GL_EXTENSIONS));
+    return nullptr != extensions &&
+            nullptr != strstr(extensions, "GL_OES_element_index_uint");
+}
+
 bool checkGLError(const char *cmd) {
     const GLenum err = glGetError();
     if (err != GL_NO_ERROR) {
@@ -157,6 +195,13 @@ bool checkEGLError(const char *cmd) {
 
 void prepareContext()
 {
+    if(!uintIndexChecked) {
+        uintIndexSupported = checkUintIndexSupport();
+        uintIndexChecked = true;
+        CPLDebug("ngstore", "32-bit element indices %s",
+                 uintIndexSupported ? "supported" : "not supported");
+    }
+
 //#ifdef GL_PROGRAM_POINT_SIZE_EXT
 //    ngsCheckGLError(glEnable(GL_PROGRAM_POINT_SIZE_EXT));
 //#endif
@@ -177,6 +222,17 @@ void prepareContext()
 //    ngsCheckGLError(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
 }
 
+bool isUintIndexSupported()
+{
+    return uintIndexSupported;
+}
+
+void setUintIndexSupported(bool supported)
+{
+    uintIndexSupported = supported;
+    uintIndexChecked = true;
+}
+
 GlObject::GlObject() : m_bound(false)
 {
 }
@@ -98,6 +98,17 @@ inline ngsRGBA ngsGl2RGBA(const GlColor &color) {
 bool checkGLError(const char *cmd);
 void reportGlStatus(GLuint obj);
 void prepareContext();
+/**
+ * @brief isUintIndexSupported Returns true if Gl context can draw elements
+ * with 32-bit indices. Known after first prepareContext() call.
+ */
+bool isUintIndexSupported();
+/**
+ * @brief setUintIndexSupported Sets 32-bit element indices support without
+ * Gl context check. Used to fill buffers before the context exists, e.g. in
+ * tests.
+ */
+void setUintIndexSupported(bool supported);
 
 /**
  * @brief The GlObject class Base class for Gl objects
@@ -24,6 +24,86 @@
 
 namespace ngs {
 
+//------------------------------------------------------------------------------
+// GlImageBufferPool
+//------------------------------------------------------------------------------
+
+GlImageBufferPool::GlImageBufferPool(size_t maxSize) :
+    m_maxSize(maxSize),
+    m_size(0)
+{
+}
+
+GlImageBufferPool::~GlImageBufferPool()
+{
+    clear();
+}
+
+GlImageBufferPtr GlImageBufferPool::take(size_t size)
+{
+    GLubyte *buffer = nullptr;
+    {
+        MutexHolder holder(m_mutex);
+        auto it = m_buffers.find(size);
+        if(it != m_buffers.end() && !it->second.empty()) {
+            buffer = it->second.back();
+            it->second.pop_back();
+            m_size -= size;
+        }
+    }
+
+    if(nullptr == buffer) {
+        buffer = static_cast<GLubyte*>(VSI_MALLOC_VERBOSE(size));
+        if(nullptr == buffer) {
+            return GlImageBufferPtr();
+        }
+    }
+
+    std::weak_ptr<GlImageBufferPool> pool = shared_from_this();
+    return GlImageBufferPtr(buffer, [pool, size](GLubyte *data) {
+        GlImageBufferPoolPtr owner = pool.lock();
+        if(owner) {
+            owner->release(data, size);
+        }
+        else {
+            CPLFree(data);
+        }
+    });
+}
+
+void GlImageBufferPool::release(GLubyte *buffer, size_t size)
+{
+    MutexHolder holder(m_mutex);
+    if(m_size + size > m_maxSize) {
+        CPLFree(buffer);
+        return;
+    }
+    m_buffers[size].push_back(buffer);
+    m_size += size;
+}
+
+void GlImageBufferPool::clear()
+{
+    MutexHolder holder(m_mutex);
+    for(auto &item : m_buffers) {
+        for(GLubyte *buffer : item.second) {
+            CPLFree(buffer);
+        }
+    }
+    m_buffers.clear();
+    m_size = 0;
+}
+
+size_t GlImageBufferPool::size() const
+{
+    MutexHolder holder(m_mutex);
+    return m_size;
+}
+
+//------------------------------------------------------------------------------
+// GlImage
+//------------------------------------------------------------------------------
+
 GlImage::GlImage() : GlObject(),
     m_imageData(nullptr),
     m_id(0),
@@ -33,10 +113,7 @@ GlImage::GlImage() : GlObject(),
 
 GlImage::~GlImage()
 {
-    if(m_imageData) {
-        CPLFree(m_imageData);
-        m_imageData = nullptr;
-    }
+    freeImageData();
 }
 
 void GlImage::bind()
@@ -49,8 +126,7 @@ void GlImage::bind()
                     GL_RGBA, GL_UNSIGNED_BYTE, m_imageData));
     m_bound = true;
 
-    CPLFree(m_imageData);
-    m_imageData = nullptr;
+    freeImageData();
 }
 
 void GlImage::rebind() const
@@ -68,10 +144,19 @@ void GlImage::destroy()
         ngsCheckGLError(glDeleteTextures(1, &m_id));
     }
 
-    if(m_imageData) {
+    freeImageData();
+}
+
+void GlImage::freeImageData()
+{
+    if(m_buffer) {
+        // Shared buffer is released by the last owner.
+        m_buffer.reset();
+    }
+    else if(m_imageData) {
         CPLFree(m_imageData);
-        m_imageData = nullptr;
     }
+    m_imageData = nullptr;
 }
 
 } // namespace ngs
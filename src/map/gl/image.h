@@ -23,10 +23,46 @@
 
 #include "functions.h"
 
+// stl
+#include <map>
+#include <memory>
+#include <vector>
+
 #include "ds/raster.h"
+#include "util/mutex.h"
 
 namespace ngs {
 
+/**
+ * RGBA buffer shared between texture and raster tile cache. The last owner
+ * returns the buffer to the pool it was taken from.
+ */
+using GlImageBufferPtr = std::shared_ptr<GLubyte>;
+
+/**
+ * @brief The GlImageBufferPool class Keeps released image buffers to reuse
+ * them for next textures instead of allocate and free memory for each tile.
+ */
+class GlImageBufferPool : public std::enable_shared_from_this<GlImageBufferPool>
+{
+public:
+    explicit GlImageBufferPool(size_t maxSize);
+    ~GlImageBufferPool();
+    GlImageBufferPtr take(size_t size);
+    void clear();
+    size_t size() const;
+
+protected:
+    void release(GLubyte *buffer, size_t size);
+
+private:
+    std::map<size_t, std::vector<GLubyte*>> m_buffers;
+    size_t m_maxSize, m_size;
+    mutable Mutex m_mutex;
+};
+
+using GlImageBufferPoolPtr = std::shared_ptr<GlImageBufferPool>;
+
 class GlImage : public GlObject
 {
 public:
@@ -37,6 +73,13 @@ public:
         m_width = width;
         m_height = height;
     }
+    void setImage(const GlImageBufferPtr &buffer, GLsizei width,
+                  GLsizei height) {
+        m_buffer = buffer;
+        m_imageData = buffer.get();
+        m_width = width;
+        m_height = height;
+    }
     void setImage(const ImageData &data) {
         m_imageData = static_cast<GLubyte*>(data.buffer);
         m_width = data.width;
@@ -55,8 +98,12 @@ public:
     GLuint id() const { return m_id; }
     void setSmooth(bool smooth) { m_smooth = smooth; }
 
+protected:
+    void freeImageData();
+
 protected:
     GLubyte *m_imageData;
+    GlImageBufferPtr m_buffer;
     GLsizei m_width, m_height;
     GLuint m_id;
     bool m_smooth;
@@ -19,8 +19,11 @@
  *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
  ****************************************************************************/
 
+#include <algorithm>
 #include <cstring>
+#include <ctime>
 #include <math.h>
+#include <tuple>
 
 #include "cpl_conv.h"
 #include "ogr_core.h"
@@ -28,19 +31,652 @@
 #include "layer.h"
 #include "style.h"
 #include "view.h"
+#include "catalog/file.h"
+#include "catalog/folder.h"
+#include "util/buffer.h"
 #include "util/error.h"
 #include "util/settings.h"
+#include "util/stringutil.h"
 
 namespace ngs {
 
 constexpr unsigned char MAX_ZOOM = 18;
 constexpr double LOCK_TIME = 5.0;
+constexpr unsigned char SEGMENT_VERTICES_COUNT = 4;
+constexpr unsigned char SEGMENT_INDICES_COUNT = 6;
+constexpr size_t IMAGE_BUFFER_POOL_SIZE = 8 * 1024 * 1024; // 8 Mb
+constexpr GUInt32 RASTER_TILE_MAGIC = 0x5452474E; // NGRT
+constexpr GByte RASTER_TILE_VERSION = 1;
+constexpr const char *RASTER_TILE_EXT = "ngrt";
+constexpr int WARP_GRID_STEP = 16; // Pixels
+constexpr double WARP_MAX_ERROR = 0.125; // Pixels, as gdalwarp default
+constexpr double WARP_WINDOW_MARGIN = 2.0; // Cubic kernel radius
+constexpr int WARP_EXTENT_SEGMENTS = 32;
+
+// Buffer size estimates. Used to reserve buffer arrays once before fill tile
+// instead of grow them by push_back. Overestimated space is freed by shrink.
+static void addPointsEstimate(size_t count, const PointStyle *style,
+                              size_t &vertices, size_t &indices)
+{
+    switch(style->bufferType()) {
+    case GlBuffer::BF_PT:
+        vertices += count * style->pointVerticesCount();
+        indices += count;
+        break;
+    case GlBuffer::BF_TEX:
+        vertices += count * style->pointVerticesCount() *
+                VERTEX_WITH_NORMAL_SIZE;
+        indices += count * SEGMENT_INDICES_COUNT;
+        break;
+    default:
+        vertices += count * style->pointVerticesCount() *
+                VERTEX_WITH_NORMAL_SIZE;
+        indices += count * style->pointVerticesCount();
+        break;
+    }
+}
+
+static void addLineEstimate(size_t count, bool closed,
+                            const SimpleLineStyle *style,
+                            size_t &vertices, size_t &indices)
+{
+    if(count < 2) {
+        return;
+    }
+    size_t segments = count - 1;
+    size_t joinCaps = (segments - 1) * style->lineJoinVerticesCount();
+    if(closed) {
+        joinCaps += style->lineJoinVerticesCount();
+    }
+    else {
+        joinCaps += 2 * style->lineCapVerticesCount();
+    }
+    vertices += (segments * SEGMENT_VERTICES_COUNT + joinCaps) *
+            VERTEX_WITH_NORMAL_SIZE;
+    indices += segments * SEGMENT_INDICES_COUNT + joinCaps;
+}
+
+static void addPolygonEstimate(const VectorTileItem &item,
+                               const SimpleLineStyle *style,
+                               size_t &fillVertices, size_t &fillIndices,
+                               size_t &lineVertices, size_t &lineIndices)
+{
+    fillVertices += item.points().size() * 3;
+    fillIndices += item.indices().size();
+    if(nullptr == style) {
+        return;
+    }
+    for(size_t ring = 0; ring < item.borderCount(); ++ring) {
+        addLineEstimate(item.borderIndices(ring).size(), true, style,
+                        lineVertices, lineIndices);
+    }
+}
+
+//------------------------------------------------------------------------------
+// GlTileCache
+//------------------------------------------------------------------------------
+
+GlTileCache::GlTileCache(size_t maxSize) :
+    m_maxSize(maxSize),
+    m_size(0),
+    m_epoch(0),
+    m_layerId(0),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+bool GlTileCache::take(unsigned int layerId, const Tile &tile, Entry &entry)
+{
+    MutexHolder holder(m_mutex);
+    auto it = m_items.find({layerId, tile});
+    if(it == m_items.end()) {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    entry = std::move(it->second.entry);
+    // Entry survived all invalidations since it was put.
+    entry.epoch = m_epoch;
+    erase(it);
+    return true;
+}
+
+bool GlTileCache::contains(unsigned int layerId, const Tile &tile) const
+{
+    MutexHolder holder(m_mutex);
+    return m_items.find({layerId, tile}) != m_items.end();
+}
+
+void GlTileCache::put(unsigned int layerId, const Tile &tile, Entry &&entry)
+{
+    MutexHolder holder(m_mutex);
+    // The data was filled before some region was invalidated and may be stale.
+    if(entry.epoch != m_epoch || m_maxSize == 0) {
+        return;
+    }
+
+    Key key = {layerId, tile};
+    auto it = m_items.find(key);
+    if(it != m_items.end()) {
+        erase(it);
+    }
+
+    m_order.push_front(key);
+    size_t size = entrySize(entry);
+    m_items[key] = {std::move(entry), size, m_order.begin()};
+    m_size += size;
+
+    evict();
+}
+
+void GlTileCache::remove(const Envelope &bounds)
+{
+    MutexHolder holder(m_mutex);
+    m_epoch++;
+    auto it = m_items.begin();
+    while(it != m_items.end()) {
+        auto current = it++;
+        if(current->second.entry.extent.intersects(bounds)) {
+            erase(current);
+        }
+    }
+}
+
+void GlTileCache::clear()
+{
+    MutexHolder holder(m_mutex);
+    m_epoch++;
+    m_items.clear();
+    m_order.clear();
+    m_size = 0;
+}
+
+unsigned int GlTileCache::epoch() const
+{
+    MutexHolder holder(m_mutex);
+    return m_epoch;
+}
+
+unsigned int GlTileCache::nextLayerId()
+{
+    MutexHolder holder(m_mutex);
+    return ++m_layerId;
+}
+
+void GlTileCache::setMaxSize(size_t maxSize)
+{
+    MutexHolder holder(m_mutex);
+    m_maxSize = maxSize;
+    evict();
+}
+
+size_t GlTileCache::maxSize() const
+{
+    MutexHolder holder(m_mutex);
+    return m_maxSize;
+}
+
+size_t GlTileCache::size() const
+{
+    MutexHolder holder(m_mutex);
+    return m_size;
+}
+
+GUIntBig GlTileCache::hits() const
+{
+    MutexHolder holder(m_mutex);
+    return m_hits;
+}
+
+GUIntBig GlTileCache::misses() const
+{
+    MutexHolder holder(m_mutex);
+    return m_misses;
+}
+
+void GlTileCache::resetStatistics()
+{
+    MutexHolder holder(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void GlTileCache::erase(std::map<Key, Item>::iterator it)
+{
+    m_size -= it->second.size;
+    m_order.erase(it->second.order);
+    m_items.erase(it);
+}
+
+void GlTileCache::evict()
+{
+    while(m_size > m_maxSize && !m_order.empty()) {
+        erase(m_items.find(m_order.back()));
+    }
+}
+
+size_t GlTileCache::entrySize(const Entry &entry)
+{
+    size_t size = sizeof(Item) + entry.vtile.memorySize();
+    VectorGlObject *object = ngsDynamicCast(VectorGlObject, entry.object);
+    if(nullptr != object) {
+        size += object->memorySize();
+    }
+    return size;
+}
+
+//------------------------------------------------------------------------------
+// GlRasterTileCache
+//------------------------------------------------------------------------------
+
+bool GlRasterTileCache::Key::operator<(const Key &other) const
+{
+    return std::tie(raster, bands, transparency, tile) <
+            std::tie(other.raster, other.bands, other.transparency, other.tile);
+}
+
+GlRasterTileCache::GlRasterTileCache(size_t maxSize, size_t maxDiskSize) :
+    m_maxSize(maxSize),
+    m_size(0),
+    m_maxDiskSize(maxDiskSize),
+    m_diskSize(0),
+    m_hits(0),
+    m_misses(0),
+    m_pool(std::make_shared<GlImageBufferPool>(IMAGE_BUFFER_POOL_SIZE))
+{
+}
+
+bool GlRasterTileCache::get(const Key &key, Entry &entry)
+{
+    std::string path;
+    {
+        MutexHolder holder(m_mutex);
+        auto it = m_items.find(key);
+        if(it != m_items.end()) {
+            m_hits++;
+            m_order.splice(m_order.begin(), m_order, it->second.order);
+            entry = it->second.entry;
+            return true;
+        }
+
+        if(m_diskPath.empty()) {
+            m_misses++;
+            return false;
+        }
+        path = tilePath(key);
+    }
+
+    // Read and inflate the tile without lock, other layers may use memory tier.
+    bool result = load(path, entry);
+
+    MutexHolder holder(m_mutex);
+    if(!result) {
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    insert(key, entry);
+    auto fileIt = m_fileIndex.find(path);
+    if(fileIt != m_fileIndex.end()) {
+        m_files.splice(m_files.begin(), m_files, fileIt->second);
+    }
+    return true;
+}
+
+void GlRasterTileCache::put(const Key &key, const Entry &entry)
+{
+    std::string path;
+    {
+        MutexHolder holder(m_mutex);
+        insert(key, entry);
+        if(!m_diskPath.empty()) {
+            path = tilePath(key);
+        }
+    }
+
+    if(path.empty() || Folder::isExists(path)) {
+        return;
+    }
+    size_t fileSize = save(path, entry);
+    if(fileSize == 0) {
+        return;
+    }
+
+    std::vector<std::string> evicted;
+    {
+        MutexHolder holder(m_mutex);
+        // Disk path may be changed while saving
+        if(!m_diskPath.empty() && startsWith(path, m_diskPath)) {
+            useFile(path, fileSize);
+            evicted = evictFiles();
+        }
+    }
+    for(const std::string &evictedPath : evicted) {
+        File::deleteFile(evictedPath);
+    }
+}
+
+GlImageBufferPtr GlRasterTileCache::createBuffer(size_t size)
+{
+    return m_pool->take(size);
+}
+
+void GlRasterTileCache::clear()
+{
+    MutexHolder holder(m_mutex);
+    m_items.clear();
+    m_order.clear();
+    m_size = 0;
+}
+
+/**
+ * @brief GlRasterTileCache::remove Removes raster tiles from memory. Disk
+ * tiles are evicted by disk budget, as the raster key is part of file name
+ * hash.
+ * @param raster Raster key.
+ */
+void GlRasterTileCache::remove(const std::string &raster)
+{
+    MutexHolder holder(m_mutex);
+    for(auto it = m_items.begin(); it != m_items.end();) {
+        auto next = std::next(it);
+        if(it->first.raster == raster) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void GlRasterTileCache::setMaxSize(size_t maxSize)
+{
+    MutexHolder holder(m_mutex);
+    m_maxSize = maxSize;
+    evict();
+}
+
+size_t GlRasterTileCache::maxSize() const
+{
+    MutexHolder holder(m_mutex);
+    return m_maxSize;
+}
+
+size_t GlRasterTileCache::size() const
+{
+    MutexHolder holder(m_mutex);
+    return m_size;
+}
+
+void GlRasterTileCache::setDiskPath(const std::string &path)
+{
+    // Files left by previous sessions, the oldest are evicted first
+    std::vector<std::pair<time_t, DiskFile>> files;
+    if(!path.empty()) {
+        if(!Folder::isExists(path)) {
+            Folder::mkDir(path, true);
+        }
+        for(const std::string &name : Folder::listFiles(path)) {
+            if(!compare(File::getExtension(name), RASTER_TILE_EXT)) {
+                continue;
+            }
+            std::string filePath = File::formFileName(path, name);
+            VSIStatBufL sbuf;
+            if(VSIStatL(filePath.c_str(), &sbuf) == 0) {
+                files.push_back({sbuf.st_mtime,
+                                 {filePath, static_cast<size_t>(sbuf.st_size)}});
+            }
+        }
+        std::sort(files.begin(), files.end(),
+                  [](const std::pair<time_t, DiskFile> &a,
+                     const std::pair<time_t, DiskFile> &b) {
+            return a.first > b.first;
+        });
+    }
+
+    std::vector<std::string> evicted;
+    {
+        MutexHolder holder(m_mutex);
+        m_diskPath = path;
+        m_files.clear();
+        m_fileIndex.clear();
+        m_diskSize = 0;
+        for(const auto &file : files) {
+            m_files.push_back(file.second);
+            m_fileIndex[file.second.path] = std::prev(m_files.end());
+            m_diskSize += file.second.size;
+        }
+        evicted = evictFiles();
+    }
+    for(const std::string &evictedPath : evicted) {
+        File::deleteFile(evictedPath);
+    }
+}
+
+std::string GlRasterTileCache::diskPath() const
+{
+    MutexHolder holder(m_mutex);
+    return m_diskPath;
+}
+
+void GlRasterTileCache::setMaxDiskSize(size_t maxSize)
+{
+    std::vector<std::string> evicted;
+    {
+        MutexHolder holder(m_mutex);
+        m_maxDiskSize = maxSize;
+        evicted = evictFiles();
+    }
+    for(const std::string &evictedPath : evicted) {
+        File::deleteFile(evictedPath);
+    }
+}
+
+size_t GlRasterTileCache::maxDiskSize() const
+{
+    MutexHolder holder(m_mutex);
+    return m_maxDiskSize;
+}
+
+size_t GlRasterTileCache::diskSize() const
+{
+    MutexHolder holder(m_mutex);
+    return m_diskSize;
+}
+
+GUIntBig GlRasterTileCache::hits() const
+{
+    MutexHolder holder(m_mutex);
+    return m_hits;
+}
+
+GUIntBig GlRasterTileCache::misses() const
+{
+    MutexHolder holder(m_mutex);
+    return m_misses;
+}
+
+void GlRasterTileCache::resetStatistics()
+{
+    MutexHolder holder(m_mutex);
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void GlRasterTileCache::erase(std::map<Key, Item>::iterator it)
+{
+    m_size -= entrySize(it->second.entry);
+    m_order.erase(it->second.order);
+    m_items.erase(it);
+}
+
+void GlRasterTileCache::evict()
+{
+    while(m_size > m_maxSize && !m_order.empty()) {
+        erase(m_items.find(m_order.back()));
+    }
+}
+
+void GlRasterTileCache::useFile(const std::string &path, size_t size)
+{
+    auto it = m_fileIndex.find(path);
+    if(it != m_fileIndex.end()) {
+        m_diskSize -= it->second->size;
+        it->second->size = size;
+        m_files.splice(m_files.begin(), m_files, it->second);
+    }
+    else {
+        m_files.push_front({path, size});
+        m_fileIndex[path] = m_files.begin();
+    }
+    m_diskSize += size;
+}
+
+/**
+ * @brief GlRasterTileCache::evictFiles Removes least recently used files from
+ * the index until disk size fits the budget. Call with lock held.
+ * @return Paths to delete after the lock released.
+ */
+std::vector<std::string> GlRasterTileCache::evictFiles()
+{
+    std::vector<std::string> out;
+    while(m_diskSize > m_maxDiskSize && !m_files.empty()) {
+        const DiskFile &file = m_files.back();
+        m_diskSize -= file.size;
+        out.push_back(file.path);
+        m_fileIndex.erase(file.path);
+        m_files.pop_back();
+    }
+    return out;
+}
+
+void GlRasterTileCache::insert(const Key &key, const Entry &entry)
+{
+    if(m_maxSize == 0) {
+        return;
+    }
+
+    auto it = m_items.find(key);
+    if(it != m_items.end()) {
+        erase(it);
+    }
+
+    m_order.push_front(key);
+    m_items[key] = {entry, m_order.begin()};
+    m_size += entrySize(entry);
+
+    evict();
+}
+
+bool GlRasterTileCache::load(const std::string &path, Entry &entry)
+{
+    if(!Folder::isExists(path)) {
+        return false;
+    }
+
+    std::string data = File::readFile(path);
+    Buffer buffer(reinterpret_cast<GByte*>(&data[0]),
+                  static_cast<int>(data.size()), false);
+    if(buffer.getULong() != RASTER_TILE_MAGIC ||
+            buffer.getByte() != RASTER_TILE_VERSION) {
+        return false;
+    }
+
+    GUInt32 width = buffer.getULong();
+    GUInt32 height = buffer.getULong();
+    bool smooth = buffer.getByte() != 0;
+    double extent[4];
+    if(!buffer.get(extent, sizeof(extent))) {
+        return false;
+    }
+    GUInt32 size = buffer.getULong();
+    if(size == 0 || size != width * height * 4) {
+        return false;
+    }
+
+    GlImageBufferPtr pixels = createBuffer(size);
+    if(!pixels) {
+        return false;
+    }
+    size_t outSize = 0;
+    if(nullptr == CPLZLibInflate(buffer.data() + buffer.position(),
+                                 buffer.available(), pixels.get(), size,
+                                 &outSize) || outSize != size) {
+        return false;
+    }
+
+    entry.data = pixels;
+    entry.width = static_cast<int>(width);
+    entry.height = static_cast<int>(height);
+    entry.extent = Envelope(extent[0], extent[1], extent[2], extent[3]);
+    entry.smooth = smooth;
+    return true;
+}
+
+/**
+ * @brief GlRasterTileCache::save Writes compressed tile to the file.
+ * @return Written file size or zero on error.
+ */
+size_t GlRasterTileCache::save(const std::string &path,
+                               const Entry &entry) const
+{
+    size_t size = static_cast<size_t>(entry.width * entry.height * 4);
+    size_t compressedSize = 0;
+    void *compressed = CPLZLibDeflate(entry.data.get(), size, -1, nullptr, 0,
+                                      &compressedSize);
+    if(nullptr == compressed) {
+        return 0;
+    }
+
+    double extent[4] = { entry.extent.minX(), entry.extent.minY(),
+                         entry.extent.maxX(), entry.extent.maxY() };
+    Buffer buffer;
+    buffer.put(RASTER_TILE_MAGIC);
+    buffer.put(RASTER_TILE_VERSION);
+    buffer.put(static_cast<GUInt32>(entry.width));
+    buffer.put(static_cast<GUInt32>(entry.height));
+    buffer.put(static_cast<GByte>(entry.smooth ? 1 : 0));
+    buffer.put(extent, sizeof(extent));
+    buffer.put(static_cast<GUInt32>(size));
+    buffer.put(compressed, compressedSize);
+    CPLFree(compressed);
+
+    // Several threads may fill the same tile, so write to unique temporary
+    // file and move it in place.
+    std::string tmpPath = path + "." + random(8);
+    if(!File::writeFile(tmpPath, buffer.data(),
+                        static_cast<size_t>(buffer.size()))) {
+        File::deleteFile(tmpPath);
+        return 0;
+    }
+    if(VSIRename(tmpPath.c_str(), path.c_str()) != 0) {
+        File::deleteFile(tmpPath);
+        return 0;
+    }
+    return static_cast<size_t>(buffer.size());
+}
+
+std::string GlRasterTileCache::tilePath(const Key &key) const
+{
+    std::string name = fastHash(CPLSPrintf("%s|%u|%d|%d/%d/%d/%d",
+                                           key.raster.c_str(), key.bands,
+                                           key.transparency, key.tile.z,
+                                           key.tile.x, key.tile.y,
+                                           key.tile.crossExtent));
+    return File::formFileName(m_diskPath, name, RASTER_TILE_EXT);
+}
+
+size_t GlRasterTileCache::entrySize(const Entry &entry)
+{
+    return sizeof(Item) + static_cast<size_t>(entry.width * entry.height * 4);
+}
 
 //------------------------------------------------------------------------------
 // GlRenderLayer
 //------------------------------------------------------------------------------
 
-GlRenderLayer::GlRenderLayer()
+GlRenderLayer::GlRenderLayer() :
+    m_renderVersion(0)
 {
 }
 
@@ -82,9 +718,22 @@ std::string GlRenderLayer::styleName() const
 	return "";
 }
 
+bool GlRenderLayer::prefetch(const TileItem &tileItem, float z)
+{
+    ngsUnused(tileItem);
+    ngsUnused(z);
+    return true;
+}
+
+void GlRenderLayer::refill()
+{
+}
+
 bool GlRenderLayer::setStyle(const CPLJSONObject &style)
 {
     if(m_style) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        m_renderVersion++;
         return m_style->load(style);
     }
     return false;
@@ -96,53 +745,106 @@ bool GlRenderLayer::setStyle(const CPLJSONObject &style)
 
 GlFeatureLayer::GlFeatureLayer(Map *map, const std::string &name) :
     FeatureLayer(map, name),
-    GlRenderLayer()
+    GlRenderLayer(),
+    m_cacheId(0)
 {
+    GlTileCache *cache = tileCache();
+    if(nullptr != cache) {
+        m_cacheId = cache->nextLayerId();
+    }
 }
 
 bool GlFeatureLayer::fill(const GlTilePtr &tile, float z, bool isLastTry)
 {
     ngsUnused(isLastTry);
-    if(!(m_visible && tile->getTile().z > m_minZoom && tile->getTile().z < m_maxZoom)) {
+    if(!isVisible(tile->getTile().z)) {
         MutexHolder holder(m_dataMutex, LOCK_TIME);
         m_tiles[tile->getTile()] = GlObjectPtr();
         return true;
     }
 
-    VectorGlObject *bufferArray = nullptr;
-    VectorTile vtile = m_featureClass->getTile(tile->getTile(), tile->getExtent());
-    if(vtile.empty()) {
+    unsigned int version;
+    {
         MutexHolder holder(m_dataMutex, LOCK_TIME);
-        m_tiles[tile->getTile()] = GlObjectPtr();
-        return true;
+        version = m_renderVersion;
     }
 
-    switch(m_style->type()) {
-    case ST_POINT:
-        bufferArray = fillPoints(vtile, z);
-        break;
-    case ST_LINE:
-        bufferArray = fillLines(vtile, z);
-        break;
-    case ST_FILL:
-        bufferArray = fillPolygons(vtile, z);
-        break;
-    case ST_IMAGE:
-        return true;
+    GlTileCache::Entry entry;
+    GlTileCache *cache = tileCache();
+    if(nullptr == cache || !cache->take(m_cacheId, tile->getTile(), entry)) {
+        entry.epoch = nullptr == cache ? 0 : cache->epoch();
+        entry.extent = tile->getExtent();
+        entry.vtile = m_featureClass->getTile(tile->getTile(), entry.extent);
+        if(!tessellate(entry, z)) {
+            return true;
+        }
     }
+    else if(entry.version != version || !isEqual(entry.z, z)) {
+        if(!tessellate(entry, z)) {
+            return true;
+        }
+    }
+    // else vertex arrays are up to date, only upload to Gl is needed.
 
-    if(!bufferArray) {
-        MutexHolder holder(m_dataMutex, LOCK_TIME);
-        m_tiles[tile->getTile()] = GlObjectPtr();
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    m_tiles[tile->getTile()] = entry.object;
+    m_tileData[tile->getTile()] = std::move(entry);
+
+    return true;
+}
+
+bool GlFeatureLayer::prefetch(const TileItem &tileItem, float z)
+{
+    GlTileCache *cache = tileCache();
+    if(nullptr == cache || !isVisible(tileItem.tile.z) ||
+            cache->contains(m_cacheId, tileItem.tile)) {
         return true;
     }
 
-    MutexHolder holder(m_dataMutex, LOCK_TIME);
-    m_tiles[tile->getTile()] = GlObjectPtr(bufferArray);
+    {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        if(m_tileData.find(tileItem.tile) != m_tileData.end()) {
+            return true; // Tile is in view already
+        }
+    }
 
+    GlTileCache::Entry entry;
+    entry.epoch = cache->epoch();
+    // Same extent as GlTile created for this tile item
+    entry.extent = tileItem.env;
+    entry.extent.resize(TILE_RESIZE);
+    entry.vtile = m_featureClass->getTile(tileItem.tile, entry.extent);
+    if(tessellate(entry, z)) {
+        cache->put(m_cacheId, tileItem.tile, std::move(entry));
+    }
     return true;
 }
 
+void GlFeatureLayer::free(const GlTilePtr &tile)
+{
+    GlTileCache *cache = tileCache();
+    if(nullptr != cache) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        auto dataIt = m_tileData.find(tile->getTile());
+        if(dataIt != m_tileData.end()) {
+            GlTileCache::Entry entry = std::move(dataIt->second);
+            m_tileData.erase(dataIt);
+
+            // Release Gl names only, vertex arrays go to cache.
+            auto it = m_tiles.find(tile->getTile());
+            if(it != m_tiles.end()) {
+                if(it->second) {
+                    it->second->destroy();
+                }
+                m_tiles.erase(it);
+            }
+            cache->put(m_cacheId, tile->getTile(), std::move(entry));
+        }
+    }
+
+    GlRenderLayer::free(tile);
+}
+
 bool GlFeatureLayer::draw(const GlTilePtr &tile)
 {
     if(!tile) {
@@ -188,8 +890,10 @@ bool GlFeatureLayer::setStyleName(const std::string &name)
     GlView *mapView = dynamic_cast<GlView*>(m_map);
     StylePtr newStyle = StylePtr(Style::createStyle(name, mapView->textureAtlas()));
     if(newStyle) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
         m_oldStyles.push_back(m_style);
         m_style = newStyle;
+        m_renderVersion++;
     }
     return true;
 }
@@ -224,6 +928,8 @@ void GlFeatureLayer::setFeatureClass(const FeatureClassOverviewPtr &featureClass
 {
     FeatureLayer::setFeatureClass(featureClass);
     GlView *mapView = dynamic_cast<GlView*>(m_map);
+    // Cached tiles of previous feature class will be evicted by LRU.
+    m_cacheId = mapView->tileCache()->nextLayerId();
     switch(OGR_GT_Flatten(featureClass->geometryType())) {
     case wkbPoint:
     case wkbMultiPoint:
@@ -240,16 +946,112 @@ void GlFeatureLayer::setFeatureClass(const FeatureClassOverviewPtr &featureClass
     }
 }
 
+void GlFeatureLayer::setSelectedIds(const FeatureIDs &selectedIds)
+{
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    FeatureLayer::setSelectedIds(selectedIds);
+    m_renderVersion++;
+}
+
+void GlFeatureLayer::setHideIds(const FeatureIDs &hideIds)
+{
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    FeatureLayer::setHideIds(hideIds);
+    m_renderVersion++;
+}
+
+GlTileCache *GlFeatureLayer::tileCache() const
+{
+    GlView *mapView = dynamic_cast<GlView*>(m_map);
+    if(nullptr == mapView) {
+        return nullptr;
+    }
+    return mapView->tileCache();
+}
+
+bool GlFeatureLayer::isVisible(unsigned char zoom) const
+{
+    return m_visible && zoom > m_minZoom && zoom < m_maxZoom;
+}
+
+bool GlFeatureLayer::tessellate(GlTileCache::Entry &entry, float z)
+{
+    {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        entry.version = m_renderVersion;
+    }
+    entry.object = GlObjectPtr();
+    entry.z = z;
+
+    if(entry.vtile.empty()) {
+        return true;
+    }
+
+    VectorGlObject *bufferArray = nullptr;
+    switch(m_style->type()) {
+    case ST_POINT:
+        bufferArray = fillPoints(entry.vtile, z);
+        break;
+    case ST_LINE:
+        bufferArray = fillLines(entry.vtile, z);
+        break;
+    case ST_FILL:
+        bufferArray = fillPolygons(entry.vtile, z);
+        break;
+    case ST_IMAGE:
+        return false;
+    }
+
+    if(bufferArray) {
+        bufferArray->shrink();
+        entry.object = GlObjectPtr(bufferArray);
+    }
+    return true;
+}
+
+/**
+ * @brief GlFeatureLayer::polygonsEstimate Upper bound of fillPolygons buffers
+ * sizes to reserve them once.
+ * @param tile Tile to fill
+ * @param fillVertices Fill vertex array size in floats
+ * @param fillIndices Fill index count
+ * @param lineVertices Border vertex array size in floats
+ * @param lineIndices Border index count
+ */
+void GlFeatureLayer::polygonsEstimate(const VectorTile &tile,
+                                      size_t &fillVertices, size_t &fillIndices,
+                                      size_t &lineVertices,
+                                      size_t &lineIndices) const
+{
+    SimpleFillBorderedStyle *borderedStyle =
+            ngsDynamicCast(SimpleFillBorderedStyle, m_style);
+    SimpleLineStyle *borderStyle = borderedStyle ?
+                borderedStyle->lineStyle() : nullptr;
+    for(const VectorTileItem &tileItem : tile.items()) {
+        if(!tileItem.isIdsPresent(m_hideFIDs)) {
+            addPolygonEstimate(tileItem, borderStyle,
+                               fillVertices, fillIndices,
+                               lineVertices, lineIndices);
+        }
+    }
+}
+
 VectorGlObject *GlFeatureLayer::fillPoints(const VectorTile &tile, float z)
 {
     VectorGlObject *bufferArray = new VectorGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short index = 0;
-    GlBuffer *buffer = new GlBuffer(GlBuffer::BF_PT);
+    GLuint index = 0;
     PointStyle *style = ngsDynamicCast(PointStyle, m_style);
+    size_t vertices = 0, indices = 0;
+    for(const VectorTileItem &tileItem : items) {
+        if(m_hideFIDs.empty() || !tileItem.isIdsPresent(m_hideFIDs)) {
+            addPointsEstimate(tileItem.pointCount(), style, vertices, indices);
+        }
+    }
+    GlBuffer *buffer = new GlBuffer(GlBuffer::BF_PT, vertices, indices);
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(!m_hideFIDs.empty() && tileItem.isIdsPresent(m_hideFIDs)) {
             ++it;
             continue;
@@ -281,14 +1083,21 @@ VectorGlObject *GlFeatureLayer::fillPoints(const VectorTile &tile, float z)
 VectorGlObject *GlFeatureLayer::fillLines(const VectorTile &tile, float z)
 {
     VectorGlObject *bufferArray = new VectorGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short index = 0;
-    GlBuffer *buffer = new GlBuffer(GlBuffer::BF_LINE);
+    GLuint index = 0;
     SimpleLineStyle *style = ngsStaticCast(SimpleLineStyle, m_style);
+    size_t vertices = 0, indices = 0;
+    for(const VectorTileItem &tileItem : items) {
+        if(!tileItem.isIdsPresent(m_hideFIDs)) {
+            addLineEstimate(tileItem.pointCount(), tileItem.isClosed(), style,
+                            vertices, indices);
+        }
+    }
+    GlBuffer *buffer = new GlBuffer(GlBuffer::BF_LINE, vertices, indices);
 
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(tileItem.isIdsPresent(m_hideFIDs)) {
             ++it;
             continue;
@@ -366,23 +1175,31 @@ VectorGlObject *GlFeatureLayer::fillLines(const VectorTile &tile, float z)
 VectorGlObject *GlFeatureLayer::fillPolygons(const VectorTile &tile, float z)
 {
     VectorGlObject *bufferArray = new VectorGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short fillIndex = 0;
-    unsigned short lineIndex = 0;
-    GlBuffer *fillBuffer = new GlBuffer(GlBuffer::BF_FILL);
-    GlBuffer *lineBuffer = new GlBuffer(GlBuffer::BF_LINE);
-    SimpleLineStyle *style = ngsStaticCast(SimpleLineStyle, m_style);
+    GLuint fillIndex = 0;
+    GLuint lineIndex = 0;
+    SimpleFillBorderedStyle *borderedStyle =
+            ngsDynamicCast(SimpleFillBorderedStyle, m_style);
+    SimpleLineStyle *style = borderedStyle ? borderedStyle->lineStyle() :
+                                             nullptr;
+    size_t fillVertices = 0, fillIndices = 0, lineVertices = 0, lineIndices = 0;
+    polygonsEstimate(tile, fillVertices, fillIndices, lineVertices,
+                     lineIndices);
+    GlBuffer *fillBuffer = new GlBuffer(GlBuffer::BF_FILL, fillVertices,
+                                        fillIndices);
+    GlBuffer *lineBuffer = new GlBuffer(GlBuffer::BF_LINE, lineVertices,
+                                        lineIndices);
 
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(tileItem.isIdsPresent(m_hideFIDs)) {
             ++it;
             continue;
         }
 
-        auto points = tileItem.points();
-        auto indices = tileItem.indices();
+        const auto &points = tileItem.points();
+        const auto &indices = tileItem.indices();
 
         if(points.size() < 3 || points.size() > GlBuffer::maxIndices() ||
                 points.size() > GlBuffer::maxVertices()) {
@@ -404,7 +1221,7 @@ VectorGlObject *GlFeatureLayer::fillPolygons(const VectorTile &tile, float z)
         }
 
         // FIXME: Expected indices should fit to buffer as points can
-        unsigned short maxFillIndex = 0;
+        GLuint maxFillIndex = 0;
         for(auto indexPoint : indices) {
             fillBuffer->addIndex(fillIndex + indexPoint);
             if(maxFillIndex < indexPoint) {
@@ -416,10 +1233,10 @@ VectorGlObject *GlFeatureLayer::fillPolygons(const VectorTile &tile, float z)
 
         // Fill borders
         // FIXME: May be more styles with borders
-        if(compare(m_style->name(), "simpleFillBordered")) {
+        if(nullptr != style) {
 
-        auto borders = (*it).borderIndices();
-        for(auto border : borders) {
+        for(size_t ring = 0; ring < tileItem.borderCount(); ++ring) {
+            ArrayView<unsigned short> border = tileItem.borderIndices(ring);
             Normal prevNormal;
             Normal firstNormal;
             bool firstNormalSet = false;
@@ -550,21 +1367,38 @@ VectorGlObject* GlSelectableFeatureLayer::fillPoints(const VectorTile &tile,
                                                      float z)
 {
     VectorSelectableGlObject *bufferArray = new VectorSelectableGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short index = 0;
+    GLuint index = 0;
     GlBuffer *buffer = nullptr;
     PointStyle *style = nullptr;
 
     PointStyle *drawStyle = ngsDynamicCast(PointStyle, m_style);
     PointStyle *selectStyle = ngsDynamicCast(PointStyle, selectionStyle());
-    GlBuffer *draw = new GlBuffer(drawStyle->bufferType());
-    GlBuffer *select = new GlBuffer(selectStyle->bufferType());
-    unsigned short drawIndex = 0;
-    unsigned short selectIndex = 0;
+    size_t drawVertices = 0, drawIndices = 0;
+    size_t selectVertices = 0, selectIndices = 0;
+    for(const VectorTileItem &tileItem : items) {
+        if(tileItem.isIdsPresent(m_hideFIDs, true)) {
+            continue;
+        }
+        if(tileItem.isIdsPresent(m_selectedFIDs, false)) {
+            addPointsEstimate(tileItem.pointCount(), selectStyle,
+                              selectVertices, selectIndices);
+        }
+        else {
+            addPointsEstimate(tileItem.pointCount(), drawStyle,
+                              drawVertices, drawIndices);
+        }
+    }
+    GlBuffer *draw = new GlBuffer(drawStyle->bufferType(), drawVertices,
+                                  drawIndices);
+    GlBuffer *select = new GlBuffer(selectStyle->bufferType(), selectVertices,
+                                    selectIndices);
+    GLuint drawIndex = 0;
+    GLuint selectIndex = 0;
 
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(tileItem.isIdsPresent(m_hideFIDs, true)) {
             ++it;
             continue;
@@ -628,20 +1462,36 @@ VectorGlObject *GlSelectableFeatureLayer::fillLines(const VectorTile &tile,
                                                     float z)
 {
     VectorSelectableGlObject *bufferArray = new VectorSelectableGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short index = 0;
+    GLuint index = 0;
     GlBuffer *buffer = nullptr;
-    GlBuffer *draw = new GlBuffer(GlBuffer::BF_LINE);
-    GlBuffer *select = new GlBuffer(GlBuffer::BF_LINE);
     SimpleLineStyle *drawStyle = ngsDynamicCast(SimpleLineStyle, m_style);
     SimpleLineStyle *selectStyle = ngsDynamicCast(SimpleLineStyle, selectionStyle());
+    size_t drawVertices = 0, drawIndices = 0;
+    size_t selectVertices = 0, selectIndices = 0;
+    for(const VectorTileItem &tileItem : items) {
+        if(tileItem.isIdsPresent(m_hideFIDs)) {
+            continue;
+        }
+        if(tileItem.isIdsPresent(m_selectedFIDs, false)) {
+            addLineEstimate(tileItem.pointCount(), tileItem.isClosed(),
+                            selectStyle, selectVertices, selectIndices);
+        }
+        else {
+            addLineEstimate(tileItem.pointCount(), tileItem.isClosed(),
+                            drawStyle, drawVertices, drawIndices);
+        }
+    }
+    GlBuffer *draw = new GlBuffer(GlBuffer::BF_LINE, drawVertices, drawIndices);
+    GlBuffer *select = new GlBuffer(GlBuffer::BF_LINE, selectVertices,
+                                    selectIndices);
     SimpleLineStyle *style = nullptr;
-    unsigned short drawIndex = 0;
-    unsigned short selectIndex = 0;
+    GLuint drawIndex = 0;
+    GLuint selectIndex = 0;
 
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(tileItem.isIdsPresent(m_hideFIDs)) {
             ++it;
             continue;
@@ -782,14 +1632,10 @@ VectorGlObject *GlSelectableFeatureLayer::fillPolygons(const VectorTile& tile,
                                                        float z)
 {
     VectorSelectableGlObject *bufferArray = new VectorSelectableGlObject;
-    auto items = tile.items();
+    const VectorTileItemArray &items = tile.items();
     auto it = items.begin();
-    unsigned short fillIndex = 0;
-    unsigned short lineIndex = 0;
-    GlBuffer *drawFillBuffer = new GlBuffer(GlBuffer::BF_FILL);
-    GlBuffer *drawLineBuffer = new GlBuffer(GlBuffer::BF_LINE);
-    GlBuffer *selectFillBuffer = new GlBuffer(GlBuffer::BF_FILL);
-    GlBuffer *selectLineBuffer = new GlBuffer(GlBuffer::BF_LINE);
+    GLuint fillIndex = 0;
+    GLuint lineIndex = 0;
     GlBuffer *fillBuffer = nullptr;
     GlBuffer *lineBuffer = nullptr;
 
@@ -801,23 +1647,53 @@ VectorGlObject *GlSelectableFeatureLayer::fillPolygons(const VectorTile& tile,
                                                           selectionStyle());
     SimpleLineStyle *selectLineStyle = selectStyle->lineStyle();
 
+    size_t drawFillVertices = 0, drawFillIndices = 0;
+    size_t drawLineVertices = 0, drawLineIndices = 0;
+    size_t selectFillVertices = 0, selectFillIndices = 0;
+    size_t selectLineVertices = 0, selectLineIndices = 0;
+    for(const VectorTileItem &tileItem : items) {
+        if(tileItem.isIdsPresent(m_hideFIDs)) {
+            continue;
+        }
+        if(tileItem.isIdsPresent(m_selectedFIDs, false)) {
+            addPolygonEstimate(tileItem, selectLineStyle,
+                               selectFillVertices, selectFillIndices,
+                               selectLineVertices, selectLineIndices);
+        }
+        else {
+            addPolygonEstimate(tileItem, drawLineStyle,
+                               drawFillVertices, drawFillIndices,
+                               drawLineVertices, drawLineIndices);
+        }
+    }
+    GlBuffer *drawFillBuffer = new GlBuffer(GlBuffer::BF_FILL, drawFillVertices,
+                                            drawFillIndices);
+    GlBuffer *drawLineBuffer = new GlBuffer(GlBuffer::BF_LINE, drawLineVertices,
+                                            drawLineIndices);
+    GlBuffer *selectFillBuffer = new GlBuffer(GlBuffer::BF_FILL,
+                                              selectFillVertices,
+                                              selectFillIndices);
+    GlBuffer *selectLineBuffer = new GlBuffer(GlBuffer::BF_LINE,
+                                              selectLineVertices,
+                                              selectLineIndices);
+
     SimpleFillBorderedStyle *style;
     SimpleLineStyle *lineStyle;
 
-    unsigned short selectFillIndex = 0;
-    unsigned short selectLineIndex = 0;
-    unsigned short drawFillIndex = 0;
-    unsigned short drawLineIndex = 0;
+    GLuint selectFillIndex = 0;
+    GLuint selectLineIndex = 0;
+    GLuint drawFillIndex = 0;
+    GLuint drawLineIndex = 0;
 
     while(it != items.end()) {
-        VectorTileItem tileItem = *it;
+        const VectorTileItem &tileItem = *it;
         if(tileItem.isIdsPresent(m_hideFIDs)) {
             ++it;
             continue;
         }
 
-        auto points = tileItem.points();
-        auto indices = tileItem.indices();
+        const auto &points = tileItem.points();
+        const auto &indices = tileItem.indices();
 
         if(points.size() < 3 || points.size() > GlBuffer::maxIndices() ||
                 points.size() > GlBuffer::maxVertices()) {
@@ -868,7 +1744,7 @@ VectorGlObject *GlSelectableFeatureLayer::fillPolygons(const VectorTile& tile,
         }
 
         // FIXME: Expected indices should fit to buffer as points can
-//        unsigned short maxFillIndex = 0;
+//        GLuint maxFillIndex = 0;
         for(auto indexPoint : indices) {
             ngsUnused(indexPoint);
             fillBuffer->addIndex(fillIndex++);
@@ -884,8 +1760,8 @@ VectorGlObject *GlSelectableFeatureLayer::fillPolygons(const VectorTile& tile,
         // FIXME: May be more styles with borders
         if(compare(style->name(), "simpleFillBordered")) {
 
-        auto borders = (*it).borderIndices();
-        for(auto border : borders) {
+        for(size_t ring = 0; ring < tileItem.borderCount(); ++ring) {
+            ArrayView<unsigned short> border = tileItem.borderIndices(ring);
             Normal prevNormal;
             Normal firstNormal;
             bool firstNormalSet = false;
@@ -1005,7 +1881,10 @@ GlRasterLayer::GlRasterLayer(Map *map, const std::string &name) :
     m_blue(3),
     m_alpha(0),
     m_transparency(0),
-    m_dataType(GDT_Byte)
+    m_dataType(GDT_Byte),
+    m_cacheExpires(0),
+    m_warp(false),
+    m_resampling(RasterResampling::Nearest)
 {
 }
 
@@ -1021,6 +1900,17 @@ bool GlRasterLayer::fill(const GlTilePtr &tile, float z, bool isLastTry)
         return true;
     }
 
+    // Same tile may be decoded before by this or other layer of the raster.
+    GlRasterTileCache *cache = tileCache();
+    GlRasterTileCache::Key key = cacheKey(tile->getTile());
+    GlRasterTileCache::Entry entry;
+    if(nullptr != cache && cache->get(key, entry)) {
+        GlObjectPtr tileData = createObject(entry, z);
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        m_tiles[tile->getTile()] = tileData;
+        return true;
+    }
+
     Envelope rasterExtent = m_raster->extent();
     Envelope tileExtent = tile->getExtent();
 
@@ -1037,7 +1927,9 @@ bool GlRasterLayer::fill(const GlTilePtr &tile, float z, bool isLastTry)
         tileExtentH = tileExtent.height();
     }
 
-    // FIXME: Reproject tile extent to raster extent
+    if(m_warp) {
+        return fillWarped(tile, tileExtent, z, isLastTry, key);
+    }
 
     Envelope outExt = rasterExtent.intersect(tileExtent);
 
@@ -1138,44 +2030,199 @@ bool GlRasterLayer::fill(const GlTilePtr &tile, float z, bool isLastTry)
     int dataSize = GDALGetDataTypeSizeBytes(m_dataType);
     size_t bufferSize = static_cast<size_t>(outWidth * outHeight *
                                             dataSize * 4); // NOTE: We use RGBA to store textures
-    GLubyte *pixData = static_cast<GLubyte*>(CPLMalloc(bufferSize));
+    GlImageBufferPtr pixData;
+    if(nullptr != cache) {
+        pixData = cache->createBuffer(bufferSize);
+    }
+    else {
+        pixData = GlImageBufferPtr(static_cast<GLubyte*>(
+                                       VSI_MALLOC_VERBOSE(bufferSize)), VSIFree);
+    }
+    if(!pixData) {
+        return false;
+    }
 
+    bool result;
     if(m_alpha == 0) {
-        std::memset(pixData, 255 - m_transparency, bufferSize);
-        if(!m_raster->pixelData(pixData, minX, minY, width, height, outWidth,
-                                outHeight, m_dataType, bandCount, bands, true, true)) {
-            CPLFree(pixData);
-
-            if(isLastTry) {
-                MutexHolder holder(m_dataMutex, LOCK_TIME);
-                m_tiles[tile->getTile()] = GlObjectPtr();
-                return true;
-            }
+        std::memset(pixData.get(), 255 - m_transparency, bufferSize);
+        result = m_raster->pixelData(pixData.get(), minX, minY, width, height,
+                                     outWidth, outHeight, m_dataType,
+                                     bandCount, bands, true, true);
+    }
+    else {
+        result = m_raster->pixelData(pixData.get(), minX, minY, width, height,
+                                     outWidth, outHeight, m_dataType,
+                                     bandCount, bands);
+    }
 
-            // TODO: Get overzoom or underzoom pixels here
+    if(!result) {
+        if(isLastTry) {
+            MutexHolder holder(m_dataMutex, LOCK_TIME);
+            m_tiles[tile->getTile()] = GlObjectPtr();
+            return true;
+        }
 
-            return false;
+        // TODO: Get overzoom or underzoom pixels here
+
+        return false;
+    }
+
+    entry.data = pixData;
+    entry.width = outWidth;
+    entry.height = outHeight;
+    entry.extent = outExt;
+    entry.smooth = smooth;
+    if(nullptr != cache) {
+        cache->put(key, entry);
+    }
+
+    GlObjectPtr tileData = createObject(entry, z);
+
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    m_tiles[tile->getTile()] = tileData;
+
+    return true;
+}
+
+bool GlRasterLayer::fillWarped(const GlTilePtr &tile,
+                               const Envelope &tileExtent, float z,
+                               bool isLastTry,
+                               const GlRasterTileCache::Key &key)
+{
+    if(!m_mapExtent.intersects(tileExtent)) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        m_tiles[tile->getTile()] = GlObjectPtr();
+        return true;
+    }
+
+    // Grid depends only on source georeference and tile, so it is shared by
+    // all rasters with the same georeference.
+    int size = static_cast<int>(tile->getSizeInPixels());
+    GlView *mapView = dynamic_cast<GlView*>(m_map);
+    WarpGridPtr grid;
+    if(nullptr != mapView) {
+        grid = mapView->warpGridCache()->get(m_warpKey, tile->getTile());
+    }
+    if(!grid) {
+        double geoTransform[6] = { 0.0 };
+        m_raster->geoTransform(geoTransform);
+        grid = std::make_shared<WarpGrid>();
+        if(!grid->create(m_srcWKT, geoTransform, m_dstWKT, tileExtent, size,
+                         size, WARP_GRID_STEP, WARP_MAX_ERROR)) {
+            // Tile is out of source spatial reference area of use
+            MutexHolder holder(m_dataMutex, LOCK_TIME);
+            m_tiles[tile->getTile()] = GlObjectPtr();
+            return true;
         }
+        if(nullptr != mapView) {
+            mapView->warpGridCache()->put(m_warpKey, tile->getTile(), grid);
+        }
+    }
+
+    // Get source window with kernel margin
+    double scaleX, scaleY;
+    Envelope window = grid->sourceExtent(scaleX, scaleY);
+    if(!window.isInit()) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        m_tiles[tile->getTile()] = GlObjectPtr();
+        return true;
+    }
+    int minX = static_cast<int>(std::max(
+                std::floor(window.minX() - WARP_WINDOW_MARGIN), 0.0));
+    int minY = static_cast<int>(std::max(
+                std::floor(window.minY() - WARP_WINDOW_MARGIN), 0.0));
+    int maxX = static_cast<int>(std::min(
+                std::ceil(window.maxX() + WARP_WINDOW_MARGIN),
+                static_cast<double>(m_raster->width())));
+    int maxY = static_cast<int>(std::min(
+                std::ceil(window.maxY() + WARP_WINDOW_MARGIN),
+                static_cast<double>(m_raster->height())));
+    if(maxX <= minX || maxY <= minY) {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        m_tiles[tile->getTile()] = GlObjectPtr();
+        return true;
+    }
+
+    // Read source pixels at about the tile resolution, GDAL uses overviews
+    int width = maxX - minX;
+    int height = maxY - minY;
+    int bufWidth = scaleX > 1.0 ?
+                static_cast<int>(std::ceil(width / scaleX)) : width;
+    int bufHeight = scaleY > 1.0 ?
+                static_cast<int>(std::ceil(height / scaleY)) : height;
+
+    int bands[4] = { m_red, m_green, m_blue, m_alpha };
+    std::vector<GByte> srcData(static_cast<size_t>(bufWidth * bufHeight * 4));
+    bool result;
+    if(m_alpha == 0) {
+        std::memset(srcData.data(), 255 - m_transparency, srcData.size());
+        result = m_raster->pixelData(srcData.data(), minX, minY, width, height,
+                                     bufWidth, bufHeight, m_dataType, 4,
+                                     bands, true, true);
     }
     else {
-        if(!m_raster->pixelData(pixData, minX, minY, width, height, outWidth,
-                                outHeight, m_dataType, bandCount, bands)) {
-            CPLFree(pixData);
-
-            if(isLastTry) {
-                MutexHolder holder(m_dataMutex, LOCK_TIME);
-                m_tiles[tile->getTile()] = GlObjectPtr();
-                return true;
-            }
+        result = m_raster->pixelData(srcData.data(), minX, minY, width, height,
+                                     bufWidth, bufHeight, m_dataType, 4,
+                                     bands);
+    }
 
-            return false;
+    if(!result) {
+        if(isLastTry) {
+            MutexHolder holder(m_dataMutex, LOCK_TIME);
+            m_tiles[tile->getTile()] = GlObjectPtr();
+            return true;
         }
+        return false;
     }
 
+    GlRasterTileCache *cache = tileCache();
+    size_t bufferSize = static_cast<size_t>(size * size * 4);
+    GlImageBufferPtr pixData;
+    if(nullptr != cache) {
+        pixData = cache->createBuffer(bufferSize);
+    }
+    else {
+        pixData = GlImageBufferPtr(static_cast<GLubyte*>(
+                                       VSI_MALLOC_VERBOSE(bufferSize)), VSIFree);
+    }
+    if(!pixData) {
+        return false;
+    }
+
+    // Pixels out of raster stay transparent
+    std::memset(pixData.get(), 0, bufferSize);
+    warpImage(*grid, srcData.data(),
+              Envelope(minX, minY, maxX, maxY), bufWidth, bufHeight,
+              m_raster->width(), m_raster->height(), m_resampling,
+              pixData.get());
+
+    GlRasterTileCache::Entry entry;
+    entry.data = pixData;
+    entry.width = size;
+    entry.height = size;
+    entry.extent = tileExtent;
+    entry.smooth = m_resampling != RasterResampling::Nearest;
+    if(nullptr != cache) {
+        cache->put(key, entry);
+    }
+
+    GlObjectPtr tileData = createObject(entry, z);
+
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    m_tiles[tile->getTile()] = tileData;
+
+    return true;
+}
+
+GlObjectPtr GlRasterLayer::createObject(const GlRasterTileCache::Entry &entry,
+                                        float z) const
+{
     GlImage *image = new GlImage;
-    image->setImage(pixData, outWidth, outHeight); // NOTE: May be not working NOD
-    image->setSmooth(smooth);
+    // NOTE: The buffer is shared with tile cache and released after bind.
+    image->setImage(entry.data, entry.width, entry.height);
+    image->setSmooth(entry.smooth);
 
+    const Envelope &outExt = entry.extent;
     // FIXME: Reproject intersect raster extent to tile extent
     GlBuffer *tileExtentBuff = new GlBuffer(GlBuffer::BF_TEX);
     tileExtentBuff->addVertex(static_cast<float>(outExt.minX()));
@@ -1205,12 +2252,134 @@ bool GlRasterLayer::fill(const GlTilePtr &tile, float z, bool isLastTry)
     tileExtentBuff->addIndex(2);
     tileExtentBuff->addIndex(3);
 
-    GlObjectPtr tileData(new RasterGlObject(tileExtentBuff, image));
+    return GlObjectPtr(new RasterGlObject(tileExtentBuff, image));
+}
 
+GlRasterTileCache *GlRasterLayer::tileCache() const
+{
+    GlView *mapView = dynamic_cast<GlView*>(m_map);
+    if(nullptr == mapView) {
+        return nullptr;
+    }
+    return mapView->rasterTileCache();
+}
+
+GlRasterTileCache::Key GlRasterLayer::cacheKey(const Tile &tile) const
+{
+    GUInt32 bands = static_cast<GUInt32>(m_red) |
+            static_cast<GUInt32>(m_green) << 8 |
+            static_cast<GUInt32>(m_blue) << 16 |
+            static_cast<GUInt32>(m_alpha) << 24;
     MutexHolder holder(m_dataMutex, LOCK_TIME);
-    m_tiles[tile->getTile()] = tileData;
+    if(m_cacheExpires <= 0) {
+        return {m_cacheKey, bands, m_transparency, tile};
+    }
+    // Remote tiles are decoded again in each cache expire period.
+    std::string raster = m_cacheKey + "|" +
+            std::to_string(time(nullptr) / m_cacheExpires);
+    return {raster, bands, m_transparency, tile};
+}
 
-    return true;
+void GlRasterLayer::updateCacheKey()
+{
+    MutexHolder holder(m_dataMutex, LOCK_TIME);
+    if(!m_raster) {
+        m_cacheKey.clear();
+        m_cacheExpires = 0;
+        return;
+    }
+    // Modification time drops disk cache tiles of rewritten raster file.
+    std::string path = m_raster->path();
+    m_cacheKey = path + "|" + std::to_string(File::modificationDate(path));
+    if(m_warp) {
+        m_cacheKey += "|" + std::to_string(m_map->epsg()) + "|" +
+                resamplingToString(m_resampling);
+    }
+    // TMS connection file is not changed when server tiles are, so tiles
+    // expire as set in connection.
+    m_cacheExpires = 0;
+    if(m_raster->type() == CAT_RASTER_TMS) {
+        m_cacheExpires = atoi(m_raster->property("TMS_CACHE_EXPIRES", "0",
+                                                 "").c_str());
+    }
+}
+
+void GlRasterLayer::refill()
+{
+    std::string oldKey;
+    {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        oldKey = m_cacheKey;
+    }
+    updateCacheKey();
+
+    // Only tiles of changed raster are dropped, other layers keep their tiles
+    std::string newKey;
+    {
+        MutexHolder holder(m_dataMutex, LOCK_TIME);
+        newKey = m_cacheKey;
+    }
+    GlRasterTileCache *cache = tileCache();
+    if(nullptr != cache && oldKey != newKey) {
+        cache->remove(oldKey);
+    }
+}
+
+void GlRasterLayer::updateWarp()
+{
+    m_warp = false;
+    if(!m_raster || nullptr == m_map) {
+        return;
+    }
+
+    SpatialReferencePtr srcSRS = m_raster->spatialReference();
+    SpatialReferencePtr dstSRS = SpatialReferencePtr::importFromEPSG(m_map->epsg());
+    double geoTransform[6] = { 0.0 };
+    if(!srcSRS || !dstSRS || !m_raster->geoTransform(geoTransform)) {
+        return;
+    }
+    const char *options[] = { "IGNORE_DATA_AXIS_TO_SRS_AXIS_MAPPING=YES",
+                              nullptr };
+    if(srcSRS->IsSame(dstSRS, options)) {
+        return;
+    }
+
+    char *wkt = nullptr;
+    srcSRS->exportToWkt(&wkt);
+    m_srcWKT = fromCString(wkt);
+    CPLFree(wkt);
+    wkt = nullptr;
+    dstSRS->exportToWkt(&wkt);
+    m_dstWKT = fromCString(wkt);
+    CPLFree(wkt);
+
+    m_warpKey = fastHash(m_dstWKT + m_srcWKT +
+                         CPLSPrintf("|%.17g|%.17g|%.17g|%.17g|%.17g|%.17g",
+                                    geoTransform[0], geoTransform[1],
+                                    geoTransform[2], geoTransform[3],
+                                    geoTransform[4], geoTransform[5]));
+
+    // Densify raster extent borders to get extent in map spatial reference
+    SpatialReferencePtr extentSRS(srcSRS->Clone());
+    extentSRS->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+    const Envelope &extent = m_raster->extent();
+    GeometryPtr geometry = extent.toGeometry(extentSRS);
+    CoordinateTransformation transformation(extentSRS, dstSRS);
+    if(geometry) {
+        geometry->segmentize(std::max(extent.width(), extent.height()) /
+                             WARP_EXTENT_SEGMENTS);
+    }
+    if(geometry && transformation.transform(geometry)) {
+        OGREnvelope env;
+        geometry->getEnvelope(&env);
+        m_mapExtent = env;
+    }
+    else {
+        // Check each tile by warp grid
+        m_mapExtent = DEFAULT_BOUNDS_Y2X4;
+    }
+
+    m_warp = true;
 }
 
 bool GlRasterLayer::draw(const GlTilePtr &tile)
@@ -1347,7 +2516,11 @@ bool GlRasterLayer::load(const CPLJSONObject &store, ObjectContainer *objectCont
         m_alpha = static_cast<unsigned char>(raster.GetInteger("alpha", m_alpha));
         m_transparency = static_cast<unsigned char>(raster.GetInteger("transparency",
                                                                       m_transparency));
+        m_resampling = resamplingFromString(raster.GetString("resampling",
+                                            resamplingToString(m_resampling)));
     }
+    updateWarp();
+    updateCacheKey();
 
     GlView *mapView = dynamic_cast<GlView*>(m_map);
     m_style = StylePtr(Style::createStyle("simpleImage", mapView->textureAtlas()));
@@ -1363,6 +2536,7 @@ CPLJSONObject GlRasterLayer::save(const ObjectContainer *objectContainer) const
     raster.Add("blue", m_blue);
     raster.Add("alpha", m_alpha);
     raster.Add("transparency", m_transparency);
+    raster.Add("resampling", resamplingToString(m_resampling));
     out.Add("raster", raster);
     return out;
 }
@@ -1377,6 +2551,8 @@ void GlRasterLayer::setRaster(const RasterPtr &raster)
     if(raster->bandCount() == 4) {
         m_alpha = 4;
     }
+    updateWarp();
+    updateCacheKey();
 }
 
 //------------------------------------------------------------------------------
@@ -1442,6 +2618,23 @@ void VectorGlObject::destroy()
     for(GlBufferPtr& buffer : m_buffers) {
         buffer->destroy();
     }
+    m_bound = false;
+}
+
+size_t VectorGlObject::memorySize() const
+{
+    size_t size = sizeof(VectorGlObject);
+    for(const GlBufferPtr& buffer : m_buffers) {
+        size += buffer->memorySize();
+    }
+    return size;
+}
+
+void VectorGlObject::shrink()
+{
+    for(GlBufferPtr& buffer : m_buffers) {
+        buffer->shrink();
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1484,16 +2677,32 @@ void VectorSelectableGlObject::rebind() const
 
 void VectorSelectableGlObject::destroy()
 {
+    // Keep vertex arrays, so the object may be cached and bound again.
     for(GlBufferPtr& buffer : m_buffers) {
         buffer->destroy();
     }
-    m_buffers.clear();
 
     for(GlBufferPtr& buffer : m_selectionBuffers) {
         buffer->destroy();
     }
-    m_selectionBuffers.clear();
     m_bound = false;
 }
 
+size_t VectorSelectableGlObject::memorySize() const
+{
+    size_t size = VectorGlObject::memorySize();
+    for(const GlBufferPtr& buffer : m_selectionBuffers) {
+        size += buffer->memorySize();
+    }
+    return size;
+}
+
+void VectorSelectableGlObject::shrink()
+{
+    VectorGlObject::shrink();
+    for(GlBufferPtr& buffer : m_selectionBuffers) {
+        buffer->shrink();
+    }
+}
+
 } // namespace ngs
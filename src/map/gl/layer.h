@@ -21,14 +21,157 @@
 #ifndef NGSGLMAPLAYER_H
 #define NGSGLMAPLAYER_H
 
+#include <list>
 #include <set>
 
 #include "style.h"
 #include "tile.h"
 #include "map/layer.h"
+#include "map/warp.h"
 
 namespace ngs {
 
+/**
+ * @brief The GlTileCache class LRU cache of layer tile data which left the
+ * view. Keeps decoded vector tiles together with CPU side vertex arrays within
+ * memory budget. Entries are moved out of cache on take and returned on put, so
+ * one tile data never present in cache and in layer at the same time.
+ */
+class GlTileCache
+{
+public:
+    typedef struct _entry {
+        VectorTile vtile;
+        GlObjectPtr object; // Vertex arrays without Gl names
+        Envelope extent;
+        unsigned int version;
+        unsigned int epoch;
+        float z;
+    } Entry;
+
+public:
+    explicit GlTileCache(size_t maxSize);
+    bool take(unsigned int layerId, const Tile &tile, Entry &entry);
+    bool contains(unsigned int layerId, const Tile &tile) const;
+    void put(unsigned int layerId, const Tile &tile, Entry &&entry);
+    void remove(const Envelope &bounds);
+    void clear();
+    unsigned int epoch() const;
+    unsigned int nextLayerId();
+    void setMaxSize(size_t maxSize);
+    size_t maxSize() const;
+    size_t size() const;
+    GUIntBig hits() const;
+    GUIntBig misses() const;
+    void resetStatistics();
+
+protected:
+    typedef struct _key {
+        unsigned int layerId;
+        Tile tile;
+        bool operator<(const struct _key &other) const {
+            return layerId < other.layerId ||
+                    (layerId == other.layerId && tile < other.tile);
+        }
+    } Key;
+
+    typedef struct _item {
+        Entry entry;
+        size_t size;
+        std::list<Key>::iterator order;
+    } Item;
+
+    typedef struct _diskFile {
+        std::string path;
+        size_t size;
+    } DiskFile;
+
+    void erase(std::map<Key, Item>::iterator it);
+    void evict();
+    void useFile(const std::string &path, size_t size);
+    std::vector<std::string> evictFiles();
+    static size_t entrySize(const Entry &entry);
+
+private:
+    std::map<Key, Item> m_items;
+    std::list<Key> m_order; // Most recently used first
+    size_t m_maxSize, m_size;
+    unsigned int m_epoch, m_layerId;
+    GUIntBig m_hits, m_misses;
+    mutable Mutex m_mutex;
+};
+
+/**
+ * @brief The GlRasterTileCache class LRU cache of decoded raster tiles shared by
+ * all raster layers of the view. Keeps RGBA buffers ready to upload to texture,
+ * so tile refill does not read and resample raster pixels again. Optionally
+ * the tiles are stored deflate compressed on disk and survive the memory
+ * eviction and the map close. Disk tier is LRU with own byte budget.
+ */
+class GlRasterTileCache
+{
+public:
+    typedef struct _key {
+        std::string raster; // Raster path, modification time and expire period
+        GUInt32 bands; // Red, green, blue and alpha band numbers
+        unsigned char transparency;
+        Tile tile;
+        bool operator<(const struct _key &other) const;
+    } Key;
+
+    typedef struct _entry {
+        GlImageBufferPtr data;
+        int width, height;
+        Envelope extent; // Raster and tile extents intersection
+        bool smooth;
+    } Entry;
+
+public:
+    GlRasterTileCache(size_t maxSize, size_t maxDiskSize);
+    bool get(const Key &key, Entry &entry);
+    void put(const Key &key, const Entry &entry);
+    GlImageBufferPtr createBuffer(size_t size);
+    void clear();
+    void remove(const std::string &raster);
+    void setMaxSize(size_t maxSize);
+    size_t maxSize() const;
+    size_t size() const;
+    void setDiskPath(const std::string &path);
+    std::string diskPath() const;
+    void setMaxDiskSize(size_t maxSize);
+    size_t maxDiskSize() const;
+    size_t diskSize() const;
+    GUIntBig hits() const;
+    GUIntBig misses() const;
+    void resetStatistics();
+
+protected:
+    typedef struct _item {
+        Entry entry;
+        std::list<Key>::iterator order;
+    } Item;
+
+    void erase(std::map<Key, Item>::iterator it);
+    void evict();
+    void insert(const Key &key, const Entry &entry);
+    bool load(const std::string &path, Entry &entry);
+    size_t save(const std::string &path, const Entry &entry) const;
+    std::string tilePath(const Key &key) const;
+    static size_t entrySize(const Entry &entry);
+
+private:
+    std::map<Key, Item> m_items;
+    std::list<Key> m_order; // Most recently used first
+    size_t m_maxSize, m_size;
+    std::string m_diskPath;
+    std::list<DiskFile> m_files; // Most recently used first
+    std::map<std::string, std::list<DiskFile>::iterator> m_fileIndex;
+    size_t m_maxDiskSize, m_diskSize;
+    GUIntBig m_hits, m_misses;
+    GlImageBufferPoolPtr m_pool;
+    mutable Mutex m_mutex;
+};
+
 /**
  * @brief The GlRenderLayer class Interface for renderable map layers
  */
@@ -42,11 +185,22 @@ public:
      * @param tile Tile to load data
      */
     virtual bool fill(const GlTilePtr &tile, float z, bool isLastTry) = 0;
+    /**
+     * @brief prefetch Prepare data for tile which is not in view yet. Executed
+     * from separate thread.
+     * @param tileItem Tile to load data
+     */
+    virtual bool prefetch(const TileItem &tileItem, float z);
     /**
      * @brief free Free Gl objects. Run from Gl context.
      * @param tile Tile to free data
      */
     virtual void free(const GlTilePtr &tile);
+    /**
+     * @brief refill Drop data kept between fills which is changed in source.
+     * Run before all tiles refill.
+     */
+    virtual void refill();
     /**
      * @brief draw Draw data for specific tile. Run from Gl context.
      * @param tile Tile to draw
@@ -63,6 +217,7 @@ protected:
     StylePtr m_style;
     Mutex m_dataMutex;
     std::vector<StylePtr> m_oldStyles;
+    unsigned int m_renderVersion; // Changed with anything affects fill result
 };
 
 /**
@@ -74,6 +229,8 @@ public:
     VectorGlObject();
     const std::vector<GlBufferPtr> &buffers() const { return m_buffers; }
     void addBuffer(GlBuffer *buffer) { m_buffers.push_back(GlBufferPtr(buffer)); }
+    virtual size_t memorySize() const;
+    virtual void shrink();
 
     // GlObject interface
 public:
@@ -94,6 +251,8 @@ public:
     void addSelectionBuffer(GlBuffer *buffer) {
         m_selectionBuffers.push_back(GlBufferPtr(buffer));
     }
+    virtual size_t memorySize() const override;
+    virtual void shrink() override;
 
     // GlObject interface
 public:
@@ -113,10 +272,13 @@ class GlFeatureLayer : public FeatureLayer, public GlRenderLayer
 public:
     explicit GlFeatureLayer(Map *map, const std::string &name = DEFAULT_LAYER_NAME);
     virtual ~GlFeatureLayer() override = default;
+    unsigned int cacheId() const { return m_cacheId; }
 
     // GlRenderLayer interface
 public:
     virtual bool fill(const GlTilePtr &tile, float z, bool isLastTry) override;
+    virtual bool prefetch(const TileItem &tileItem, float z) override;
+    virtual void free(const GlTilePtr &tile) override;
     virtual bool draw(const GlTilePtr &tile) override;
     virtual bool setStyleName(const std::string &name) override;
 
@@ -129,10 +291,25 @@ public:
 public:
     virtual void setFeatureClass(const FeatureClassOverviewPtr &featureClass) override;
 
+    // ISelectableFeatureLayer interface
+public:
+    virtual void setSelectedIds(const FeatureIDs &selectedIds) override;
+    virtual void setHideIds(const FeatureIDs &hideIds = FeatureIDs()) override;
+
 protected:
     virtual VectorGlObject *fillPoints(const VectorTile &tile, float z);
     virtual VectorGlObject *fillLines(const VectorTile &tile, float z);
     virtual VectorGlObject *fillPolygons(const VectorTile &tile, float z);
+    void polygonsEstimate(const VectorTile &tile, size_t &fillVertices,
+                          size_t &fillIndices, size_t &lineVertices,
+                          size_t &lineIndices) const;
+    GlTileCache *tileCache() const;
+    bool isVisible(unsigned char zoom) const;
+    bool tessellate(GlTileCache::Entry &entry, float z);
+
+protected:
+    std::map<Tile, GlTileCache::Entry> m_tileData;
+    unsigned int m_cacheId;
 };
 
 using SelectionStyles = std::map<enum ngsStyleType, StylePtr>;
@@ -194,6 +371,7 @@ public:
     // GlRenderLayer interface
 public:
     virtual bool fill(const GlTilePtr &tile, float z, bool isLastTry) override;
+    virtual void refill() override;
     virtual bool draw(const GlTilePtr &tile) override;
     virtual bool setStyleName(const std::string &name) override;
 
@@ -206,9 +384,26 @@ public:
 public:
     virtual void setRaster(const RasterPtr &raster) override;
 
+protected:
+    GlRasterTileCache *tileCache() const;
+    GlRasterTileCache::Key cacheKey(const Tile &tile) const;
+    void updateCacheKey();
+    void updateWarp();
+    bool fillWarped(const GlTilePtr &tile, const Envelope &tileExtent,
+                    float z, bool isLastTry, const GlRasterTileCache::Key &key);
+    GlObjectPtr createObject(const GlRasterTileCache::Entry &entry,
+                             float z) const;
+
 private:
     unsigned char m_red, m_green, m_blue, m_alpha, m_transparency;
     GDALDataType m_dataType;
+    std::string m_cacheKey;
+    int m_cacheExpires; // Seconds, zero if tiles never expire
+    // Reprojection of raster which spatial reference differs from map one
+    bool m_warp;
+    enum RasterResampling m_resampling;
+    std::string m_srcWKT, m_dstWKT, m_warpKey;
+    Envelope m_mapExtent; // Raster extent in map spatial reference
 };
 
 } // namespace ngs
@@ -342,7 +342,7 @@ void GlEditLayerOverlay::fillPointElements(const std::vector<OGRRawPoint> &point
     enum ngsEditElementType elementType = (m_walkingMode) ? EET_WALK_POINT :
                                                             EET_POINT;
 
-    unsigned short index = 0;
+    GLuint index = 0;
     int pointIndex = -1;
     for(const OGRRawPoint &point : points) {
         SimplePoint pt = {static_cast<float>(point.x),
@@ -383,7 +383,7 @@ void GlEditLayerOverlay::fillMiddlePointElements(
     GlBuffer *selBuffer = new GlBuffer(GlBuffer::BF_PT);
     VectorGlObject *selBufferArray = new VectorGlObject();
 
-    int index = 0;
+    GLuint index = 0;
     size_t numPoints = points.size();
     for(size_t i = 0; i < numPoints - 1; ++i) {
         OGRRawPoint medianPoint = ngsGetMiddlePoint(points[i], points[i + 1]);
@@ -407,9 +407,7 @@ void GlEditLayerOverlay::fillMiddlePointElements(
         if(editPointStyle) {
             editPointStyle->setEditElementType(EET_MEDIAN_POINT);
         }
-        index = m_pointStyle->addPoint(pt, 0.0f,
-                                       static_cast<unsigned short>(index),
-                                       buffer);
+        index = m_pointStyle->addPoint(pt, 0.0f, index, buffer);
     }
 
     bufferArray->addBuffer(buffer);
@@ -480,7 +478,7 @@ void GlEditLayerOverlay::fillLineBuffers(const Line &line,
 
     if(numPoints > 0) {
         bool isClosedLine = ngsIsNear(line.front(), line.back(), DELTA);
-        unsigned short index = 0;
+        GLuint index = 0;
         Normal prevNormal;
 
         auto createBufferIfNeed = [bufferArray, &buffer, &index](size_t amount) -> void {
@@ -570,7 +568,7 @@ void GlEditLayerOverlay::fillPolygonBuffers(const Polygon &polygon,
 
     // The index type. Defaults to uint32_t, but you can also pass uint16_t
     // if you know that your data won't have more than 65536 vertices.
-    using N = unsigned short;
+    using N = GLuint;
 
     using MBPoint = std::array<Coord, 2>;
 
@@ -592,7 +590,7 @@ void GlEditLayerOverlay::fillPolygonBuffers(const Polygon &polygon,
 
 	// Fill triangles.
     GlBuffer *fillBuffer = new GlBuffer(GlBuffer::BF_FILL);
-    unsigned short index = 0;
+    GLuint index = 0;
     for(N mbIndex : mbIndices) {
         if(!fillBuffer->canStoreVertices(mbIndices.size() * 3)) {
             bufferArray->addBuffer(fillBuffer);
@@ -344,8 +344,8 @@ SimplePointStyle::SimplePointStyle(enum PointType type) : PointStyle(type)
     m_fragmentShaderSource = pointFragmentShaderSource;
 }
 
-unsigned short SimplePointStyle::addPoint(const SimplePoint &pt, float z,
-                                          unsigned short index, GlBuffer *buffer)
+GLuint SimplePointStyle::addPoint(const SimplePoint &pt, float z,
+                                  GLuint index, GlBuffer *buffer)
 {
     buffer->addVertex(pt.x);
     buffer->addVertex(pt.y);
@@ -372,7 +372,7 @@ void SimplePointStyle::draw(const GlBuffer& buffer) const
     SimpleVectorStyle::draw(buffer);
 
     ngsCheckGLError(glDrawElements(GL_POINTS, buffer.indexSize(),
-                                   GL_UNSIGNED_SHORT, nullptr));
+                                   buffer.indexType(), nullptr));
 }
 
 
@@ -438,7 +438,7 @@ void SimpleLineStyle::draw(const GlBuffer &buffer) const
         return;
     SimpleVectorStyle::draw(buffer);
     ngsCheckGLError(glDrawElements(GL_TRIANGLES, buffer.indexSize(),
-                                   GL_UNSIGNED_SHORT, nullptr));
+                                   buffer.indexType(), nullptr));
 }
 
 bool SimpleLineStyle::load(const CPLJSONObject &store)
@@ -492,9 +492,9 @@ void SimpleLineStyle::setSegmentCount(unsigned char segmentCount)
     m_segmentCount = segmentCount;
 }
 
-unsigned short SimpleLineStyle::addLineCap(const SimplePoint &point,
-                                           const Normal &normal, float z,
-                                           unsigned short index, GlBuffer *buffer)
+GLuint SimpleLineStyle::addLineCap(const SimplePoint &point,
+                                   const Normal &normal, float z,
+                                   GLuint index, GlBuffer *buffer)
 {
     switch(m_capType) {
         case CapType::CT_ROUND:
@@ -606,12 +606,12 @@ size_t SimpleLineStyle::lineCapVerticesCount() const
     return 0;
 }
 
-unsigned short SimpleLineStyle::addLineJoin(const SimplePoint &point,
-                                            const Normal &prevNormal,
-                                            const Normal &normal,
-                                            float z,
-                                            unsigned short index,
-                                            GlBuffer *buffer)
+GLuint SimpleLineStyle::addLineJoin(const SimplePoint &point,
+                                    const Normal &prevNormal,
+                                    const Normal &normal,
+                                    float z,
+                                    GLuint index,
+                                    GlBuffer *buffer)
 {
 //    float maxWidth = width() * 5;
     float start = angle(prevNormal);
@@ -762,12 +762,12 @@ size_t SimpleLineStyle::lineJoinVerticesCount() const
     return 0;
 }
 
-unsigned short SimpleLineStyle::addSegment(const SimplePoint &pt1,
-                                           const SimplePoint &pt2,
-                                           const Normal &normal,
-                                           float z,
-                                           unsigned short index,
-                                           GlBuffer *buffer)
+GLuint SimpleLineStyle::addSegment(const SimplePoint &pt1,
+                                   const SimplePoint &pt2,
+                                   const Normal &normal,
+                                   float z,
+                                   GLuint index,
+                                   GlBuffer *buffer)
 {
     // 0
     buffer->addVertex(pt1.x);
@@ -825,9 +825,9 @@ void PrimitivePointStyle::setType(enum PointType type)
     PointStyle::setType(type);
 }
 
-unsigned short PrimitivePointStyle::addPoint(const SimplePoint &pt, float z,
-                                             unsigned short index,
-                                             GlBuffer *buffer)
+GLuint PrimitivePointStyle::addPoint(const SimplePoint &pt, float z,
+                                     GLuint index,
+                                     GlBuffer *buffer)
 {
     switch(pointType()) {
     case PT_SQUARE:
@@ -1105,7 +1105,7 @@ void PrimitivePointStyle::draw(const GlBuffer &buffer) const
         return;
     SimpleVectorStyle::draw(buffer);
     ngsCheckGLError(glDrawElements(GL_TRIANGLES, buffer.indexSize(),
-                                   GL_UNSIGNED_SHORT, nullptr));
+                                   buffer.indexType(), nullptr));
 }
 
 bool PrimitivePointStyle::load(const CPLJSONObject &store)
@@ -1171,7 +1171,7 @@ void SimpleFillStyle::draw(const GlBuffer& buffer) const
 {
     SimpleVectorStyle::draw(buffer);
     ngsCheckGLError(glDrawElements(GL_TRIANGLES, buffer.indexSize(),
-            GL_UNSIGNED_SHORT, nullptr));
+            buffer.indexType(), nullptr));
 }
 
 //------------------------------------------------------------------------------
@@ -1320,7 +1320,7 @@ void SimpleImageStyle::draw(const GlBuffer &buffer) const
     m_image->rebind();
 
     ngsCheckGLError(glDrawElements(GL_TRIANGLES, buffer.indexSize(),
-            GL_UNSIGNED_SHORT, nullptr));
+            buffer.indexType(), nullptr));
 }
 
 bool SimpleImageStyle::load(const CPLJSONObject &store)
@@ -1400,8 +1400,8 @@ void MarkerStyle::setType(enum PointType type)
     ngsUnused(type);
 }
 
-unsigned short MarkerStyle::addPoint(const SimplePoint &pt, float z,
-                                     unsigned short index, GlBuffer *buffer)
+GLuint MarkerStyle::addPoint(const SimplePoint &pt, float z,
+                             GLuint index, GlBuffer *buffer)
 {
     float nx1, ny1, nx2, ny2;
 
@@ -1494,7 +1494,7 @@ void MarkerStyle::draw(const GlBuffer &buffer) const
     m_iconSet->rebind();
 
     ngsCheckGLError(glDrawElements(GL_TRIANGLES, buffer.indexSize(),
-                                   GL_UNSIGNED_SHORT, nullptr));
+                                   buffer.indexType(), nullptr));
 }
 
 bool MarkerStyle::load(const CPLJSONObject &store)
@@ -134,9 +134,9 @@ public:
     float rotation() const { return m_rotation; }
     void setRotation(float rotation) { m_rotation = rotation; }
 
-    virtual unsigned short addPoint(const SimplePoint &pt, float z,
-                                    unsigned short index,
-                                    GlBuffer *buffer) = 0;
+    virtual GLuint addPoint(const SimplePoint &pt, float z,
+                            GLuint index,
+                            GlBuffer *buffer) = 0;
     virtual size_t pointVerticesCount() const = 0;
 
     // Style interface
@@ -163,9 +163,9 @@ public:
 
     // PointStyle interface
 public:
-    virtual unsigned short addPoint(const SimplePoint &pt, float z,
-                                    unsigned short index,
-                                    GlBuffer *buffer) override;
+    virtual GLuint addPoint(const SimplePoint &pt, float z,
+                            GLuint index,
+                            GlBuffer *buffer) override;
     virtual size_t pointVerticesCount() const override { return 3; }
     virtual enum GlBuffer::BufferType bufferType() const override {
         return GlBuffer::BF_PT;
@@ -196,9 +196,9 @@ public:
     // PointStyle interface
 public:
     virtual void setType(enum PointType type) override;
-    virtual unsigned short addPoint(const SimplePoint &pt, float z,
-                                    unsigned short index,
-                                    GlBuffer *buffer) override;
+    virtual GLuint addPoint(const SimplePoint &pt, float z,
+                            GLuint index,
+                            GlBuffer *buffer) override;
     virtual size_t pointVerticesCount() const override;
     virtual enum GlBuffer::BufferType bufferType() const override {
         return GlBuffer::BF_FILL;
@@ -248,16 +248,16 @@ public:
     unsigned char segmentCount() const;
     void setSegmentCount(unsigned char segmentCount);
 
-    unsigned short addLineCap(const SimplePoint &point, const Normal &normal,
-                              float z, unsigned short index, GlBuffer *buffer);
+    GLuint addLineCap(const SimplePoint &point, const Normal &normal,
+                      float z, GLuint index, GlBuffer *buffer);
     size_t lineCapVerticesCount() const;
-    unsigned short addLineJoin(const SimplePoint &point, const Normal &prevNormal,
-                               const Normal &normal, float z, unsigned short index,
-                               GlBuffer *buffer);
+    GLuint addLineJoin(const SimplePoint &point, const Normal &prevNormal,
+                       const Normal &normal, float z, GLuint index,
+                       GlBuffer *buffer);
     size_t lineJoinVerticesCount() const;
-    virtual unsigned short addSegment(const SimplePoint &pt1, const SimplePoint &pt2,
+    virtual GLuint addSegment(const SimplePoint &pt1, const SimplePoint &pt2,
                               const Normal &normal, float z,
-                              unsigned short index, GlBuffer *buffer);
+                              GLuint index, GlBuffer *buffer);
 
     // SimpleVectorStyle
 public:
@@ -385,9 +385,9 @@ public:
 public:
     virtual void setType(enum PointType type) override;
     virtual size_t pointVerticesCount() const override { return 4; }
-    virtual unsigned short addPoint(const SimplePoint &pt, float z,
-                                    unsigned short index,
-                                    GlBuffer *buffer) override;
+    virtual GLuint addPoint(const SimplePoint &pt, float z,
+                            GLuint index,
+                            GlBuffer *buffer) override;
     virtual enum GlBuffer::BufferType bufferType() const override {
         return GlBuffer::BF_TEX;
     }
@@ -29,7 +29,8 @@ GlTile::GlTile(const GlTile other, bool initNew) : GlObject(),
     m_tileItem(other.m_tileItem),
     m_id(0),
     m_did(0),
-    m_filled(false)
+    m_filled(false),
+    m_fillQueued(false)
 {
     ngsUnused(initNew);
     m_originalTileSize = other.m_originalTileSize;
@@ -42,7 +43,8 @@ GlTile::GlTile(unsigned short tileSize, const TileItem &tileItem) : GlObject(),
     m_tileItem(tileItem),
     m_id(0),
     m_did(0),
-    m_filled(false)
+    m_filled(false),
+    m_fillQueued(false)
 {
     m_originalTileSize = tileSize;
     m_originalEnv = tileItem.env;
@@ -158,6 +160,14 @@ void GlTile::destroy()
     m_tile.destroy();
 }
 
+void GlTile::cancelFill()
+{
+    // Skip queued fill jobs and start new group for next fill.
+    m_fillToken.cancel();
+    m_fillToken = CancelToken();
+    m_fillQueued = false;
+}
+
 void GlTile::prepareContext()
 {
     #ifdef GL_PROGRAM_POINT_SIZE_EXT
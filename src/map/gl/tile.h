@@ -25,6 +25,7 @@
 #include "image.h"
 #include "ds/geometry.h"
 #include "map/glm/mat4x4.hpp"
+#include "util/threadpool.h"
 
 namespace ngs {
 
@@ -51,6 +52,10 @@ public:
     const Envelope &getExtent() const { return m_tileItem.env; }
     bool filled() const { return m_filled; }
     void setFilled(bool filled = true) { m_filled = filled; }
+    const CancelToken &fillToken() const { return m_fillToken; }
+    bool fillQueued() const { return m_fillQueued; }
+    void setFillQueued() { m_fillQueued = true; }
+    void cancelFill();
     size_t getSizeInPixels() const {
         return size_t(m_originalTileSize);///*m_image.getWidth()*/ * 256.0 / GLTILE_SIZE);
     }
@@ -76,6 +81,8 @@ protected:
     glm::mat4 m_sceneMatrix;
     glm::mat4 m_invViewMatrix;
     bool m_filled;
+    CancelToken m_fillToken;
+    bool m_fillQueued;
     unsigned short m_tileSize, m_originalTileSize;
     Envelope m_originalEnv;
 };
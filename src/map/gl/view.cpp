@@ -21,17 +21,28 @@
 
 #include "view.h"
 
+// stl
+#include <set>
+
 #include "ds/featureclassovr.h"
 #include "layer.h"
 #include "style.h"
 #include "map/overlay.h"
 #include "overlay.h"
+#include "catalog/file.h"
 #include "util/error.h"
+#include "util/settings.h"
 
 namespace ngs {
 
 constexpr unsigned char MAX_TRIES = 2;
 constexpr const char* SELECTION_KEY = "selection";
+constexpr size_t TILE_CACHE_SIZE = 32 * 1024 * 1024; // 32 Mb
+constexpr size_t RASTER_CACHE_SIZE = 64 * 1024 * 1024; // 64 Mb
+constexpr size_t RASTER_CACHE_DISK_SIZE = 256 * 1024 * 1024; // 256 Mb
+constexpr const char *RASTER_CACHE_DIR = "raster_tiles";
+constexpr size_t WARP_GRID_CACHE_SIZE = 1024; // Grids count
+constexpr unsigned char MAX_PREFETCH_ZOOM = 21;
 
 //------------------------------------------------------------------------------
 // LayerFillData
@@ -47,26 +58,64 @@ public:
     float m_zlevel;
 };
 
+//------------------------------------------------------------------------------
+// LayerPrefetchData
+//------------------------------------------------------------------------------
+
+class LayerPrefetchData : public ThreadData {
+public:
+    LayerPrefetchData(const TileItem &tileItem, LayerPtr layer, float z,
+                      bool own) :
+        ThreadData(own), m_tileItem(tileItem), m_layer(layer), m_zlevel(z) {
+    }
+    TileItem m_tileItem;
+    LayerPtr m_layer;
+    float m_zlevel;
+};
+
+static double tileDistance(const Tile &tile, const Envelope &extent,
+                           const OGRRawPoint &center)
+{
+    Envelope env = extent;
+    env.move(tile.crossExtent * DEFAULT_BOUNDS.width(), 0.0);
+    return ngsDistance(env.center(), center);
+}
+
 //------------------------------------------------------------------------------
 // GlView
 //------------------------------------------------------------------------------
 
 
-GlView::GlView() : MapView()
+GlView::GlView() : MapView(),
+    m_tileCache(TILE_CACHE_SIZE),
+    m_rasterTileCache(RASTER_CACHE_SIZE, RASTER_CACHE_DISK_SIZE),
+    m_warpGridCache(WARP_GRID_CACHE_SIZE),
+    m_prefetch(false),
+    m_frameWaiting(false),
+    m_frameTime(-1.0)
 {
     initView();
 }
 
 GlView::GlView(const std::string &name, const std::string &description,
                unsigned short epsg, const Envelope &bounds) :
-    MapView(name, description, epsg, bounds)
+    MapView(name, description, epsg, bounds),
+    m_tileCache(TILE_CACHE_SIZE),
+    m_rasterTileCache(RASTER_CACHE_SIZE, RASTER_CACHE_DISK_SIZE),
+    m_warpGridCache(WARP_GRID_CACHE_SIZE),
+    m_prefetch(false),
+    m_frameWaiting(false),
+    m_frameTime(-1.0)
 {
     initView();
 }
 
 void GlView::clearTiles()
 {
-    std::for_each(m_tiles.begin(), m_tiles.end(), [](GlTilePtr &tile){ tile->destroy(); });
+    std::for_each(m_tiles.begin(), m_tiles.end(), [](GlTilePtr &tile){
+        tile->cancelFill();
+        tile->destroy();
+    });
     m_tiles.clear();
 }
 
@@ -84,6 +133,9 @@ bool GlView::close()
     freeOldTiles();
     freeResources();
     clearTiles();
+    m_tileCache.clear();
+    m_rasterTileCache.clear();
+    m_warpGridCache.clear();
     return MapView::close();
 }
 
@@ -104,6 +156,7 @@ bool GlView::setSelectionStyleName(enum ngsStyleType styleType, const std::strin
     if(nullptr != newStyle) {
         freeResource(m_selectionStyles[styleType]);
         m_selectionStyles[styleType] = StylePtr(newStyle);
+        m_tileCache.clear();
         return true;
     }
     return false;
@@ -132,6 +185,16 @@ bool GlView::layerDataFillJobThreadFunc(ThreadData* threadData)
         }
     }
 
+    LayerPrefetchData *prefetchData = dynamic_cast<LayerPrefetchData*>(threadData);
+    if (nullptr != prefetchData) {
+        GlRenderLayer *renderLayer = ngsDynamicCast(GlRenderLayer,
+                                                    prefetchData->m_layer);
+        if (nullptr != renderLayer) {
+            return renderLayer->prefetch(prefetchData->m_tileItem,
+                                         prefetchData->m_zlevel);
+        }
+    }
+
 	return true;
 }
 
@@ -170,26 +233,25 @@ bool GlView::draw(ngsDrawState state, const Progress &progress)
     case DS_REDRAW:
         clearTiles();
     [[clang::fallthrough]]; case DS_REFILL:
+        // Layers data may be changed, so cached tiles are not valid any more.
+        // Raster layers drop only tiles of changed rasters.
+        m_tileCache.clear();
+        for(const LayerPtr &layer : m_layers) {
+            GlRenderLayer *renderLayer = ngsDynamicCast(GlRenderLayer, layer);
+            if(renderLayer) {
+                renderLayer->refill();
+            }
+        }
         for(GlTilePtr& tile : m_tiles) {
             tile->setFilled(false);
+            tile->cancelFill();
         }
     [[clang::fallthrough]]; case DS_NORMAL:
-        // Get tiles for extent and mark to delete out of bounds tiles
+        // Get tiles for extent and cancel fill of out of bounds tiles
         updateTilesList();
         // Start load layers data for tiles
-        m_threadPool.clearThreadData();
-        for(const GlTilePtr& tile : m_tiles) {
-            if(tile->filled())
-                continue;
-            float z = 0.0f;
-            for(auto layerIt = m_layers.rbegin(); layerIt != m_layers.rend();
-                 ++layerIt) {
-                const LayerPtr &layer = *layerIt;
-                m_threadPool.addThreadData(new LayerFillData(tile, layer, z, true));
-
-                z += 1000.0f;
-            }
-        }
+        fillTiles();
+        prefetchTiles();
     [[clang::fallthrough]]; case DS_PRESERVED:
         bool result = drawTiles(progress);
         // Free unnecessary Gl objects as this call is in Gl context
@@ -204,12 +266,16 @@ void GlView::invalidate(const Envelope &bounds)
 {
     std::vector<GlTilePtr> newTiles;
 
+    m_tileCache.remove(bounds);
+    m_tileCache.remove(m_invalidRegion);
+
     auto it = m_tiles.begin();
     while(it != m_tiles.end()) {
          GlTilePtr tile = *it;
          Envelope env = tile->getExtent();
          env.resize(TILE_RESIZE);
          if(env.intersects(bounds) || env.intersects(m_invalidRegion)) {
+             tile->cancelFill();
              m_oldTiles.push_back(tile);
              it = m_tiles.erase(it);
 
@@ -220,23 +286,91 @@ void GlView::invalidate(const Envelope &bounds)
          }
     }
 
-    for(const GlTilePtr &tile : newTiles) {
-        m_tiles.push_back(tile);
-        float z = 0.0f;
-        for (auto layerIt = m_layers.rbegin(); layerIt != m_layers.rend();
-             ++layerIt) {
-            const LayerPtr &layer = *layerIt;
-            m_threadPool.addThreadData(new LayerFillData(tile, layer, z, true));
-            z += 1000.f;
+    m_tiles.insert(m_tiles.end(), newTiles.begin(), newTiles.end());
+    fillTiles();
+
+    m_invalidRegion = bounds;
+}
+
+bool GlView::setOptions(const Options &options)
+{
+    if(!MapView::setOptions(options)) {
+        return false;
+    }
+
+    if(options.hasKey("TILE_CACHE_SIZE")) {
+        long size = options.asLong("TILE_CACHE_SIZE",
+                                   static_cast<long>(TILE_CACHE_SIZE));
+        m_tileCache.setMaxSize(size < 0 ? 0 : static_cast<size_t>(size));
+    }
+
+    if(options.hasKey("TILE_PREFETCH")) {
+        m_prefetch = options.asBool("TILE_PREFETCH", false);
+    }
+
+    if(options.hasKey("RASTER_CACHE_SIZE")) {
+        long size = options.asLong("RASTER_CACHE_SIZE",
+                                   static_cast<long>(RASTER_CACHE_SIZE));
+        m_rasterTileCache.setMaxSize(size < 0 ? 0 : static_cast<size_t>(size));
+    }
+
+    if(options.hasKey("RASTER_CACHE_DISK")) {
+        std::string path;
+        if(options.asBool("RASTER_CACHE_DISK", false)) {
+            std::string cachePath =
+                    Settings::instance().getString("common/cache_path", "");
+            if(cachePath.empty()) {
+                return errorMessage(_("Cache path option must be present"));
+            }
+            path = File::formFileName(cachePath, RASTER_CACHE_DIR);
         }
+        m_rasterTileCache.setDiskPath(path);
     }
 
-    m_invalidRegion = bounds;
+    if(options.hasKey("RASTER_CACHE_DISK_SIZE")) {
+        long size = options.asLong("RASTER_CACHE_DISK_SIZE",
+                                   static_cast<long>(RASTER_CACHE_DISK_SIZE));
+        m_rasterTileCache.setMaxDiskSize(size < 0 ? 0 :
+                                                    static_cast<size_t>(size));
+    }
+
+    if(options.asBool("TILE_CACHE_RESET_STATISTICS", false)) {
+        m_tileCache.resetStatistics();
+        m_rasterTileCache.resetStatistics();
+    }
+    return true;
+}
+
+Options GlView::options() const
+{
+    Options options = MapView::options();
+    options.add("TILE_PREFETCH", m_prefetch ? "ON" : "OFF");
+    options.add("TILE_CACHE_SIZE", static_cast<GIntBig>(m_tileCache.maxSize()));
+    options.add("TILE_CACHE_USED", static_cast<GIntBig>(m_tileCache.size()));
+    options.add("TILE_CACHE_HITS", static_cast<GIntBig>(m_tileCache.hits()));
+    options.add("TILE_CACHE_MISSES", static_cast<GIntBig>(m_tileCache.misses()));
+    options.add("RASTER_CACHE_SIZE",
+                static_cast<GIntBig>(m_rasterTileCache.maxSize()));
+    options.add("RASTER_CACHE_DISK",
+                m_rasterTileCache.diskPath().empty() ? "OFF" : "ON");
+    options.add("RASTER_CACHE_DISK_SIZE",
+                static_cast<GIntBig>(m_rasterTileCache.maxDiskSize()));
+    options.add("RASTER_CACHE_DISK_USED",
+                static_cast<GIntBig>(m_rasterTileCache.diskSize()));
+    options.add("RASTER_CACHE_USED",
+                static_cast<GIntBig>(m_rasterTileCache.size()));
+    options.add("RASTER_CACHE_HITS",
+                static_cast<GIntBig>(m_rasterTileCache.hits()));
+    options.add("RASTER_CACHE_MISSES",
+                static_cast<GIntBig>(m_rasterTileCache.misses()));
+    options.add("FRAME_TIME", CPLSPrintf("%.1f", m_frameTime * 1000.0));
+    return options;
 }
 
 bool GlView::setSelectionStyle(enum ngsStyleType styleType,
                                const CPLJSONObject &style)
 {
+    m_tileCache.clear();
     return m_selectionStyles[styleType]->load(style);
 }
 
@@ -360,6 +494,7 @@ void GlView::updateTilesList()
         }
 
         if(markToDelete) {
+            (*tileIt)->cancelFill();
             m_oldTiles.push_back(*tileIt);
             tileIt = m_tiles.erase(tileIt);
         }
@@ -373,10 +508,117 @@ void GlView::updateTilesList()
         m_tiles.push_back(GlTilePtr(new GlTile(GLTILE_SIZE, tileItem)));
     }
 
+    // New tiles after pan or zoom, time the frame until all of them drawn.
+    // Time from the first change if the view changes again before that.
+    if(!tileItems.empty() && !m_frameWaiting) {
+        m_viewChangeTime = std::chrono::steady_clock::now();
+        m_frameWaiting = true;
+    }
+
 //    CPLDebug("ngstore", "Tile count: %ld", m_tiles.size());
 //    CPLDebug("ngstore", "Old tile count: %ld", m_oldTiles.size());
 }
 
+void GlView::fillTiles()
+{
+    std::vector<GlTilePtr> tiles;
+    for(const GlTilePtr &tile : m_tiles) {
+        if(!tile->filled() && !tile->fillQueued()) {
+            tiles.push_back(tile);
+        }
+    }
+
+    // Fill tiles nearest to the view center first to get complete frame as
+    // soon as possible.
+    OGRRawPoint center = getCenter();
+    std::sort(tiles.begin(), tiles.end(),
+              [&center](const GlTilePtr &tile1, const GlTilePtr &tile2) {
+        return tileDistance(tile1->getTile(), tile1->getExtent(), center) <
+                tileDistance(tile2->getTile(), tile2->getExtent(), center);
+    });
+
+    Envelope ext = getExtent();
+    for(const GlTilePtr &tile : tiles) {
+        Envelope env = tile->getExtent();
+        env.move(tile->getTile().crossExtent * DEFAULT_BOUNDS.width(), 0.0);
+        // Tiles only in resize margin are not visible now.
+        ThreadPool::Priority priority = env.intersects(ext) ?
+                    ThreadPool::Priority::High : ThreadPool::Priority::Normal;
+        float z = 0.0f;
+        for(auto layerIt = m_layers.rbegin(); layerIt != m_layers.rend();
+             ++layerIt) {
+            const LayerPtr &layer = *layerIt;
+            LayerFillData *data = new LayerFillData(tile, layer, z, true);
+            data->setCancelToken(tile->fillToken());
+            m_threadPool.addThreadData(data, priority);
+
+            z += 1000.0f;
+        }
+        tile->setFillQueued();
+    }
+}
+
+void GlView::prefetchTiles()
+{
+    // Previous prefetch is out of date after view changed.
+    m_prefetchToken.cancel();
+    m_prefetchToken = CancelToken();
+
+    if(!m_prefetch || m_tileCache.maxSize() == 0) {
+        return;
+    }
+
+    Envelope ext = getExtent();
+    ext.resize(TILE_RESIZE);
+    unsigned char zoom = getZoom();
+    OGRRawPoint center = getCenter();
+
+    // Ring of neighbour tiles around the view
+    double tileSize = DEFAULT_BOUNDS.width() / (1 << zoom);
+    Envelope ringExt(ext.minX() - tileSize, ext.minY() - tileSize,
+                     ext.maxX() + tileSize, ext.maxY() + tileSize);
+    std::vector<TileItem> ringItems = getTilesForExtent(ringExt, zoom, false,
+                                                        getXAxisLooped());
+    std::set<Tile> viewTiles;
+    for(const GlTilePtr &tile : m_tiles) {
+        viewTiles.insert(tile->getTile());
+    }
+    std::vector<TileItem> items;
+    for(const TileItem &item : ringItems) {
+        if(viewTiles.find(item.tile) == viewTiles.end()) {
+            items.push_back(item);
+        }
+    }
+
+    auto byDistance = [&center](const TileItem &item1, const TileItem &item2) {
+        return tileDistance(item1.tile, item1.env, center) <
+                tileDistance(item2.tile, item2.env, center);
+    };
+    std::sort(items.begin(), items.end(), byDistance);
+
+    // Next zoom level tiles after the ring
+    if(zoom < MAX_PREFETCH_ZOOM) {
+        std::vector<TileItem> zoomItems = getTilesForExtent(getExtent(),
+                                                            zoom + 1, false,
+                                                            getXAxisLooped());
+        std::sort(zoomItems.begin(), zoomItems.end(), byDistance);
+        items.insert(items.end(), zoomItems.begin(), zoomItems.end());
+    }
+
+    for(const TileItem &item : items) {
+        float z = 0.0f;
+        for(auto layerIt = m_layers.rbegin(); layerIt != m_layers.rend();
+             ++layerIt) {
+            const LayerPtr &layer = *layerIt;
+            LayerPrefetchData *data = new LayerPrefetchData(item, layer, z, true);
+            data->setCancelToken(m_prefetchToken);
+            m_threadPool.addThreadData(data, ThreadPool::Priority::Low);
+
+            z += 1000.0f;
+        }
+    }
+}
+
 void GlView::freeResources()
 {
     std::for_each(m_freeResources.begin(), m_freeResources.end(),
@@ -490,6 +732,14 @@ bool GlView::drawTiles(const Progress &progress)
 
 //    CPLDebug("ngstore", "Drawing %f of %f", done, totalDrawCalls);
     if(done >= totalDrawCalls) {
+        if(m_frameWaiting) {
+            m_frameTime = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() -
+                        m_viewChangeTime).count();
+            m_frameWaiting = false;
+            CPLDebug("ngstore", "First complete frame after view change in %.1f ms",
+                     m_frameTime * 1000.0);
+        }
         freeOldTiles();
         progress.onProgress(COD_FINISHED, 1.0, _("Map render finished."));
     }
@@ -47,11 +47,22 @@ public:
     }
     TextureAtlas textureAtlas() const { return m_textureAtlas; }
     SelectionStyles selectionStyles() const { return m_selectionStyles; }
+    GlTileCache *tileCache() { return &m_tileCache; }
+    GlRasterTileCache *rasterTileCache() { return &m_rasterTileCache; }
+    WarpGridCache *warpGridCache() { return &m_warpGridCache; }
+    /**
+     * @brief GlView::frameTime Seconds from the view change to the first
+     * complete frame drawn after it.
+     * @return Last measured time or negative value if not measured yet.
+     */
+    double frameTime() const { return m_frameTime; }
 
     // Run in GL context
 protected:
     void clearTiles();
     void updateTilesList();
+    void fillTiles();
+    void prefetchTiles();
     void freeResources();
     bool drawTiles(const Progress &progress);
     void drawOldTiles();
@@ -75,6 +86,8 @@ protected:
 public:
     virtual bool draw(ngsDrawState state, const Progress &progress) override;
     virtual void invalidate(const Envelope& bounds) override;
+    virtual bool setOptions(const Options &options) override;
+    virtual Options options() const override;
     virtual bool setSelectionStyleName(enum ngsStyleType styleType,
                                        const std::string &name) override;
     virtual bool setSelectionStyle(enum ngsStyleType styleType,
@@ -115,6 +128,14 @@ private:
     Envelope m_invalidRegion;
     SimpleImageStyle m_fboDrawStyle;
     SelectionStyles m_selectionStyles;
+    GlTileCache m_tileCache;
+    GlRasterTileCache m_rasterTileCache;
+    WarpGridCache m_warpGridCache;
+    CancelToken m_prefetchToken;
+    bool m_prefetch;
+    std::chrono::steady_clock::time_point m_viewChangeTime;
+    bool m_frameWaiting;
+    double m_frameTime;
     ThreadPool m_threadPool;
 };
 
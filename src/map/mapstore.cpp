@@ -24,6 +24,7 @@
 #include <limits>
 #include <util/error.h>
 
+#include "cpu/view.h"
 #include "ngstore/util/constants.h"
 #include "util/notify.h"
 
@@ -31,7 +32,7 @@
 #include "gl/view.h"
 	#define NewView GlView
 #else
-	#define NewView MapViewStab
+	#define NewView CpuView
 #endif
 
 namespace ngs {
@@ -44,6 +45,14 @@ constexpr char INVALID_MAPID = NOT_FOUND;
 typedef std::unique_ptr<MapStore> MapStorePtr;
 static MapStorePtr gMapStore;
 
+/**
+ * Maps are rendered on CPU if library initialized with HEADLESS option.
+ */
+static bool isHeadless()
+{
+    return CPLTestBool(CPLGetConfigOption("NGS_HEADLESS", "OFF"));
+}
+
 
 MapStore::MapStore()
 {
@@ -56,7 +65,12 @@ char MapStore::createMap(const std::string &name, const std::string &description
         // No space for new maps
         return INVALID_MAPID;
     }
-    m_maps.push_back(MapViewPtr(new NewView(name, description, epsg, bounds)));
+    if(isHeadless()) {
+        m_maps.push_back(MapViewPtr(new CpuView(name, description, epsg, bounds)));
+    }
+    else {
+        m_maps.push_back(MapViewPtr(new NewView(name, description, epsg, bounds)));
+    }
     char mapId = static_cast<char>(m_maps.size() - 1);
     Notify::instance().onNotify(std::to_string(mapId), CC_CREATE_MAP);
     return mapId;
@@ -171,6 +185,38 @@ void MapStore::invalidateMap(char mapId, const Envelope &bounds)
     map->invalidate(bounds);
 }
 
+GByte *MapStore::renderMapTile(char mapId, int x, int y, unsigned char z,
+                               int tileSize, int &size)
+{
+    CpuView *view = dynamic_cast<CpuView*>(getMap(mapId).get());
+    if(nullptr == view) {
+        errorMessage(_("Map with id %d not exists or not headless"), mapId);
+        return nullptr;
+    }
+
+    Canvas canvas;
+    if(!view->renderTile(x, y, z, tileSize, canvas)) {
+        return nullptr;
+    }
+    return canvas.toPng(size);
+}
+
+GByte *MapStore::renderMapExtent(char mapId, const Envelope &extent, int width,
+                                 int height, int &size)
+{
+    CpuView *view = dynamic_cast<CpuView*>(getMap(mapId).get());
+    if(nullptr == view) {
+        errorMessage(_("Map with id %d not exists or not headless"), mapId);
+        return nullptr;
+    }
+
+    Canvas canvas;
+    if(!view->renderExtent(extent, width, height, canvas)) {
+        return nullptr;
+    }
+    return canvas.toPng(size);
+}
+
 ngsRGBA MapStore::getMapBackgroundColor(char mapId) const
 {
     MapViewPtr map = getMap(mapId);
@@ -382,6 +428,15 @@ bool MapStore::setOptions(char mapId, const Options& options)
     return map->setOptions(options);
 }
 
+Options MapStore::getOptions(char mapId) const
+{
+    MapViewPtr map = getMap(mapId);
+    if(!map) {
+        return Options();
+    }
+    return map->options();
+}
+
 bool MapStore::setExtentLimits(char mapId, const Envelope &extentLimits)
 {
     MapViewPtr map = getMap(mapId);
@@ -401,6 +456,9 @@ char MapStore::invalidMapId()
 // static
 MapViewPtr MapStore::initMap()
 {
+    if(isHeadless()) {
+        return MapViewPtr(new CpuView);
+    }
     return MapViewPtr(new NewView);
 }
 
@@ -62,6 +62,10 @@ public:
     // Map manipulation
     bool drawMap(char mapId, enum ngsDrawState state, const Progress &progress = Progress());
     void invalidateMap(char mapId, const Envelope &bounds);
+    GByte *renderMapTile(char mapId, int x, int y, unsigned char z,
+                         int tileSize, int &size);
+    GByte *renderMapExtent(char mapId, const Envelope &extent, int width,
+                           int height, int &size);
 
     bool setMapSize(char mapId, int width, int height, bool YAxisInverted);
     ngsRGBA getMapBackgroundColor(char mapId) const;
@@ -82,6 +86,7 @@ public:
     bool deleteLayer(char mapId, Layer *layer);
     bool reorderLayers(char mapId, Layer *beforeLayer, Layer *movedLayer);
     bool setOptions(char mapId, const Options &options);
+    Options getOptions(char mapId) const;
     bool setExtentLimits(char mapId, const Envelope &extentLimits);
     OverlayPtr getOverlay(char mapId, enum ngsMapOverlayType type) const;
     bool setOverlayVisible(char mapId, int typeMask, bool visible);
@@ -297,6 +297,14 @@ bool MapView::setOptions(const Options &options)
     return true;
 }
 
+Options MapView::options() const
+{
+    Options options;
+    options.add("VIEWPORT_REDUCE_FACTOR", std::to_string(m_reduceFactor));
+    options.add("ZOOM_INCREMENT", static_cast<long>(m_extraZoom));
+    return options;
+}
+
 bool MapView::addIconSet(const std::string &name, const std::string &path,
                          bool ownByMap)
 {
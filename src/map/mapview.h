@@ -49,6 +49,7 @@ public:
     void setOverlayVisible(int typeMask, bool visible);
     int overlayVisibleMask() const;
     virtual bool setOptions(const Options &options);
+    virtual Options options() const;
     virtual bool setSelectionStyleName(enum ngsStyleType styleType,
                                        const std::string &name) = 0;
     virtual bool setSelectionStyle(enum ngsStyleType styleType,
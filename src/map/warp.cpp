@@ -0,0 +1,380 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "warp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// gdal
+#include "gdal_alg.h"
+
+#include "util/error.h"
+#include "util/stringutil.h"
+
+namespace ngs {
+
+constexpr GByte PIXEL_SIZE = 4; // RGBA
+constexpr double CUBIC_A = -0.5;
+
+RasterResampling resamplingFromString(const std::string &name)
+{
+    if(compare(name, "bilinear")) {
+        return RasterResampling::Bilinear;
+    }
+    if(compare(name, "cubic")) {
+        return RasterResampling::Cubic;
+    }
+    return RasterResampling::Nearest;
+}
+
+std::string resamplingToString(enum RasterResampling resampling)
+{
+    switch(resampling) {
+    case RasterResampling::Bilinear:
+        return "bilinear";
+    case RasterResampling::Cubic:
+        return "cubic";
+    default:
+        return "nearest";
+    }
+}
+
+//------------------------------------------------------------------------------
+// WarpGrid
+//------------------------------------------------------------------------------
+
+WarpGrid::WarpGrid() :
+    m_width(0),
+    m_height(0),
+    m_step(1),
+    m_columns(0),
+    m_rows(0)
+{
+}
+
+bool WarpGrid::create(const std::string &srcWKT, const double *srcGeoTransform,
+                      const std::string &dstWKT, const Envelope &dstExtent,
+                      int width, int height, int step, double maxError)
+{
+    if(width <= 0 || height <= 0 || step <= 0) {
+        return false;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_step = step;
+    m_columns = (width + step - 1) / step + 1;
+    m_rows = (height + step - 1) / step + 1;
+    size_t count = static_cast<size_t>(m_columns * m_rows);
+    m_x.resize(count);
+    m_y.resize(count);
+    m_valid.assign(count, 0);
+
+    double dstGeoTransform[6] = { dstExtent.minX(), dstExtent.width() / width,
+                                  0.0, dstExtent.maxY(), 0.0,
+                                  -dstExtent.height() / height };
+    void *transformArg = GDALCreateGenImgProjTransformer3(srcWKT.c_str(),
+                                                          srcGeoTransform,
+                                                          dstWKT.c_str(),
+                                                          dstGeoTransform);
+    if(nullptr == transformArg) {
+        return errorMessage(CPLGetLastErrorMsg());
+    }
+    void *approxArg = GDALCreateApproxTransformer(GDALGenImgProjTransform,
+                                                  transformArg, maxError);
+    GDALApproxTransformerOwnsSubtransformer(approxArg, TRUE);
+
+    // Approximate transformer interpolates along the row, so transform nodes
+    // row by row.
+    std::vector<double> z(static_cast<size_t>(m_columns));
+    std::vector<int> success(static_cast<size_t>(m_columns));
+    bool result = false;
+    for(int row = 0; row < m_rows; ++row) {
+        size_t offset = static_cast<size_t>(row * m_columns);
+        double *x = m_x.data() + offset;
+        double *y = m_y.data() + offset;
+        for(int column = 0; column < m_columns; ++column) {
+            x[column] = column * step;
+            y[column] = row * step;
+            z[static_cast<size_t>(column)] = 0.0;
+        }
+
+        GDALApproxTransform(approxArg, TRUE, m_columns, x, y, z.data(),
+                            success.data());
+
+        for(int column = 0; column < m_columns; ++column) {
+            if(success[static_cast<size_t>(column)] && std::isfinite(x[column]) &&
+                    std::isfinite(y[column])) {
+                m_valid[offset + static_cast<size_t>(column)] = 1;
+                result = true;
+            }
+        }
+    }
+
+    GDALDestroyApproxTransformer(approxArg);
+    return result;
+}
+
+bool WarpGrid::sourcePoint(double x, double y, double &srcX, double &srcY) const
+{
+    double u = x / m_step;
+    double v = y / m_step;
+    int column = std::min(std::max(static_cast<int>(u), 0), m_columns - 2);
+    int row = std::min(std::max(static_cast<int>(v), 0), m_rows - 2);
+    u -= column;
+    v -= row;
+
+    size_t topLeft = static_cast<size_t>(row * m_columns + column);
+    size_t bottomLeft = topLeft + static_cast<size_t>(m_columns);
+    if(!m_valid[topLeft] || !m_valid[topLeft + 1] || !m_valid[bottomLeft] ||
+            !m_valid[bottomLeft + 1]) {
+        return false;
+    }
+
+    double top = m_x[topLeft] + (m_x[topLeft + 1] - m_x[topLeft]) * u;
+    double bottom = m_x[bottomLeft] + (m_x[bottomLeft + 1] - m_x[bottomLeft]) * u;
+    srcX = top + (bottom - top) * v;
+
+    top = m_y[topLeft] + (m_y[topLeft + 1] - m_y[topLeft]) * u;
+    bottom = m_y[bottomLeft] + (m_y[bottomLeft + 1] - m_y[bottomLeft]) * u;
+    srcY = top + (bottom - top) * v;
+    return true;
+}
+
+Envelope WarpGrid::sourceExtent(double &scaleX, double &scaleY) const
+{
+    Envelope out(std::numeric_limits<double>::max(),
+                 std::numeric_limits<double>::max(),
+                 std::numeric_limits<double>::lowest(),
+                 std::numeric_limits<double>::lowest());
+    double sumX = 0.0, sumY = 0.0;
+    int countX = 0, countY = 0;
+    for(int row = 0; row < m_rows; ++row) {
+        for(int column = 0; column < m_columns; ++column) {
+            size_t index = static_cast<size_t>(row * m_columns + column);
+            if(!m_valid[index]) {
+                continue;
+            }
+            out.setMinX(std::min(out.minX(), m_x[index]));
+            out.setMinY(std::min(out.minY(), m_y[index]));
+            out.setMaxX(std::max(out.maxX(), m_x[index]));
+            out.setMaxY(std::max(out.maxY(), m_y[index]));
+
+            if(column + 1 < m_columns && m_valid[index + 1]) {
+                sumX += std::hypot(m_x[index + 1] - m_x[index],
+                                   m_y[index + 1] - m_y[index]);
+                countX++;
+            }
+            size_t next = index + static_cast<size_t>(m_columns);
+            if(row + 1 < m_rows && m_valid[next]) {
+                sumY += std::hypot(m_x[next] - m_x[index],
+                                   m_y[next] - m_y[index]);
+                countY++;
+            }
+        }
+    }
+
+    scaleX = countX > 0 ? sumX / countX / m_step : 1.0;
+    scaleY = countY > 0 ? sumY / countY / m_step : 1.0;
+    if(out.minX() > out.maxX()) {
+        return Envelope();
+    }
+    return out;
+}
+
+size_t WarpGrid::memorySize() const
+{
+    return sizeof(WarpGrid) + (m_x.size() + m_y.size()) * sizeof(double) +
+            m_valid.size();
+}
+
+//------------------------------------------------------------------------------
+// WarpGridCache
+//------------------------------------------------------------------------------
+
+WarpGridCache::WarpGridCache(size_t maxCount) :
+    m_maxCount(maxCount)
+{
+}
+
+WarpGridPtr WarpGridCache::get(const std::string &source, const Tile &tile)
+{
+    MutexHolder holder(m_mutex);
+    auto it = m_items.find({source, tile});
+    if(it == m_items.end()) {
+        return WarpGridPtr();
+    }
+    m_order.splice(m_order.begin(), m_order, it->second.order);
+    return it->second.grid;
+}
+
+void WarpGridCache::put(const std::string &source, const Tile &tile,
+                        const WarpGridPtr &grid)
+{
+    MutexHolder holder(m_mutex);
+    if(m_maxCount == 0) {
+        return;
+    }
+
+    Key key = {source, tile};
+    auto it = m_items.find(key);
+    if(it != m_items.end()) {
+        it->second.grid = grid;
+        m_order.splice(m_order.begin(), m_order, it->second.order);
+        return;
+    }
+
+    m_order.push_front(key);
+    m_items[key] = {grid, m_order.begin()};
+    while(m_items.size() > m_maxCount) {
+        m_items.erase(m_order.back());
+        m_order.pop_back();
+    }
+}
+
+void WarpGridCache::clear()
+{
+    MutexHolder holder(m_mutex);
+    m_items.clear();
+    m_order.clear();
+}
+
+size_t WarpGridCache::count() const
+{
+    MutexHolder holder(m_mutex);
+    return m_items.size();
+}
+
+//------------------------------------------------------------------------------
+// Resampling
+//------------------------------------------------------------------------------
+
+static inline const GByte *pixel(const GByte *src, int width, int height,
+                                 int x, int y)
+{
+    x = std::min(std::max(x, 0), width - 1);
+    y = std::min(std::max(y, 0), height - 1);
+    return src + (static_cast<size_t>(y) * static_cast<size_t>(width) +
+                  static_cast<size_t>(x)) * PIXEL_SIZE;
+}
+
+static inline double cubicWeight(double x)
+{
+    x = std::fabs(x);
+    if(x < 1.0) {
+        return ((CUBIC_A + 2.0) * x - (CUBIC_A + 3.0)) * x * x + 1.0;
+    }
+    if(x < 2.0) {
+        return ((CUBIC_A * x - 5.0 * CUBIC_A) * x + 8.0 * CUBIC_A) * x -
+                4.0 * CUBIC_A;
+    }
+    return 0.0;
+}
+
+static void samplePixel(const GByte *src, int width, int height, double x,
+                        double y, enum RasterResampling resampling, GByte *out)
+{
+    switch(resampling) {
+    case RasterResampling::Nearest:
+    {
+        const GByte *in = pixel(src, width, height, static_cast<int>(x),
+                                static_cast<int>(y));
+        std::copy(in, in + PIXEL_SIZE, out);
+        return;
+    }
+    case RasterResampling::Bilinear:
+    {
+        // Pixel centers are at half pixel
+        x -= 0.5;
+        y -= 0.5;
+        int x0 = static_cast<int>(std::floor(x));
+        int y0 = static_cast<int>(std::floor(y));
+        double tx = x - x0;
+        double ty = y - y0;
+        const GByte *p00 = pixel(src, width, height, x0, y0);
+        const GByte *p10 = pixel(src, width, height, x0 + 1, y0);
+        const GByte *p01 = pixel(src, width, height, x0, y0 + 1);
+        const GByte *p11 = pixel(src, width, height, x0 + 1, y0 + 1);
+        for(GByte i = 0; i < PIXEL_SIZE; ++i) {
+            double top = p00[i] + (p10[i] - p00[i]) * tx;
+            double bottom = p01[i] + (p11[i] - p01[i]) * tx;
+            out[i] = static_cast<GByte>(top + (bottom - top) * ty + 0.5);
+        }
+        return;
+    }
+    case RasterResampling::Cubic:
+    {
+        x -= 0.5;
+        y -= 0.5;
+        int x0 = static_cast<int>(std::floor(x));
+        int y0 = static_cast<int>(std::floor(y));
+        double wx[4], wy[4];
+        for(int i = 0; i < 4; ++i) {
+            wx[i] = cubicWeight(x - (x0 - 1 + i));
+            wy[i] = cubicWeight(y - (y0 - 1 + i));
+        }
+        double sum[PIXEL_SIZE] = { 0.0 };
+        for(int j = 0; j < 4; ++j) {
+            for(int i = 0; i < 4; ++i) {
+                const GByte *in = pixel(src, width, height, x0 - 1 + i,
+                                        y0 - 1 + j);
+                double weight = wx[i] * wy[j];
+                for(GByte k = 0; k < PIXEL_SIZE; ++k) {
+                    sum[k] += in[k] * weight;
+                }
+            }
+        }
+        for(GByte k = 0; k < PIXEL_SIZE; ++k) {
+            out[k] = static_cast<GByte>(std::min(std::max(sum[k] + 0.5, 0.0),
+                                                 255.0));
+        }
+        return;
+    }
+    }
+}
+
+void warpImage(const WarpGrid &grid, const GByte *src, const Envelope &srcWindow,
+               int srcWidth, int srcHeight, int rasterWidth, int rasterHeight,
+               enum RasterResampling resampling, GByte *dst)
+{
+    double scaleX = srcWidth / srcWindow.width();
+    double scaleY = srcHeight / srcWindow.height();
+    for(int y = 0; y < grid.height(); ++y) {
+        GByte *out = dst + static_cast<size_t>(y) *
+                static_cast<size_t>(grid.width()) * PIXEL_SIZE;
+        for(int x = 0; x < grid.width(); ++x, out += PIXEL_SIZE) {
+            double srcX, srcY;
+            if(!grid.sourcePoint(x + 0.5, y + 0.5, srcX, srcY)) {
+                continue;
+            }
+            if(srcX < 0.0 || srcY < 0.0 || srcX >= rasterWidth ||
+                    srcY >= rasterHeight) {
+                continue;
+            }
+            samplePixel(src, srcWidth, srcHeight,
+                        (srcX - srcWindow.minX()) * scaleX,
+                        (srcY - srcWindow.minY()) * scaleY, resampling, out);
+        }
+    }
+}
+
+} // namespace ngs
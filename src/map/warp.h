@@ -0,0 +1,145 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2019 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSWARP_H
+#define NGSWARP_H
+
+// stl
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ds/geometry.h"
+#include "util/mutex.h"
+
+namespace ngs {
+
+enum class RasterResampling {
+    Nearest,
+    Bilinear,
+    Cubic
+};
+
+RasterResampling resamplingFromString(const std::string &name);
+std::string resamplingToString(enum RasterResampling resampling);
+
+/**
+ * @brief The WarpGrid class Source raster pixel coordinates for the nodes of
+ * regular grid over destination image. Node coordinates are computed by GDAL
+ * approximate transformer, coordinates of pixels between nodes are
+ * interpolated bilinearly. So per image transform cost depends on grid step
+ * and not on image size.
+ */
+class WarpGrid
+{
+public:
+    WarpGrid();
+    /**
+     * @brief create Computes grid nodes.
+     * @param srcWKT Source raster spatial reference.
+     * @param srcGeoTransform Source raster geotransform.
+     * @param dstWKT Destination image spatial reference.
+     * @param dstExtent Destination image extent.
+     * @param width Destination image width in pixels.
+     * @param height Destination image height in pixels.
+     * @param step Grid step in destination pixels.
+     * @param maxError Transformer approximation error in source pixels.
+     * @return True if at least one grid node was transformed.
+     */
+    bool create(const std::string &srcWKT, const double *srcGeoTransform,
+                const std::string &dstWKT, const Envelope &dstExtent,
+                int width, int height, int step, double maxError);
+    bool sourcePoint(double x, double y, double &srcX, double &srcY) const;
+    /**
+     * @brief sourceExtent Returns bounding box of the grid nodes in source
+     * pixels and average source pixels count per destination pixel.
+     */
+    Envelope sourceExtent(double &scaleX, double &scaleY) const;
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    size_t memorySize() const;
+
+private:
+    int m_width, m_height, m_step, m_columns, m_rows;
+    std::vector<double> m_x, m_y;
+    std::vector<char> m_valid;
+};
+
+using WarpGridPtr = std::shared_ptr<WarpGrid>;
+
+/**
+ * @brief The WarpGridCache class LRU cache of warp grids. Grid depends only on
+ * source georeference and destination tile, so the grids are shared by all
+ * rasters with the same spatial reference and geotransform.
+ */
+class WarpGridCache
+{
+public:
+    explicit WarpGridCache(size_t maxCount);
+    WarpGridPtr get(const std::string &source, const Tile &tile);
+    void put(const std::string &source, const Tile &tile,
+             const WarpGridPtr &grid);
+    void clear();
+    size_t count() const;
+
+protected:
+    typedef struct _key {
+        std::string source;
+        Tile tile;
+        bool operator<(const struct _key &other) const {
+            return source < other.source ||
+                    (source == other.source && tile < other.tile);
+        }
+    } Key;
+
+    typedef struct _item {
+        WarpGridPtr grid;
+        std::list<Key>::iterator order;
+    } Item;
+
+private:
+    std::map<Key, Item> m_items;
+    std::list<Key> m_order; // Most recently used first
+    size_t m_maxCount;
+    mutable Mutex m_mutex;
+};
+
+/**
+ * @brief warpImage Resamples RGBA source window to RGBA destination image.
+ * Destination pixels which are out of source raster are left untouched.
+ * @param grid Warp grid of destination image.
+ * @param src Source window pixels.
+ * @param srcWindow Source window in full resolution raster pixels.
+ * @param srcWidth Source window buffer width.
+ * @param srcHeight Source window buffer height.
+ * @param rasterWidth Full resolution raster width.
+ * @param rasterHeight Full resolution raster height.
+ * @param resampling Resampling kernel.
+ * @param dst Destination image of grid width and height.
+ */
+void warpImage(const WarpGrid &grid, const GByte *src, const Envelope &srcWindow,
+               int srcWidth, int srcHeight, int rasterWidth, int rasterHeight,
+               enum RasterResampling resampling, GByte *dst);
+
+} // namespace ngs
+
+#endif // NGSWARP_H
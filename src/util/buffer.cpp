@@ -20,6 +20,7 @@
  ****************************************************************************/
 #include "buffer.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "cpl_conv.h"
@@ -55,13 +56,39 @@ Buffer::~Buffer()
     }
 }
 
+void Buffer::reserve(size_t size)
+{
+    if(static_cast<size_t>(m_mallocSize) >= size) {
+        return;
+    }
+    // Grow geometrically to not realloc on each put for big buffers.
+    size_t newSize = std::max(static_cast<size_t>(m_mallocSize) * 2,
+                              static_cast<size_t>(DEFAULT_BUFFER_SIZE));
+    while(newSize < size) {
+        newSize *= 2;
+    }
+    m_mallocSize = static_cast<int>(newSize);
+    m_data = static_cast<GByte*>(CPLRealloc(m_data, newSize));
+}
+
+Buffer &Buffer::put(const void *data, size_t size)
+{
+    if(0 == size) {
+        return *this;
+    }
+    reserve(m_currentPos + size);
+
+    std::memcpy(m_data + m_currentPos, data, size);
+    m_currentPos += size;
+    m_size += size;
+
+    return *this;
+}
+
 Buffer &Buffer::put(GUInt32 val)
 {
     size_t size = sizeof(GUInt32);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -73,10 +100,7 @@ Buffer &Buffer::put(GUInt32 val)
 Buffer &Buffer::put(float val)
 {
     size_t size = sizeof(float);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -88,10 +112,7 @@ Buffer &Buffer::put(float val)
 Buffer &Buffer::put(GByte val)
 {
     size_t size = sizeof(GByte);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -103,10 +124,7 @@ Buffer &Buffer::put(GByte val)
 Buffer &Buffer::put(GUInt16 val)
 {
     size_t size = sizeof(GUInt16);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -118,10 +136,7 @@ Buffer &Buffer::put(GUInt16 val)
 Buffer &Buffer::put(GUIntBig val)
 {
     size_t size = sizeof(GUIntBig);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -133,10 +148,7 @@ Buffer &Buffer::put(GUIntBig val)
 Buffer &Buffer::put(GIntBig val)
 {
     size_t size = sizeof(GIntBig);
-    if(static_cast<size_t>(m_mallocSize) < m_currentPos + size) {
-        m_mallocSize += DEFAULT_BUFFER_SIZE;
-        m_data = static_cast<GByte*>(CPLRealloc(m_data, static_cast<size_t>(m_mallocSize)));
-    }
+    reserve(m_currentPos + size);
 
     std::memcpy(m_data + m_currentPos, &val, size);
     m_currentPos += size;
@@ -145,11 +157,39 @@ Buffer &Buffer::put(GIntBig val)
     return *this;
 }
 
+bool Buffer::get(void *data, size_t size)
+{
+    if(size > available()) {
+        return false;
+    }
+    if(size > 0) {
+        std::memcpy(data, m_data + m_currentPos, size);
+    }
+    m_currentPos += size;
+    return true;
+}
+
+/**
+ * @brief Buffer::view Returns pointer to the next size bytes and skips them.
+ * Data is not copied and is valid while buffer data is not changed.
+ * @param size Bytes count.
+ * @return Pointer or nullptr if buffer has less data.
+ */
+const GByte *Buffer::view(size_t size)
+{
+    if(size > available() || nullptr == m_data) {
+        return nullptr;
+    }
+    const GByte *out = m_data + m_currentPos;
+    m_currentPos += size;
+    return out;
+}
+
 GUInt32 Buffer::getULong()
 {
     GUInt32 val = 0;
     size_t size = sizeof(GUInt32);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -160,7 +200,7 @@ float Buffer::getFloat()
 {
     float val = 0.0;
     size_t size = sizeof(float);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -171,7 +211,7 @@ GByte Buffer::getByte()
 {
     GByte val = 0;
     size_t size = sizeof(GByte);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -182,7 +222,7 @@ GUInt16 Buffer::getUShort()
 {
     GUInt16 val = 0;
     size_t size = sizeof(GUInt16);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -193,7 +233,7 @@ GUIntBig Buffer::getUBig()
 {
     GUIntBig val = 0;
     size_t size = sizeof(GUIntBig);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -204,7 +244,7 @@ GIntBig Buffer::getBig()
 {
     GIntBig val = 0;
     size_t size = sizeof(GIntBig);
-    if(m_currentPos + size > static_cast<size_t>(m_size))
+    if(size > available())
         return val;
     std::memcpy(&val, m_data + m_currentPos, size);
     m_currentPos += size;
@@ -44,6 +44,7 @@ public:
     Buffer &put(GUInt16 val);
     Buffer &put(GUIntBig val);
     Buffer &put(GIntBig val);
+    Buffer &put(const void *data, size_t size);
 
     GUInt32 getULong();
     float getFloat();
@@ -51,8 +52,16 @@ public:
     GUInt16 getUShort();
     GUIntBig getUBig();
     GIntBig getBig();
+    bool get(void *data, size_t size);
+    const GByte *view(size_t size);
+    size_t available() const {
+        return m_currentPos < static_cast<size_t>(m_size) ?
+                    static_cast<size_t>(m_size) - m_currentPos : 0;
+    }
 
     void seek(size_t position) { m_currentPos = position; }
+    size_t position() const { return m_currentPos; }
+    void reserve(size_t size);
 
 private:
     int m_size;
@@ -0,0 +1,147 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2020 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#include "download.h"
+
+// stl
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace ngs {
+
+namespace http {
+
+constexpr const char *HTTP_ERROR_PREFIX = "HTTP error code : ";
+
+static double steadyTime()
+{
+    return std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+// HostRateLimiter
+//------------------------------------------------------------------------------
+
+HostRateLimiter::HostRateLimiter(double requestsPerSecond) :
+    m_interval(requestsPerSecond > 0.0 ? 1.0 / requestsPerSecond : 0.0)
+{
+}
+
+void HostRateLimiter::wait(const std::string &url)
+{
+    if(m_interval <= 0.0) {
+        return;
+    }
+
+    double now = steadyTime();
+    double requestTime;
+    {
+        // Reserve the slot and sleep outside of lock, so other hosts are not
+        // blocked.
+        MutexHolder holder(m_mutex);
+        double &nextTime = m_nextRequestTime[urlHost(url)];
+        requestTime = std::max(now, nextTime);
+        nextTime = requestTime + m_interval;
+    }
+
+    if(requestTime > now) {
+        CPLSleep(requestTime - now);
+    }
+}
+
+//------------------------------------------------------------------------------
+// PersistentSessions
+//------------------------------------------------------------------------------
+
+PersistentSessions::PersistentSessions(const std::string &prefix) :
+    m_prefix(prefix)
+{
+}
+
+PersistentSessions::~PersistentSessions()
+{
+    close();
+}
+
+std::string PersistentSessions::current()
+{
+    std::string name = m_prefix + CPLSPrintf("_" CPL_FRMT_GIB,
+                                             static_cast<GIntBig>(CPLGetPID()));
+    MutexHolder holder(m_mutex);
+    m_names.insert(name);
+    return name;
+}
+
+void PersistentSessions::close()
+{
+    MutexHolder holder(m_mutex);
+    for(const std::string &name : m_names) {
+        char **options = CSLAddNameValue(nullptr, "CLOSE_PERSISTENT",
+                                         name.c_str());
+        CPLHTTPDestroyResult(CPLHTTPFetch("", options));
+        CSLDestroy(options);
+    }
+    m_names.clear();
+}
+
+//------------------------------------------------------------------------------
+//
+//------------------------------------------------------------------------------
+
+std::string urlHost(const std::string &url)
+{
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    std::string host = url.substr(start, end == std::string::npos ?
+                                      std::string::npos : end - start);
+    // Strip user info
+    size_t at = host.rfind('@');
+    if(at != std::string::npos) {
+        host = host.substr(at + 1);
+    }
+    return host;
+}
+
+int responseCode(const CPLHTTPResult *result)
+{
+    if(nullptr == result) {
+        return 0;
+    }
+    if(result->pszErrBuf != nullptr &&
+            STARTS_WITH(result->pszErrBuf, HTTP_ERROR_PREFIX)) {
+        return atoi(result->pszErrBuf + strlen(HTTP_ERROR_PREFIX));
+    }
+    if(result->nStatus != 0 || result->pszErrBuf != nullptr) {
+        return 0;
+    }
+    return 200;
+}
+
+bool isRetryable(int code)
+{
+    return code == 0 || code == 408 || code == 429 || code >= 500;
+}
+
+}
+
+}
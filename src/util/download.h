@@ -0,0 +1,96 @@
+/******************************************************************************
+ * Project: libngstore
+ * Purpose: NextGIS store and visualization support library
+ * Author:  Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2020 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSDOWNLOAD_H
+#define NGSDOWNLOAD_H
+
+// stl
+#include <map>
+#include <set>
+#include <string>
+
+// gdal
+#include "cpl_http.h"
+
+#include "mutex.h"
+
+namespace ngs {
+
+namespace http {
+
+/**
+ * @brief The HostRateLimiter class Spaces requests to the same host at least
+ * 1 / requestsPerSecond seconds apart. Zero rate disables the limit.
+ */
+class HostRateLimiter
+{
+public:
+    explicit HostRateLimiter(double requestsPerSecond = 0.0);
+    /**
+     * @brief wait Blocks calling thread until request to the url host is
+     * allowed.
+     * @param url Request url.
+     */
+    void wait(const std::string &url);
+
+private:
+    double m_interval;
+    std::map<std::string, double> m_nextRequestTime;
+    Mutex m_mutex;
+};
+
+/**
+ * @brief The PersistentSessions class Names of GDAL persistent HTTP sessions,
+ * one per calling thread. Requests of the thread reuse the same curl handle
+ * and so the keep-alive connection to the server. Sessions are closed on
+ * destruction.
+ */
+class PersistentSessions
+{
+public:
+    explicit PersistentSessions(const std::string &prefix);
+    ~PersistentSessions();
+    std::string current();
+    void close();
+
+private:
+    std::string m_prefix;
+    std::set<std::string> m_names;
+    Mutex m_mutex;
+};
+
+std::string urlHost(const std::string &url);
+/**
+ * @brief responseCode Returns HTTP response code of the request result.
+ * @param result Request result.
+ * @return Response code or 0 if the server was not reached.
+ */
+int responseCode(const CPLHTTPResult *result);
+/**
+ * @brief isRetryable Returns true if request failed with the code may
+ * succeed later: network errors, timeouts, throttling and server errors.
+ */
+bool isRetryable(int code);
+
+}
+
+}
+
+#endif // NGSDOWNLOAD_H
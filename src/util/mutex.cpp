@@ -53,4 +53,34 @@ MutexHolder::~MutexHolder()
     m_mutex.release();
 }
 
+Condition::Condition() : m_cond(CPLCreateCond())
+{
+}
+
+Condition::~Condition()
+{
+    CPLDestroyCond(m_cond);
+}
+
+void Condition::wait(Mutex &mutex)
+{
+    CPLCondWait(m_cond, mutex.m_mutex);
+}
+
+bool Condition::wait(Mutex &mutex, double timeout)
+{
+    return CPLCondTimedWait(m_cond, mutex.m_mutex, timeout) ==
+            COND_TIMED_WAIT_COND;
+}
+
+void Condition::signal()
+{
+    CPLCondSignal(m_cond);
+}
+
+void Condition::broadcast()
+{
+    CPLCondBroadcast(m_cond);
+}
+
 }
@@ -29,6 +29,7 @@ namespace ngs {
  * @brief The Mutex class
  */
 class Mutex {
+    friend class Condition;
 public:
     Mutex();
     ~Mutex();
@@ -51,6 +52,23 @@ protected:
     Mutex &m_mutex;
 };
 
+/**
+ * @brief The Condition class Condition variable. The mutex must be acquired
+ * once before wait.
+ */
+class Condition
+{
+public:
+    Condition();
+    ~Condition();
+    void wait(Mutex &mutex);
+    bool wait(Mutex &mutex, double timeout);
+    void signal();
+    void broadcast();
+private:
+    CPLCond *m_cond;
+};
+
 
 }
 
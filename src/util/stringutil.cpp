@@ -186,6 +186,90 @@ std::string md5(const std::string &val)
     return toHex(digest, MD5_DIGEST_LENGTH);
 }
 
+static inline GUInt64 rotl64(GUInt64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline GUInt64 fmix64(GUInt64 k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline GUInt64 getBlock64(const unsigned char *data)
+{
+    GUInt64 out = 0;
+    for(int i = 7; i >= 0; --i) {
+        out = (out << 8) | data[i];
+    }
+    return out;
+}
+
+/**
+ * @brief fastHash Non-cryptographic 128-bit hash (MurmurHash3 x64_128).
+ * @param val Any data including binary
+ * @return Hex string of the same length as md5 result
+ */
+std::string fastHash(const std::string &val)
+{
+    const GUInt64 c1 = 0x87c37b91114253d5ULL;
+    const GUInt64 c2 = 0x4cf5ad432745937fULL;
+    auto data = reinterpret_cast<const unsigned char*>(val.data());
+    size_t len = val.size();
+    size_t blockCount = len / 16;
+    GUInt64 h1 = 0;
+    GUInt64 h2 = 0;
+
+    for(size_t i = 0; i < blockCount; ++i) {
+        GUInt64 k1 = getBlock64(data + i * 16);
+        GUInt64 k2 = getBlock64(data + i * 16 + 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char *tail = data + blockCount * 16;
+    GUInt64 k1 = 0;
+    GUInt64 k2 = 0;
+    size_t tailLen = len & 15;
+    for(size_t i = tailLen; i > 8; --i) {
+        k2 ^= static_cast<GUInt64>(tail[i - 1]) << ((i - 9) * 8);
+    }
+    if(tailLen > 8) {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    for(size_t i = std::min(tailLen, size_t(8)); i > 0; --i) {
+        k1 ^= static_cast<GUInt64>(tail[i - 1]) << ((i - 1) * 8);
+    }
+    if(tailLen > 0) {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    unsigned char digest[16];
+    for(int i = 0; i < 8; ++i) {
+        digest[i] = static_cast<unsigned char>(h1 >> (i * 8));
+        digest[i + 8] = static_cast<unsigned char>(h2 >> (i * 8));
+    }
+    return toHex(digest, 16);
+}
+
 std::string crypt_salt()
 {
     return random(BLOCK_SIZE);
@@ -47,6 +47,7 @@ bool endsWith(const std::string &str, const std::string &part,
 std::string replace(const std::string &str, const std::string &from,
                     const std::string to);
 std::string md5(const std::string &val);
+std::string fastHash(const std::string &val);
 std::string fromCString(const char *str);
 std::string random(int size);
 std::string crypt_salt();
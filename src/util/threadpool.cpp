@@ -20,17 +20,30 @@
  ****************************************************************************/
 #include "threadpool.h"
 
+#include <algorithm>
+
 #include "cpl_conv.h"
 
+#include "api_priv.h"
+
 namespace ngs {
 
+constexpr double WAIT_PROGRESS_PERIOD = 0.25;
+constexpr double WAIT_RETRY_PERIOD = 0.1;
+
+// Worker of the pool executing current thread. Used to put new data to the
+// own worker queue.
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
 
 //------------------------------------------------------------------------------
 // ThreadData
 //------------------------------------------------------------------------------
 ThreadData::ThreadData(bool own) :
     m_own(own),
-    m_tries(0)
+    m_tries(0),
+    m_retryTime(std::chrono::steady_clock::now()),
+    m_priority(0)
 {
 
 }
@@ -50,150 +63,296 @@ unsigned char ThreadData::tries() const
     return m_tries;
 }
 
+/**
+ * @brief ThreadData::setRetryDelay Sets the time to wait before the next try
+ * of failed data. The data waits in queue and the worker processes other data.
+ * @param seconds Delay in seconds.
+ */
+void ThreadData::setRetryDelay(double seconds)
+{
+    m_retryTime = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(seconds));
+}
+
+double ThreadData::retryDelay() const
+{
+    return std::chrono::duration<double>(
+                m_retryTime - std::chrono::steady_clock::now()).count();
+}
+
+void ThreadData::onComplete(bool result)
+{
+    ngsUnused(result);
+}
+
 //------------------------------------------------------------------------------
 // ThreadPool
 //------------------------------------------------------------------------------
 ThreadPool::ThreadPool() :
+    m_queuedCount(0),
+    m_pendingCount(0),
+    m_nextWorker(0),
     m_function(nullptr),
     m_maxThreadCount(1),
-    m_threadCount(0),
+    m_runningCount(0),
     m_tries(3),
     m_stopOnFirstFail(false),
-    m_failed(false)
+    m_failed(false),
+    m_stop(false)
 {
 }
 
 ThreadPool::~ThreadPool()
 {
     clearThreadData();
+    stopWorkers();
 }
 
 void ThreadPool::init(unsigned char numThreads, poolThreadFunction function,
                       unsigned char tries, bool stopOnFirstFail)
 {
-    m_maxThreadCount = numThreads;
+    m_maxThreadCount = numThreads > 0 ? numThreads : 1;
     m_function = function;
     m_tries = tries;
     m_stopOnFirstFail = stopOnFirstFail;
 }
 
-void ThreadPool::addThreadData(ThreadData *data)
+void ThreadPool::addThreadData(ThreadData *data, Priority priority)
 {
-    m_dataMutex.acquire(15.5);
-    m_threadData.push_back(data);
-    m_dataMutex.release();
+    if(nullptr == data) {
+        return;
+    }
 
-    newWorker();
+    MutexHolder holder(m_stateMutex);
+    if(m_workers.empty()) {
+        startWorkers();
+    }
+
+    // Data added from worker goes to its own queue.
+    size_t index = currentPool == this ? currentWorker :
+                                         m_nextWorker++ % m_workers.size();
+    Worker *worker = m_workers[index].get();
+    data->m_priority = static_cast<size_t>(priority);
+    worker->mutex.acquire(15.5);
+    worker->queues[data->m_priority].push_back(data);
+    worker->mutex.release();
+
+    m_queuedCount++;
+    m_pendingCount++;
+    m_workCondition.signal();
 }
 
 void ThreadPool::clearThreadData()
 {
-    MutexHolder holder(m_dataMutex, 25.5);
-    if(m_threadData.empty()) {
+    std::vector<ThreadData*> removed;
+    for(const WorkerUPtr &worker : m_workers) {
+        MutexHolder holder(worker->mutex, 25.5);
+        for(auto &queue : worker->queues) {
+            removed.insert(removed.end(), queue.begin(), queue.end());
+            queue.clear();
+        }
+    }
+
+    if(removed.empty()) {
         return;
     }
 
-    for(ThreadData *data : m_threadData) {
+    for(ThreadData *data : removed) {
         if(data && data->isOwn()) {
             delete data;
         }
     }
-    m_threadData.clear();
+
+    MutexHolder holder(m_stateMutex);
+    m_queuedCount -= removed.size();
+    m_pendingCount -= removed.size();
+    if(m_pendingCount == 0) {
+        m_completeCondition.broadcast();
+    }
 }
 
 void ThreadPool::waitComplete(const Progress &progress)
 {
-    bool complete = false;
-    size_t currentDataCount = dataCount();
-    while(true) {
+    m_stateMutex.acquire();
+    size_t currentDataCount = m_pendingCount;
+    while(m_pendingCount > 0) {
+        // Wake up on complete or periodically to report progress.
+        m_completeCondition.wait(m_stateMutex, WAIT_PROGRESS_PERIOD);
+        size_t pendingCount = m_pendingCount;
+        if(pendingCount == 0) {
+            break;
+        }
+        m_stateMutex.release();
 
-        m_threadMutex.acquire(7.0);
-        complete = m_threadCount <= 0;
-        double completePercent = double(dataCount()) / currentDataCount;
+        double completePercent = currentDataCount > 0 ?
+                    double(pendingCount) / currentDataCount : 0.0;
         if(!progress.onProgress(COD_IN_PROCESS, 1.0 - completePercent,
                                 _("Working..."))) {
             clearThreadData();
         }
-        m_threadMutex.release();
+        m_stateMutex.acquire();
+    }
+    m_stateMutex.release();
+}
 
-        if(complete) {
-            return;
+ThreadData *ThreadPool::takeThreadData(size_t workerIndex, size_t &priority)
+{
+    size_t count = m_workers.size();
+    for(priority = 0; priority < PRIORITY_COUNT; ++priority) {
+        // Own queue first, than steal from the tail of other workers queues.
+        for(size_t i = 0; i < count; ++i) {
+            Worker *worker = m_workers[(workerIndex + i) % count].get();
+            MutexHolder holder(worker->mutex, 19.5);
+            auto &queue = worker->queues[priority];
+            if(queue.empty()) {
+                continue;
+            }
+            ThreadData *data;
+            if(i == 0) {
+                data = queue.front();
+                queue.pop_front();
+            }
+            else {
+                data = queue.back();
+                queue.pop_back();
+            }
+            return data;
         }
-
-        CPLSleep(0.55);
     }
+    return nullptr;
 }
 
-bool ThreadPool::process()
+bool ThreadPool::process(size_t workerIndex)
 {
-    m_dataMutex.acquire(19.5);
-    if(m_threadData.empty()) {
-        m_dataMutex.release();
-        return false;
-    }
-    ThreadData* data = m_threadData.front();
-    m_threadData.pop_front();
-    m_dataMutex.release();
+    size_t priority;
+    ThreadData *data = takeThreadData(workerIndex, priority);
     if(nullptr == data) {
-        return false; // Should never happened.
+        MutexHolder holder(m_stateMutex);
+        if(m_stop) {
+            return false;
+        }
+        if(m_queuedCount == 0) {
+            m_workCondition.wait(m_stateMutex);
+        }
+        return !m_stop;
     }
 
-    if(m_function(data)) {
-        if(data->isOwn()) {
-            delete data;
-        }
+    m_stateMutex.acquire();
+    m_queuedCount--;
+    m_runningCount++;
+    m_stateMutex.release();
+
+    if(data->isCanceled()) {
+        finished(data);
+        return true;
     }
-    else if(data->tries() > m_tries) {
-        if(data->isOwn()) {
-            delete data;
+
+    double delay = data->retryDelay();
+    if(delay > 0.0) {
+        // Delayed data waits in the low priority queue to not hold other data.
+        // Not notify, so workers don't pass delayed data to each other in
+        // loop. Wake up on new data or to check the delay again.
+        requeue(workerIndex, data, static_cast<size_t>(Priority::Low), false);
+        if(priority != static_cast<size_t>(Priority::Low)) {
+            return true; // Process other data first
         }
-        if(m_stopOnFirstFail) {
-            clearThreadData();
+        MutexHolder holder(m_stateMutex);
+        if(!m_stop) {
+            m_workCondition.wait(m_stateMutex,
+                                 std::min(delay, WAIT_RETRY_PERIOD));
+        }
+        return !m_stop;
+    }
+
+    bool result = m_function(data);
+    if(result || data->tries() > m_tries) {
+        data->onComplete(result);
+        if(!result && m_stopOnFirstFail) {
             m_failed = true;
-            return false;
+            clearThreadData();
         }
+        finished(data);
     }
     else {
+        // Retry after other data of the same priority.
         data->increaseTries();
-        MutexHolder holder(m_dataMutex, 19.5);
-        m_threadData.push_back(data);
+        requeue(workerIndex, data, data->m_priority, true);
     }
 
     return true;
 }
 
-void ThreadPool::finished()
+void ThreadPool::requeue(size_t workerIndex, ThreadData *data,
+                         size_t priority, bool notify)
 {
-    m_threadMutex.acquire(19.5);
-    m_threadCount--;
-    m_threadMutex.release();
+    MutexHolder holder(m_stateMutex);
+    Worker *worker = m_workers[workerIndex].get();
+    worker->mutex.acquire(19.5);
+    worker->queues[priority].push_back(data);
+    worker->mutex.release();
 
-    MutexHolder holder(m_dataMutex, 19.5);
-    if(m_threadData.empty()) {
-        return;
+    m_runningCount--;
+    m_queuedCount++;
+    if(notify) {
+        m_workCondition.signal();
     }
+}
 
-    newWorker();
+void ThreadPool::finished(ThreadData *data)
+{
+    if(data->isOwn()) {
+        delete data;
+    }
+
+    MutexHolder holder(m_stateMutex);
+    m_runningCount--;
+    m_pendingCount--;
+    if(m_pendingCount == 0) {
+        m_completeCondition.broadcast();
+    }
 }
 
-void ThreadPool::newWorker()
+void ThreadPool::startWorkers()
 {
-    MutexHolder holder(m_threadMutex, 19.5);
-    if(m_threadCount == m_maxThreadCount) {
-        return;
+    m_stop = false;
+    for(unsigned char i = 0; i < m_maxThreadCount; ++i) {
+        WorkerUPtr worker(new Worker);
+        worker->pool = this;
+        worker->index = i;
+        worker->thread = nullptr;
+        m_workers.emplace_back(std::move(worker));
+    }
+    // Start threads after all workers created as they steal from each other.
+    for(const WorkerUPtr &worker : m_workers) {
+        worker->thread = CPLCreateJoinableThread(threadFunction, worker.get());
+    }
+}
+
+void ThreadPool::stopWorkers()
+{
+    m_stateMutex.acquire();
+    m_stop = true;
+    m_workCondition.broadcast();
+    m_stateMutex.release();
+
+    for(const WorkerUPtr &worker : m_workers) {
+        if(nullptr != worker->thread) {
+            CPLJoinThread(worker->thread);
+        }
     }
-    CPLCreateThread(threadFunction, this);
-    m_threadCount++;
+    m_workers.clear();
 }
 
 void ThreadPool::threadFunction(void *threadData)
 {
-    ThreadPool *pool = static_cast<ThreadPool*>(threadData);
-    if(nullptr != pool) {
-        while(pool->process()) {
-            //CPLSleep(0.125);
+    Worker *worker = static_cast<Worker*>(threadData);
+    if(nullptr != worker) {
+        currentPool = worker->pool;
+        currentWorker = worker->index;
+        while(worker->pool->process(worker->index)) {
         }
-        pool->finished();
+        currentPool = nullptr;
     }
 }
 
@@ -21,7 +21,12 @@
 #ifndef NGSTHREADPOOL_H
 #define NGSTHREADPOOL_H
 
-#include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
 
 #include "cpl_multiproc.h"
 
@@ -30,60 +35,113 @@
 
 namespace ngs {
 
+/**
+ * @brief The CancelToken class Shared flag to cancel a group of thread data.
+ * Copies of token share the same flag.
+ */
+class CancelToken
+{
+public:
+    CancelToken() : m_canceled(new std::atomic_bool(false)) {}
+    void cancel() { *m_canceled = true; }
+    bool isCanceled() const { return *m_canceled; }
+
+private:
+    std::shared_ptr<std::atomic_bool> m_canceled;
+};
+
 /**
  * @brief The ThreadData class Data for thread
  */
 class ThreadData
 {
+    friend class ThreadPool;
 public:
     explicit ThreadData(bool own);
     virtual ~ThreadData() = default;
     bool isOwn() const;
     void increaseTries();
     unsigned char tries() const;
+    void setRetryDelay(double seconds);
+    double retryDelay() const;
+    void setCancelToken(const CancelToken &token) { m_cancelToken = token; }
+    bool isCanceled() const { return m_cancelToken.isCanceled(); }
+    /**
+     * @brief onComplete Executed in worker thread after the data processed
+     * successfully or all tries failed.
+     * @param result Thread function result.
+     */
+    virtual void onComplete(bool result);
 
 protected:
     bool m_own;
     unsigned char m_tries;
+    std::chrono::steady_clock::time_point m_retryTime;
+    CancelToken m_cancelToken;
+    size_t m_priority; // Queue index, set by ThreadPool
 };
 
-
-
 /**
- * @brief The ThreadPool class Pool of threads simultaniously executed
+ * @brief The ThreadPool class Pool of persistent worker threads. Each worker
+ * has own queues and steals data from other workers when own queues are
+ * empty.
  */
 class ThreadPool
 {
     typedef bool (*poolThreadFunction)(ThreadData*);
+public:
+    enum class Priority {
+        High = 0,
+        Normal,
+        Low
+    };
+
 public:
     ThreadPool();
     ~ThreadPool();
     void init(unsigned char numThreads, poolThreadFunction function,
               unsigned char tries = 3, bool stopOnFirstFail = false);
-    void addThreadData(ThreadData* data);
+    void addThreadData(ThreadData *data, Priority priority = Priority::Normal);
     void clearThreadData();
-    unsigned char currentWorkerCount() const { return m_threadCount; }
+    unsigned char currentWorkerCount() const { return m_runningCount; }
     unsigned char maxWorkerCount() const { return m_maxThreadCount; }
     void waitComplete(const Progress &progress);
-    size_t dataCount() const { return m_threadData.size(); }
+    size_t dataCount() const { return m_pendingCount; }
     bool isFailed() const { return m_failed; }
 
 protected:
-    bool process();
-    void finished();
-    void newWorker();
+    bool process(size_t workerIndex);
+    ThreadData *takeThreadData(size_t workerIndex, size_t &priority);
+    void finished(ThreadData *data);
+    void requeue(size_t workerIndex, ThreadData *data, size_t priority,
+                 bool notify);
+    void startWorkers();
+    void stopWorkers();
 
     // static
     static void threadFunction(void *threadData);
 
 protected:
-    std::list<ThreadData*> m_threadData;
-    Mutex m_dataMutex, m_threadMutex;
+    constexpr static size_t PRIORITY_COUNT = 3;
+    typedef struct _worker {
+        ThreadPool *pool;
+        size_t index;
+        CPLJoinableThread *thread;
+        Mutex mutex;
+        std::array<std::deque<ThreadData*>, PRIORITY_COUNT> queues;
+    } Worker;
+    using WorkerUPtr = std::unique_ptr<Worker>;
+
+    std::vector<WorkerUPtr> m_workers;
+    Mutex m_stateMutex;
+    Condition m_workCondition, m_completeCondition;
+    size_t m_queuedCount, m_pendingCount, m_nextWorker;
     poolThreadFunction m_function;
-    unsigned char m_maxThreadCount, m_threadCount;
+    unsigned char m_maxThreadCount, m_runningCount;
     unsigned char m_tries;
     bool m_stopOnFirstFail;
     bool m_failed;
+    bool m_stop;
 };
 
 }
@@ -21,9 +21,21 @@
 
 #include "test.h"
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
 #include "cpl_conv.h"
+#include "geos_c.h"
 
+#include "catalog/catalog.h"
+#include "catalog/folder.h"
 #include "ds/featureclass.h"
+#include "map/gl/layer.h"
+#include "map/gl/tile.h"
+#include "map/gl/view.h"
+#include "map/maptransform.h"
 #include "util/buffer.h"
 
 TEST(GlTests, TestTileBuffer) {
@@ -57,6 +69,28 @@ TEST(GlTests, TestTileBuffer) {
     EXPECT_FLOAT_EQ(4.0, fval);
 }
 
+TEST(GlTests, TestTileBufferView) {
+    ngs::Buffer buffer;
+    for(GUInt32 i = 0; i < 4; ++i)
+        buffer.put(i);
+
+    buffer.seek(0);
+    EXPECT_EQ(buffer.available(), 4 * sizeof(GUInt32));
+    const GByte *view = buffer.view(2 * sizeof(GUInt32));
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view, buffer.data());
+    EXPECT_EQ(buffer.available(), 2 * sizeof(GUInt32));
+    EXPECT_EQ(buffer.view(3 * sizeof(GUInt32)), nullptr);
+    EXPECT_EQ(buffer.getULong(), 2u);
+
+    // Position past the end must not wrap available size.
+    buffer.seek(100);
+    EXPECT_EQ(buffer.available(), 0u);
+    EXPECT_EQ(buffer.view(1), nullptr);
+    GByte byte = 0;
+    EXPECT_FALSE(buffer.get(&byte, 1));
+}
+
 TEST(GlTests, TestTileBufferSaveLoad) {
     ngs::VectorTile vtile0;
 
@@ -112,6 +146,870 @@ TEST(GlTests, TestTileBufferSaveLoad) {
     EXPECT_EQ(vitem4.isIdsPresent(idset2), true);
 }
 
+TEST(GlTests, TestTileBufferLoadVersion1) {
+    // Tile blob stored by previous versions without header.
+    ngs::Buffer buffer;
+    buffer.put(static_cast<GUInt32>(1)); // Items count
+    buffer.put(static_cast<GByte>(1)); // 2d
+    buffer.put(static_cast<GUInt32>(2)); // Points
+    buffer.put(1.5f);
+    buffer.put(2.5f);
+    buffer.put(3.5f);
+    buffer.put(4.5f);
+    buffer.put(static_cast<GUInt32>(2)); // Indices
+    buffer.put(static_cast<GUInt16>(0));
+    buffer.put(static_cast<GUInt16>(1));
+    buffer.put(static_cast<GUInt32>(1)); // Border indices
+    buffer.put(static_cast<GUInt32>(1));
+    buffer.put(static_cast<GUInt16>(1));
+    buffer.put(static_cast<GUInt32>(0)); // Centroids
+    buffer.put(static_cast<GUInt32>(2)); // Ids
+    buffer.put(static_cast<GIntBig>(3));
+    buffer.put(static_cast<GIntBig>(5));
+
+    ngs::VectorTile vtile;
+    buffer.seek(0);
+    EXPECT_EQ(vtile.load(buffer), true);
+    ASSERT_EQ(vtile.items().size(), 1);
+
+    ngs::VectorTileItem vitem = vtile.items()[0];
+    EXPECT_EQ(vitem.pointCount(), 2);
+    EXPECT_FLOAT_EQ(vitem.point(1).y, 4.5f);
+    EXPECT_EQ(vitem.indices().size(), 2);
+    ASSERT_EQ(vitem.borderCount(), 1);
+    EXPECT_EQ(vitem.borderIndices(0)[0], 1);
+    EXPECT_EQ(vitem.isIdsPresent({3, 5}), true);
+
+    // Saved in current format and loaded back.
+    ngs::BufferPtr saved = vtile.save();
+    ngs::VectorTile vtile1;
+    saved->seek(0);
+    EXPECT_EQ(vtile1.load(*saved.get()), true);
+    ASSERT_EQ(vtile1.items().size(), 1);
+    ngs::VectorTileItem vitem1 = vtile1.items()[0];
+    EXPECT_EQ(vitem1 == vitem, true);
+    EXPECT_EQ(vitem1.indices(), vitem.indices());
+    ASSERT_EQ(vitem1.borderCount(), vitem.borderCount());
+    EXPECT_EQ(vitem1.borderIndices(0), vitem.borderIndices(0));
+    EXPECT_EQ(vitem1.isIdsPresent({3, 5}), true);
+
+    // Truncated blob must fail.
+    ngs::Buffer truncated(saved->data(), saved->size() - 4, false);
+    ngs::VectorTile vtile2;
+    EXPECT_EQ(vtile2.load(truncated), false);
+}
+
+TEST(GlTests, TestTileItemView) {
+    ngs::VectorTile vtile;
+    for(int i = 0; i < 10; ++i) {
+        ngs::VectorTileItem vitem;
+        float shift = static_cast<float>(i);
+        vitem.addPoint({shift, 0.0f});
+        vitem.addPoint({shift + 1.0f, 0.0f});
+        vitem.addPoint({shift + 1.0f, 1.0f});
+        vitem.addPoint({shift, 0.0f});
+        vitem.addIndex(0);
+        vitem.addIndex(1);
+        vitem.addIndex(2);
+        vitem.addBorderIndex(0, 0);
+        vitem.addBorderIndex(0, 1);
+        vitem.addBorderIndex(0, 2);
+        vitem.addBorderIndex(2, 3); // Empty ring 1 is skipped
+        vitem.addCentroid({shift + 0.5f, 0.5f});
+        vitem.addId(i * 2);
+        vitem.addId(i * 2 + 1);
+        vitem.setValid(true);
+        vtile.add(vitem);
+    }
+
+    ngs::BufferPtr buffer = vtile.save();
+    buffer->seek(0);
+    ngs::VectorTile view;
+    ASSERT_EQ(view.load(*buffer.get(), buffer), true);
+    ASSERT_EQ(view.items().size(), vtile.items().size());
+
+    // Items use blob data in place.
+    const GByte *begin = buffer->data();
+    const GByte *end = begin + buffer->size();
+    for(size_t i = 0; i < vtile.items().size(); ++i) {
+        const ngs::VectorTileItem &item = view.items()[i];
+        const ngs::VectorTileItem &source = vtile.items()[i];
+        EXPECT_EQ(item.isView(), true);
+        const GByte *points = reinterpret_cast<const GByte*>(item.points().data());
+        EXPECT_GE(points, begin);
+        EXPECT_LT(points, end);
+        EXPECT_EQ(item == source, true);
+        EXPECT_EQ(item.indices(), source.indices());
+        EXPECT_EQ(item.centroids(), source.centroids());
+        ASSERT_EQ(item.borderCount(), 2);
+        EXPECT_EQ(item.borderIndices(0), source.borderIndices(0));
+        EXPECT_EQ(item.borderIndices(1), source.borderIndices(2));
+        EXPECT_EQ(item.isClosed(), true);
+        GIntBig id = static_cast<GIntBig>(i) * 2;
+        EXPECT_EQ(item.isIdsPresent({id, id + 1}), true);
+        EXPECT_EQ(item.isIdsPresent({id + 1}, false), true);
+        EXPECT_EQ(item.idsIntesect({id + 1, 100}).size(), 1);
+        EXPECT_EQ(item.hash(), source.hash());
+    }
+
+    // Views keep the blob alive.
+    ngs::VectorTileItem item = view.items()[3];
+    buffer.reset();
+    view = ngs::VectorTile();
+    EXPECT_FLOAT_EQ(item.point(1).x, 4.0f);
+
+    // Change copies data from the blob.
+    item.removeId(100);
+    EXPECT_EQ(item.isView(), true);
+    item.removeId(6);
+    EXPECT_EQ(item.isView(), false);
+    EXPECT_EQ(item.isIdsPresent({7}), true);
+    EXPECT_EQ(item.pointCount(), 4);
+    ASSERT_EQ(item.borderCount(), 2);
+    EXPECT_EQ(item.borderIndices(1)[0], 3);
+
+    // Not aligned blob is copied.
+    ngs::BufferPtr saved = vtile.save();
+    std::vector<GByte> shifted(static_cast<size_t>(saved->size()) + 1);
+    std::memcpy(shifted.data() + 1, saved->data(), saved->size());
+    ngs::Buffer unaligned(shifted.data() + 1, saved->size(), false);
+    ngs::VectorTile copy;
+    ASSERT_EQ(copy.load(unaligned, saved), true);
+    ASSERT_EQ(copy.items().size(), vtile.items().size());
+    EXPECT_EQ(copy.items()[0].isView(), false);
+    EXPECT_EQ(copy.items()[0] == vtile.items()[0], true);
+
+    // Broken ring offsets must fail.
+    ngs::VectorTileItem broken;
+    broken.addPoint({0.0f, 0.0f});
+    broken.addBorderIndex(0, 0);
+    broken.addId(1);
+    broken.setValid(true);
+    ngs::VectorTile brokenTile;
+    brokenTile.add(broken);
+    ngs::BufferPtr brokenBuffer = brokenTile.save();
+    // Header (9 bytes), 2d flag, points (count, padding, 8 bytes from 16),
+    // indices (count, padding), ring offsets count and {0, 1} from 40.
+    const size_t ringEndPos = 44;
+    GUInt32 badOffset = 5;
+    std::memcpy(brokenBuffer->data() + ringEndPos, &badOffset,
+                sizeof(badOffset));
+    brokenBuffer->seek(0);
+    ngs::VectorTile brokenLoad;
+    EXPECT_EQ(brokenLoad.load(*brokenBuffer.get(), brokenBuffer), false);
+}
+
+TEST(GlTests, TestTileBufferCodecs) {
+    ngs::VectorTile vtile;
+    for(int i = 0; i < 100; ++i) {
+        ngs::VectorTileItem vitem;
+        vitem.addPoint({1000.0f + i * 2.5f, -2000.0f - i * 0.5f});
+        vitem.addPoint({1000.0f + i * 3.0f, -2000.0f + i});
+        vitem.addIndex(0);
+        vitem.addIndex(1);
+        vitem.addBorderIndex(0, 1);
+        vitem.addCentroid({1001.5f, -1999.0f});
+        vitem.addId(1000000 + i * 7);
+        vitem.addId(5);
+        vitem.setValid(true);
+        vtile.add(vitem);
+    }
+
+    ngs::BufferPtr raw = vtile.save();
+    for(auto codec : {ngs::TileCodec::DELTA, ngs::TileCodec::DEFLATE}) {
+        ngs::BufferPtr encoded = vtile.save(codec, 0.125);
+        EXPECT_LT(encoded->size(), raw->size());
+
+        ngs::VectorTile vtile1;
+        encoded->seek(0);
+        EXPECT_EQ(vtile1.load(*encoded.get()), true);
+        ASSERT_EQ(vtile1.items().size(), vtile.items().size());
+        for(size_t i = 0; i < vtile.items().size(); ++i) {
+            ngs::VectorTileItem item0 = vtile.items()[i];
+            ngs::VectorTileItem item1 = vtile1.items()[i];
+            ASSERT_EQ(item1.pointCount(), item0.pointCount());
+            for(size_t j = 0; j < item0.pointCount(); ++j) {
+                EXPECT_NEAR(item1.point(j).x, item0.point(j).x, 0.0625);
+                EXPECT_NEAR(item1.point(j).y, item0.point(j).y, 0.0625);
+            }
+            EXPECT_EQ(item1.indices(), item0.indices());
+            ASSERT_EQ(item1.borderCount(), item0.borderCount());
+            for(size_t ring = 0; ring < item0.borderCount(); ++ring) {
+                EXPECT_EQ(item1.borderIndices(ring), item0.borderIndices(ring));
+            }
+            EXPECT_EQ(item1.isIdsPresent({5, 1000000 + static_cast<GIntBig>(i) * 7}),
+                      true);
+        }
+    }
+}
+
+TEST(GlTests, TestTileBufferCodecsDecodeSpeed) {
+    // Lines of 64 points in 1/8 grid like overview tiles of a dense layer
+    ngs::VectorTile vtile;
+    for(int i = 0; i < 2000; ++i) {
+        ngs::VectorTileItem vitem;
+        for(int j = 0; j < 64; ++j) {
+            vitem.addPoint({(i % 50) * 80.0f + j * 1.125f,
+                            (i / 50) * 80.0f + (j % 8) * 0.5f});
+            if(j > 0) {
+                vitem.addIndex(static_cast<unsigned short>(j - 1));
+                vitem.addIndex(static_cast<unsigned short>(j));
+            }
+        }
+        vitem.addId(i);
+        vitem.setValid(true);
+        vtile.add(vitem);
+    }
+
+    const int repeatCount = 20;
+    const char *names[] = {"RAW", "DELTA", "DEFLATE"};
+    size_t rawSize = 0;
+    for(auto codec : {ngs::TileCodec::RAW, ngs::TileCodec::DELTA,
+                      ngs::TileCodec::DEFLATE}) {
+        ngs::BufferPtr encoded = vtile.save(codec, 0.125);
+        if(codec == ngs::TileCodec::RAW) {
+            rawSize = encoded->size();
+        }
+        size_t pointCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < repeatCount; ++i) {
+            ngs::VectorTile vtile1;
+            encoded->seek(0);
+            ASSERT_EQ(vtile1.load(*encoded.get()), true);
+            ASSERT_EQ(vtile1.items().size(), vtile.items().size());
+            pointCount += vtile1.items().back().pointCount();
+        }
+        double seconds = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+        EXPECT_EQ(pointCount, 64 * repeatCount);
+        std::cout << names[static_cast<int>(codec)] << ": "
+                  << encoded->size() << " bytes, "
+                  << seconds * 1000.0 / repeatCount << " ms per tile, "
+                  << rawSize * repeatCount / seconds / (1024 * 1024)
+                  << " Mb/s of decoded data\n";
+        // Generous bound: about 1.5 Mb of decoded data per tile.
+        EXPECT_LT(seconds / repeatCount, 0.5);
+    }
+}
+
+TEST(GlTests, TestGeneralizeLongLine) {
+    OGRLineString line;
+    for(int i = 0; i < 100000; ++i) {
+        double x = i * 0.05;
+        line.addPoint(x, std::sin(x * 0.01) * 100.0);
+    }
+
+    ngs::GEOSGeometryWrap geom(&line);
+    geom.simplify(1.0);
+    ngs::VectorTileItemArray items;
+    geom.fillTile(1, items);
+    ASSERT_EQ(items.size(), 1);
+
+    const auto &points = items[0].points();
+    EXPECT_GT(points.size(), 2);
+    EXPECT_LT(points.size(), 100000);
+    for(size_t i = 0; i < points.size(); ++i) {
+        EXPECT_FLOAT_EQ(points[i].x, std::round(points[i].x));
+        EXPECT_FLOAT_EQ(points[i].y, std::round(points[i].y));
+        if(i > 0) {
+            EXPECT_FALSE(points[i] == points[i - 1]);
+        }
+    }
+}
+
+// Line generalization before contiguous arrays: GEOS accessors per vertex.
+static GEOSGeom legacyGeneralizeLine(GEOSContextHandle_t handle,
+                                     const GEOSGeom_t *geom, double step)
+{
+    const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq_r(handle, geom);
+    unsigned int count = 0;
+    GEOSCoordSeq_getSize_r(handle, cs, &count);
+
+    OGRRawPoint prevPoint(1e20, 1e20);
+    std::vector<OGRRawPoint> parts;
+    double x, y;
+    for(unsigned int i = 0; i < count; ++i) {
+        GEOSCoordSeq_getX_r(handle, cs, i, &x);
+        GEOSCoordSeq_getY_r(handle, cs, i, &y);
+        OGRRawPoint point(static_cast<long>(x / step) * step,
+                          static_cast<long>(y / step) * step);
+        if(isEqual(prevPoint.x, point.x) && isEqual(prevPoint.y, point.y)) {
+            continue;
+        }
+        parts.push_back(point);
+        prevPoint = point;
+    }
+
+    GEOSCoordSequence *ncs = GEOSCoordSeq_create_r(
+                handle, static_cast<unsigned int>(parts.size()), 2);
+    unsigned int counter = 0;
+    for(const OGRRawPoint &point : parts) {
+        GEOSCoordSeq_setX_r(handle, ncs, counter, point.x);
+        GEOSCoordSeq_setY_r(handle, ncs, counter, point.y);
+        counter++;
+    }
+    return GEOSGeom_createLineString_r(handle, ncs);
+}
+
+static unsigned int lineVertexCount(GEOSContextHandle_t handle,
+                                    const GEOSGeom_t *geom)
+{
+    unsigned int count = 0;
+    GEOSCoordSeq_getSize_r(handle, GEOSGeom_getCoordSeq_r(handle, geom), &count);
+    return count;
+}
+
+TEST(GlTests, TestGeneralizeLongLineSpeed) {
+    // Closed coastline of an island about 600 km long with 1 m step
+    OGRLineString line;
+    const int vertexCount = 600000;
+    for(int i = 0; i < vertexCount; ++i) {
+        double angle = 2.0 * M_PI * i / vertexCount;
+        double radius = 100000.0 + 500.0 * std::sin(angle * 400.0);
+        line.addPoint(radius * std::cos(angle), radius * std::sin(angle));
+    }
+    line.addPoint(line.getX(0), line.getY(0));
+
+    GEOSContextHandle_t handle = OGRGeometry::createGEOSContext();
+    const int repeatCount = 5;
+    double step = 10.0;
+    double seconds[2] = {0.0, 0.0};
+    unsigned int counts[2] = {0, 0};
+    for(int i = 0; i < repeatCount; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        GEOSGeom geom = line.exportToGEOS(handle);
+        GEOSGeom legacy = legacyGeneralizeLine(handle, geom, step);
+        seconds[0] += std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+        counts[0] = lineVertexCount(handle, legacy);
+        GEOSGeom_destroy_r(handle, legacy);
+        GEOSGeom_destroy_r(handle, geom);
+
+        start = std::chrono::high_resolution_clock::now();
+        ngs::GEOSGeometryWrap wrap(&line);
+        wrap.simplify(step);
+        seconds[1] += std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+        counts[1] = lineVertexCount(handle, wrap.geom());
+    }
+    OGRGeometry::freeGEOSContext(handle);
+
+    std::cout << "Generalize line of " << vertexCount << " vertices to "
+              << counts[1] << ": per vertex "
+              << seconds[0] * 1000.0 / repeatCount << " ms, arrays "
+              << seconds[1] * 1000.0 / repeatCount << " ms, speedup "
+              << seconds[0] / seconds[1] << "\n";
+    EXPECT_GT(counts[1], 1000);
+    EXPECT_EQ(counts[1], counts[0]);
+    EXPECT_LT(seconds[1], seconds[0]);
+}
+
+TEST(GlTests, TestGeneralizeMultiPoint) {
+    OGRMultiPoint multiPoint;
+    for(int i = 0; i < 10000; ++i) {
+        OGRPoint point(i * 0.25, 10.5);
+        multiPoint.addGeometry(&point);
+    }
+
+    ngs::GEOSGeometryWrap geom(&multiPoint);
+    geom.simplify(1.0);
+    ngs::VectorTileItemArray items;
+    geom.fillTile(1, items);
+    ASSERT_EQ(items.size(), 1);
+
+    // Each four points in a row share one cell
+    const auto &points = items[0].points();
+    EXPECT_EQ(points.size(), 2500);
+    for(size_t i = 0; i < points.size(); ++i) {
+        EXPECT_FLOAT_EQ(points[i].x, std::round(points[i].x));
+        EXPECT_FLOAT_EQ(points[i].y, std::round(points[i].y));
+        if(i > 0) {
+            EXPECT_FALSE(points[i] == points[i - 1]);
+        }
+    }
+}
+
+TEST(GlTests, TestGeneralizePolygon) {
+    OGRPolygon polygon;
+    OGRLinearRing ring;
+    for(int i = 0; i < 1000; ++i) {
+        double angle = 2.0 * static_cast<double>(M_PI_F) * i / 1000;
+        ring.addPoint(100.0 * std::cos(angle), 100.0 * std::sin(angle));
+    }
+    ring.closeRings();
+    polygon.addRing(&ring);
+
+    ngs::GEOSGeometryWrap geom(&polygon);
+    geom.simplify(1.0);
+    ngs::VectorTileItemArray items;
+    geom.fillTile(1, items);
+    ASSERT_EQ(items.size(), 1);
+    EXPECT_GT(items[0].points().size(), 3);
+    EXPECT_LT(items[0].points().size(), 1000);
+
+    // Polygon smaller than step is replaced by its envelope
+    OGRPolygon small;
+    OGRLinearRing smallRing;
+    smallRing.addPoint(0.0, 0.0);
+    smallRing.addPoint(0.0, 0.5);
+    smallRing.addPoint(0.5, 0.5);
+    smallRing.addPoint(0.0, 0.0);
+    small.addRing(&smallRing);
+    ngs::GEOSGeometryWrap smallGeom(&small);
+    smallGeom.simplify(1.0);
+    items.clear();
+    smallGeom.fillTile(2, items);
+    ASSERT_EQ(items.size(), 1);
+    for(const auto &point : items[0].points()) {
+        EXPECT_TRUE(isEqual(point.x, 0.0f) || isEqual(point.x, 0.5f));
+        EXPECT_TRUE(isEqual(point.y, 0.0f) || isEqual(point.y, 0.5f));
+    }
+}
+
+TEST(GlTests, TestEnvelopeIndex) {
+    std::vector<ngs::EnvelopeIndex::Item> items;
+    for(int i = 0; i < 5000; ++i) {
+        double x = (i % 100) * 10.0;
+        double y = (i / 100) * 10.0;
+        items.push_back({i, ngs::Envelope(x, y, x + 5.0, y + 5.0)});
+    }
+    auto bruteForce = [&items](const ngs::Envelope &env) {
+        std::vector<GIntBig> out;
+        for(const auto &item : items) {
+            if(env.intersects(item.env)) {
+                out.push_back(item.id);
+            }
+        }
+        return out;
+    };
+    auto search = [](const ngs::EnvelopeIndex &index,
+                     const ngs::Envelope &env) {
+        std::vector<GIntBig> out = index.search(env);
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+
+    ngs::EnvelopeIndex index;
+    EXPECT_FALSE(index.isBuilt());
+    index.build(std::vector<ngs::EnvelopeIndex::Item>(items));
+    EXPECT_TRUE(index.isBuilt());
+
+    ngs::Envelope env(102.0, 33.0, 251.0, 77.0);
+    EXPECT_EQ(search(index, env), bruteForce(env));
+    EXPECT_TRUE(search(index, ngs::Envelope(-20.0, -20.0, -10.0, -10.0)).empty());
+
+    // Move feature 0 into the search extent and delete feature 1.
+    index.remove(0);
+    index.insert(0, ngs::Envelope(150.0, 50.0, 151.0, 51.0));
+    index.remove(1);
+    items[0].env = ngs::Envelope(150.0, 50.0, 151.0, 51.0);
+    items.erase(items.begin() + 1);
+    EXPECT_EQ(search(index, env), bruteForce(env));
+    ngs::Envelope first(0.0, 0.0, 20.0, 5.0);
+    EXPECT_EQ(search(index, first), bruteForce(first));
+
+    // Many changes pack the tree again.
+    for(int i = 5000; i < 7000; ++i) {
+        double x = (i % 100) * 10.0;
+        items.push_back({i, ngs::Envelope(x, 500.0, x + 5.0, 505.0)});
+        index.insert(i, items.back().env);
+    }
+    ngs::Envelope all(-1.0, -1.0, 2000.0, 2000.0);
+    EXPECT_EQ(search(index, all).size(), items.size());
+    EXPECT_EQ(search(index, env), bruteForce(env));
+}
+
+TEST(GlTests, TestTileDuplicates) {
+    ngs::VectorTile vtile;
+
+    // 100 distinct lines, each added by 5 features.
+    for(int i = 0; i < 500; ++i) {
+        ngs::VectorTileItem vitem;
+        float shift = static_cast<float>(i % 100);
+        vitem.addPoint({shift, 0.0f});
+        vitem.addPoint({shift, 10.0f});
+        vitem.addId(i);
+        vitem.setValid(true);
+        vtile.add(vitem, true);
+    }
+
+    EXPECT_EQ(vtile.items().size(), 100);
+    std::set<GIntBig> ids = {3, 103, 203, 303, 403};
+    EXPECT_EQ(vtile.items()[3].isIdsPresent(ids), true);
+
+    // After remove index must be rebuilt for new items positions.
+    for(GIntBig id = 0; id < 500; id += 100) {
+        vtile.remove(id);
+    }
+    EXPECT_EQ(vtile.items().size(), 99);
+
+    ngs::VectorTileItem vitem;
+    vitem.addPoint({99.0f, 0.0f});
+    vitem.addPoint({99.0f, 10.0f});
+    vitem.addId(1000);
+    vitem.setValid(true);
+    vtile.add(vitem, true);
+    EXPECT_EQ(vtile.items().size(), 99);
+    std::set<GIntBig> ids99 = {99, 1000};
+    EXPECT_EQ(vtile.items()[98].isIdsPresent(ids99, false), true);
+}
+
+TEST(GlTests, TestTileCache) {
+    ngs::GlTileCache cache(0);
+    unsigned int layerId = cache.nextLayerId();
+    ngs::Tile tile1 = {1, 1, 2, 0};
+    ngs::Tile tile2 = {2, 1, 2, 0};
+
+    ngs::GlTileCache::Entry entry;
+    entry.extent = ngs::Envelope(0.0, 0.0, 10.0, 10.0);
+    entry.epoch = cache.epoch();
+    entry.version = 1;
+    entry.z = 0.0f;
+    cache.put(layerId, tile1, std::move(entry));
+    EXPECT_EQ(cache.size(), 0); // Cache disabled
+
+    cache.setMaxSize(1024 * 1024);
+    for(const ngs::Tile &tile : {tile1, tile2}) {
+        ngs::GlTileCache::Entry newEntry;
+        newEntry.extent = ngs::Envelope(tile.x * 10.0, 0.0, tile.x * 10.0 + 9.0,
+                                        10.0);
+        newEntry.epoch = cache.epoch();
+        newEntry.version = 1;
+        newEntry.z = 0.0f;
+        cache.put(layerId, tile, std::move(newEntry));
+    }
+    EXPECT_GT(cache.size(), 0);
+
+    // Entry is moved out of cache on take
+    ngs::GlTileCache::Entry outEntry;
+    EXPECT_EQ(cache.take(layerId, tile1, outEntry), true);
+    EXPECT_EQ(outEntry.version, 1);
+    EXPECT_EQ(cache.take(layerId, tile1, outEntry), false);
+    EXPECT_EQ(cache.take(cache.nextLayerId(), tile2, outEntry), false);
+
+    // Invalidated entries are removed and stale ones are not accepted
+    cache.remove(ngs::Envelope(20.0, 0.0, 21.0, 1.0));
+    EXPECT_EQ(cache.take(layerId, tile2, outEntry), false);
+    cache.put(layerId, tile1, std::move(outEntry));
+    EXPECT_EQ(cache.size(), 0);
+
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(cache.misses(), 3);
+    cache.resetStatistics();
+    EXPECT_EQ(cache.hits(), 0);
+}
+
+TEST(GlTests, TestRasterTileCache) {
+    const int size = 4 * 4 * 4;
+    ngs::GlRasterTileCache cache(1024 * 1024, 1024 * 1024);
+    ngs::GlRasterTileCache::Key key = {"raster|0", 0x00030201, 0,
+                                       {1, 1, 2, 0}};
+    ngs::GlRasterTileCache::Entry entry;
+    entry.data = cache.createBuffer(size);
+    ASSERT_NE(entry.data.get(), nullptr);
+    for(int i = 0; i < size; ++i) {
+        entry.data.get()[i] = static_cast<GLubyte>(i);
+    }
+    entry.width = 4;
+    entry.height = 4;
+    entry.extent = ngs::Envelope(0.0, 0.0, 10.0, 10.0);
+    entry.smooth = true;
+    cache.put(key, entry);
+    EXPECT_GT(cache.size(), 0);
+
+    ngs::GlRasterTileCache::Entry outEntry;
+    EXPECT_EQ(cache.get(key, outEntry), true);
+    EXPECT_EQ(outEntry.data.get(), entry.data.get()); // Shared, not copied
+    key.transparency = 128;
+    EXPECT_EQ(cache.get(key, outEntry), false);
+    key.transparency = 0;
+
+    // Only tiles of changed raster are removed
+    ngs::GlRasterTileCache::Key otherKey = key;
+    otherKey.raster = "other|0";
+    cache.put(otherKey, entry);
+    cache.remove(key.raster);
+    EXPECT_EQ(cache.get(key, outEntry), false);
+    EXPECT_EQ(cache.get(otherKey, outEntry), true);
+
+    // Disk tier returns evicted tile
+    std::string path = ngsFormFileName(ngsGetCurrentDirectory(), "tmp",
+                                       nullptr, 0);
+    path = ngsFormFileName(path.c_str(), "raster_tiles", nullptr, 0);
+    if(ngs::Folder::isExists(path)) {
+        ngs::Folder::rmDir(path);
+    }
+    cache.setDiskPath(path);
+    cache.put(key, entry);
+    size_t fileSize = cache.diskSize();
+    EXPECT_GT(fileSize, 0u);
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+    ngs::GlRasterTileCache::Entry diskEntry;
+    EXPECT_EQ(cache.get(key, diskEntry), true);
+    EXPECT_EQ(diskEntry.width, 4);
+    EXPECT_EQ(diskEntry.smooth, true);
+    EXPECT_DOUBLE_EQ(diskEntry.extent.maxX(), 10.0);
+    EXPECT_EQ(std::memcmp(diskEntry.data.get(), entry.data.get(), size), 0);
+
+    EXPECT_EQ(cache.hits(), 3);
+    EXPECT_EQ(cache.misses(), 2);
+
+    // Least recently used tile is deleted above disk budget
+    cache.setMaxDiskSize(fileSize);
+    ngs::GlRasterTileCache::Key nextKey = key;
+    nextKey.tile.x = 2;
+    cache.put(nextKey, entry);
+    EXPECT_LE(cache.diskSize(), fileSize);
+    cache.clear();
+    EXPECT_EQ(cache.get(key, diskEntry), false);
+    EXPECT_EQ(cache.get(nextKey, diskEntry), true);
+
+    cache.setDiskPath("");
+    EXPECT_EQ(ngs::Folder::rmDir(path), true);
+    EXPECT_EQ(ngs::Folder::isExists(path), false);
+}
+
+/**
+ * @brief The FillTestLayer class Feature layer with fill methods available to
+ * tests.
+ */
+class FillTestLayer : public ngs::GlFeatureLayer
+{
+public:
+    explicit FillTestLayer(ngs::GlView *view, const std::string &styleName) :
+        GlFeatureLayer(view, "fill_test") {
+        m_style = ngs::StylePtr(ngs::Style::createStyle(styleName,
+                                                        view->textureAtlas()));
+    }
+    using GlFeatureLayer::tessellate;
+    using GlFeatureLayer::fillPolygons;
+    using GlFeatureLayer::polygonsEstimate;
+};
+
+// Tile with count polygons of vertexCount vertices each, triangulated as fan.
+static ngs::VectorTile denseTile(int count, int vertexCount)
+{
+    ngs::VectorTile vtile;
+    for(int i = 0; i < count; ++i) {
+        ngs::VectorTileItem vitem;
+        float centerX = static_cast<float>(i % 100) * 10.0f;
+        float centerY = static_cast<float>(i / 100) * 10.0f;
+        for(int j = 0; j <= vertexCount; ++j) {
+            double angle = 2.0 * M_PI * (j % vertexCount) / vertexCount;
+            vitem.addPoint({centerX + 4.0f * static_cast<float>(std::cos(angle)),
+                            centerY + 4.0f * static_cast<float>(std::sin(angle))});
+            vitem.addBorderIndex(0, static_cast<unsigned short>(j));
+        }
+        for(int j = 1; j < vertexCount - 1; ++j) {
+            vitem.addIndex(0);
+            vitem.addIndex(static_cast<unsigned short>(j));
+            vitem.addIndex(static_cast<unsigned short>(j + 1));
+        }
+        vitem.addCentroid({centerX, centerY});
+        vitem.addId(i);
+        vitem.setValid(true);
+        vtile.add(vitem);
+    }
+    return vtile;
+}
+
+static size_t filledVertices(const ngs::GlObjectPtr &object)
+{
+    size_t out = 0;
+    ngs::VectorGlObject *vectorObject = ngsDynamicCast(ngs::VectorGlObject,
+                                                       object);
+    for(const ngs::GlBufferPtr &buffer : vectorObject->buffers()) {
+        out += buffer->vertexSize();
+    }
+    return out;
+}
+
+TEST(GlTests, TestFillDenseTile) {
+    initLib();
+
+    ngs::GlView view("fill", "", 3857, ngs::DEFAULT_BOUNDS);
+    ngs::BufferPtr blob = denseTile(5000, 32).save();
+    const int repeats = 5;
+
+    for(const char *styleName : {"simplePoint", "simpleLine",
+                                 "simpleFillBordered"}) {
+        FillTestLayer layer(&view, styleName);
+
+        // Tile copied from the blob, as before, and tile used in place.
+        double seconds[2] = {0.0, 0.0};
+        size_t vertices[2] = {0, 0};
+        for(int i = 0; i < repeats; ++i) {
+            for(int inPlace = 0; inPlace < 2; ++inPlace) {
+                auto start = std::chrono::high_resolution_clock::now();
+                ngs::GlTileCache::Entry entry;
+                blob->seek(0);
+                ASSERT_EQ(entry.vtile.load(*blob.get(), inPlace ?
+                                               std::shared_ptr<const void>(blob) :
+                                               std::shared_ptr<const void>()),
+                          true);
+                EXPECT_EQ(entry.vtile.items().front().isView(), inPlace == 1);
+                ASSERT_EQ(layer.tessellate(entry, 0.0f), true);
+                seconds[inPlace] += std::chrono::duration<double>(
+                            std::chrono::high_resolution_clock::now() -
+                            start).count();
+                ASSERT_NE(entry.object, nullptr);
+                vertices[inPlace] = filledVertices(entry.object);
+            }
+        }
+        EXPECT_GT(vertices[0], 0u);
+        EXPECT_EQ(vertices[1], vertices[0]);
+        std::cout << styleName << " load and fill per tile: copy "
+                  << seconds[0] * 1000.0 / repeats << " ms, in place "
+                  << seconds[1] * 1000.0 / repeats << " ms\n";
+        // Generous bound, 165 000 vertices tile.
+        EXPECT_LT(seconds[1] / repeats, 2.0);
+    }
+
+    ngsUnInit();
+}
+
+TEST(GlTests, TestGlBufferIndices) {
+    // Indices are packed to GLushort while fit to it.
+    ngs::GlBuffer buffer(ngs::GlBuffer::BF_FILL);
+    for(GLuint index : {0u, 65535u, 7u}) {
+        buffer.addIndex(index);
+    }
+    std::vector<GLushort> shortIndices;
+    EXPECT_EQ(buffer.packIndices(shortIndices),
+              static_cast<GLenum>(GL_UNSIGNED_SHORT));
+    EXPECT_EQ(buffer.indexType(), static_cast<GLenum>(GL_UNSIGNED_SHORT));
+    EXPECT_EQ(shortIndices, std::vector<GLushort>({0, 65535, 7}));
+
+    buffer.addIndex(65536);
+    EXPECT_EQ(buffer.packIndices(shortIndices),
+              static_cast<GLenum>(GL_UNSIGNED_INT));
+    EXPECT_EQ(buffer.indexType(), static_cast<GLenum>(GL_UNSIGNED_INT));
+    EXPECT_EQ(shortIndices.empty(), true);
+}
+
+TEST(GlTests, TestFillDensePolygons) {
+    initLib();
+
+    ngs::GlView view("fill", "", 3857, ngs::DEFAULT_BOUNDS);
+    FillTestLayer layer(&view, "simpleFillBordered");
+    ngs::VectorTile vtile = denseTile(5000, 32);
+
+    size_t fillVertices = 0, fillIndices = 0, lineVertices = 0, lineIndices = 0;
+    layer.polygonsEstimate(vtile, fillVertices, fillIndices, lineVertices,
+                           lineIndices);
+    EXPECT_GT(fillVertices, ngs::GlBuffer::maxVertices());
+
+    const int repeats = 5;
+    size_t drawCalls[2] = {0, 0};
+    for(bool uintIndex : {false, true}) {
+        ngs::setUintIndexSupported(uintIndex);
+        double seconds = 0.0;
+        std::unique_ptr<ngs::VectorGlObject> object;
+        for(int i = 0; i < repeats; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            object.reset(layer.fillPolygons(vtile, 0.0f));
+            seconds += std::chrono::duration<double>(
+                        std::chrono::high_resolution_clock::now() -
+                        start).count();
+        }
+
+        // Pre-pass sizes are upper bound of filled data.
+        size_t filled[4] = {0, 0, 0, 0};
+        for(const ngs::GlBufferPtr &buffer : object->buffers()) {
+            EXPECT_LE(buffer->vertexSize(), ngs::GlBuffer::maxVertices());
+            size_t shift = buffer->type() == ngs::GlBuffer::BF_FILL ? 0 : 2;
+            filled[shift] += buffer->vertexSize();
+            filled[shift + 1] += static_cast<size_t>(buffer->indexSize());
+
+            std::vector<GLushort> shortIndices;
+            GLenum indexType = buffer->packIndices(shortIndices);
+            if(!uintIndex) {
+                EXPECT_EQ(indexType, static_cast<GLenum>(GL_UNSIGNED_SHORT));
+                EXPECT_EQ(shortIndices.size(),
+                          static_cast<size_t>(buffer->indexSize()));
+            }
+        }
+        EXPECT_GT(filled[0], 0u);
+        EXPECT_GT(filled[2], 0u);
+        EXPECT_LE(filled[0], fillVertices);
+        EXPECT_LE(filled[1], fillIndices);
+        EXPECT_LE(filled[2], lineVertices);
+        EXPECT_LE(filled[3], lineIndices);
+
+        // One draw call per buffer.
+        drawCalls[uintIndex] = object->buffers().size();
+        if(uintIndex) {
+            // One buffer per style: fill and border.
+            ASSERT_EQ(object->buffers().size(), 2);
+            EXPECT_EQ(object->buffers()[0]->type(), ngs::GlBuffer::BF_FILL);
+            EXPECT_EQ(object->buffers()[1]->type(), ngs::GlBuffer::BF_LINE);
+            std::vector<GLushort> shortIndices;
+            for(const ngs::GlBufferPtr &buffer : object->buffers()) {
+                EXPECT_EQ(buffer->packIndices(shortIndices),
+                          static_cast<GLenum>(GL_UNSIGNED_INT));
+                EXPECT_EQ(buffer->indexType(),
+                          static_cast<GLenum>(GL_UNSIGNED_INT));
+            }
+        }
+        std::cout << (uintIndex ? "32" : "16") << "-bit indices: "
+                  << drawCalls[uintIndex] << " draw calls, fill "
+                  << seconds * 1000.0 / repeats << " ms per tile\n";
+        // Generous bound, 165 000 vertices tile.
+        EXPECT_LT(seconds / repeats, 2.0);
+    }
+    EXPECT_LT(drawCalls[1], drawCalls[0]);
+
+    ngs::setUintIndexSupported(false);
+    ngsUnInit();
+}
+
+TEST(GlTests, TestTilePrefetch) {
+    initLib();
+
+    ngs::CatalogPtr catalog = ngs::Catalog::instance();
+    std::string shapePath = ngsFormFileName(ngsGetCurrentDirectory(), "data",
+                                            nullptr, 0);
+    shapePath = ngsFormFileName(shapePath.c_str(), "bld", "shp", 0);
+    ngs::ObjectPtr shape = catalog->getObjectBySystemPath(shapePath);
+    ASSERT_NE(shape, nullptr);
+
+    ngs::GlView view("prefetch", "", 3857, ngs::DEFAULT_BOUNDS);
+    int layerId = view.createLayer("bld", shape);
+    ASSERT_GE(layerId, 0);
+    auto layer = std::dynamic_pointer_cast<ngs::GlFeatureLayer>(
+                view.getLayer(layerId));
+    ASSERT_NE(layer, nullptr);
+
+    auto featureClass = ngsDynamicCast(ngs::FeatureClass, shape);
+    ASSERT_NE(featureClass, nullptr);
+    std::vector<ngs::TileItem> items =
+            ngs::MapTransform::getTilesForExtent(featureClass->extent(), 15,
+                                                 false, false);
+    ASSERT_FALSE(items.empty());
+    const ngs::TileItem &item = items.front();
+
+    // Prefetched tile is tessellated to cache and taken by fill
+    ngs::GlTileCache *cache = view.tileCache();
+    cache->resetStatistics();
+    EXPECT_EQ(layer->prefetch(item, 0.0f), true);
+    EXPECT_EQ(cache->contains(layer->cacheId(), item.tile), true);
+    size_t cacheSize = cache->size();
+    EXPECT_EQ(layer->prefetch(item, 0.0f), true);
+    EXPECT_EQ(cache->size(), cacheSize);
+
+    ngs::GlTilePtr tile(new ngs::GlTile(ngs::GLTILE_SIZE, item));
+    EXPECT_EQ(layer->fill(tile, 0.0f, true), true);
+    EXPECT_EQ(cache->contains(layer->cacheId(), item.tile), false);
+    EXPECT_EQ(cache->hits(), 1);
+
+    // Tile in view is not prefetched again
+    EXPECT_EQ(layer->prefetch(item, 0.0f), true);
+    EXPECT_EQ(cache->contains(layer->cacheId(), item.tile), false);
+
+    ngsUnInit();
+}
+
 /*
 TEST(GlTests, TestCreate) {
 #ifdef OFFSCREEN_GL
@@ -21,16 +21,31 @@
 
 #include "test.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <thread>
 
 // gdal
 #include "cpl_string.h"
+#include "gdal.h"
 
 #include "api_priv.h"
+#include "ds/datastore.h"
+#include "ds/featureclassovr.h"
 #include "ds/geometry.h"
+#include "ds/raster.h"
+#include "ds/util.h"
+#include "map/maptransform.h"
 #include "ngstore/api.h"
 #include "ngstore/version.h"
+#include "tileserver.h"
+#include "util/stringutil.h"
+#include "util/threadpool.h"
 
 
 TEST(BasicTests, TestVersions) {
@@ -98,6 +113,23 @@ TEST(BasicTests, TestInlines) {
     EXPECT_EQ(color.A, newColor.A);
 }
 
+TEST(BasicTests, TestFastHash) {
+    // MurmurHash3 x64_128 with zero seed reference values
+    EXPECT_STREQ(ngs::fastHash("").c_str(),
+                 "00000000000000000000000000000000");
+    EXPECT_STREQ(ngs::fastHash("hello").c_str(),
+                 "029bbd41b3a7d8cb191dae486a901e5b");
+    EXPECT_STREQ(ngs::fastHash("The quick brown fox jumps over the lazy dog").c_str(),
+                 "6c1b07bc7bbc4be347939ac4a93c437a");
+    // Block boundaries
+    EXPECT_STREQ(ngs::fastHash("0123456789abcdef").c_str(),
+                 "a7d14acf946de04bda08a7635c5bc387");
+    EXPECT_STREQ(ngs::fastHash("0123456789abcdefg").c_str(),
+                 "def945aa2d61328eee72c306c2f40008");
+    std::string binary("a\0b", 3);
+    EXPECT_STRNE(ngs::fastHash(binary).c_str(), ngs::fastHash("a").c_str());
+}
+
 TEST(CatalogTests, TestCatalogQuery) {
     initLib();
 
@@ -264,6 +296,214 @@ TEST(CatalogTests, TestAreaDownload) {
     ngsUnInit();
 }
 
+// Loopback tile server is implemented with POSIX sockets only
+#ifndef _WIN32
+TEST(CatalogTests, TestAreaDownloadLoopback) {
+    TileServer server;
+    ASSERT_TRUE(server.start()) << "Loopback tile server is not available";
+    server.setFailFirstRequest(50);
+
+    initLib();
+    auto path = ngsFormFileName(ngsGetCurrentDirectory(), "tmp", nullptr, 0);
+    auto catalogPath = ngsCatalogPathFromSystem(path);
+    ASSERT_STRNE(catalogPath, "");
+    CatalogObjectH catalog = ngsCatalogObjectGet(catalogPath);
+
+    char **options = nullptr;
+    options = ngsListAddNameIntValue(options, "TYPE", CAT_RASTER_TMS);
+    options = ngsListAddNameValue(options, "CREATE_UNIQUE", "ON");
+    options = ngsListAddNameValue(options, "url", server.url().c_str());
+    options = ngsListAddNameValue(options, "epsg", "3857");
+    options = ngsListAddNameValue(options, "z_min", "0");
+    options = ngsListAddNameValue(options, "z_max", "19");
+    options = ngsListAddNameValue(options, "cache_expires", "3600");
+    CatalogObjectH raster = ngsCatalogObjectCreate(catalog, "loopback.wconn",
+                                                   options);
+    ngsListFree(options);
+    options = nullptr;
+    ASSERT_NE(raster, nullptr);
+    EXPECT_EQ(ngsCatalogObjectOpen(raster, nullptr), 1);
+
+    options = ngsListAddNameValue(options, "MINX", "4100000.0");
+    options = ngsListAddNameValue(options, "MINY", "7400000.0");
+    options = ngsListAddNameValue(options, "MAXX", "4300000.0");
+    options = ngsListAddNameValue(options, "MAXY", "7600000.0");
+    options = ngsListAddNameValue(options, "ZOOM_LEVELS", "8,9,10,11,12");
+    options = ngsListAddNameValue(options, "MAX_CONNECTIONS", "4");
+
+    EXPECT_EQ(ngsRasterCacheArea(raster, options, nullptr, nullptr),
+              COD_SUCCESS);
+    int requestCount = server.requestCount();
+    EXPECT_GT(requestCount, 0);
+    // Failed tiles are retried and connections are reused
+    EXPECT_LE(server.connectionCount(), 4);
+
+    // All tiles are in cache now
+    EXPECT_EQ(ngsRasterCacheArea(raster, options, nullptr, nullptr),
+              COD_SUCCESS);
+    EXPECT_EQ(server.requestCount(), requestCount);
+    ngsListFree(options);
+
+    ngsUnInit();
+}
+#endif // _WIN32
+
+static int cancelOverviewProgressFunc(enum ngsCode /*status*/,
+                                      double /*complete*/, const char *message,
+                                      void * /*progressArguments*/)
+{
+    return message == nullptr ||
+            !ngs::startsWith(message, "Build overview") ? TRUE : FALSE;
+}
+
+TEST(CatalogTests, TestRasterCOGCopy) {
+    initLib();
+    auto path = ngsFormFileName(ngsGetCurrentDirectory(), "tmp", nullptr, 0);
+    std::string srcPath = ngsFormFileName(path, "cog_src", "tif", 0);
+
+    GDALDriverH driver = GDALGetDriverByName("GTiff");
+    ASSERT_NE(driver, nullptr);
+    GDALDatasetH ds = GDALCreate(driver, srcPath.c_str(), 50, 40, 3, GDT_Byte,
+                                 nullptr);
+    ASSERT_NE(ds, nullptr);
+    double geoTransform[6] = { 4183837.0, 10.0, 0.0, 7513067.0, 0.0, -10.0 };
+    GDALSetGeoTransform(ds, geoTransform);
+    std::vector<GByte> data(50 * 40);
+    for(size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<GByte>(i % 256);
+    }
+    for(int band = 1; band <= 3; ++band) {
+        EXPECT_EQ(GDALRasterIO(GDALGetRasterBand(ds, band), GF_Write, 0, 0,
+                               50, 40, data.data(), 50, 40, GDT_Byte, 0, 0),
+                  CE_None);
+    }
+    GDALClose(ds);
+
+    auto catalogPath = ngsCatalogPathFromSystem(path);
+    ASSERT_STRNE(catalogPath, "");
+    CatalogObjectH catalog = ngsCatalogObjectGet(catalogPath);
+    ngsCatalogObjectRefresh(catalog);
+    auto rasterPath = ngsFormFileName(catalogPath, "cog_src.tif", nullptr, 0);
+    CatalogObjectH raster = ngsCatalogObjectGet(rasterPath);
+    ASSERT_NE(raster, nullptr);
+
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "COG", "ON");
+    options = ngsListAddNameValue(options, "BLOCKSIZE", "16");
+    options = ngsListAddNameValue(options, "NEW_NAME", "cog_dst");
+    resetCounter();
+    EXPECT_EQ(ngsCatalogObjectCopy(raster, catalog, options,
+                                   ngsTestProgressFunc, nullptr), COD_SUCCESS);
+    ngsListFree(options);
+    EXPECT_GE(getCounter(), 1);
+
+    std::string dstPath = ngsFormFileName(path, "cog_dst", "tif", 0);
+    ds = GDALOpen(dstPath.c_str(), GA_ReadOnly);
+    ASSERT_NE(ds, nullptr);
+    GDALRasterBandH band = GDALGetRasterBand(ds, 1);
+    int blockX = 0, blockY = 0;
+    GDALGetBlockSize(band, &blockX, &blockY);
+    EXPECT_EQ(blockX, 16);
+    EXPECT_EQ(blockY, 16);
+    EXPECT_EQ(GDALGetOverviewCount(band), 2);
+    GDALClose(ds);
+
+    // Cancel on overviews build must not write COG
+    options = nullptr;
+    options = ngsListAddNameValue(options, "COG", "ON");
+    options = ngsListAddNameValue(options, "BLOCKSIZE", "16");
+    options = ngsListAddNameValue(options, "NEW_NAME", "cog_canceled");
+    EXPECT_NE(ngsCatalogObjectCopy(raster, catalog, options,
+                                   cancelOverviewProgressFunc, nullptr),
+              COD_SUCCESS);
+    ngsListFree(options);
+    std::string canceledPath = ngsFormFileName(path, "cog_canceled", "tif", 0);
+    VSIStatBufL sbuf;
+    EXPECT_NE(VSIStatL(canceledPath.c_str(), &sbuf), 0);
+    EXPECT_NE(VSIStatL((canceledPath + ".tmp.tif").c_str(), &sbuf), 0);
+
+    ngsUnInit();
+}
+
+TEST(CatalogTests, TestRasterReadHandles) {
+    initLib();
+    auto path = ngsFormFileName(ngsGetCurrentDirectory(), "tmp", nullptr, 0);
+    std::string srcPath = ngsFormFileName(path, "read_handles", "tif", 0);
+
+    GDALDriverH driver = GDALGetDriverByName("GTiff");
+    ASSERT_NE(driver, nullptr);
+    GDALDatasetH ds = GDALCreate(driver, srcPath.c_str(), 64, 64, 1, GDT_Byte,
+                                 nullptr);
+    ASSERT_NE(ds, nullptr);
+    double geoTransform[6] = { 4183837.0, 10.0, 0.0, 7513067.0, 0.0, -10.0 };
+    GDALSetGeoTransform(ds, geoTransform);
+    GDALClose(ds);
+
+    auto catalogPath = ngsCatalogPathFromSystem(path);
+    ASSERT_STRNE(catalogPath, "");
+    CatalogObjectH catalog = ngsCatalogObjectGet(catalogPath);
+    ngsCatalogObjectRefresh(catalog);
+    auto rasterPath = ngsFormFileName(catalogPath, "read_handles.tif", nullptr,
+                                      0);
+    CatalogObjectH rasterObject = ngsCatalogObjectGet(rasterPath);
+    ASSERT_NE(rasterObject, nullptr);
+    ngs::Raster *raster = ngsDynamicCast(ngs::Raster,
+        static_cast<ngs::Object*>(rasterObject)->pointer());
+    ASSERT_NE(raster, nullptr);
+    ASSERT_TRUE(raster->open(GDAL_OF_SHARED|GDAL_OF_UPDATE|
+                             GDAL_OF_VERBOSE_ERROR));
+
+    // Parallel reads go through own handles
+    int band = 1;
+    std::vector<std::thread> threads;
+    std::atomic_int okCount(0);
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back([raster, &band, &okCount]() {
+            std::vector<GByte> data(16 * 16, 1);
+            if(raster->pixelData(data.data(), 0, 0, 16, 16, 16, 16, GDT_Byte,
+                                 1, &band, true, false) &&
+                    data[0] == 0) {
+                okCount++;
+            }
+        });
+    }
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    EXPECT_EQ(okCount, 4);
+
+    // Read after write must not come from stale handle
+    std::vector<GByte> data(16 * 16, 7);
+    EXPECT_TRUE(raster->pixelData(data.data(), 0, 0, 16, 16, 16, 16, GDT_Byte,
+                                  1, &band, false, false));
+    std::fill(data.begin(), data.end(), 0);
+    EXPECT_TRUE(raster->pixelData(data.data(), 0, 0, 16, 16, 16, 16, GDT_Byte,
+                                  1, &band, true, false));
+    EXPECT_EQ(data[0], 7);
+    EXPECT_EQ(data[data.size() - 1], 7);
+
+    // Close while reading
+    std::atomic_bool stop(false);
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back([raster, &band, &stop]() {
+            std::vector<GByte> buffer(16 * 16);
+            while(!stop) {
+                raster->pixelData(buffer.data(), 16, 16, 16, 16, 16, 16,
+                                  GDT_Byte, 1, &band, true, false);
+            }
+        });
+    }
+    raster->close();
+    stop = true;
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+    EXPECT_FALSE(raster->isOpened());
+
+    ngsUnInit();
+}
+
 TEST(CatalogTests, TestDelete) {
     initLib();
 
@@ -324,6 +564,127 @@ static CatalogObjectH createDataStore(const std::string &name, CatalogObjectH ca
     return out;
 }
 
+/**
+ * Creates polygon layer in the store with count squares in a grid. Squares are
+ * inserted by one batch.
+ */
+static ngs::FeatureClassOverview *createPolygonLayer(const std::string &storePath,
+                                                     const std::string &name,
+                                                     int count,
+                                                     int vertexCount = 4)
+{
+    CatalogObjectH store = ngsCatalogObjectGet(storePath.c_str());
+    if(nullptr == store) {
+        return nullptr;
+    }
+    CatalogObjectH fc = ngsCatalogObjectGet((storePath + "/" + name).c_str());
+    if(nullptr != fc) {
+        ngsCatalogObjectDelete(fc);
+    }
+
+    char **options = nullptr;
+    options = ngsListAddNameIntValue(options, "TYPE", CAT_FC_GPKG);
+    options = ngsListAddNameValue(options, "EPSG", "3857");
+    options = ngsListAddNameValue(options, "GEOMETRY_TYPE", "POLYGON");
+    options = ngsListAddNameValue(options, "FIELD_COUNT", "1");
+    options = ngsListAddNameValue(options, "FIELD_0_TYPE", "INTEGER");
+    options = ngsListAddNameValue(options, "FIELD_0_NAME", "id");
+    fc = ngsCatalogObjectCreate(store, name.c_str(), options);
+    ngsListFree(options);
+    if(nullptr == fc) {
+        return nullptr;
+    }
+    auto featureClass = ngsDynamicCast(ngs::FeatureClassOverview,
+                                       static_cast<ngs::Object*>(fc)->pointer());
+    if(nullptr == featureClass) {
+        return nullptr;
+    }
+
+    // Squares of 1 km with 2 km step, vertices are spread along the edges
+    int side = static_cast<int>(std::ceil(std::sqrt(count)));
+    int edgeVertexCount = std::max(1, vertexCount / 4);
+    ngs::FeatureBatch batch(featureClass->definition());
+    batch.reserve(static_cast<size_t>(count));
+    for(int i = 0; i < count; ++i) {
+        double minX = (i % side) * 2000.0;
+        double minY = (i / side) * 2000.0;
+        OGRLinearRing *ring = new OGRLinearRing;
+        for(int edge = 0; edge < 4; ++edge) {
+            for(int j = 0; j < edgeVertexCount; ++j) {
+                double t = 1000.0 * j / edgeVertexCount;
+                switch(edge) {
+                case 0: ring->addPoint(minX + t, minY); break;
+                case 1: ring->addPoint(minX + 1000.0, minY + t); break;
+                case 2: ring->addPoint(minX + 1000.0 - t, minY + 1000.0); break;
+                default: ring->addPoint(minX, minY + 1000.0 - t); break;
+                }
+            }
+        }
+        ring->closeRings();
+        OGRPolygon *polygon = new OGRPolygon;
+        polygon->addRingDirectly(ring);
+
+        ngs::FeaturePtr feature = featureClass->createFeature();
+        feature->SetField(0, i);
+        feature->SetGeometryDirectly(polygon);
+        batch.addFeature(feature);
+    }
+    std::vector<GIntBig> fids;
+    if(!featureClass->insertFeatures(batch, fids, 100000, false)) {
+        return nullptr;
+    }
+    return featureClass;
+}
+
+/**
+ * Returns items count of each not empty tile of zoom levels.
+ */
+static std::map<ngs::Tile, size_t> overviewTiles(ngs::FeatureClassOverview *featureClass,
+                                                 const std::vector<unsigned char> &zooms)
+{
+    std::map<ngs::Tile, size_t> out;
+    for(unsigned char zoom : zooms) {
+        auto items = ngs::MapTransform::getTilesForExtent(
+                    featureClass->extent(), zoom, false, false);
+        for(const ngs::TileItem &item : items) {
+            ngs::VectorTile tile = featureClass->getTile(item.tile, item.env);
+            if(!tile.empty()) {
+                out[item.tile] = tile.items().size();
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * Returns tile blobs saved in the overviews table of the feature class.
+ */
+static std::map<ngs::Tile, std::string> storedOverviewTiles(ngs::DataStore *store,
+                                                            const std::string &name)
+{
+    std::map<ngs::Tile, std::string> out;
+    ngs::TablePtr table = store->executeSQL(
+                std::string("SELECT z, x, y, tile FROM ") + ngs::NG_PREFIX +
+                name + "_overviews");
+    if(!table) {
+        return out;
+    }
+    table->reset();
+    ngs::FeaturePtr feature;
+    while((feature = table->nextFeature())) {
+        ngs::Tile tile;
+        tile.z = static_cast<unsigned char>(feature->GetFieldAsInteger(0));
+        tile.x = feature->GetFieldAsInteger(1);
+        tile.y = feature->GetFieldAsInteger(2);
+        tile.crossExtent = 0;
+        int size = 0;
+        GByte *data = feature->GetFieldAsBinary(3, &size);
+        out[tile] = std::string(reinterpret_cast<const char*>(data),
+                                static_cast<size_t>(size));
+    }
+    return out;
+}
+
 TEST(DataStoreTests, TestCreateDataStore) {
     initLib();
     char **options = nullptr;
@@ -470,6 +831,307 @@ TEST(DataStoreTests, TestLoadAndDelete) {
     ngsUnInit();
 }
 
+TEST(DataStoreTests, TestCreateOverviewsThreads) {
+    initLib();
+
+    CPLString testPath = ngsGetCurrentDirectory();
+    CPLString catalogPath = ngsCatalogPathFromSystem(testPath);
+    CPLString storePath = catalogPath + "/tmp/main.ngst";
+    CPLString shapePath = catalogPath + "/data/bld.shp";
+    CatalogObjectH store = ngsCatalogObjectGet(storePath);
+    CatalogObjectH shape = ngsCatalogObjectGet(shapePath);
+    ASSERT_NE(store, nullptr);
+    ASSERT_NE(shape, nullptr);
+
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "CREATE_OVERVIEWS", "OFF");
+    options = ngsListAddNameValue(options, "NEW_NAME", "ovr_threads");
+    EXPECT_EQ(ngsCatalogObjectCopy(shape, store, options,
+                                   ngsTestProgressFunc, nullptr), COD_SUCCESS);
+    ngsListFree(options);
+
+    CatalogObjectH fc = ngsCatalogObjectGet(CPLString(storePath + "/ovr_threads"));
+    ASSERT_NE(fc, nullptr);
+    auto featureClass = ngsDynamicCast(ngs::FeatureClassOverview,
+                                       static_cast<ngs::Object*>(fc)->pointer());
+    ASSERT_NE(featureClass, nullptr);
+
+    // Overviews built by any threads count have the same tiles
+    const char *threads[] = {"1", "4", "256"};
+    size_t firstTileCount = 0;
+    size_t firstItemCount = 0;
+    for(int i = 0; i < 3; ++i) {
+        ngs::Options ovrOptions;
+        ovrOptions.add("FORCE", true);
+        ovrOptions.add("ZOOM_LEVELS", "10,14");
+        ovrOptions.add("NUM_THREADS", threads[i]);
+        EXPECT_EQ(featureClass->createOverviews(ngs::Progress(), ovrOptions),
+                  true);
+        EXPECT_EQ(featureClass->hasOverviews(), true);
+
+        size_t tileCount = 0;
+        size_t itemCount = 0;
+        for(unsigned char zoom : {10, 14}) {
+            auto items = ngs::MapTransform::getTilesForExtent(
+                        featureClass->extent(), zoom, false, false);
+            for(const ngs::TileItem &item : items) {
+                ngs::VectorTile tile = featureClass->getTile(item.tile,
+                                                             item.env);
+                if(!tile.empty()) {
+                    tileCount++;
+                    itemCount += tile.items().size();
+                }
+            }
+        }
+        EXPECT_GT(tileCount, 0);
+        if(i == 0) {
+            firstTileCount = tileCount;
+            firstItemCount = itemCount;
+        }
+        else {
+            EXPECT_EQ(tileCount, firstTileCount);
+            EXPECT_EQ(itemCount, firstItemCount);
+        }
+    }
+
+    EXPECT_EQ(ngsCatalogObjectDelete(fc), COD_SUCCESS);
+
+    // Timing of one thread against all cores on synthetic polygons
+    ngs::FeatureClassOverview *polygons =
+            createPolygonLayer(storePath, "ovr_threads_timing", 20000, 32);
+    ASSERT_NE(polygons, nullptr);
+    std::vector<unsigned char> zooms = {8, 12, 14};
+    unsigned int coreCount = std::max(4u, std::thread::hardware_concurrency());
+    double seconds[2];
+    std::map<ngs::Tile, size_t> tiles[2];
+    for(int i = 0; i < 2; ++i) {
+        ngs::Options ovrOptions;
+        ovrOptions.add("FORCE", true);
+        ovrOptions.add("ZOOM_LEVELS", "8,12,14");
+        ovrOptions.add("NUM_THREADS", i == 0 ? 1L : static_cast<long>(coreCount));
+        auto start = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(polygons->createOverviews(ngs::Progress(), ovrOptions), true);
+        seconds[i] = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+        tiles[i] = overviewTiles(polygons, zooms);
+    }
+    std::cout << "Overviews of 20000 polygons: 1 thread " << seconds[0]
+              << " s, " << coreCount << " threads " << seconds[1]
+              << " s, speedup " << seconds[0] / seconds[1] << "\n";
+    EXPECT_GT(tiles[0].size(), 0);
+    EXPECT_EQ(tiles[0] == tiles[1], true);
+    // Generous bound: more threads must not slow down the build.
+    EXPECT_LT(seconds[1], seconds[0] * 1.5);
+    EXPECT_EQ(polygons->destroy(), true);
+
+    ngsUnInit();
+}
+
+static int cancelTilingProgressFunc(enum ngsCode /*status*/,
+                                    double /*complete*/, const char *message,
+                                    void * /*progressArguments*/)
+{
+    return message == nullptr ||
+            !ngs::startsWith(message, "Tiling") ? TRUE : FALSE;
+}
+
+TEST(DataStoreTests, TestCreateOverviewsStreaming) {
+    initLib();
+
+    CPLString testPath = ngsGetCurrentDirectory();
+    CPLString catalogPath = ngsCatalogPathFromSystem(testPath);
+    CPLString storePath = catalogPath + "/tmp/main.ngst";
+
+    // More features than one tiling chunk, so low zoom tiles get items from
+    // several chunks.
+    ngs::FeatureClassOverview *featureClass =
+            createPolygonLayer(storePath, "ovr_streaming", 25000);
+    ASSERT_NE(featureClass, nullptr);
+    std::vector<unsigned char> zooms = {4, 8, 12};
+
+    ngs::Options options;
+    options.add("FORCE", true);
+    options.add("ZOOM_LEVELS", "4,8,12");
+    EXPECT_EQ(featureClass->createOverviews(ngs::Progress(), options), true);
+    auto singleFlushTiles = overviewTiles(featureClass, zooms);
+    EXPECT_GT(singleFlushTiles.size(), 0);
+
+    // Zero memory limit flushes tiles after each chunk, the split tiles are
+    // merged at the end.
+    options.add("MEMORY_LIMIT", 0L);
+    EXPECT_EQ(featureClass->createOverviews(ngs::Progress(), options), true);
+    auto streamedTiles = overviewTiles(featureClass, zooms);
+    EXPECT_EQ(streamedTiles.size(), singleFlushTiles.size());
+    EXPECT_EQ(streamedTiles == singleFlushTiles, true);
+
+    // Canceled build leaves no overviews
+    EXPECT_EQ(featureClass->createOverviews(
+                  ngs::Progress(cancelTilingProgressFunc, nullptr), options),
+              false);
+    EXPECT_EQ(featureClass->hasOverviews(), false);
+    EXPECT_STREQ(featureClass->property("zoom_levels", "",
+                                        ngs::NG_ADDITIONS_KEY).c_str(), "");
+    options.add("FORCE", false);
+    EXPECT_EQ(featureClass->createOverviews(ngs::Progress(), options), true);
+    EXPECT_EQ(overviewTiles(featureClass, zooms) == singleFlushTiles, true);
+
+    EXPECT_EQ(featureClass->destroy(), true);
+
+    ngsUnInit();
+}
+
+TEST(DataStoreTests, TestEditOverviewsBatchMode) {
+    initLib();
+
+    CPLString testPath = ngsGetCurrentDirectory();
+    CPLString catalogPath = ngsCatalogPathFromSystem(testPath);
+    CPLString storePath = catalogPath + "/tmp/main.ngst";
+    CatalogObjectH store = ngsCatalogObjectGet(storePath);
+    ASSERT_NE(store, nullptr);
+    auto dataStore = dynamic_cast<ngs::DataStore*>(static_cast<ngs::Object*>(store));
+    ASSERT_NE(dataStore, nullptr);
+
+    ngs::FeatureClassOverview *featureClass =
+            createPolygonLayer(storePath, "ovr_batch", 100);
+    ASSERT_NE(featureClass, nullptr);
+    ngs::Options options;
+    options.add("FORCE", true);
+    options.add("ZOOM_LEVELS", "8,12");
+    EXPECT_EQ(featureClass->createOverviews(ngs::Progress(), options), true);
+    std::vector<unsigned char> zooms = {8, 12};
+    auto storedBefore = storedOverviewTiles(dataStore, "ovr_batch");
+    auto tilesBefore = overviewTiles(featureClass, zooms);
+    ASSERT_GT(storedBefore.size(), 0);
+
+    std::vector<GIntBig> fids;
+    featureClass->reset();
+    ngs::FeaturePtr feature;
+    while((feature = featureClass->nextFeature())) {
+        fids.push_back(feature->GetFID());
+    }
+    ASSERT_EQ(fids.size(), 100);
+
+    CatalogObjectH fc = ngsCatalogObjectGet(CPLString(storePath + "/ovr_batch"));
+    ASSERT_NE(fc, nullptr);
+    ngsFeatureClassBatchMode(fc, 1);
+
+    // Move ten squares to the gap between rows, delete two and insert one.
+    for(size_t i = 0; i < 10; ++i) {
+        feature = featureClass->getFeature(fids[i]);
+        ASSERT_NE(feature, nullptr);
+        OGREnvelope env;
+        feature->GetGeometryRef()->getEnvelope(&env);
+        OGRLinearRing *ring = new OGRLinearRing;
+        ring->addPoint(env.MinX, env.MinY + 1000.0);
+        ring->addPoint(env.MaxX, env.MinY + 1000.0);
+        ring->addPoint(env.MaxX, env.MaxY + 1000.0);
+        ring->addPoint(env.MinX, env.MaxY + 1000.0);
+        ring->closeRings();
+        OGRPolygon *polygon = new OGRPolygon;
+        polygon->addRingDirectly(ring);
+        feature->SetGeometryDirectly(polygon);
+        EXPECT_EQ(featureClass->updateFeature(feature, false), true);
+    }
+    EXPECT_EQ(featureClass->deleteFeature(fids[50], false), true);
+    EXPECT_EQ(featureClass->deleteFeature(fids[51], false), true);
+    feature = featureClass->getFeature(fids[52]);
+    ASSERT_NE(feature, nullptr);
+    ngs::FeaturePtr newFeature = featureClass->createFeature();
+    newFeature->SetField(0, 100);
+    newFeature->SetGeometry(feature->GetGeometryRef());
+    EXPECT_EQ(featureClass->insertFeature(newFeature, false), true);
+
+    // Changed tiles are read from the cache, the table is not changed yet.
+    auto batchTiles = overviewTiles(featureClass, zooms);
+    EXPECT_EQ(batchTiles == tilesBefore, false);
+    EXPECT_EQ(storedOverviewTiles(dataStore, "ovr_batch") == storedBefore, true);
+
+    // Stopping batch mode saves the changed tiles.
+    ngsFeatureClassBatchMode(fc, 0);
+    auto storedAfter = storedOverviewTiles(dataStore, "ovr_batch");
+    EXPECT_GT(storedAfter.size(), 0);
+    EXPECT_EQ(storedAfter == storedBefore, false);
+    EXPECT_EQ(overviewTiles(featureClass, zooms) == batchTiles, true);
+
+    EXPECT_EQ(featureClass->destroy(), true);
+
+    ngsUnInit();
+}
+
+TEST(DataStoreTests, TestInsertFeaturesTransaction) {
+    initLib();
+
+    CPLString testPath = ngsGetCurrentDirectory();
+    CPLString catalogPath = ngsCatalogPathFromSystem(testPath);
+    CPLString storePath = catalogPath + "/tmp/main.ngst";
+    CPLString shapePath = catalogPath + "/data/bld.shp";
+    CatalogObjectH store = ngsCatalogObjectGet(storePath);
+    CatalogObjectH shape = ngsCatalogObjectGet(shapePath);
+    ASSERT_NE(store, nullptr);
+    ASSERT_NE(shape, nullptr);
+
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "CREATE_OVERVIEWS", "OFF");
+    options = ngsListAddNameValue(options, "NEW_NAME", "insert_tx");
+    options = ngsListAddNameValue(options, "TRANSACTION_SIZE", "7");
+    EXPECT_EQ(ngsCatalogObjectCopy(shape, store, options,
+                                   ngsTestProgressFunc, nullptr), COD_SUCCESS);
+    ngsListFree(options);
+
+    CatalogObjectH fc = ngsCatalogObjectGet(CPLString(storePath + "/insert_tx"));
+    ASSERT_NE(fc, nullptr);
+    long long count = ngsFeatureClassCount(fc);
+    EXPECT_EQ(count, ngsFeatureClassCount(shape));
+    auto featureClass = ngsDynamicCast(ngs::FeatureClassOverview,
+                                       static_cast<ngs::Object*>(fc)->pointer());
+    auto srcTable = ngsDynamicCast(ngs::Table,
+                                   static_cast<ngs::Object*>(shape)->pointer());
+    ASSERT_NE(featureClass, nullptr);
+    ASSERT_NE(srcTable, nullptr);
+
+    ngs::FieldMapPtr fieldMap(srcTable->fields(), featureClass->fields());
+    ngs::FeatureBatch batch(featureClass->definition());
+    srcTable->reset();
+    ngs::Envelope firstExtent;
+    for(int i = 0; i < 10; ++i) {
+        ngs::FeaturePtr feature = srcTable->nextFeature();
+        ASSERT_NE(feature, nullptr);
+        if(i == 0 && feature->GetGeometryRef()) {
+            OGREnvelope env;
+            feature->GetGeometryRef()->getEnvelope(&env);
+            firstExtent = env;
+        }
+        batch.addFeature(feature, fieldMap.get());
+    }
+
+    // Transaction stays open between batches until its size is reached
+    GIntBig transactionCounter = 0;
+    std::vector<GIntBig> fids;
+    EXPECT_EQ(featureClass->insertFeatures(batch, fids, 100, false, nullptr,
+                                           &transactionCounter), true);
+    EXPECT_EQ(transactionCounter, 10);
+    std::vector<GIntBig> moreFids;
+    EXPECT_EQ(featureClass->insertFeatures(batch, moreFids, 15, false, nullptr,
+                                           &transactionCounter), true);
+    EXPECT_EQ(transactionCounter, 5);
+    featureClass->commitTransaction(transactionCounter);
+    EXPECT_EQ(transactionCounter, 0);
+    EXPECT_EQ(ngsFeatureClassCount(fc), count + 20);
+
+    // Batch hook adds rows to the envelope index
+    ASSERT_EQ(fids.size(), 10);
+    if(firstExtent.isInit()) {
+        firstExtent.fix();
+        auto ids = featureClass->featureIds(firstExtent);
+        EXPECT_NE(std::find(ids.begin(), ids.end(), fids[0]), ids.end());
+        EXPECT_NE(std::find(ids.begin(), ids.end(), moreFids[0]), ids.end());
+    }
+
+    EXPECT_EQ(ngsCatalogObjectDelete(fc), COD_SUCCESS);
+
+    ngsUnInit();
+}
+
 TEST(DataStoreTests, TestCopyFCToGeoJSON) {
     initLib();
     resetCounter();
@@ -1039,3 +1701,147 @@ TEST(MiscTests, TestCrypt) {
 
     ngsUnInit();
 }
+
+static std::atomic_int threadPoolCounter(0);
+
+class CounterData : public ngs::ThreadData {
+public:
+    explicit CounterData(unsigned char fails) : ThreadData(true),
+        m_fails(fails) {}
+    unsigned char m_fails;
+};
+
+static bool counterThreadFunc(ngs::ThreadData *threadData)
+{
+    CounterData *data = static_cast<CounterData*>(threadData);
+    if(data->tries() < data->m_fails) {
+        return false;
+    }
+    threadPoolCounter++;
+    return true;
+}
+
+TEST(MiscTests, TestThreadPool) {
+    ngs::ThreadPool pool;
+    pool.init(4, counterThreadFunc);
+
+    // Small tasks dispatch, each hundredth task fails once.
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < 100000; ++i) {
+        pool.addThreadData(new CounterData(i % 100 == 0 ? 1 : 0));
+    }
+    pool.waitComplete(ngs::Progress());
+    double seconds = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    EXPECT_EQ(threadPoolCounter, 100000);
+    // Generous bound: dispatch must not poll or start a thread per task.
+    EXPECT_LT(seconds, 5.0);
+    EXPECT_EQ(pool.dataCount(), 0);
+
+    // Small batches waited one by one like tiles of a frame. The previous
+    // pool polled completion every 0.55 s, so it took over 110 s here.
+    start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < 200; ++i) {
+        for(int j = 0; j < 50; ++j) {
+            pool.addThreadData(new CounterData(0));
+        }
+        pool.waitComplete(ngs::Progress());
+    }
+    double batchSeconds = std::chrono::duration<double>(
+                std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Thread pool dispatch: " << seconds * 10.0
+              << " us per task, " << batchSeconds * 5.0
+              << " ms per batch of 50 tasks\n";
+    EXPECT_EQ(threadPoolCounter, 110000);
+    EXPECT_LT(batchSeconds, 5.0);
+
+    // Canceled data is skipped.
+    ngs::CancelToken token;
+    token.cancel();
+    for(int i = 0; i < 100; ++i) {
+        CounterData *data = new CounterData(0);
+        data->setCancelToken(token);
+        pool.addThreadData(data, ngs::ThreadPool::Priority::Low);
+    }
+    pool.waitComplete(ngs::Progress());
+    EXPECT_EQ(threadPoolCounter, 110000);
+    EXPECT_EQ(pool.dataCount(), 0);
+}
+
+static std::atomic_int delayedCounter(0);
+
+static bool delayedThreadFunc(ngs::ThreadData *threadData)
+{
+    CounterData *data = static_cast<CounterData*>(threadData);
+    if(data->tries() < data->m_fails) {
+        data->setRetryDelay(0.5);
+        return false;
+    }
+    // Other data is processed while the failed one waits for retry.
+    if(data->m_fails > 0) {
+        EXPECT_EQ(threadPoolCounter, 100);
+    }
+    else {
+        threadPoolCounter++;
+    }
+    delayedCounter++;
+    return true;
+}
+
+TEST(MiscTests, TestThreadPoolRetryDelay) {
+    threadPoolCounter = 0;
+    ngs::ThreadPool pool;
+    pool.init(1, delayedThreadFunc);
+
+    pool.addThreadData(new CounterData(1));
+    for(int i = 0; i < 100; ++i) {
+        pool.addThreadData(new CounterData(0));
+    }
+    pool.waitComplete(ngs::Progress());
+    EXPECT_EQ(delayedCounter, 101);
+    EXPECT_EQ(pool.dataCount(), 0);
+}
+
+static std::vector<int> processOrder;
+
+class OrderData : public CounterData {
+public:
+    OrderData(int id, unsigned char fails, int sleepMs = 0) : CounterData(fails),
+        m_id(id), m_sleepMs(sleepMs) {}
+    int m_id;
+    int m_sleepMs;
+};
+
+static bool orderThreadFunc(ngs::ThreadData *threadData)
+{
+    OrderData *data = static_cast<OrderData*>(threadData);
+    if(data->m_sleepMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(data->m_sleepMs));
+    }
+    if(data->tries() < data->m_fails) {
+        return false;
+    }
+    processOrder.push_back(data->m_id);
+    return true;
+}
+
+TEST(MiscTests, TestThreadPoolRetryPriority) {
+    ngs::ThreadPool pool;
+    pool.init(1, orderThreadFunc);
+
+    // The worker is busy with the first data while the rest is queued.
+    pool.addThreadData(new OrderData(0, 0, 50), ngs::ThreadPool::Priority::High);
+    pool.addThreadData(new OrderData(1, 1), ngs::ThreadPool::Priority::High);
+    for(int i = 2; i < 12; ++i) {
+        pool.addThreadData(new OrderData(i, 0));
+    }
+    pool.addThreadData(new OrderData(12, 0), ngs::ThreadPool::Priority::Low);
+    pool.waitComplete(ngs::Progress());
+
+    // Failed high priority data is retried before normal priority data.
+    ASSERT_EQ(processOrder.size(), 13);
+    EXPECT_EQ(processOrder[0], 0);
+    EXPECT_EQ(processOrder[1], 1);
+    EXPECT_EQ(processOrder[12], 12);
+    EXPECT_EQ(pool.dataCount(), 0);
+}
@@ -20,16 +20,24 @@
  ****************************************************************************/
 #include "test.h"
 // stl
+#include <algorithm>
 #include <memory>
 
+// gdal
+#include "gdal.h"
+
 #include "catalog/catalog.h"
 #include "catalog/folder.h"
 #include "ds/datastore.h"
+#include "ds/featureclassovr.h"
 #include "ds/geometry.h"
+#include "map/cpu/canvas.h"
+#include "map/cpu/view.h"
 #include "map/gl/view.h"
 #include "map/mapstore.h"
 #include "map/mapview.h"
 #include "map/overlay.h"
+#include "map/warp.h"
 #include "ngstore/codes.h"
 #include "ngstore/util/constants.h"
 
@@ -409,6 +417,215 @@ TEST(MapTests, TestProject)
     EXPECT_DOUBLE_EQ(wdPt.y, 480);
 }
 
+TEST(MapTests, TestCanvas) {
+    ngs::Canvas canvas(16, 16);
+    canvas.clear({255, 255, 255, 255});
+    EXPECT_EQ(canvas.data()[0], 255);
+
+    // Two triangles of square with common edge
+    ngsRGBA color = {255, 0, 0, 128};
+    canvas.fillTriangle({4.0, 4.0}, {12.0, 4.0}, {12.0, 12.0}, color);
+    canvas.fillTriangle({4.0, 4.0}, {12.0, 12.0}, {4.0, 12.0}, color);
+    const GByte *pixel = canvas.data() + (8 * 16 + 8) * 4;
+    EXPECT_EQ(pixel[0], 255);
+    EXPECT_NEAR(pixel[1], 127, 1); // Blended only once
+    pixel = canvas.data() + (2 * 16 + 2) * 4;
+    EXPECT_EQ(pixel[1], 255);
+
+    GDALAllRegister();
+    int size = 0;
+    GByte *png = canvas.toPng(size);
+    ASSERT_NE(png, nullptr);
+    EXPECT_GT(size, 0);
+    EXPECT_EQ(png[1], 'P');
+    CPLFree(png);
+}
+
+TEST(MapTests, TestWarpGrid) {
+    char *wkt = nullptr;
+    ngs::SpatialReferencePtr::importFromEPSG(4326)->exportToWkt(&wkt);
+    std::string srcWKT = wkt;
+    CPLFree(wkt);
+    wkt = nullptr;
+    ngs::SpatialReferencePtr::importFromEPSG(3857)->exportToWkt(&wkt);
+    std::string dstWKT = wkt;
+    CPLFree(wkt);
+
+    // One degree pixels of whole world raster to whole world tile
+    double geoTransform[6] = { -180.0, 1.0, 0.0, 90.0, 0.0, -1.0 };
+    ngs::WarpGrid grid;
+    ASSERT_EQ(grid.create(srcWKT, geoTransform, dstWKT, ngs::DEFAULT_BOUNDS,
+                          256, 256, 16, 0.125), true);
+    double srcX, srcY;
+    ASSERT_EQ(grid.sourcePoint(128.0, 128.0, srcX, srcY), true);
+    EXPECT_NEAR(srcX, 180.0, 0.2);
+    EXPECT_NEAR(srcY, 90.0, 0.2);
+    ASSERT_EQ(grid.sourcePoint(0.0, 128.0, srcX, srcY), true);
+    EXPECT_NEAR(srcX, 0.0, 0.2);
+
+    // Left half of source is black, right half is white
+    std::vector<GByte> src(360 * 180 * 4, 0);
+    for(size_t i = 0; i < src.size(); i += 4) {
+        src[i + 3] = 255;
+        if((i / 4) % 360 >= 180) {
+            std::fill(src.begin() + static_cast<long>(i),
+                      src.begin() + static_cast<long>(i + 3), 255);
+        }
+    }
+    std::vector<GByte> dst(256 * 256 * 4, 0);
+    ngs::warpImage(grid, src.data(), ngs::Envelope(0.0, 0.0, 360.0, 180.0),
+                   360, 180, 360, 180, ngs::RasterResampling::Bilinear,
+                   dst.data());
+    EXPECT_EQ(dst[(128 * 256 + 10) * 4], 0);
+    EXPECT_EQ(dst[(128 * 256 + 250) * 4], 255);
+    EXPECT_EQ(dst[(128 * 256 + 250) * 4 + 3], 255);
+
+    ngs::WarpGridCache cache(1);
+    ngs::Tile tile1 = {0, 0, 0, 0};
+    ngs::Tile tile2 = {1, 0, 1, 0};
+    cache.put("4326", tile1, std::make_shared<ngs::WarpGrid>(grid));
+    cache.put("4326", tile2, std::make_shared<ngs::WarpGrid>());
+    EXPECT_EQ(cache.count(), 1);
+    EXPECT_EQ(cache.get("4326", tile1), nullptr);
+}
+
+TEST(MapTests, TestCpuRender) {
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "DEBUG_MODE", "ON");
+    const char *path = ngsFormFileName(ngsGetCurrentDirectory(), "tmp", nullptr, 0);
+    options = ngsListAddNameValue(options, "SETTINGS_DIR", path);
+    options = ngsListAddNameValue(options, "CACHE_DIR", path);
+    options = ngsListAddNameValue(options, "HEADLESS", "ON");
+    EXPECT_EQ(ngsInit(options), COD_SUCCESS);
+    ngsListFree(options);
+
+    // Red whole world raster in EPSG:4326 to be reprojected
+    std::string tmpPath = path;
+    std::string rasterPath = ngsFormFileName(tmpPath.c_str(), "cpu_render",
+                                             "tif", 0);
+    GDALDriverH driver = GDALGetDriverByName("GTiff");
+    ASSERT_NE(driver, nullptr);
+    GDALDatasetH ds = GDALCreate(driver, rasterPath.c_str(), 360, 180, 3,
+                                 GDT_Byte, nullptr);
+    ASSERT_NE(ds, nullptr);
+    double geoTransform[6] = { -180.0, 1.0, 0.0, 90.0, 0.0, -1.0 };
+    GDALSetGeoTransform(ds, geoTransform);
+    char *wkt = nullptr;
+    ngs::SpatialReferencePtr::importFromEPSG(4326)->exportToWkt(&wkt);
+    GDALSetProjection(ds, wkt);
+    CPLFree(wkt);
+    for(int band = 1; band <= 3; ++band) {
+        GDALFillRaster(GDALGetRasterBand(ds, band), band == 1 ? 255 : 0, 0);
+    }
+    GDALClose(ds);
+
+    auto catalogPath = ngsCatalogPathFromSystem(tmpPath.c_str());
+    ASSERT_STRNE(catalogPath, "");
+    CatalogObjectH catalog = ngsCatalogObjectGet(catalogPath);
+    ngsCatalogObjectRefresh(catalog);
+    CatalogObjectH rasterObject = ngsCatalogObjectGet(
+                ngsFormFileName(catalogPath, "cpu_render.tif", nullptr, 0));
+    ASSERT_NE(rasterObject, nullptr);
+
+    // Square polygon 400 m wide in the map centre
+    options = nullptr;
+    options = ngsListAddNameIntValue(options, "TYPE", CAT_CONTAINER_MEM);
+    options = ngsListAddNameValue(options, "CREATE_UNIQUE", "ON");
+    CatalogObjectH store = ngsCatalogObjectCreate(catalog, "cpu_render", options);
+    ngsListFree(options);
+    ASSERT_NE(store, nullptr);
+    ngs::ObjectContainer *storeContainer = ngsDynamicCast(ngs::ObjectContainer,
+            static_cast<ngs::Object*>(store)->pointer());
+    ASSERT_NE(storeContainer, nullptr);
+
+    GDALDatasetH memDS = GDALCreate(GDALGetDriverByName("Memory"), "", 0, 0, 0,
+                                    GDT_Unknown, nullptr);
+    ASSERT_NE(memDS, nullptr);
+    ngs::SpatialReferencePtr srs = ngs::SpatialReferencePtr::importFromEPSG(3857);
+    OGRLayerH memLayer = GDALDatasetCreateLayer(memDS, "polygons", srs.get(),
+                                                wkbPolygon, nullptr);
+    ASSERT_NE(memLayer, nullptr);
+    OGRFeatureH feature = OGR_F_Create(OGR_L_GetLayerDefn(memLayer));
+    OGRGeometryH polygon = nullptr;
+    char *polygonWkt = const_cast<char*>(
+                "POLYGON ((-200 -200,200 -200,200 200,-200 200,-200 -200))");
+    OGR_G_CreateFromWkt(&polygonWkt, srs.get(), &polygon);
+    OGR_F_SetGeometryDirectly(feature, polygon);
+    EXPECT_EQ(OGR_L_CreateFeature(memLayer, feature), OGRERR_NONE);
+    OGR_F_Destroy(feature);
+
+    {
+        ngs::FeatureClassOverviewPtr featureClass(
+                    new ngs::FeatureClassOverview(
+                        reinterpret_cast<OGRLayer*>(memLayer), storeContainer,
+                        CAT_FC_MEM, "polygons"));
+        ngs::CpuView view(DEFAULT_MAP_NAME, "", DEFAULT_EPSG,
+                          ngs::DEFAULT_BOUNDS);
+        view.setBackgroundColor(DEFAULT_MAP_BK);
+        ngs::Envelope extent(-500.0, -500.0, 500.0, 500.0);
+
+        // Background only
+        ngs::Canvas canvas;
+        ASSERT_EQ(view.renderExtent(extent, 320, 320, canvas), true);
+        ASSERT_EQ(canvas.width(), 320);
+        const GByte *pixel = canvas.data();
+        EXPECT_EQ(pixel[0], DEFAULT_MAP_BK.R);
+        EXPECT_EQ(pixel[1], DEFAULT_MAP_BK.G);
+        EXPECT_EQ(pixel[2], DEFAULT_MAP_BK.B);
+
+        // Raster under polygon. The polygon spans two render blocks.
+        ngs::Map &map = view;
+        EXPECT_EQ(map.createLayer("raster",
+                  static_cast<ngs::Object*>(rasterObject)->pointer()), 0);
+        EXPECT_EQ(map.createLayer("polygons", featureClass), 1);
+        ASSERT_EQ(view.renderExtent(extent, 320, 320, canvas), true);
+
+        pixel = canvas.data() + (5 * 320 + 5) * 4;
+        EXPECT_EQ(pixel[0], 255);
+        EXPECT_EQ(pixel[1], 0);
+        EXPECT_EQ(pixel[2], 0);
+        for(int x : {100, 160, 220}) {
+            pixel = canvas.data() + (160 * 320 + x) * 4;
+            EXPECT_EQ(pixel[0], 0);
+            EXPECT_EQ(pixel[1], 255);
+            EXPECT_EQ(pixel[2], 0);
+        }
+
+        // Repeated render reads tiles again
+        ASSERT_EQ(view.renderExtent(extent, 320, 320, canvas), true);
+        pixel = canvas.data() + (160 * 320 + 160) * 4;
+        EXPECT_EQ(pixel[1], 255);
+    }
+    GDALClose(memDS);
+
+    // Public API renders PNG
+    char mapId = ngsMapCreate(DEFAULT_MAP_NAME, "", DEFAULT_EPSG,
+                              ngs::DEFAULT_BOUNDS.minX(),
+                              ngs::DEFAULT_BOUNDS.minY(),
+                              ngs::DEFAULT_BOUNDS.maxX(),
+                              ngs::DEFAULT_BOUNDS.maxY());
+    ASSERT_NE(mapId, ngs::MapStore::invalidMapId());
+    int size = 0;
+    unsigned char *png = ngsMapRenderTile(mapId, 0, 0, 0, 256, &size);
+    ASSERT_NE(png, nullptr);
+    EXPECT_GT(size, 8);
+    EXPECT_EQ(png[1], 'P');
+    ngsFree(png);
+    EXPECT_EQ(ngsMapRenderTile(mapId, 2, 0, 0, 256, &size), nullptr);
+
+    ngsExtent ext = {-500.0, -500.0, 500.0, 500.0};
+    png = ngsMapRenderExtent(mapId, ext, 300, 200, &size);
+    ASSERT_NE(png, nullptr);
+    EXPECT_EQ(png[1], 'P');
+    // Width and height in IHDR chunk
+    EXPECT_EQ((png[18] << 8) | png[19], 300);
+    EXPECT_EQ((png[22] << 8) | png[23], 200);
+    ngsFree(png);
+
+    ngsUnInit();
+    CPLSetConfigOption("NGS_HEADLESS", nullptr);
+}
+
 /*
 TEST(MapTests, TestDrawing) {
     ngs::MapStore mapStore;
@@ -246,6 +246,250 @@ TEST(MIStoreTests, TestLogEdits) {
     ngsUnInit();
 }
 
+TEST(MIStoreTests, TestSyncEditOperations) {
+    initLib();
+
+    CatalogObjectH mistore = createMIStore("test_mistore");
+    ASSERT_NE(mistore, nullptr);
+
+    CatalogObjectH shape = getLocalFile("/data/bld.shp");
+    ASSERT_NE(shape, nullptr);
+
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "CREATE_OVERVIEWS", "OFF");
+    options = ngsListAddNameValue(options, "CREATE_UNIQUE", "ON");
+    options = ngsListAddNameValue(options, "NEW_NAME", "shp_bld");
+    options = ngsListAddNameValue(options, "DESCRIPTION", "Sync edits");
+    options = ngsListAddNameValue(options, "LOG_EDIT_HISTORY", "ON");
+    EXPECT_EQ(ngsCatalogObjectCopy(shape, mistore, options,
+                                   ngsTestProgressFunc, nullptr), COD_SUCCESS);
+    ngsListFree(options);
+
+    CatalogObjectH tab = ngsCatalogObjectGetByName(mistore, "Sync edits", 1);
+    ASSERT_NE(tab, nullptr);
+    ngsEditOperation *ops = ngsFeatureClassGetEditOperations(tab);
+    ASSERT_NE(ops, nullptr);
+    EXPECT_EQ(ops[0].fid, NOT_FOUND);
+    ngsFree(ops);
+
+    // Insert, change attributes only and delete outside MIStore
+    auto basePath = ngsCatalogObjectProperty(mistore, "system_path", "", "");
+    auto editPath = ngsFormFileName(basePath, "shp_bld", "tab", 0);
+    GDALDataset *DS = static_cast<GDALDataset*>(
+                GDALOpenEx(editPath, GDAL_OF_UPDATE|GDAL_OF_SHARED, nullptr,
+                           nullptr, nullptr));
+    ASSERT_NE(DS, nullptr);
+    OGRLayer *layer = DS->GetLayer(0);
+    ASSERT_NE(layer, nullptr);
+
+    OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+    feature->SetField("CLCODE", "1");
+    OGRGeometry *geom = nullptr;
+    EXPECT_EQ(OGRGeometryFactory::createFromWkt("POLYGON ((0 0,0 1,1 1,1 0,0 0))",
+                                                layer->GetSpatialRef(), &geom),
+              OGRERR_NONE);
+    feature->SetGeometryDirectly(geom);
+    EXPECT_EQ(layer->CreateFeature(feature), OGRERR_NONE);
+    GIntBig createdId = feature->GetFID();
+    OGRFeature::DestroyFeature(feature);
+
+    feature = layer->GetFeature(1);
+    ASSERT_NE(feature, nullptr);
+    feature->SetField("CLNAME", "changed");
+    EXPECT_EQ(layer->SetFeature(feature), OGRERR_NONE);
+    OGRFeature::DestroyFeature(feature);
+
+    EXPECT_EQ(layer->DeleteFeature(2), OGRERR_NONE);
+    GDALClose(DS);
+
+    // Each edit is reported once with its own code
+    ops = ngsFeatureClassGetEditOperations(tab);
+    ASSERT_NE(ops, nullptr);
+    int count = 0;
+    bool created = false, changed = false, deleted = false;
+    while(ops[count].fid != NOT_FOUND) {
+        switch(ops[count].code) {
+        case CC_CREATE_FEATURE:
+            created = ops[count].fid == createdId;
+            break;
+        case CC_CHANGE_FEATURE:
+            changed = ops[count].fid == 1;
+            break;
+        case CC_DELETE_FEATURE:
+            deleted = ops[count].fid == 2;
+            break;
+        default:
+            break;
+        }
+        count++;
+    }
+    ngsFree(ops);
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(created, true);
+    EXPECT_EQ(changed, true);
+    EXPECT_EQ(deleted, true);
+
+    EXPECT_EQ(ngsCatalogObjectDelete(mistore), COD_SUCCESS);
+
+    ngsUnInit();
+}
+
+TEST(MIStoreTests, TestParallelFillHash) {
+    initLib();
+
+    CatalogObjectH mistore = createMIStore("test_mistore");
+    ASSERT_NE(mistore, nullptr);
+
+    CatalogObjectH shape = getLocalFile("/data/bld.shp");
+    ASSERT_NE(shape, nullptr);
+
+    // Thread counts out of unsigned char range are clamped
+    const char *threads[] = {"4", "256", "-1"};
+    for(int i = 0; i < 3; ++i) {
+        std::string name = std::string("Parallel hash ") + threads[i];
+        char **options = nullptr;
+        options = ngsListAddNameValue(options, "CREATE_OVERVIEWS", "OFF");
+        options = ngsListAddNameValue(options, "CREATE_UNIQUE", "ON");
+        options = ngsListAddNameValue(options, "NEW_NAME", "shp_bld");
+        options = ngsListAddNameValue(options, "DESCRIPTION", name.c_str());
+        options = ngsListAddNameValue(options, "LOG_EDIT_HISTORY", "ON");
+        options = ngsListAddNameValue(options, "NUM_THREADS", threads[i]);
+        EXPECT_EQ(ngsCatalogObjectCopy(shape, mistore, options,
+                                       ngsTestProgressFunc, nullptr),
+                  COD_SUCCESS);
+        ngsListFree(options);
+
+        // Every feature has hash equal to the sequential check hash
+        CatalogObjectH tab = ngsCatalogObjectGetByName(mistore, name.c_str(), 1);
+        ASSERT_NE(tab, nullptr);
+        EXPECT_EQ(ngsFeatureClassCount(tab), ngsFeatureClassCount(shape));
+        ngsEditOperation *ops = ngsFeatureClassGetEditOperations(tab);
+        ASSERT_NE(ops, nullptr);
+        EXPECT_EQ(ops[0].fid, NOT_FOUND);
+        ngsFree(ops);
+    }
+
+    EXPECT_EQ(ngsCatalogObjectDelete(mistore), COD_SUCCESS);
+
+    ngsUnInit();
+}
+
+TEST(StoreTests, TestFeatureBatch) {
+    OGRFeatureDefn *definition = new OGRFeatureDefn("batch");
+    definition->Reference();
+    OGRFieldDefn idField("id", OFTInteger);
+    definition->AddFieldDefn(&idField);
+    OGRFieldDefn valueField("value", OFTReal);
+    definition->AddFieldDefn(&valueField);
+    OGRFieldDefn nameField("name", OFTString);
+    definition->AddFieldDefn(&nameField);
+
+    ngs::FeatureBatch batch(definition);
+    EXPECT_EQ(batch.columns().size(), 3);
+    EXPECT_EQ(batch.hasGeometry(), true);
+
+    ngs::FeaturePtr feature = OGRFeature::CreateFeature(definition);
+    feature->SetField(0, 7);
+    feature->SetField(1, 1.5);
+    feature->SetFieldNull(2);
+    feature->SetGeometryDirectly(new OGRPoint(1.0, 2.0));
+    batch.addFeature(feature);
+
+    // Copy only value field
+    int fieldMap[3] = { -1, 1, -1 };
+    feature->SetField(1, 2.5);
+    feature->SetGeometryDirectly(nullptr);
+    batch.addFeature(feature, fieldMap);
+    feature = ngs::FeaturePtr();
+
+    ASSERT_EQ(batch.size(), 2);
+    const auto &columns = batch.columns();
+    EXPECT_EQ(columns[0].states[0], ngs::FeatureBatch::State::SET);
+    EXPECT_EQ(columns[0].integers[0], 7);
+    EXPECT_EQ(columns[0].states[1], ngs::FeatureBatch::State::UNSET);
+    EXPECT_DOUBLE_EQ(columns[1].reals[0], 1.5);
+    EXPECT_DOUBLE_EQ(columns[1].reals[1], 2.5);
+    EXPECT_EQ(columns[2].states[0], ngs::FeatureBatch::State::NUL);
+    EXPECT_EQ(columns[2].states[1], ngs::FeatureBatch::State::UNSET);
+    ASSERT_EQ(batch.geometries().size(), 2);
+    EXPECT_EQ(batch.geometries()[0].size(), 21); // WKB point
+    EXPECT_EQ(batch.geometries()[1].empty(), true);
+
+    batch.clear();
+    EXPECT_EQ(batch.empty(), true);
+    EXPECT_EQ(columns[0].states.empty(), true);
+
+    definition->Release();
+}
+
+TEST(MIStoreTests, TestInsertFeatures) {
+    initLib();
+
+    CatalogObjectH mistore = createMIStore("test_mistore");
+    ASSERT_NE(mistore, nullptr);
+
+    CatalogObjectH shape = getLocalFile("/data/bld.shp");
+    ASSERT_NE(shape, nullptr);
+
+    // Copy to store is inserted by batches
+    char **options = nullptr;
+    options = ngsListAddNameValue(options, "CREATE_OVERVIEWS", "OFF");
+    options = ngsListAddNameValue(options, "CREATE_UNIQUE", "ON");
+    options = ngsListAddNameValue(options, "NEW_NAME", "shp_bld");
+    options = ngsListAddNameValue(options, "DESCRIPTION", "Batch insert");
+    options = ngsListAddNameValue(options, "LOG_EDIT_HISTORY", "ON");
+    options = ngsListAddNameValue(options, "TRANSACTION_SIZE", "100");
+    EXPECT_EQ(ngsCatalogObjectCopy(shape, mistore, options,
+                                   ngsTestProgressFunc, nullptr), COD_SUCCESS);
+    ngsListFree(options);
+
+    CatalogObjectH tab = ngsCatalogObjectGetByName(mistore, "Batch insert", 1);
+    ASSERT_NE(tab, nullptr);
+    long long count = ngsFeatureClassCount(tab);
+    EXPECT_EQ(count, ngsFeatureClassCount(shape));
+
+    ngsEditOperation *ops = ngsFeatureClassGetEditOperations(tab);
+    ASSERT_NE(ops, nullptr);
+    EXPECT_EQ(ops[0].fid, NOT_FOUND);
+    ngsFree(ops);
+
+    auto srcTable = ngsDynamicCast(ngs::Table,
+                                   static_cast<ngs::Object*>(shape)->pointer());
+    auto dstTable = ngsDynamicCast(ngs::Table,
+                                   static_cast<ngs::Object*>(tab)->pointer());
+    ASSERT_NE(srcTable, nullptr);
+    ASSERT_NE(dstTable, nullptr);
+
+    // Inserted rows get hashes, so they are not reported as created outside
+    ngs::FieldMapPtr fieldMap(srcTable->fields(), dstTable->fields());
+    ngs::FeatureBatch batch(dstTable->definition());
+    srcTable->reset();
+    for(int i = 0; i < 10; ++i) {
+        ngs::FeaturePtr feature = srcTable->nextFeature();
+        ASSERT_NE(feature, nullptr);
+        batch.addFeature(feature, fieldMap.get());
+    }
+    std::vector<GIntBig> fids;
+    std::vector<ngs::FeaturePtr> features;
+    EXPECT_EQ(dstTable->insertFeatures(batch, fids, 3, false, &features), true);
+    ASSERT_EQ(fids.size(), 10);
+    ASSERT_EQ(features.size(), 10);
+    for(size_t i = 0; i < fids.size(); ++i) {
+        EXPECT_NE(fids[i], NOT_FOUND);
+        EXPECT_EQ(features[i]->GetFID(), fids[i]);
+    }
+    EXPECT_EQ(ngsFeatureClassCount(tab), count + 10);
+
+    ops = ngsFeatureClassGetEditOperations(tab);
+    ASSERT_NE(ops, nullptr);
+    EXPECT_EQ(ops[0].fid, NOT_FOUND);
+    ngsFree(ops);
+
+    EXPECT_EQ(ngsCatalogObjectDelete(mistore), COD_SUCCESS);
+
+    ngsUnInit();
+}
+
 TEST(MIStoreTests, TestTabPathFromSystem) {
 	initLib();
 
@@ -0,0 +1,244 @@
+/******************************************************************************
+ * Project:  libngstore
+ * Purpose:  NextGIS store and visualisation support library
+ * Author: Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016-2020 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "tileserver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+TileServer::TileServer() :
+    m_listenSocket(-1),
+    m_port(0),
+    m_stop(false),
+    m_failEvery(0),
+    m_delay(0),
+    m_requestCount(0),
+    m_connectionCount(0),
+    m_tileCount(0)
+{
+}
+
+TileServer::~TileServer()
+{
+    stop();
+}
+
+std::string TileServer::url() const
+{
+    return "http://127.0.0.1:" + std::to_string(m_port) + "/{z}/{x}/{y}.png";
+}
+
+#ifdef _WIN32
+
+bool TileServer::start()
+{
+    return false;
+}
+
+void TileServer::stop()
+{
+}
+
+void TileServer::acceptConnections()
+{
+}
+
+void TileServer::serve(int /*socket*/)
+{
+}
+
+bool TileServer::answer(int /*socket*/, const std::string &/*path*/)
+{
+    return false;
+}
+
+void TileServer::closeSocket(int /*socket*/)
+{
+}
+
+#else
+
+bool TileServer::start()
+{
+    m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if(m_listenSocket < 0) {
+        return false;
+    }
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0; // Any free port
+    socklen_t length = sizeof(address);
+    if(bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+            listen(m_listenSocket, 64) != 0 ||
+            getsockname(m_listenSocket, reinterpret_cast<sockaddr*>(&address),
+                        &length) != 0) {
+        close(m_listenSocket);
+        m_listenSocket = -1;
+        return false;
+    }
+
+    m_port = ntohs(address.sin_port);
+    m_stop = false;
+    m_acceptThread = std::thread(&TileServer::acceptConnections, this);
+    return true;
+}
+
+void TileServer::stop()
+{
+    if(m_listenSocket < 0) {
+        return;
+    }
+
+    m_stop = true;
+    shutdown(m_listenSocket, SHUT_RDWR);
+    close(m_listenSocket);
+    m_listenSocket = -1;
+    if(m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+
+    // Serving thread owns its socket and removes and closes it under the
+    // same lock, so only open sockets are shut down here.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(int socket : m_sockets) {
+            shutdown(socket, SHUT_RDWR);
+        }
+    }
+    for(std::thread &thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+    m_sockets.clear();
+}
+
+void TileServer::acceptConnections()
+{
+    while(!m_stop) {
+        int socket = accept(m_listenSocket, nullptr, nullptr);
+        if(socket < 0) {
+            break;
+        }
+        m_connectionCount++;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sockets.push_back(socket);
+        m_threads.emplace_back(&TileServer::serve, this, socket);
+    }
+}
+
+void TileServer::serve(int socket)
+{
+    std::string request;
+    char buffer[4096];
+    while(!m_stop) {
+        ssize_t size = recv(socket, buffer, sizeof(buffer), 0);
+        if(size <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(size));
+
+        // Requests are GET without body, so the headers end is request end
+        size_t end;
+        while((end = request.find("\r\n\r\n")) != std::string::npos) {
+            std::string line = request.substr(0, request.find("\r\n"));
+            request.erase(0, end + 4);
+
+            char path[1024] = {0};
+            if(sscanf(line.c_str(), "GET %1023s", path) != 1 ||
+                    !answer(socket, path)) {
+                closeSocket(socket);
+                return;
+            }
+        }
+    }
+    closeSocket(socket);
+}
+
+void TileServer::closeSocket(int socket)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_sockets.begin(); it != m_sockets.end(); ++it) {
+        if(*it == socket) {
+            m_sockets.erase(it);
+            break;
+        }
+    }
+    close(socket);
+}
+
+bool TileServer::answer(int socket, const std::string &path)
+{
+    m_requestCount++;
+    if(m_delay > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_delay));
+    }
+
+    int z, x, y;
+    std::string status = "200 OK";
+    std::string body;
+    if(sscanf(path.c_str(), "/%d/%d/%d.png", &z, &x, &y) != 3) {
+        status = "404 Not Found";
+    }
+    else {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_failEvery > 0 && m_failedPaths.find(path) == m_failedPaths.end() &&
+                ++m_tileCount % m_failEvery == 0) {
+            m_failedPaths.insert(path);
+            status = "503 Service Unavailable";
+        }
+        else {
+            body = "tile " + std::to_string(z) + "/" + std::to_string(x) + "/" +
+                    std::to_string(y);
+        }
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: image/png\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: keep-alive\r\n\r\n" + body;
+    size_t sent = 0;
+    while(sent < response.size()) {
+        ssize_t size = send(socket, response.data() + sent,
+                            response.size() - sent, MSG_NOSIGNAL);
+        if(size <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(size);
+    }
+    return true;
+}
+
+#endif // _WIN32
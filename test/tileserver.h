@@ -0,0 +1,78 @@
+/******************************************************************************
+ * Project:  libngstore
+ * Purpose:  NextGIS store and visualisation support library
+ * Author: Dmitry Baryshnikov, dmitry.baryshnikov@nextgis.com
+ ******************************************************************************
+ *   Copyright (c) 2016 NextGIS, <info@nextgis.com>
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+#ifndef NGSTILESERVER_H
+#define NGSTILESERVER_H
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The TileServer class Loopback HTTP/1.1 tile server for tests and
+ * benchmarks. Answers GET /z/x/y.png with small tile body, keeps connections
+ * alive and counts requests and accepted connections.
+ */
+class TileServer
+{
+public:
+    TileServer();
+    ~TileServer();
+    bool start();
+    void stop();
+    /**
+     * @brief url Returns TMS url template of the server.
+     */
+    std::string url() const;
+    /**
+     * @brief setFailFirstRequest Each n-th tile answers 503 to the first
+     * request and succeeds on next ones. Zero disables failures.
+     */
+    void setFailFirstRequest(int every) { m_failEvery = every; }
+    /**
+     * @brief setDelay Emulates server latency in milliseconds per request.
+     */
+    void setDelay(int delay) { m_delay = delay; }
+    int requestCount() const { return m_requestCount; }
+    int connectionCount() const { return m_connectionCount; }
+
+private:
+    void acceptConnections();
+    void serve(int socket);
+    bool answer(int socket, const std::string &path);
+    void closeSocket(int socket);
+
+private:
+    int m_listenSocket;
+    int m_port;
+    std::atomic_bool m_stop;
+    std::atomic_int m_failEvery, m_delay, m_requestCount, m_connectionCount;
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_threads;
+    std::vector<int> m_sockets;
+    std::set<std::string> m_failedPaths;
+    int m_tileCount;
+    std::mutex m_mutex;
+};
+
+#endif // NGSTILESERVER_H